@@ -0,0 +1,274 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Decode throughput of the texture image decoders.
+ *
+ * Each PNG given is decoded with libpng (PNGDecoder) and LodePNG
+ * (LodePNGDecoder), and, re-encoded as QOI, with QOIDecoder. All three
+ * keep sRGB images encoded (decodeSRGB()), as textures are loaded. The
+ * LodePNG and QOI images are checked against libpng's; QOI is lossless,
+ * so they must match exactly.
+ * "make decodebench" runs this on the images in media/. Exits non-zero
+ * if a check fails.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <texture/decoders/png.h>
+#include <texture/decoders/lodepng.h>
+#include <texture/decoders/qoi.h>
+
+using namespace Texture::Image;
+
+//==============================================================================
+
+namespace
+{
+	const int NUM_REPEATS = 20;
+
+	double now()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+	struct Image
+	{
+		uint8_t *m_data;
+		uint16_t m_width, m_height, m_rowBytes;
+		uint8_t m_nChannels, m_bitDepth;
+		bool m_sRGB;
+	};
+
+	// Decode file with decoder, into image; the best time of
+	// NUM_REPEATS, in ms, or a negative time if it fails
+	double decodeFile(const Decoder & decoder, FILE *file, Image & image)
+	{
+		double best = -1.0;
+		image.m_data = 0;
+		for (int r = 0; r < NUM_REPEATS; ++r)
+		{
+			rewind(file);
+			free(image.m_data);
+			const double start = now();
+			image.m_data = (uint8_t*)decoder.decodeSRGB(file, image.m_width, image.m_height,
+					image.m_nChannels, image.m_bitDepth, image.m_rowBytes, image.m_sRGB);
+			const double ms = (now() - start) * 1e3;
+			if (!image.m_data)
+				return -1.0;
+			if (best < 0.0 || ms < best)
+				best = ms;
+		}
+		return best;
+	}
+
+	// Largest difference between the texels of a and b; -1 if their
+	// layouts differ
+	int maxDifference(const Image & a, const Image & b)
+	{
+		if (a.m_width != b.m_width || a.m_height != b.m_height || a.m_nChannels != b.m_nChannels ||
+				a.m_bitDepth != b.m_bitDepth || a.m_sRGB != b.m_sRGB)
+			return -1;
+		int diff = 0;
+		const size_t rowBytes = (size_t)a.m_width * a.m_nChannels * (a.m_bitDepth / 8);
+		for (uint16_t y = 0; y < a.m_height; ++y)
+		{
+			const uint8_t *ra = a.m_data + (size_t)y * a.m_rowBytes;
+			const uint8_t *rb = b.m_data + (size_t)y * b.m_rowBytes;
+			for (size_t i = 0; i < rowBytes; ++i)
+				diff = std::max(diff, abs(ra[i] - rb[i]));
+		}
+		return diff;
+	}
+
+	void put32(std::vector<uint8_t> & out, uint32_t v)
+	{
+		out.push_back(v >> 24);
+		out.push_back(v >> 16);
+		out.push_back(v >> 8);
+		out.push_back(v);
+	}
+
+	// Encode an 8-bit RGB image as QOI (without alpha, so no QOI_OP_RGBA)
+	void encodeQOI(const Image & image, std::vector<uint8_t> & out)
+	{
+		out.clear();
+		out.push_back('q'); out.push_back('o'); out.push_back('i'); out.push_back('f');
+		put32(out, image.m_width);
+		put32(out, image.m_height);
+		out.push_back(3);
+		out.push_back(image.m_sRGB ? 0 : 1);
+
+		uint8_t index[64][3];
+		memset(index, 0, sizeof(index));
+		uint8_t prev[3] = { 0, 0, 0 };
+		int run = 0;
+		const size_t n = (size_t)image.m_width * image.m_height;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const uint8_t *px = image.m_data + (i / image.m_width) * image.m_rowBytes + (i % image.m_width) * 3;
+			if (0 == memcmp(px, prev, 3))
+			{
+				if (62 == ++run || i + 1 == n)
+				{
+					out.push_back(0xc0 | (run - 1));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0)
+			{
+				out.push_back(0xc0 | (run - 1));
+				run = 0;
+			}
+			// Alpha is always 255
+			const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) & 63;
+			if (0 == memcmp(index[hash], px, 3))
+			{
+				out.push_back(hash);
+			}
+			else
+			{
+				memcpy(index[hash], px, 3);
+				const int dr = (int8_t)(px[0] - prev[0]);
+				const int dg = (int8_t)(px[1] - prev[1]);
+				const int db = (int8_t)(px[2] - prev[2]);
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				}
+				else if (dg >= -32 && dg <= 31 && dr - dg >= -8 && dr - dg <= 7 && db - dg >= -8 && db - dg <= 7)
+				{
+					out.push_back(0x80 | (dg + 32));
+					out.push_back((dr - dg + 8) << 4 | (db - dg + 8));
+				}
+				else
+				{
+					out.push_back(0xfe);
+					out.push_back(px[0]);
+					out.push_back(px[1]);
+					out.push_back(px[2]);
+				}
+			}
+			memcpy(prev, px, 3);
+		}
+		static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		out.insert(out.end(), end, end + sizeof(end));
+	}
+
+	void report(const char * decoder, double ms, size_t fileBytes, const Image & image, double refMs, int diff)
+	{
+		const double mpix = (double)image.m_width * image.m_height / (ms * 1e3);
+		printf("  %-8s %9zu %8.2f %8.1f %7.2fx %5d\n", decoder, fileBytes, ms, mpix, refMs / ms, diff);
+	}
+
+	long fileSize(FILE *file)
+	{
+		fseek(file, 0, SEEK_END);
+		const long size = ftell(file);
+		rewind(file);
+		return size;
+	}
+}
+
+//==============================================================================
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: decodebench image.png...\n");
+		return 1;
+	}
+
+	const PNGDecoder png;
+	const LodePNGDecoder lodepng;
+	const QOIDecoder qoi;
+	bool ok = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		FILE *file = fopen(argv[i], "rb");
+		if (!file || !png.checkSig(file))
+		{
+			printf("%s: skipped, not a png\n", argv[i]);
+			if (file) fclose(file);
+			continue;
+		}
+
+		Image ref, lode, q;
+		const double pngMs = decodeFile(png, file, ref);
+		if (pngMs < 0.0)
+		{
+			printf("%s: FAIL, libpng could not decode it\n", argv[i]);
+			fclose(file);
+			ok = false;
+			continue;
+		}
+		printf("%s: %ux%u, %u channel(s), %u-bit%s\n", argv[i], ref.m_width, ref.m_height,
+				ref.m_nChannels, ref.m_bitDepth, ref.m_sRGB ? ", sRGB" : "");
+		printf("  %-8s %9s %8s %8s %8s %5s\n", "decoder", "bytes", "ms", "Mpix/s", "speedup", "diff");
+		report("libpng", pngMs, fileSize(file), ref, pngMs, 0);
+
+		// LodePNG reduces 16-bit images to 8 bits, so they do not compare
+		const double lodeMs = decodeFile(lodepng, file, lode);
+		const int lodeDiff = (8 == ref.m_bitDepth) ? maxDifference(lode, ref) : 0;
+		if (lodeMs < 0.0 || lodeDiff < 0)
+		{
+			printf("  %-8s FAIL\n", "lodepng");
+			ok = false;
+		}
+		else
+		{
+			report("lodepng", lodeMs, fileSize(file), lode, pngMs, lodeDiff);
+		}
+		free(lode.m_data);
+		fclose(file);
+
+		if (8 != ref.m_bitDepth || 3 != ref.m_nChannels)
+		{
+			printf("  %-8s skipped, only 8-bit RGB is re-encoded\n", "qoi");
+			free(ref.m_data);
+			continue;
+		}
+		std::vector<uint8_t> encoded;
+		encodeQOI(ref, encoded);
+		FILE *qoiFile = tmpfile();
+		if (!qoiFile || 1 != fwrite(&encoded[0], encoded.size(), 1, qoiFile) || 0 != fflush(qoiFile))
+		{
+			printf("  %-8s FAIL, could not write the encoded image\n", "qoi");
+			ok = false;
+		}
+		else
+		{
+			const double qoiMs = decodeFile(qoi, qoiFile, q);
+			const int qoiDiff = maxDifference(q, ref);
+			if (qoiMs < 0.0 || 0 != qoiDiff)
+			{
+				printf("  %-8s FAIL, diff %d\n", "qoi", qoiDiff);
+				ok = false;
+			}
+			else
+			{
+				report("qoi", qoiMs, encoded.size(), q, pngMs, qoiDiff);
+			}
+			free(q.m_data);
+		}
+		if (qoiFile) fclose(qoiFile);
+		free(ref.m_data);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Correctness checks and microbenchmarks for the gml SIMD backends.
+ *
+ * Every kernel with a SIMD version is compared against its reference in
+ * gml::ref on random inputs, then both are timed over the same inputs.
+ * The affine transform functions are compared and timed against the
+ * general 4x4 functions, and the batch functions against loops doing the
+ * same one vector at a time. The gml::expr chains are compared and timed
+ * against the same chains of gml functions.
+ * "make gmlbench" builds and runs this once per backend; backends the
+ * CPU does not support are skipped. Exits non-zero if a check fails.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <time.h>
+#include <gml/gml.h>
+#include <gml/expr.h>
+
+//==============================================================================
+
+namespace
+{
+	const int NUM_INPUTS = 1024;
+	const int NUM_REPEATS = 2000;
+
+	volatile float g_sink;
+
+	const char * backendName()
+	{
+		switch (GML_BACKEND)
+		{
+		case GML_BACKEND_SSE2: return "sse2";
+		case GML_BACKEND_SSE41: return "sse4.1";
+		case GML_BACKEND_AVX: return "avx";
+		default: return "ref";
+		}
+	}
+
+	bool cpuSupported()
+	{
+#if GML_BACKEND == GML_BACKEND_AVX
+		return __builtin_cpu_supports("avx");
+#elif GML_BACKEND == GML_BACKEND_SSE41
+		return __builtin_cpu_supports("sse4.1");
+#else
+		return true;
+#endif
+	}
+
+	double now()
+	{
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+	float randomFloat() { return rand() / (float)RAND_MAX * 2.0f - 1.0f; }
+
+	// Largest difference between a and its reference, relative to the
+	// magnitude of the reference where that is over 1
+	template <typename T>
+	float maxError(const std::vector<T> & a, const std::vector<T> & ref)
+	{
+		const int n = sizeof(T) / sizeof(float);
+		float e = 0.0f;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			const float * _a = (const float*)&a[i];
+			const float * _r = (const float*)&ref[i];
+			for (int j = 0; j < n; ++j)
+				e = fmaxf(e, fabsf(_a[j] - _r[j]) / fmaxf(1.0f, fabsf(_r[j])));
+		}
+		return e;
+	}
+
+	// Nanoseconds per call of f(i), over all the inputs
+	template <typename F>
+	double timeNs(F f)
+	{
+		const double start = now();
+		for (int r = 0; r < NUM_REPEATS; ++r)
+			for (int i = 0; i < NUM_INPUTS; ++i)
+				f(i);
+		return (now() - start) * 1e9 / ((double)NUM_REPEATS * NUM_INPUTS);
+	}
+
+	// Check simd(i) against ref(i), both writing out[i], then time them
+	template <typename T, typename R, typename S>
+	bool run(const char * kernel, float tolerance, std::vector<T> & out, R ref, S simd)
+	{
+		std::vector<T> expected(out.size());
+		for (int i = 0; i < NUM_INPUTS; ++i)
+			ref(i);
+		expected.swap(out);
+		for (int i = 0; i < NUM_INPUTS; ++i)
+			simd(i);
+		const float err = maxError(out, expected);
+
+		const double refNs = timeNs(ref);
+		const double simdNs = timeNs(simd);
+		g_sink = *(const float*)&out[NUM_INPUTS - 1];
+
+		const bool ok = err <= tolerance;
+		printf("  %-14s %9.2e %-4s %8.2f %8.2f %7.2fx\n", kernel, err, ok ? "ok" : "FAIL",
+				refNs, simdNs, refNs / simdNs);
+		return ok;
+	}
+
+	// Batches: check batch() against loop(), which does the same one
+	// vector at a time, then time them. Both write out.
+	template <typename L, typename B>
+	bool runBatch(const char * kernel, float tolerance, gml::vec3array_t & out, L loop, B batch)
+	{
+		loop();
+		const gml::vec3array_t expected = out;
+		batch();
+		const float err = maxError(out.data, expected.data);
+
+		// Per vector, like the single kernels above
+		const int repeats = NUM_REPEATS / 4;
+		double start = now();
+		for (int r = 0; r < repeats; ++r)
+			loop();
+		const double loopNs = (now() - start) * 1e9 / ((double)repeats * out.size());
+		start = now();
+		for (int r = 0; r < repeats; ++r)
+			batch();
+		const double batchNs = (now() - start) * 1e9 / ((double)repeats * out.size());
+		g_sink = out.data[0];
+
+		const bool ok = err <= tolerance;
+		printf("  %-14s %9.2e %-4s %8.2f %8.2f %7.2fx\n", kernel, err, ok ? "ok" : "FAIL",
+				loopNs, batchNs, loopNs / batchNs);
+		return ok;
+	}
+}
+
+//==============================================================================
+
+int main()
+{
+	if (!cpuSupported())
+	{
+		printf("gml backend %s: skipped, not supported by this CPU\n", backendName());
+		return 0;
+	}
+
+	srand(485);
+	std::vector<gml::mat4x4_t> A(NUM_INPUTS), B(NUM_INPUTS), M(NUM_INPUTS);
+	std::vector<gml::vec4_t> u(NUM_INPUTS), v(NUM_INPUTS);
+	std::vector<gml::vec3_t> a(NUM_INPUTS), b(NUM_INPUTS), c(NUM_INPUTS);
+	for (int i = 0; i < NUM_INPUTS; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+			for (int k = 0; k < 4; ++k)
+			{
+				// Diagonally dominant, so well conditioned for inverse()
+				A[i][j][k] = randomFloat() + (j == k ? 4.0f : 0.0f);
+				B[i][j][k] = randomFloat();
+			}
+		u[i] = gml::vec4_t(randomFloat(), randomFloat(), randomFloat(), randomFloat());
+		a[i] = gml::vec3_t(randomFloat(), randomFloat(), randomFloat());
+		b[i] = gml::vec3_t(randomFloat(), randomFloat(), randomFloat());
+	}
+
+	printf("gml backend %s\n", backendName());
+	printf("  %-14s %9s %-4s %8s %8s %8s\n", "kernel", "max err", "", "ref ns", "simd ns", "speedup");
+
+	bool ok = true;
+	ok &= run("mul(m4, m4)", 1e-5f, M,
+			[&](int i) { M[i] = gml::ref::mul(A[i], B[i]); },
+			[&](int i) { M[i] = gml::mul(A[i], B[i]); });
+	ok &= run("mul(m4, v4)", 1e-5f, v,
+			[&](int i) { v[i] = gml::ref::mul(A[i], u[i]); },
+			[&](int i) { v[i] = gml::mul(A[i], u[i]); });
+	ok &= run("inverse(m4)", 1e-5f, M,
+			[&](int i) { M[i] = gml::ref::inverse(A[i]); },
+			[&](int i) { M[i] = gml::inverse(A[i]); });
+	ok &= run("transpose(m4)", 0.0f, M,
+			[&](int i) { M[i] = gml::ref::transpose(A[i]); },
+			[&](int i) { M[i] = gml::transpose(A[i]); });
+	// Affine transforms, against their general 4x4 equivalents
+	std::vector<gml::affine_t> F(NUM_INPUTS), G(NUM_INPUTS), H(NUM_INPUTS);
+	std::vector<gml::mat3x3_t> N(NUM_INPUTS);
+	for (int i = 0; i < NUM_INPUTS; ++i)
+	{
+		F[i] = gml::affine(A[i]);
+		G[i] = gml::affine(B[i]);
+	}
+	ok &= run("mul(aff, aff)", 1e-5f, H,
+			[&](int i) { H[i] = gml::affine(gml::mul(gml::embed(F[i]), gml::embed(G[i]))); },
+			[&](int i) { H[i] = gml::mul(F[i], G[i]); });
+	ok &= run("inverse(aff)", 1e-5f, H,
+			[&](int i) { H[i] = gml::affine(gml::inverse(gml::embed(F[i]))); },
+			[&](int i) { H[i] = gml::inverse(F[i]); });
+	ok &= run("normalMatrix", 1e-5f, N,
+			[&](int i) { N[i] = gml::extract(gml::transpose(gml::inverse(gml::embed(F[i])))); },
+			[&](int i) { N[i] = gml::normalMatrix(F[i]); });
+	ok &= run("normalize(v4)", 1e-6f, v,
+			[&](int i) { v[i] = gml::ref::normalize(u[i]); },
+			[&](int i) { v[i] = gml::normalize(u[i]); });
+	ok &= run("normalize(v3)", 1e-6f, c,
+			[&](int i) { c[i] = gml::ref::normalize(a[i]); },
+			[&](int i) { c[i] = gml::normalize(a[i]); });
+	ok &= run("cross(v3)", 1e-6f, c,
+			[&](int i) { c[i] = gml::ref::cross(a[i], b[i]); },
+			[&](int i) { c[i] = gml::cross(a[i], b[i]); });
+
+	// Not a multiple of any SIMD width, so the tails get checked too
+	const size_t n = NUM_INPUTS * 4 + 3;
+	gml::vec3array_t points(n), lo(n), hi(n), out(n), outHi(n);
+	std::vector<float> radius(n), outRadius(n);
+	gml::vec3soa_t p = points.soa(), l = lo.soa(), h = hi.soa(), o = out.soa(), oh = outHi.soa();
+	for (size_t i = 0; i < n; ++i)
+	{
+		p.set(i, gml::vec3_t(randomFloat(), randomFloat(), randomFloat()));
+		l.set(i, gml::sub(p.get(i), gml::vec3_t(1.0f, 1.0f, 1.0f)));
+		h.set(i, gml::add(p.get(i), gml::vec3_t(randomFloat() + 1.0f, 1.0f, 2.0f)));
+		radius[i] = randomFloat() + 1.0f;
+	}
+	const gml::mat4x4_t T = gml::mul(gml::translate(gml::vec3_t(1.0f, 2.0f, 3.0f)),
+			gml::mul(gml::rotateYh(0.7f), gml::scaleh(1.0f, 2.0f, 0.5f)));
+
+	printf("  %-14s %9s %-4s %8s %8s %8s\n", "batch", "max err", "", "loop ns", "batch ns", "speedup");
+	ok &= runBatch("points", 1e-5f, out,
+			[&]() { for (size_t i = 0; i < n; ++i) o.set(i, gml::extract3(gml::mul(T, gml::vec4_t(p.get(i), 1.0f)))); },
+			[&]() { gml::transformPoints(T, p, o); });
+	ok &= runBatch("directions", 1e-5f, out,
+			[&]() { for (size_t i = 0; i < n; ++i) o.set(i, gml::extract3(gml::mul(T, gml::vec4_t(p.get(i), 0.0f)))); },
+			[&]() { gml::transformDirections(T, p, o); });
+	ok &= runBatch("normalize", 1e-6f, out,
+			[&]() { for (size_t i = 0; i < n; ++i) o.set(i, gml::normalize(p.get(i))); },
+			[&]() { gml::normalize(p, o); });
+	ok &= runBatch("spheres", 1e-5f, out,
+			[&]() {
+				const float s = sqrtf(fmaxf(gml::length2(gml::extract3(T[0])),
+						fmaxf(gml::length2(gml::extract3(T[1])), gml::length2(gml::extract3(T[2])))));
+				for (size_t i = 0; i < n; ++i)
+				{
+					o.set(i, gml::extract3(gml::mul(T, gml::vec4_t(p.get(i), 1.0f))));
+					outRadius[i] = s * radius[i];
+				}
+			},
+			[&]() { gml::transformSpheres(T, p, &radius[0], o, &outRadius[0]); });
+	ok &= runBatch("aabbs", 1e-5f, out,
+			[&]() {
+				// Transform all eight corners and bound them
+				for (size_t i = 0; i < n; ++i)
+				{
+					gml::vec3_t bmin(1e30f, 1e30f, 1e30f), bmax(-1e30f, -1e30f, -1e30f);
+					for (int k = 0; k < 8; ++k)
+					{
+						const gml::vec3_t c((k & 1) ? h.x[i] : l.x[i], (k & 2) ? h.y[i] : l.y[i], (k & 4) ? h.z[i] : l.z[i]);
+						const gml::vec3_t t = gml::extract3(gml::mul(T, gml::vec4_t(c, 1.0f)));
+						for (int r = 0; r < 3; ++r)
+						{
+							bmin[r] = fminf(bmin[r], t[r]);
+							bmax[r] = fmaxf(bmax[r], t[r]);
+						}
+					}
+					o.set(i, bmin);
+					oh.set(i, bmax);
+				}
+			},
+			[&]() { gml::transformAABBs(T, l, h, o, oh); });
+
+	// Chains from the renderer, lazily evaluated against gml's functions
+	std::vector<float> angle(NUM_INPUTS);
+	for (int i = 0; i < NUM_INPUTS; ++i)
+		angle[i] = randomFloat() * 3.0f;
+	const gml::mat4x4_t bias = gml::mul(gml::translate(gml::vec3_t(0.5f, 0.5f, 0.5f)), gml::scaleh(0.5f, 0.5f, 0.5f));
+
+	printf("  %-14s %9s %-4s %8s %8s %8s\n", "expr", "max err", "", "gml ns", "expr ns", "speedup");
+	ok &= run("t*rz*s", 1e-6f, M,
+			[&](int i) { M[i] = gml::mul(gml::translate(a[i]), gml::mul(gml::rotateZh(angle[i]), gml::scaleh(b[i]))); },
+			[&](int i) { M[i] = gml::expr::eval(gml::expr::mul(gml::expr::translate(a[i]),
+					gml::expr::mul(gml::expr::rotateZh(angle[i]), gml::expr::scaleh(b[i])))); });
+	ok &= run("t*rz*s aff", 1e-6f, H,
+			[&](int i) { H[i] = gml::affine(gml::mul(gml::translate(a[i]), gml::mul(gml::rotateZh(angle[i]), gml::scaleh(b[i])))); },
+			[&](int i) { H[i] = gml::expr::evalAffine(gml::expr::mul(gml::expr::translate(a[i]),
+					gml::expr::mul(gml::expr::rotateZh(angle[i]), gml::expr::scaleh(b[i])))); });
+	ok &= run("m4*t*s", 1e-5f, M,
+			[&](int i) { M[i] = gml::mul(A[i], gml::mul(gml::translate(a[i]), gml::scaleh(b[i]))); },
+			[&](int i) { M[i] = gml::expr::eval(gml::expr::mul(A[i],
+					gml::expr::mul(gml::expr::translate(a[i]), gml::expr::scaleh(b[i])))); });
+	ok &= run("bias*m4", 1e-5f, M,
+			[&](int i) { M[i] = gml::mul(bias, A[i]); },
+			[&](int i) { M[i] = gml::expr::eval(gml::expr::mul(gml::expr::mul(gml::expr::translate(gml::vec3_t(0.5f, 0.5f, 0.5f)),
+					gml::expr::scaleh(0.5f, 0.5f, 0.5f)), A[i])); });
+	ok &= run("m4*point", 1e-5f, c,
+			[&](int i) { c[i] = gml::extract3(gml::mul(A[i], gml::vec4_t(a[i], 1.0f))); },
+			[&](int i) { c[i] = gml::expr::eval3(gml::expr::mul(A[i], gml::expr::point(a[i]))); });
+	ok &= run("m4*m4", 1e-5f, M,
+			[&](int i) { M[i] = gml::mul(A[i], B[i]); },
+			[&](int i) { M[i] = gml::expr::eval(gml::expr::mul(A[i], B[i])); });
+
+	return ok ? 0 : 1;
+}
@@ -3,9 +3,6 @@
 #if !defined (__INC_CONFIG_H_)
 #define __INC_CONFIG_H_
 
-#define PNG_LOADER_LIBPNG 1
-//#define PNG_LOADER_LODEPNG 1
-
 #define PIPELINE_DEFERRED 1
 
 //#define PIPELINE_DEFERRED_DEBUG 1
@@ -14,6 +11,90 @@
 
 #define DO_SMOOTH_SHADOW 1
 
+// Number of orthographic cascades for the directional light (2 to 4)
+#define SHADOW_NUM_CASCADES 4
+#define SHADOW_NUM_CASCADES_STR "4"
+
+// Point light shadows share one square depth atlas of SHADOW_ATLAS_SIZE
+// texels. Each light gets a tile of six cube faces, each face between
+// SHADOW_ATLAS_MIN_TILE and SHADOW_ATLAS_MAX_TILE texels (powers of two)
+#define SHADOW_ATLAS_SIZE 4096
+#define SHADOW_ATLAS_MIN_TILE 64
+#define SHADOW_ATLAS_MAX_TILE 512
+
+// Per-frame budget for point light shadow updates: at most
+// SHADOW_UPDATE_FACES cube faces are rendered, and fewer when their
+// measured GPU cost would exceed SHADOW_UPDATE_MS (0 = no time limit).
+// The rest are refreshed on later frames, most important first.
+#define SHADOW_UPDATE_FACES 24
+#define SHADOW_UPDATE_MS 2.0
+
+// Point lights after the first SHADOW_CUBE_LIGHTS get dual-paraboloid
+// shadows: two hemispheres rendered in two passes instead of six cube
+// faces, at some cost in accuracy
+#define SHADOW_CUBE_LIGHTS 4
+
+// Store shadow map depths in 16 bits instead of 24; halves the memory
+// and bandwidth of the atlas and the cascades
+//#define SHADOW_DEPTH_16BIT 1
+
+// Shadow filtering (see shadowfilter.h). The rotated Poisson disk takes
+// SHADOW_PCF_TAPS (4 to 8) bilinear PCF taps spread over SHADOW_PCF_RADIUS
+// shadow map texels. Exponential shadow maps store exp(k * depth) with
+// k = SHADOW_ESM_EXPONENT; larger values darken contact shadows but need
+// more precision.
+#define SHADOW_PCF_TAPS 8
+#define SHADOW_PCF_TAPS_STR "8"
+#define SHADOW_PCF_RADIUS_STR "1.5"
+#define SHADOW_ESM_EXPONENT 80.0f
+#define SHADOW_ESM_EXPONENT_STR "80.0"
+
+// Screen-space contact shadows for point lights that have no shadow map
+// this frame: CONTACT_SHADOW_STEPS G-buffer samples along a ray of up
+// to CONTACT_SHADOW_LENGTH view units towards the light. A sample hits
+// when it is behind the surface at its pixel by less than
+// CONTACT_SHADOW_THICKNESS.
+#define DO_CONTACT_SHADOW 1
+#define CONTACT_SHADOW_STEPS_STR "12"
+#define CONTACT_SHADOW_LENGTH_STR "0.75"
+#define CONTACT_SHADOW_THICKNESS_STR "0.25"
+
+// Linked GLSL programs are kept in this directory, keyed by driver and
+// source, so later runs load them instead of compiling. Comment out to
+// always compile.
+#define SHADER_CACHE_DIR ".shadercache"
+
+// Textures are sampled tri-linearly from their mip chain by default, with
+// up to TEXTURE_ANISOTROPY x anisotropic filtering where the GL supports
+// it (1.0f turns it off)
+#define TEXTURE_ANISOTROPY 8.0f
+
+// Block compress textures when they are loaded: BC7 where the GL has
+// BPTC, else BC1, and BC4 for single channel images. The compressed mip
+// chains are kept in TEXTURE_CACHE_DIR, so only the first run pays for
+// the encoding; comment that out to compress on every run.
+#define TEXTURE_COMPRESS true
+#define TEXTURE_CACHE_DIR ".texturecache"
+
+// Keep RGB images that are sRGB encoded (by their PNG sRGB or gAMA chunk)
+// that way, in GL_SRGB8 or an sRGB block format, and let the GL linearize
+// them when it samples; false linearizes them on load, in 8 bits.
+#define TEXTURE_SRGB true
+
+// GL memory the textures may use, in MB. Over it, the least recently
+// bound textures are reloaded without their top mip levels. 0 for no limit.
+#define TEXTURE_BUDGET_MB 256
+
+// Load textures in the background; they show a placeholder until they
+// are in. At most TEXTURE_STREAM_KB of texture data is uploaded a frame.
+#define TEXTURE_STREAM true
+#define TEXTURE_STREAM_KB 4096
+
+// Pack the scene's textures that share a size, format and sampling into
+// the layers of texture arrays, so that the deferred geometry pass binds
+// one array for all of them. Comment out to bind each texture instead.
+#define TEXTURE_ARRAYS
+
 #define USE_ASSIMP	1
 
 #endif // __INC_CONFIG_H_
@@ -0,0 +1,112 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#pragma once
+
+// Inline function definitions for affine transforms.
+// This file should not be directly included by anything other than gml.h
+
+inline affine_t affine(const mat4x4_t M)
+{
+	affine_t dst;
+	for (int i = 0; i < 3; i++)
+		dst[i] = vec4_t(M[0][i], M[1][i], M[2][i], M[3][i]);
+	return dst;
+}
+inline affine_t affine(const mat3x3_t L, const vec3_t t)
+{
+	affine_t dst;
+	for (int i = 0; i < 3; i++)
+		dst[i] = vec4_t(L[0][i], L[1][i], L[2][i], t[i]);
+	return dst;
+}
+
+inline mat4x4_t embed(const affine_t A)
+{
+	mat4x4_t dst;
+	dst[0] = vec4_t(A[0].x, A[1].x, A[2].x, 0.0f);
+	dst[1] = vec4_t(A[0].y, A[1].y, A[2].y, 0.0f);
+	dst[2] = vec4_t(A[0].z, A[1].z, A[2].z, 0.0f);
+	dst[3] = vec4_t(A[0].w, A[1].w, A[2].w, 1.0f);
+	return dst;
+}
+
+inline mat3x3_t extract(const affine_t A)
+{
+	mat3x3_t dst;
+	dst[0] = vec3_t(A[0].x, A[1].x, A[2].x);
+	dst[1] = vec3_t(A[0].y, A[1].y, A[2].y);
+	dst[2] = vec3_t(A[0].z, A[1].z, A[2].z);
+	return dst;
+}
+
+namespace ref
+{
+inline affine_t mul(const affine_t A, const affine_t B)
+{
+	// Row i of AB is row i of A times B; B's bottom row only adds A's
+	// translation
+	affine_t dst;
+	for (int i = 0; i < 3; i++)
+	{
+		dst[i] = add( scale(A[i].x, B[0]), add(scale(A[i].y, B[1]), scale(A[i].z, B[2])) );
+		dst[i].w += A[i].w;
+	}
+	return dst;
+}
+}
+
+inline vec3_t transformPoint(const affine_t A, const vec3_t p)
+{
+	const vec4_t _p(p, 1.0f);
+	return vec3_t(dot(A[0], _p), dot(A[1], _p), dot(A[2], _p));
+}
+inline vec3_t transformDirection(const affine_t A, const vec3_t d)
+{
+	return vec3_t(dot(extract3(A[0]), d), dot(extract3(A[1]), d), dot(extract3(A[2]), d));
+}
+
+inline affine_t inverse(const affine_t A)
+{
+	// For A = [ L t ], inverse(A) = [ inverse(L) -inverse(L)t ]
+	//         [ 0 1 ]               [     0           1       ]
+	// The rows of inverse(L)^T are cross products of the rows of L, over
+	// det(L); see inverse(mat3x3_t).
+	const vec3_t r0 = extract3(A[0]), r1 = extract3(A[1]), r2 = extract3(A[2]);
+	vec3_t n0 = cross(r1, r2);
+	const float detInv = 1.0f / dot(r0, n0);
+	n0 = scale(detInv, n0);
+	const vec3_t n1 = scale(detInv, cross(r2, r0));
+	const vec3_t n2 = scale(detInv, cross(r0, r1));
+	const vec3_t t = add( scale(A[0].w, n0), add(scale(A[1].w, n1), scale(A[2].w, n2)) );
+
+	affine_t dst;
+	dst[0] = vec4_t(n0.x, n1.x, n2.x, -t.x);
+	dst[1] = vec4_t(n0.y, n1.y, n2.y, -t.y);
+	dst[2] = vec4_t(n0.z, n1.z, n2.z, -t.z);
+	return dst;
+}
+
+inline mat3x3_t normalMatrix(const affine_t A)
+{
+	// Rows of inverse(L)^T, as in inverse(affine_t)
+	const vec3_t r0 = extract3(A[0]), r1 = extract3(A[1]), r2 = extract3(A[2]);
+	const vec3_t n0 = cross(r1, r2);
+	const vec3_t n1 = cross(r2, r0);
+	const vec3_t n2 = cross(r0, r1);
+	const float detInv = 1.0f / dot(r0, n0);
+
+	mat3x3_t dst;
+	dst[0] = scale(detInv, vec3_t(n0.x, n1.x, n2.x));
+	dst[1] = scale(detInv, vec3_t(n0.y, n1.y, n2.y));
+	dst[2] = scale(detInv, vec3_t(n0.z, n1.z, n2.z));
+	return dst;
+}
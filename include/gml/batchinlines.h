@@ -0,0 +1,180 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#pragma once
+
+// Inline function definitions for the batch functions.
+// SIMD lanes hold the same component of consecutive vectors, so each
+// kernel is the scalar formula applied to 4 (SSE) or 8 (AVX) vectors at
+// a time. The tail, and the reference backend, use the scalar functions.
+// This file should not be directly included by anything other than gml.h
+
+#if GML_BACKEND >= GML_BACKEND_SSE2
+namespace simd
+{
+#if GML_BACKEND >= GML_BACKEND_AVX
+typedef __m256 floatv;
+const size_t WIDTH = 8;
+inline floatv loadv(const float *p) { return _mm256_loadu_ps(p); }
+inline void storev(float *p, const floatv v) { _mm256_storeu_ps(p, v); }
+inline floatv setv(const float f) { return _mm256_set1_ps(f); }
+inline floatv addv(const floatv a, const floatv b) { return _mm256_add_ps(a, b); }
+inline floatv subv(const floatv a, const floatv b) { return _mm256_sub_ps(a, b); }
+inline floatv mulv(const floatv a, const floatv b) { return _mm256_mul_ps(a, b); }
+inline floatv divv(const floatv a, const floatv b) { return _mm256_div_ps(a, b); }
+inline floatv sqrtv(const floatv a) { return _mm256_sqrt_ps(a); }
+#else
+typedef __m128 floatv;
+const size_t WIDTH = 4;
+inline floatv loadv(const float *p) { return _mm_loadu_ps(p); }
+inline void storev(float *p, const floatv v) { _mm_storeu_ps(p, v); }
+inline floatv setv(const float f) { return _mm_set1_ps(f); }
+inline floatv addv(const floatv a, const floatv b) { return _mm_add_ps(a, b); }
+inline floatv subv(const floatv a, const floatv b) { return _mm_sub_ps(a, b); }
+inline floatv mulv(const floatv a, const floatv b) { return _mm_mul_ps(a, b); }
+inline floatv divv(const floatv a, const floatv b) { return _mm_div_ps(a, b); }
+inline floatv sqrtv(const floatv a) { return _mm_sqrt_ps(a); }
+#endif
+
+// The upper 3x4 of a matrix, every element broadcast
+struct mat3x4v
+{
+	floatv m[4][3];
+	mat3x4v(const mat4x4_t M, const bool absolute = false)
+	{
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 3; ++r)
+				m[c][r] = setv(absolute ? fabsf(M[c][r]) : M[c][r]);
+	}
+};
+
+// Row r of M (x, y, z, w), w = 1 for points and 0 for directions
+inline floatv row(const mat3x4v & M, const int r, const floatv x, const floatv y, const floatv z, const bool point)
+{
+	floatv v = addv(mulv(M.m[0][r], x), addv(mulv(M.m[1][r], y), mulv(M.m[2][r], z)));
+	return point ? addv(v, M.m[3][r]) : v;
+}
+
+inline void transform(const mat3x4v & M, const vec3soa_t in, const vec3soa_t out, const size_t i, const bool point)
+{
+	const floatv x = loadv(in.x + i);
+	const floatv y = loadv(in.y + i);
+	const floatv z = loadv(in.z + i);
+	storev(out.x + i, row(M, 0, x, y, z, point));
+	storev(out.y + i, row(M, 1, x, y, z, point));
+	storev(out.z + i, row(M, 2, x, y, z, point));
+}
+}
+#endif
+
+inline void transformPoints(const mat4x4_t M, const vec3soa_t in, const vec3soa_t out)
+{
+	size_t i = 0;
+#if GML_BACKEND >= GML_BACKEND_SSE2
+	const simd::mat3x4v _M(M);
+	for (; i + simd::WIDTH <= in.n; i += simd::WIDTH)
+		simd::transform(_M, in, out, i, true);
+#endif
+	for (; i < in.n; ++i)
+		out.set(i, extract3(mul(M, vec4_t(in.get(i), 1.0f))));
+}
+
+inline void transformDirections(const mat4x4_t M, const vec3soa_t in, const vec3soa_t out)
+{
+	size_t i = 0;
+#if GML_BACKEND >= GML_BACKEND_SSE2
+	const simd::mat3x4v _M(M);
+	for (; i + simd::WIDTH <= in.n; i += simd::WIDTH)
+		simd::transform(_M, in, out, i, false);
+#endif
+	for (; i < in.n; ++i)
+		out.set(i, extract3(mul(M, vec4_t(in.get(i), 0.0f))));
+}
+
+inline void normalize(const vec3soa_t in, const vec3soa_t out)
+{
+	size_t i = 0;
+#if GML_BACKEND >= GML_BACKEND_SSE2
+	using namespace simd;
+	for (; i + WIDTH <= in.n; i += WIDTH)
+	{
+		const floatv x = loadv(in.x + i);
+		const floatv y = loadv(in.y + i);
+		const floatv z = loadv(in.z + i);
+		const floatv len = sqrtv(addv(mulv(x, x), addv(mulv(y, y), mulv(z, z))));
+		storev(out.x + i, divv(x, len));
+		storev(out.y + i, divv(y, len));
+		storev(out.z + i, divv(z, len));
+	}
+#endif
+	for (; i < in.n; ++i)
+		out.set(i, normalize(in.get(i)));
+}
+
+inline void transformSpheres(const mat4x4_t M, const vec3soa_t center, const float *radius,
+		const vec3soa_t outCenter, float *outRadius)
+{
+	transformPoints(M, center, outCenter);
+
+	const float s = sqrtf(fmaxf(length2(extract3(M[0])),
+			fmaxf(length2(extract3(M[1])), length2(extract3(M[2])))));
+	size_t i = 0;
+#if GML_BACKEND >= GML_BACKEND_SSE2
+	const simd::floatv _s = simd::setv(s);
+	for (; i + simd::WIDTH <= center.n; i += simd::WIDTH)
+		simd::storev(outRadius + i, simd::mulv(_s, simd::loadv(radius + i)));
+#endif
+	for (; i < center.n; ++i)
+		outRadius[i] = s * radius[i];
+}
+
+inline void transformAABBs(const mat4x4_t M, const vec3soa_t lo, const vec3soa_t hi,
+		const vec3soa_t outLo, const vec3soa_t outHi)
+{
+	// From: Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems
+	// The centre moves as a point; the half extents through |M|.
+	size_t i = 0;
+#if GML_BACKEND >= GML_BACKEND_SSE2
+	using namespace simd;
+	const mat3x4v _M(M);
+	const mat3x4v absM(M, true);
+	const floatv half = setv(0.5f);
+	for (; i + WIDTH <= lo.n; i += WIDTH)
+	{
+		const floatv lx = loadv(lo.x + i), ly = loadv(lo.y + i), lz = loadv(lo.z + i);
+		const floatv hx = loadv(hi.x + i), hy = loadv(hi.y + i), hz = loadv(hi.z + i);
+		const floatv cx = mulv(half, addv(lx, hx)), ex = mulv(half, subv(hx, lx));
+		const floatv cy = mulv(half, addv(ly, hy)), ey = mulv(half, subv(hy, ly));
+		const floatv cz = mulv(half, addv(lz, hz)), ez = mulv(half, subv(hz, lz));
+		for (int r = 0; r < 3; ++r)
+		{
+			const floatv c = row(_M, r, cx, cy, cz, true);
+			const floatv e = row(absM, r, ex, ey, ez, false);
+			float *l = (0 == r) ? outLo.x : (1 == r) ? outLo.y : outLo.z;
+			float *h = (0 == r) ? outHi.x : (1 == r) ? outHi.y : outHi.z;
+			storev(l + i, subv(c, e));
+			storev(h + i, addv(c, e));
+		}
+	}
+#endif
+	for (; i < lo.n; ++i)
+	{
+		const vec3_t l = lo.get(i);
+		const vec3_t h = hi.get(i);
+		const vec3_t c = extract3(mul(M, vec4_t(scale(0.5f, add(l, h)), 1.0f)));
+		const vec3_t e = scale(0.5f, sub(h, l));
+		vec3_t ext;
+		for (int r = 0; r < 3; ++r)
+			ext[r] = fabsf(M[0][r]) * e.x + fabsf(M[1][r]) * e.y + fabsf(M[2][r]) * e.z;
+		outLo.set(i, sub(c, ext));
+		outHi.set(i, add(c, ext));
+	}
+}
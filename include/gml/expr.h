@@ -0,0 +1,310 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Lazy evaluation of chained gml transforms.
+ *
+ * gml::expr::mul() does not multiply; it returns a Product of its operands.
+ * eval() and friends then compute each element of the destination
+ * directly from the operands, so a chain like
+ *   eval(mul(translate(t), mul(rotateZh(a), scaleh(s))))
+ * builds no intermediate matrices.
+ *
+ * Every operand type states which of its elements are always zero (its
+ * Zero<C, R>), e.g. scaleh() is diagonal and translate() is the identity
+ * plus its last column. A Product skips the terms that multiply such an
+ * element, at compile time, and its own zero elements follow from its
+ * operands'. The constant 1 elements are returned as literals, so the
+ * compiler folds those multiplies away too.
+ *
+ * Notes:
+ *  - Matrix operands are held by reference: evaluate an expression in the
+ *   statement that builds it.
+ *  - Each element of a Product is computed from its operands' elements,
+ *   so a product of several general matrices recomputes the inner
+ *   product's elements; those are cheaper with gml::mul(). The structured
+ *   operands are what makes this pay off.
+ *
+ * This is optional: it is not included by gml.h.
+ */
+
+#pragma once
+#ifndef __INC_GML_EXPR_H__
+#define __INC_GML_EXPR_H__
+
+#include <gml/gml.h>
+
+namespace gml
+{
+namespace expr
+{
+
+// Element (column C, row R) of an operand E is e.get<C, R>(), and
+// E::Zero<C, R>::value is true when that element is zero whatever the
+// operand's values. Vectors are operands with one column.
+
+// A general 4x4 matrix
+struct Matrix
+{
+	const mat4x4_t & m;
+	explicit Matrix(const mat4x4_t & _m) : m(_m) {}
+
+	template <int C, int R> struct Zero { enum { value = false }; };
+	template <int C, int R> float get() const { return m[C][R]; }
+};
+
+// An affine transform; bottom row (0, 0, 0, 1)
+struct Affine
+{
+	const affine_t & a;
+	explicit Affine(const affine_t & _a) : a(_a) {}
+
+	template <int C, int R> struct Zero { enum { value = (3 == R && 3 != C) }; };
+	template <int C, int R> float get() const
+	{
+		return (3 == R) ? (3 == C ? 1.0f : 0.0f) : a[R < 3 ? R : 0][C];
+	}
+};
+
+// translate(t)
+struct Translate
+{
+	vec3_t t;
+	explicit Translate(const vec3_t _t) : t(_t) {}
+
+	template <int C, int R> struct Zero { enum { value = !(C == R || (3 == C && R < 3)) }; };
+	template <int C, int R> float get() const
+	{
+		return (C == R) ? 1.0f : (3 == C && R < 3) ? t[R < 3 ? R : 0] : 0.0f;
+	}
+};
+
+// scaleh(s)
+struct Scale
+{
+	vec3_t s;
+	explicit Scale(const vec3_t _s) : s(_s) {}
+
+	template <int C, int R> struct Zero { enum { value = (C != R) }; };
+	template <int C, int R> float get() const
+	{
+		return (C != R) ? 0.0f : (C < 3) ? s[C < 3 ? C : 0] : 1.0f;
+	}
+};
+
+// rotateXh(), rotateYh() and rotateZh(): Axis is 0, 1 or 2. Only the
+// block of the two other axes, I and J, is not the identity.
+template <int Axis>
+struct Rotate
+{
+	float c, s;
+	explicit Rotate(const float angle) : c(cosf(angle)), s(sinf(angle)) {}
+
+	enum { I = (Axis + 1) % 3, J = (Axis + 2) % 3 };
+	template <int C, int R> struct Zero
+	{
+		enum { value = !(C == R || (I == C && J == R) || (J == C && I == R)) };
+	};
+	template <int C, int R> float get() const
+	{
+		if (C == R) return (I == C || J == C) ? c : 1.0f;
+		if (I == C && J == R) return s;
+		if (J == C && I == R) return -s;
+		return 0.0f;
+	}
+};
+
+// A column vector
+struct Vector
+{
+	vec4_t v;
+	explicit Vector(const vec4_t _v) : v(_v) {}
+
+	template <int C, int R> struct Zero { enum { value = (0 != C) }; };
+	template <int C, int R> float get() const { return (0 != C) ? 0.0f : v[R]; }
+};
+
+// (p, 1)
+struct Point
+{
+	vec3_t p;
+	explicit Point(const vec3_t _p) : p(_p) {}
+
+	template <int C, int R> struct Zero { enum { value = (0 != C) }; };
+	template <int C, int R> float get() const
+	{
+		return (0 != C) ? 0.0f : (R < 3) ? p[R < 3 ? R : 0] : 1.0f;
+	}
+};
+
+// (d, 0)
+struct Direction
+{
+	vec3_t d;
+	explicit Direction(const vec3_t _d) : d(_d) {}
+
+	template <int C, int R> struct Zero { enum { value = (0 != C || 3 == R) }; };
+	template <int C, int R> float get() const
+	{
+		return (0 != C || 3 == R) ? 0.0f : d[R < 3 ? R : 0];
+	}
+};
+
+// Sum over k >= K of a(k, R) b(C, k), leaving out the terms with a
+// structurally zero factor. zero is true when no terms are left.
+template <class A, class B, int C, int R, int K, bool Skip>
+struct DotTerm;
+
+template <class A, class B, int C, int R, int K>
+struct Dot
+{
+	typedef DotTerm<A, B, C, R, K,
+			A::template Zero<K, R>::value || B::template Zero<C, K>::value> Term;
+	enum { zero = Term::zero };
+	static float get(const A & a, const B & b) { return Term::get(a, b); }
+};
+
+template <class A, class B, int C, int R>
+struct Dot<A, B, C, R, 4>
+{
+	enum { zero = true };
+	static float get(const A &, const B &) { return 0.0f; }
+};
+
+template <class A, class B, int C, int R, int K>
+struct DotTerm<A, B, C, R, K, true> : Dot<A, B, C, R, K + 1>
+{
+};
+
+template <class A, class B, int C, int R, int K>
+struct DotTerm<A, B, C, R, K, false>
+{
+	typedef Dot<A, B, C, R, K + 1> Rest;
+	enum { zero = false };
+	static float get(const A & a, const B & b)
+	{
+		const float t = a.template get<K, R>() * b.template get<C, K>();
+		return Rest::zero ? t : t + Rest::get(a, b);
+	}
+};
+
+// a b
+template <class A, class B>
+struct Product
+{
+	A a;
+	B b;
+	Product(const A & _a, const B & _b) : a(_a), b(_b) {}
+
+	template <int C, int R> struct Zero { enum { value = Dot<A, B, C, R, 0>::zero }; };
+	template <int C, int R> float get() const { return Dot<A, B, C, R, 0>::get(a, b); }
+};
+
+// The operand type for a gml type, or an expression
+template <class T> struct Node { typedef T type; };
+template <> struct Node<mat4x4_t> { typedef Matrix type; };
+template <> struct Node<affine_t> { typedef Affine type; };
+template <> struct Node<vec4_t> { typedef Vector type; };
+
+inline Matrix node(const mat4x4_t & m) { return Matrix(m); }
+inline Affine node(const affine_t & a) { return Affine(a); }
+inline Vector node(const vec4_t & v) { return Vector(v); }
+template <class E> inline const E & node(const E & e) { return e; }
+
+//------------------------------------------------------------------------------
+// Building expressions. Operands may be expressions, mat4x4_t, affine_t
+// or vec4_t.
+
+inline Translate translate(const vec3_t t) { return Translate(t); }
+inline Scale scaleh(const float sx, const float sy, const float sz) { return Scale(vec3_t(sx, sy, sz)); }
+inline Scale scaleh(const vec3_t s) { return Scale(s); }
+inline Rotate<0> rotateXh(const float angle) { return Rotate<0>(angle); }
+inline Rotate<1> rotateYh(const float angle) { return Rotate<1>(angle); }
+inline Rotate<2> rotateZh(const float angle) { return Rotate<2>(angle); }
+inline Point point(const vec3_t p) { return Point(p); }
+inline Direction direction(const vec3_t d) { return Direction(d); }
+
+template <class A, class B>
+inline Product<typename Node<A>::type, typename Node<B>::type> mul(const A & a, const B & b)
+{
+	return Product<typename Node<A>::type, typename Node<B>::type>(node(a), node(b));
+}
+
+//------------------------------------------------------------------------------
+// Evaluating expressions; each element is computed once, straight into
+// the result.
+
+template <class E, int I>
+struct StoreMatrix
+{
+	static void store(const E & e, mat4x4_t & dst)
+	{
+		dst[I / 4][I % 4] = e.template get<I / 4, I % 4>();
+		StoreMatrix<E, I + 1>::store(e, dst);
+	}
+};
+template <class E>
+struct StoreMatrix<E, 16>
+{
+	static void store(const E &, mat4x4_t &) {}
+};
+
+template <class E, int I>
+struct StoreAffine
+{
+	static void store(const E & e, affine_t & dst)
+	{
+		dst[I / 4][I % 4] = e.template get<I % 4, I / 4>();
+		StoreAffine<E, I + 1>::store(e, dst);
+	}
+};
+template <class E>
+struct StoreAffine<E, 12>
+{
+	static void store(const E &, affine_t &) {}
+};
+
+template <class E>
+inline mat4x4_t eval(const E & e)
+{
+	mat4x4_t dst;
+	StoreMatrix<E, 0>::store(e, dst);
+	return dst;
+}
+
+// Only for expressions that are affine by construction, from Translate,
+// Scale, Rotate and Affine operands; the bottom row is not computed.
+template <class E>
+inline affine_t evalAffine(const E & e)
+{
+	static_assert(E::template Zero<0, 3>::value && E::template Zero<1, 3>::value
+			&& E::template Zero<2, 3>::value, "expression is not affine");
+	affine_t dst;
+	StoreAffine<E, 0>::store(e, dst);
+	return dst;
+}
+
+// The first three, or all four, rows of a column vector expression
+template <class E>
+inline vec3_t eval3(const E & e)
+{
+	return vec3_t(e.template get<0, 0>(), e.template get<0, 1>(), e.template get<0, 2>());
+}
+template <class E>
+inline vec4_t eval4(const E & e)
+{
+	return vec4_t(e.template get<0, 0>(), e.template get<0, 1>(), e.template get<0, 2>(), e.template get<0, 3>());
+}
+
+}
+}
+
+#endif
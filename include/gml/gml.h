@@ -43,6 +43,12 @@
  *  mechanism instead of through reference parameters. The motivation for
  *  doing so is the same as for pass-by-value parameters.
  *
+ *  The hot kernels (4x4 mul, inverse and transpose, matrix-vector mul,
+ *  normalize and affine mul) have SIMD versions, chosen at compile time from
+ *  the instruction sets the compiler targets: SSE2, SSE4.1 or AVX. Define
+ *  GML_BACKEND as GML_BACKEND_REF to use the scalar code instead. The
+ *  scalar versions are always available in gml::ref, as the reference.
+ *
  *  It looks like there is a lot here, but it is a lot of duplication.
  *  Familiarize yourself with what's available here. It will make your
  *  life easier.
@@ -54,6 +60,34 @@
 #define __INC_GML_H__
 
 #include <cmath>
+#include <cstddef>
+#include <vector>
+
+// SIMD backends, in increasing order of instruction set
+#define GML_BACKEND_REF 0
+#define GML_BACKEND_SSE2 1
+#define GML_BACKEND_SSE41 2
+#define GML_BACKEND_AVX 3
+
+#if !defined (GML_BACKEND)
+#if defined (__AVX__)
+#define GML_BACKEND GML_BACKEND_AVX
+#elif defined (__SSE4_1__)
+#define GML_BACKEND GML_BACKEND_SSE41
+#elif defined (__SSE2__)
+#define GML_BACKEND GML_BACKEND_SSE2
+#else
+#define GML_BACKEND GML_BACKEND_REF
+#endif
+#endif
+
+#if GML_BACKEND >= GML_BACKEND_AVX
+#include <immintrin.h>
+#elif GML_BACKEND >= GML_BACKEND_SSE41
+#include <smmintrin.h>
+#elif GML_BACKEND >= GML_BACKEND_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace gml
 {
@@ -80,6 +114,13 @@ typedef struct _mat4x2_t mat4x2_t;
 typedef struct _mat4x3_t mat4x3_t;
 typedef struct _mat4x4_t mat4x4_t;
 
+// Affine transform, stored as the top three rows; see gmlstructs.h
+typedef struct _affine_t affine_t;
+
+// Batches of vectors; see gmlstructs.h
+typedef struct _vec3soa_t vec3soa_t;
+typedef struct _vec3array_t vec3array_t;
+
 /*
  * Vector functions
  */
@@ -317,6 +358,58 @@ mat4x4_t mul(const mat4x3_t X, const mat3x4_t Y);
 mat4x4_t mul(const mat4x4_t X, const mat4x4_t Y);
 
 
+/*
+ * Affine transforms
+ *  Cheaper than mat4x4_t for everything the bottom row (0, 0, 0, 1) makes
+ *  redundant. Promote them with embed() where a mat4x4_t is needed, such
+ *  as when uploading to a shader.
+ */
+
+// The top three rows of M; its bottom row is taken to be (0, 0, 0, 1)
+affine_t affine(const mat4x4_t M);
+// [ L t ]
+// [ 0 1 ]
+affine_t affine(const mat3x3_t L, const vec3_t t);
+// Promote to a 4x4 matrix
+mat4x4_t embed(const affine_t A);
+// The linear part: extract L from [ L t ]
+mat3x3_t extract(const affine_t A);
+// Composition: AB
+affine_t mul(const affine_t A, const affine_t B);
+// extract3(mul(embed(A), vec4_t(p, 1)))
+vec3_t transformPoint(const affine_t A, const vec3_t p);
+// extract3(mul(embed(A), vec4_t(d, 0)))
+vec3_t transformDirection(const affine_t A, const vec3_t d);
+// Inverse. Assumes the linear part is invertible.
+affine_t inverse(const affine_t A);
+// Transform for normals: the inverse-transpose of the linear part. embed()
+// it for the equivalent of transpose(inverse(embed(A))) on directions.
+mat3x3_t normalMatrix(const affine_t A);
+
+
+/*
+ * Batch functions
+ *  Each works on the first in.n vectors of in, writing the same number
+ *  to out. in and out may be the same batch. The bulk of the batch goes
+ *  through SIMD, the last few vectors through the functions above.
+ */
+
+// Points: out[i] = extract3(mul(M, vec4_t(in[i], 1)))
+void transformPoints(const mat4x4_t M, const vec3soa_t in, const vec3soa_t out);
+// Directions: out[i] = extract3(mul(M, vec4_t(in[i], 0)))
+void transformDirections(const mat4x4_t M, const vec3soa_t in, const vec3soa_t out);
+// out[i] = normalize(in[i])
+void normalize(const vec3soa_t in, const vec3soa_t out);
+// Bounding spheres through the affine M. The radii are scaled by the
+// largest axis scale of M, so the spheres still bound what they did.
+void transformSpheres(const mat4x4_t M, const vec3soa_t center, const float *radius,
+		const vec3soa_t outCenter, float *outRadius);
+// Axis-aligned boxes (lo, hi) through the affine M, to the axis-aligned
+// boxes bounding the results
+void transformAABBs(const mat4x4_t M, const vec3soa_t lo, const vec3soa_t hi,
+		const vec3soa_t outLo, const vec3soa_t outHi);
+
+
 
 
 
@@ -344,6 +437,8 @@ mat4x4_t mul(const mat4x4_t X, const mat4x4_t Y);
 #undef TYPE
 #undef N_COMPONENTS
 
+namespace ref
+{
 inline vec3_t cross(const vec3_t a, const vec3_t b)
 {
 	vec3_t dst;
@@ -355,6 +450,7 @@ inline vec3_t cross(const vec3_t a, const vec3_t b)
 	dst.z -= a.y * b.x;
 	return dst;
 }
+}
 
 inline mat3x3_t crossMatrix(const vec3_t a)
 {
@@ -371,6 +467,9 @@ inline vec3_t extract3(const vec4_t v) { return vec3_t(v.x, v.y, v.z); }
 
 #include "matvecinlines.h"
 #include "matinlines.h"
+#include "affineinlines.h"
+#include "simdinlines.h"
+#include "batchinlines.h"
 
 }
 #endif
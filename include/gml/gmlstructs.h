@@ -96,3 +96,51 @@ DEF_MAT(4,4)
 
 #undef DEF_MAT
 
+// Affine transforms: 4x4 matrices whose bottom row is (0, 0, 0, 1), with
+// only the other three rows stored. Unlike the matrices above these are
+// stored by rows; row i is (row i of the linear part, translation i).
+struct _affine_t
+{
+	_vec4_t r[3];
+	_affine_t() {}
+	_vec4_t const & operator[](const int i) const { return r[i]; }
+	_vec4_t& operator[](const int i) { return r[i]; }
+	bool operator==(const _affine_t b) const { return r[0]==b.r[0] && r[1]==b.r[1] && r[2]==b.r[2]; }
+};
+
+// Batches of 3-element vectors, stored as a structure of arrays: the x
+// components of all of them, then the y, then the z.
+//  _vec3soa_t is a view over storage owned by someone else.
+//  _vec3array_t owns its storage, and hands out views of it. Resizing
+//  it moves the components around, so it does not keep them.
+struct _vec3soa_t
+{
+	float *x;
+	float *y;
+	float *z;
+	size_t n; // Number of vectors
+
+	_vec3soa_t() { x=y=z=0; n=0; }
+	_vec3soa_t(float *_x, float *_y, float *_z, size_t _n) { x = _x; y = _y; z = _z; n = _n; }
+
+	_vec3_t get(const size_t i) const { return _vec3_t(x[i], y[i], z[i]); }
+	void set(const size_t i, const _vec3_t v) const { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+	// View of vectors [first, first + count)
+	_vec3soa_t slice(const size_t first, const size_t count) const { return _vec3soa_t(x+first, y+first, z+first, count); }
+};
+struct _vec3array_t
+{
+	std::vector<float> data;
+
+	_vec3array_t(const size_t n = 0) : data(3*n) {}
+
+	size_t size() const { return data.size() / 3; }
+	void resize(const size_t n) { data.resize(3*n); }
+	_vec3soa_t soa()
+	{
+		const size_t n = size();
+		float *p = n ? &data[0] : 0;
+		return _vec3soa_t(p, p+n, p+2*n, n);
+	}
+};
+
@@ -548,6 +548,8 @@ inline mat4x3_t transpose(const mat3x4_t M)
 	dst[2] = vec4_t(M[0].z, M[1].z, M[2].z, M[3].z);
 	return dst;
 }
+namespace ref
+{
 inline mat4x4_t transpose(const mat4x4_t M)
 {
 	mat4x4_t dst;
@@ -557,6 +559,7 @@ inline mat4x4_t transpose(const mat4x4_t M)
 	dst[3] = vec4_t(M[0].w, M[1].w, M[2].w, M[3].w);
 	return dst;
 }
+}
 
 
 
@@ -616,6 +619,8 @@ inline mat3x3_t inverse(const mat3x3_t A)
 	return dst;
 }
 
+namespace ref
+{
 inline mat4x4_t inverse(const mat4x4_t A)
 {
 	// From: http://www.geometrictools.com/Documentation/LaplaceExpansionTheorem.pdf
@@ -640,7 +645,7 @@ inline mat4x4_t inverse(const mat4x4_t A)
 			A[1][1]*c5-A[1][2]*c4+A[1][3]*c3,
 			-(A[0][1]*c5-A[0][2]*c4+A[0][3]*c3),
 			A[3][1]*s5-A[3][2]*s4+A[3][3]*s3,
-			-(A[2][1]*s5-A[2][2]*s4-A[2][3]*s3)
+			-(A[2][1]*s5-A[2][2]*s4+A[2][3]*s3)
 			);
 	inv[1] = vec4_t(
 			-(A[1][0]*c5-A[1][2]*c2+A[1][3]*c1),
@@ -661,6 +666,7 @@ inline mat4x4_t inverse(const mat4x4_t A)
 			A[2][0]*s3-A[2][1]*s1+A[2][2]*s0
 			);
 	return scale(1.0/detA, inv);
+}
 }
 
  // Matrix embedding
@@ -919,12 +925,15 @@ inline mat4x4_t mul(const mat4x3_t X, const mat3x4_t Y)
 	dst[3] = mul(X,Y[3]);
 	return dst;
 }
+namespace ref
+{
 inline mat4x4_t mul(const mat4x4_t X, const mat4x4_t Y)
 {
 	mat4x4_t dst;
-	dst[0] = mul(X,Y[0]);
-	dst[1] = mul(X,Y[1]);
-	dst[2] = mul(X,Y[2]);
-	dst[3] = mul(X,Y[3]);
+	dst[0] = ref::mul(X,Y[0]);
+	dst[1] = ref::mul(X,Y[1]);
+	dst[2] = ref::mul(X,Y[2]);
+	dst[3] = ref::mul(X,Y[3]);
 	return dst;
 }
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#pragma once
+
+// SIMD implementations of the hot kernels, for the backend chosen in
+// gml.h. Each must agree with its reference in gml::ref; run
+// "make gmlbench" after changing anything here.
+// This file should not be directly included by anything other than gml.h
+
+#if GML_BACKEND >= GML_BACKEND_SSE2
+
+namespace simd
+{
+// Shuffles, with lanes named in memory order (x, y, z, w)
+template <int X, int Y, int Z, int W>
+inline __m128 swizzle(const __m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X)); }
+template <int X, int Y, int Z, int W>
+inline __m128 shuffle(const __m128 a, const __m128 b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(W, Z, Y, X)); }
+template <int I>
+inline __m128 splat(const __m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I)); }
+
+inline __m128 load(const vec3_t v) { return _mm_set_ps(0.0f, v.z, v.y, v.x); }
+inline __m128 load(const vec4_t v) { return _mm_loadu_ps(&v.x); }
+inline vec3_t store3(const __m128 r)
+{
+	float f[4];
+	_mm_storeu_ps(f, r);
+	return vec3_t(f[0], f[1], f[2]);
+}
+inline vec4_t store4(const __m128 r)
+{
+	vec4_t v;
+	_mm_storeu_ps(&v.x, r);
+	return v;
+}
+
+// a . b in every lane
+inline __m128 dot(const __m128 a, const __m128 b)
+{
+#if GML_BACKEND >= GML_BACKEND_SSE41
+	return _mm_dp_ps(a, b, 0xFF);
+#else
+	__m128 p = _mm_mul_ps(a, b);
+	p = _mm_add_ps(p, swizzle<1, 0, 3, 2>(p));
+	return _mm_add_ps(p, swizzle<2, 3, 0, 1>(p));
+#endif
+}
+
+// X x, with the columns of X in c
+inline __m128 mulColumn(const __m128 c[4], const __m128 x)
+{
+	__m128 r = _mm_mul_ps(c[0], splat<0>(x));
+	r = _mm_add_ps(r, _mm_mul_ps(c[1], splat<1>(x)));
+	r = _mm_add_ps(r, _mm_mul_ps(c[2], splat<2>(x)));
+	return _mm_add_ps(r, _mm_mul_ps(c[3], splat<3>(x)));
+}
+
+// 2x2 matrices packed as (m00, m01, m10, m11)
+//  mat2Mul: A B; mat2AdjMul: adj(A) B; mat2MulAdj: A adj(B)
+inline __m128 mat2Mul(const __m128 a, const __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, swizzle<0, 3, 0, 3>(b)),
+			_mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+inline __m128 mat2AdjMul(const __m128 a, const __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(swizzle<3, 3, 0, 0>(a), b),
+			_mm_mul_ps(swizzle<1, 1, 2, 2>(a), swizzle<2, 3, 0, 1>(b)));
+}
+inline __m128 mat2MulAdj(const __m128 a, const __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, swizzle<3, 0, 3, 0>(b)),
+			_mm_mul_ps(swizzle<1, 0, 3, 2>(a), swizzle<2, 1, 2, 1>(b)));
+}
+}
+
+// Packing two 12 byte vec3_t into registers and back costs more than
+// the six multiplies (about 2x slower in gmlbench), so cross() stays scalar
+inline vec3_t cross(const vec3_t a, const vec3_t b) { return ref::cross(a, b); }
+
+inline vec3_t normalize(const vec3_t v)
+{
+	const __m128 _v = simd::load(v);
+	return simd::store3(_mm_div_ps(_v, _mm_sqrt_ps(simd::dot(_v, _v))));
+}
+inline vec4_t normalize(const vec4_t v)
+{
+	const __m128 _v = simd::load(v);
+	return simd::store4(_mm_div_ps(_v, _mm_sqrt_ps(simd::dot(_v, _v))));
+}
+
+inline vec4_t mul(const mat4x4_t A, const vec4_t x)
+{
+	const __m128 c[4] = { simd::load(A[0]), simd::load(A[1]), simd::load(A[2]), simd::load(A[3]) };
+	return simd::store4(simd::mulColumn(c, simd::load(x)));
+}
+
+inline mat4x4_t mul(const mat4x4_t X, const mat4x4_t Y)
+{
+	mat4x4_t dst;
+#if GML_BACKEND >= GML_BACKEND_AVX
+	// Two columns of the result per register
+	const __m256 x0 = _mm256_broadcast_ps((const __m128*)&X[0].x);
+	const __m256 x1 = _mm256_broadcast_ps((const __m128*)&X[1].x);
+	const __m256 x2 = _mm256_broadcast_ps((const __m128*)&X[2].x);
+	const __m256 x3 = _mm256_broadcast_ps((const __m128*)&X[3].x);
+	for (int i = 0; i < 4; i += 2)
+	{
+		const __m256 y = _mm256_loadu_ps(&Y[i].x);
+		__m256 r = _mm256_mul_ps(x0, _mm256_permute_ps(y, 0x00));
+		r = _mm256_add_ps(r, _mm256_mul_ps(x1, _mm256_permute_ps(y, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(x2, _mm256_permute_ps(y, 0xAA)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(x3, _mm256_permute_ps(y, 0xFF)));
+		_mm256_storeu_ps(&dst[i].x, r);
+	}
+#else
+	const __m128 c[4] = { simd::load(X[0]), simd::load(X[1]), simd::load(X[2]), simd::load(X[3]) };
+	for (int i = 0; i < 4; ++i)
+		_mm_storeu_ps(&dst[i].x, simd::mulColumn(c, simd::load(Y[i])));
+#endif
+	return dst;
+}
+
+inline affine_t mul(const affine_t A, const affine_t B)
+{
+	const __m128 b0 = simd::load(B[0]);
+	const __m128 b1 = simd::load(B[1]);
+	const __m128 b2 = simd::load(B[2]);
+	// Picks out A's translation
+	const __m128 w = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	affine_t dst;
+	for (int i = 0; i < 3; ++i)
+	{
+		const __m128 a = simd::load(A[i]);
+		__m128 r = _mm_mul_ps(simd::splat<0>(a), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(simd::splat<1>(a), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(simd::splat<2>(a), b2));
+		_mm_storeu_ps(&dst[i].x, _mm_add_ps(r, _mm_mul_ps(a, w)));
+	}
+	return dst;
+}
+
+inline mat4x4_t transpose(const mat4x4_t M)
+{
+	__m128 c0 = simd::load(M[0]);
+	__m128 c1 = simd::load(M[1]);
+	__m128 c2 = simd::load(M[2]);
+	__m128 c3 = simd::load(M[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	mat4x4_t dst;
+	dst[0] = simd::store4(c0);
+	dst[1] = simd::store4(c1);
+	dst[2] = simd::store4(c2);
+	dst[3] = simd::store4(c3);
+	return dst;
+}
+
+inline mat4x4_t inverse(const mat4x4_t M)
+{
+	// Blockwise inverse over 2x2 sub-matrices; see
+	// https://lxjk.github.io/2017/09/03/Fast-4x4-Matrix-Inverse-with-SSE-SIMD-Explained.html
+	// That works on rows, and taking the columns as rows inverts the
+	// transpose, which is the transpose of the inverse: the rows it
+	// produces are our columns.
+	const __m128 m0 = simd::load(M[0]);
+	const __m128 m1 = simd::load(M[1]);
+	const __m128 m2 = simd::load(M[2]);
+	const __m128 m3 = simd::load(M[3]);
+
+	// M = | A B |
+	//     | C D |
+	const __m128 A = _mm_movelh_ps(m0, m1);
+	const __m128 B = _mm_movehl_ps(m1, m0);
+	const __m128 C = _mm_movelh_ps(m2, m3);
+	const __m128 D = _mm_movehl_ps(m3, m2);
+
+	// (|A|, |B|, |C|, |D|)
+	const __m128 detSub = _mm_sub_ps(
+			_mm_mul_ps(simd::shuffle<0, 2, 0, 2>(m0, m2), simd::shuffle<1, 3, 1, 3>(m1, m3)),
+			_mm_mul_ps(simd::shuffle<1, 3, 1, 3>(m0, m2), simd::shuffle<0, 2, 0, 2>(m1, m3)));
+	const __m128 detA = simd::splat<0>(detSub);
+	const __m128 detB = simd::splat<1>(detSub);
+	const __m128 detC = simd::splat<2>(detSub);
+	const __m128 detD = simd::splat<3>(detSub);
+
+	// inverse(M) = 1/|M| | X Y |, with adj(X) etc. below
+	//                    | Z W |
+	const __m128 D_C = simd::mat2AdjMul(D, C);
+	const __m128 A_B = simd::mat2AdjMul(A, B);
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), simd::mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), simd::mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), simd::mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), simd::mat2MulAdj(A, D_C));
+
+	// |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+	__m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+	detM = _mm_sub_ps(detM, simd::dot(A_B, simd::swizzle<0, 2, 1, 3>(D_C)));
+
+	const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	// Undo the adjugates while storing
+	mat4x4_t dst;
+	dst[0] = simd::store4(simd::shuffle<3, 1, 3, 1>(X_, Y_));
+	dst[1] = simd::store4(simd::shuffle<2, 0, 2, 0>(X_, Y_));
+	dst[2] = simd::store4(simd::shuffle<3, 1, 3, 1>(Z_, W_));
+	dst[3] = simd::store4(simd::shuffle<2, 0, 2, 0>(Z_, W_));
+	return dst;
+}
+
+#else
+
+inline vec3_t cross(const vec3_t a, const vec3_t b) { return ref::cross(a, b); }
+inline vec3_t normalize(const vec3_t v) { return ref::normalize(v); }
+inline vec4_t normalize(const vec4_t v) { return ref::normalize(v); }
+inline vec4_t mul(const mat4x4_t A, const vec4_t x) { return ref::mul(A, x); }
+inline mat4x4_t mul(const mat4x4_t X, const mat4x4_t Y) { return ref::mul(X, Y); }
+inline affine_t mul(const affine_t A, const affine_t B) { return ref::mul(A, B); }
+inline mat4x4_t transpose(const mat4x4_t M) { return ref::transpose(M); }
+inline mat4x4_t inverse(const mat4x4_t M) { return ref::inverse(M); }
+
+#endif
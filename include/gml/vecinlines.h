@@ -81,7 +81,14 @@ inline float length2(const TYPE v)
 	return dot(v,v);
 }
 
+namespace ref
+{
 inline TYPE normalize(const TYPE v)
 {
 	return scale(1.0f/length(v), v);
 }
+}
+#if N_COMPONENTS == 2
+// vec3_t and vec4_t are in simdinlines.h
+inline TYPE normalize(const TYPE v) { return ref::normalize(v); }
+#endif
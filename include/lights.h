@@ -46,6 +46,9 @@ public:
 	float LinearAttenuation;
 	float ExpAttenuation;
 	bool Shadow;
+	// Point lights: screen-space contact shadows whenever the light has no
+	// shadow map to use
+	bool ContactShadow;
 
 private:
 	ShadowMap* mp_shadowmap;
@@ -57,12 +60,47 @@ public:
 
 	Light();
 	bool initShadow(const unsigned int & shadow_size, Shader::Manager * shader_manager);	
-	void createShadow(const ObjectVec & scene, const Camera &mainCamera);
+	// Point lights: get the shadow ready for ShadowAtlas to schedule;
+	// see ShadowMap::prepare()
+	void prepareShadow(const ObjectVec & scene, const Camera &mainCamera);
+	// Point lights only refresh the stale cube faces in faceMask (bit i
+	// for face i)
+	void createShadow(const ObjectVec & scene, const Camera &mainCamera, unsigned int faceMask = 0x3f);
 	void bindShadow(GLenum textureUnit);
 	void unbindShadow(GLenum textureUnit);
+	// Shadow filtering mode, one of the SHADOW_FILTER_ modes; see
+	// shadowfilter.h. Directional lights keep their own exponential
+	// shadow map for SHADOW_FILTER_ESM.
+	bool setShadowFilter(int mode);
+	void bindShadowFilter(GLenum textureUnit);
+	void unbindShadowFilter(GLenum textureUnit);
 	void setType(LightType lt);
 	LightType getType() { return m_type;}
-	gml::mat4x4_t getCamProjectionMatrix ();
+	// Directional lights: view -> shadow texture matrices and far split
+	// depth of each cascade. See ShadowMap.
+	const gml::mat4x4_t* getCascadeMatrices() const;
+	gml::vec4_t getCascadeSplits() const;
+	// Point lights: single-pass layered vs. six-pass cube map rendering
+	void setShadowLayered(bool layered);
+	// Point lights: dual-paraboloid (two passes) vs. cube map shadows
+	void setShadowParaboloid(bool paraboloid);
+	bool isShadowParaboloid() const;
+	// Point lights: cube faces, or paraboloid hemispheres, of the shadow
+	unsigned short getShadowFaceCount() const;
+	// GPU time of the last shadow map update, in milliseconds
+	double getShadowTime() const;
+	// Shadow maps (cube maps or cascades) re-rendered and reused from the
+	// cache by the last update
+	void getShadowCacheStats(unsigned int & updated, unsigned int & reused) const;
+	// Point lights: distance moved since the given cube face was rendered
+	float getShadowFaceStaleness(unsigned short face) const;
+	// Point lights: radius of the sphere the light has a visible effect in
+	float getBoundingRadius() const;
+	// Point lights: tile in the ShadowAtlas, in texels when set and in
+	// normalized atlas coordinates when read back; see ShadowMap.
+	void setShadowRect(const gml::vec4_t & rect);
+	gml::vec4_t getShadowRect() const;
+	const gml::mat4x4_t* getShadowCubeMatrices() const;
 };
 
 //==============================================================================
@@ -21,6 +21,8 @@
 #ifndef __INC_GEOMETRY_H_
 #define __INC_GEOMETRY_H_
 
+#include <gml/gml.h>
+
 namespace Object
 {
 
@@ -28,10 +30,22 @@ namespace Object
 class Geometry
 {
 protected:
+	// Object-space bounding sphere of the geometry.
+	//  Defaults to the unit sphere; models that extend beyond it
+	//  must set these in their constructor.
+	gml::vec3_t m_boundCenter;
+	float m_boundRadius;
+	// Bumped whenever the mesh is (re)built, so that cached shadow maps
+	// know to re-render
+	unsigned int m_revision;
 public:
 	Geometry();
 	virtual ~Geometry();
 
+	const gml::vec3_t& getBoundCenter() const { return m_boundCenter; }
+	float getBoundRadius() const { return m_boundRadius; }
+	unsigned int getRevision() const { return m_revision; }
+
 	// Rasterize this object via OpenGL
 	virtual void rasterize() const = 0;
 };
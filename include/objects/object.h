@@ -46,14 +46,24 @@ protected:
 	Material::Material m_material;
 
 	// object -> world space transformation
-	gml::mat4x4_t m_objectToWorld;
+	gml::affine_t m_objectToWorld;
+	// Bumped whenever the transform changes
+	unsigned int m_revision;
 public:
 	Object(const Geometry *geom, const Material::Material &mat,
 			const gml::mat4x4_t &objectToWorld);
 	~Object();
 
+	// Object transforms are affine; the bottom row of transform is ignored
 	void setTransform(const gml::mat4x4_t transform);
-	gml::mat4x4_t getObjectToWorld() const { return m_objectToWorld; }
+	gml::mat4x4_t getObjectToWorld() const { return gml::embed(m_objectToWorld); }
+	const gml::affine_t & getTransform() const { return m_objectToWorld; }
+	// World-space bounding sphere of the object
+	void getBoundingSphere(gml::vec3_t &center, float &radius) const;
+	// Changes whenever the transform or the geometry does; lets cached
+	// shadow maps tell whether this caster has changed.
+	unsigned int getRevision() const { return m_revision + m_geometry->getRevision(); }
+
 	const Material::Material & getMaterial() const { return m_material; }
 
 	void setMaterial(const Material::Material &mat) { m_material = mat; }
@@ -26,12 +26,15 @@
 #include <objects/object.h>
 #include <objects/geometry.h>
 #include <shaders/manager.h>
-#include <texture/texture.h>
+#include <texture/manager.h>
 #include <shadowmap.h>
+#include <transforms.h>
 #include <ui.h>
 
 #if defined (PIPELINE_DEFERRED)
 #include <gbuffer.h>
+#include <shadowatlas.h>
+#include <texture/arraypool.h>
 class Light;
 #endif
 
@@ -46,9 +49,11 @@ public:
 protected:
 	Shader::Manager m_shaderManager;
 	Camera m_camera;
-	Texture::Texture *m_texture;
+	Texture::Manager m_textureManager;
 
 	ObjectVec m_scene;
+	// Matrices of m_scene, recomputed once per frame
+	TransformStage m_transforms;
 
 	GeometryVec m_geometries;
 
@@ -60,6 +65,8 @@ protected:
 
 	float m_movementSpeed;
 	float m_rotationSpeed;
+	// Frames are skipped until the shader programs have compiled
+	bool m_shadersReady;
 	bool m_sRGBframebuffer;
 	bool m_renderWireframe;
 	bool m_enableShadows;
@@ -81,11 +88,50 @@ protected:
 
 	GBuffer m_gbuffer;
 	bool m_gbuffer_inited;
+
+	// The scene's textures, packed into arrays for the geometry pass
+	Texture::ArrayPool m_texturePool;
+	// m_scene indices by texture array & texture, so that each is bound
+	// once a frame; sorted again when the pool is repacked
+	std::vector<size_t> m_drawOrder;
+	unsigned int m_drawOrderRevision;
+	void sortDrawOrder();
 	Object::Object * m_dummySphere;
 	Object::Object * m_dummyQuad;
 		
 	typedef std::vector<Light*> LightVec;
 	LightVec m_lights;
+	// Positions of the point lights idle() rotates, as one batch
+	gml::vec3array_t m_animatedLights;
+	ShadowAtlas m_shadowAtlas;
+
+	// Point light shadow timing and shadow cache use, reported every
+	// SHADOW_REPORT_FRAMES frames
+	bool m_layeredShadows;
+	bool m_paraboloidShadows;
+	bool m_contactShadows;
+	unsigned int m_shadowFrames;
+	double m_pointShadowTime;
+	unsigned int m_shadowUpdated;
+	unsigned int m_shadowReused;
+	unsigned int m_facesUpdated;
+	unsigned int m_facesReused;
+	unsigned int m_facesDeferred;
+	void reportShadowStats();
+	void resetShadowStats();
+
+	// Shadow filtering mode (see shadowfilter.h), and the GPU time of the
+	// light passes it is paid in, read back once it is available. Frames
+	// whose query is still pending then are not timed.
+	int m_shadowFilter;
+	GLuint m_lightPassQuery;
+	bool m_lightPassPending;
+	double m_lightPassTime;
+	unsigned int m_lightPassFrames;
+	void setShadowFilter(int mode);
+	// Dual-paraboloid shadows for the point lights past the first
+	// SHADOW_CUBE_LIGHTS, or cube shadows for all of them
+	void setParaboloidShadows(bool enable);
 
 #else
 	void rasterizeScene();
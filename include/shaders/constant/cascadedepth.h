@@ -0,0 +1,45 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+/*
+ * Shader that only outputs the hardware depth of fragments.
+ * Used for the orthographic cascades of directional light shadows,
+ * and for the cube faces of point lights when they are rendered one
+ * pass per face.
+ */
+
+
+#pragma once
+#ifndef __SHADERS_CASCADEDEPTH_H_
+#define __SHADERS_CASCADEDEPTH_H_
+
+#include <shaders/shader.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+class CascadeDepth : public Shader
+{
+protected:
+	virtual void initUniforms();
+
+public:
+	CascadeDepth();
+	virtual ~CascadeDepth();
+
+	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+/*
+ * Single-pass depth-only shader for point light shadows. Renders all six cube faces
+ * of a point light into its ShadowAtlas tile in one pass; a geometry
+ * shader sends each triangle to the faces whose frusta it overlaps.
+ */
+
+
+#pragma once
+#ifndef __SHADERS_CUBEDEPTH_H_
+#define __SHADERS_CUBEDEPTH_H_
+
+#include <shaders/shader.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+class CubeDepth : public Shader
+{
+protected:
+	virtual void initUniforms();
+
+public:
+	CubeDepth();
+	virtual ~CubeDepth();
+
+	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
+};
+
+}
+}
+
+#endif
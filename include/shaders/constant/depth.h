@@ -29,6 +29,7 @@ namespace Constant
 class Depth : public Shader
 {
 protected:
+	virtual void initUniforms();
 
 public:
 	Depth();
@@ -36,6 +36,7 @@ namespace Lambertian
 class Phong : public Shader
 {
 protected:
+	virtual void initUniforms();
 public:
 	Phong();
 	virtual ~Phong();
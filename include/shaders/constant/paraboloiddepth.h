@@ -0,0 +1,46 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+/*
+ * Depth shader for one hemisphere of a dual-paraboloid point light
+ * shadow. The vertex shader does the paraboloid projection of the
+ * hemisphere looking down -z of the modelview, and stores the distance
+ * to the light over SHADOWMAP_FAR as depth. The projection is applied
+ * per vertex, so casters need to be reasonably finely tessellated.
+ */
+
+
+#pragma once
+#ifndef __SHADERS_PARABOLOIDDEPTH_H_
+#define __SHADERS_PARABOLOIDDEPTH_H_
+
+#include <shaders/shader.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+class ParaboloidDepth : public Shader
+{
+protected:
+	virtual void initUniforms();
+
+public:
+	ParaboloidDepth();
+	virtual ~ParaboloidDepth();
+
+	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
+};
+
+}
+}
+
+#endif
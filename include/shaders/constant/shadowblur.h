@@ -0,0 +1,46 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+/*
+ * One direction of a separable blur over a region of a shadow map,
+ * used to prefilter exponential shadow maps. Optionally turns depths
+ * into exp(k * depth) as it reads them, linearizing perspective depths
+ * first. Draws a single triangle; the viewport selects the region
+ * written.
+ */
+
+
+#pragma once
+#ifndef __SHADERS_SHADOWBLUR_H_
+#define __SHADERS_SHADOWBLUR_H_
+
+#include <shaders/shader.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+class ShadowBlur : public Shader
+{
+protected:
+	virtual void initUniforms();
+
+public:
+	ShadowBlur();
+	virtual ~ShadowBlur();
+
+	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
+};
+
+}
+}
+
+#endif
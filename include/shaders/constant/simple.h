@@ -35,6 +35,7 @@ namespace Constant
 class Simple : public Shader
 {
 protected:
+	virtual void initUniforms();
 
 public:
 	Simple();
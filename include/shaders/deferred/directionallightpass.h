@@ -17,9 +17,11 @@ namespace Deferred
 class DirectionalLightPass : public Shader
 {
 protected:
+	virtual void initUniforms();
 
 public:
-	DirectionalLightPass();
+	// features: the SHADER_FEATURE_* parts to build in
+	DirectionalLightPass(unsigned int features = SHADER_FEATURES_DEFAULT);
 	virtual ~DirectionalLightPass();
 
 	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
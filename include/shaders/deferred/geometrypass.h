@@ -17,6 +17,7 @@ namespace Deferred
 class GeometryPass : public Shader
 {
 protected:
+	virtual void initUniforms();
 
 public:
 	GeometryPass();
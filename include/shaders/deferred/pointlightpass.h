@@ -17,9 +17,11 @@ namespace Deferred
 class PointLightPass : public Shader
 {
 protected:
+	virtual void initUniforms();
 
 public:
-	PointLightPass();
+	// features: the SHADER_FEATURE_* parts to build in
+	PointLightPass(unsigned int features = SHADER_FEATURES_DEFAULT);
 	virtual ~PointLightPass();
 
 	virtual bool setUniforms(const GLProgUniforms &uniforms, const bool usingShadow=false) const;
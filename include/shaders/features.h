@@ -0,0 +1,48 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Optional features of the GLSL programs.
+ *
+ * A shader with optional parts is written once, with the parts between
+ * GLSL #if defined (...) blocks. Each combination of features, given as
+ * a bitmask, is a permutation of it: a separate program, built by
+ * defining the macro of every feature in the mask ahead of its source.
+ * See GLProgram::init() and Manager.
+ */
+
+#pragma once
+#ifndef __INC_SHADERS_FEATURES_H_
+#define __INC_SHADERS_FEATURES_H_
+
+#include <config.h>
+
+// Feature bits, and the GLSL macro each one defines
+#define SHADER_FEATURE_SHADOW         0x1 // DO_SHADOW: shadow map lookups
+#define SHADER_FEATURE_CONTACT_SHADOW 0x2 // DO_CONTACT_SHADOW: screen-space contact shadows
+#define NUM_SHADER_FEATURES 2
+
+#define SHADER_FEATURE_MACROS { "DO_SHADOW", "DO_CONTACT_SHADOW" }
+
+// The features that config.h builds in; permutations are limited to these
+#if defined (DO_SHADOW)
+#define SHADER_FEATURES_SHADOW_DEFAULT SHADER_FEATURE_SHADOW
+#else
+#define SHADER_FEATURES_SHADOW_DEFAULT 0
+#endif
+#if defined (DO_CONTACT_SHADOW)
+#define SHADER_FEATURES_CONTACT_DEFAULT SHADER_FEATURE_CONTACT_SHADOW
+#else
+#define SHADER_FEATURES_CONTACT_DEFAULT 0
+#endif
+#define SHADER_FEATURES_DEFAULT (SHADER_FEATURES_SHADOW_DEFAULT | SHADER_FEATURES_CONTACT_DEFAULT)
+
+#endif
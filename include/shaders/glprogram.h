@@ -23,8 +23,12 @@
 #define __INC_SHADERS_GLPROGRAM_H_
 
 #include <gl3/gl3.h>
+#include <string>
+#include <vector>
 #include <texture/texture.h>
 #include <gml/gml.h>
+#include <config.h>
+#include <shaders/features.h>
 
 namespace Shader
 {
@@ -58,6 +62,8 @@ typedef enum
 #define UNIF_AMBIENT "ambientRadiance"
 #define UNIF_SURFREF "surfaceReflectance"
 #define UNIF_TEXTURE0 "texture0"
+#define UNIF_TEXTURE_ARRAY "textureArray"
+#define UNIF_TEXTURE_LAYER "textureLayer"
 #define UNIF_SPECEXP "specularExponent"
 #define UNIF_SPECREF "specularReflectance"
 #define UNIF_MODELVIEW "modelView"
@@ -75,13 +81,28 @@ typedef enum
 #define UNIF_DS_NORMTEX "DSNormalTexture"
 #define UNIF_DS_TEXCOORDTEX "DSTexcoordTexture"
 #define UNIF_DS_SCREENSIZE "DSScreenSize"
-#define UNIF_DS_LIGHT_PROJMAT "DSLightProjectionMatrix"
+#define UNIF_DS_CASCADE_MATS "DSCascadeMatrices"
+#define UNIF_DS_CASCADE_SPLITS "DSCascadeSplits"
+#define UNIF_CUBE_FACE_MATS "cubeFaceMatrices"
+#define UNIF_SHADOW_RECT "shadowRect"
+#define UNIF_CUBE_FACE_MASK "cubeFaceMask"
+#define UNIF_SHADOW_FILTER "shadowFilter"
+#define UNIF_SHADOW_ESM "shadowESM"
+#define UNIF_SHADOW_PARABOLOID "shadowParaboloid"
+#define UNIF_CONTACT_SHADOW "contactShadow"
+#define UNIF_BLUR_SRC_RECT "blurSrcRect"
+#define UNIF_BLUR_DST_ORIGIN "blurDstOrigin"
+#define UNIF_BLUR_STEP "blurStep"
+#define UNIF_BLUR_LAYER "blurLayer"
+#define UNIF_BLUR_EXPONENT "blurExponent"
+#define UNIF_BLUR_DEPTH_RANGE "blurDepthRange"
 
 // enum that gives the offset into the GLProgram::m_uniformLocs[]
 // array to find the handle for a uniform.
 //
 // There should be one enum element for each uniform being
-// used by your GLSL shaders.
+// used by your GLSL shaders, with its name in the same place of
+// UniformNames[] in glprogram.cpp.
 typedef enum
 {
 	UNIFORM_LIGHTPOS=0, // Position of the light. vec3
@@ -106,7 +127,23 @@ typedef enum
 	UNIFORM_DS_NORMTEX,
 	UNIFORM_DS_TEXCOORDTEX,
 	UNIFORM_DS_SCREENSIZE,
-	UNIFORM_DS_LIGHT_PROJMAT,
+	UNIFORM_DS_CASCADE_MATS,   // View -> shadow texture coords, one per cascade. mat4[]
+	UNIFORM_DS_CASCADE_SPLITS, // Far view depth of each cascade. vec4
+	UNIFORM_CUBE_FACE_MATS,    // View -> light view (or shadow texture coords) of each cube map face. mat4[6]
+	UNIFORM_SHADOW_RECT,       // Point light tile in the shadow atlas. vec4
+	UNIFORM_CUBE_FACE_MASK,    // Bit i set => render cube map face i. int
+	UNIFORM_SHADOW_FILTER,     // Shadow filtering mode; see shadowfilter.h. int
+	UNIFORM_SHADOW_ESM,        // Prefiltered exponential shadow map
+	UNIFORM_SHADOW_PARABOLOID, // Point light shadow is dual-paraboloid (1) or a cube map (0). int
+	UNIFORM_CONTACT_SHADOW,    // Ray march the G-buffer for contact shadows (1) or not (0). int
+	UNIFORM_BLUR_SRC_RECT,     // Region of the source read by the blur; x, y, w, h. ivec4
+	UNIFORM_BLUR_DST_ORIGIN,   // Corner of the region written by the blur. ivec2
+	UNIFORM_BLUR_STEP,         // Blur direction; one texel along x or y. ivec2
+	UNIFORM_BLUR_LAYER,        // Source layer of an array texture; -1 for a 2D source. int
+	UNIFORM_BLUR_EXPONENT,     // k in exp(k * depth) applied to the source; 0 for none. float
+	UNIFORM_BLUR_DEPTH_RANGE,  // Near & far of a perspective source to linearize; 0 if linear. vec2
+	UNIFORM_TEXTURE_ARRAY,     // Texture arrays of packed textures (see texture/arraypool.h). sampler2DArray
+	UNIFORM_TEXTURE_LAYER,     // Layer of UNIFORM_TEXTURE_ARRAY; -1 to sample UNIFORM_TEXTURE0 instead. int
 	NUM_UNIFORM_VARS
 } UniformVars;
 
@@ -134,6 +171,7 @@ typedef struct _GLProgUniforms
 	gml::mat4x4_t m_modelView; // Modelview matrix
 	gml::mat4x4_t m_normalTrans; // Normal transform matrix. = transpose(inverse(modelview))
 	Texture::Texture *m_texture0; // Texture 0
+	GLint m_textureLayer; // Layer of the bound texture array; -1 for texture 0
 
 	// Deferred shading specific properties
 	GLfloat m_ds_AmbientIntensity;
@@ -147,7 +185,24 @@ typedef struct _GLProgUniforms
 	Texture::Texture *m_ds_NormalTexture;
 	Texture::Texture *m_ds_TexcoordTexture;
 	gml::vec2_t m_ds_ScreenSize;
-	gml::mat4x4_t m_ds_light_projection_mat;
+	gml::mat4x4_t m_ds_cascade_mats[SHADOW_NUM_CASCADES];
+	gml::vec4_t m_ds_cascade_splits;
+
+	// Point light shadows in the shadow atlas
+	gml::mat4x4_t m_cube_face_mats[6];
+	gml::vec4_t m_shadowRect; // (x, y, face size, 1 / face texels) in atlas coords
+	GLint m_cube_face_mask; // Faces to render, one bit per face
+	GLint m_shadowParaboloid; // Two paraboloid hemispheres instead of six cube faces
+	GLint m_contactShadow; // Screen-space contact shadows instead
+
+	// Shadow filtering
+	GLint m_shadowFilter;
+	GLint m_blur_src_rect[4];
+	GLint m_blur_dst_origin[2];
+	GLint m_blur_step[2];
+	GLint m_blur_layer;
+	GLfloat m_blur_exponent;
+	gml::vec2_t m_blur_depth_range;
 	
 } GLProgUniforms;
 
@@ -162,7 +217,35 @@ protected:
 	//  being used by the program.
 	GLint m_uniformLocs[NUM_UNIFORM_VARS];
 
-	bool compileShader(const char *code, const GLuint handle) const;
+	// Value last uploaded to each uniform; m_uniformSize[i] bytes from
+	// m_uniformOffset[i] of m_uniformValues, valid iff m_uniformSet[i]
+	mutable std::vector<unsigned char> m_uniformValues;
+	size_t m_uniformOffset[NUM_UNIFORM_VARS];
+	GLsizei m_uniformSize[NUM_UNIFORM_VARS];
+	mutable bool m_uniformSet[NUM_UNIFORM_VARS];
+
+	// Fill in the above from the program's active uniforms
+	void reflectUniforms();
+	// Record value as the last upload of var; false if it already was
+	bool isChanged(UniformVars var, const void *value, GLsizei size) const;
+
+	// Shader objects of a link that has been issued, until finish()
+	GLuint m_stages[3];
+	// true from compile() until finish()
+	bool m_isPending;
+	// Where finish() saves the linked binary; empty if it does not
+	std::string m_binaryPath;
+
+	bool link(const char *vertCode, const char *geomCode, const char *fragCode);
+	GLuint compileShader(const GLenum type, const char *code) const;
+	bool checkShader(const GLuint handle) const;
+	void deleteStages();
+
+	// Program binary cache
+	static std::string addFeatures(const char *code, unsigned int features);
+	static std::string binaryPath(const std::string &vert, const std::string &geom, const std::string &frag);
+	bool loadBinary(const std::string &path);
+	void saveBinary(const std::string &path) const;
 public:
 	GLProgram();
 	~GLProgram();
@@ -170,6 +253,30 @@ public:
 	// Try to compile & link a GLSL program from the given
 	// vertex shader & fragment shader source
 	bool init(const char *vertCode, const char *fragCode);
+	// As above, with an optional geometry shader (NULL for none) and
+	// the SHADER_FEATURE_* bits to #define in every stage
+	bool init(const char *vertCode, const char *geomCode, const char *fragCode, unsigned int features = 0);
+
+	// init() in two steps. compile() hands the program to the driver and
+	// returns without waiting for it; finish() waits for the link, then
+	// looks up the uniforms. isCompiling() is true while finish() would
+	// still have to wait (only known with KHR_parallel_shader_compile;
+	// without it, it is always false).
+	bool compile(const char *vertCode, const char *geomCode, const char *fragCode, unsigned int features = 0);
+	bool isCompiling() const;
+	bool finish();
+
+	// Let the driver compile on its own threads, if it can. Needs a
+	// current context; true iff it can.
+	static bool setParallelCompile();
+
+	// Keep linked program binaries in the given directory (NULL to stop)
+	// and load them instead of compiling when the driver and source match.
+	// Needs a current context; false if the driver has no binary format.
+	static bool setBinaryCache(const char *dir);
+	// Programs loaded from the cache & compiled from source so far
+	static unsigned int getNumLoaded();
+	static unsigned int getNumCompiled();
 
 	// Bind & unbind the shader to the OpenGL context
 	void bind() const;
@@ -179,6 +286,25 @@ public:
 	inline GLuint getID() const { return m_prog; }
 	// Retrieve the handle/ID of one of the program's uniforms
 	inline GLint getUniformID(UniformVars var) const { return m_uniformLocs[var]; }
+
+	// Upload a uniform of the bound program, unless the program does not
+	// use it or it already holds that value
+	void setUniform1i(UniformVars var, GLint v) const;
+	void setUniform1f(UniformVars var, GLfloat v) const;
+	void setUniform2fv(UniformVars var, const GLfloat *v) const;
+	void setUniform3fv(UniformVars var, const GLfloat *v) const;
+	void setUniform4fv(UniformVars var, const GLfloat *v) const;
+	void setUniform2iv(UniformVars var, const GLint *v) const;
+	void setUniform4iv(UniformVars var, const GLint *v) const;
+	void setUniformMatrix4fv(UniformVars var, GLsizei count, const GLfloat *v) const;
+
+	// Samplers are bound to their texture units when the program links;
+	// this moves one to another unit
+	void setSampler(UniformVars var, GLint unit);
+
+	// Uniform uploads issued & skipped (value unchanged) since the reset
+	static void getUniformStats(unsigned int &issued, unsigned int &skipped);
+	static void resetUniformStats();
 };
 
 }
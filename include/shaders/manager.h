@@ -27,6 +27,7 @@
 #ifndef __INC_SHADER_MANAGER_H_
 #define __INC_SHADER_MANAGER_H_
 
+#include <map>
 #include <shaders/shader.h>
 #include <shaders/material.h>
 
@@ -38,23 +39,49 @@ class Manager
 protected:
 	Shader **m_shaders;
 	int m_nShaders;
+
+	// Permutations other than the default one of shaders with optional
+	// features, built on first use. Keyed by shader offset and features.
+	mutable std::map<unsigned int, Shader*> m_permutations;
+	const Shader* getPermutation(int shader, unsigned int features) const;
+
+	// Shaders are created on first use, and polled on every use
+	static Shader* create(int shader);
+	const Shader* get(int shader) const;
 public:
 	Manager();
 	~Manager();
 
 	// Must be called before trying to use.
 	// Return true iff successfully initialized
+	// The shaders of the configured pipeline are handed to the driver
+	// here, but may still be compiling when this returns; until then
+	// they are not ready. Other shaders are built on first request.
 	bool init();
 
+	// Finish the shaders the driver is done with (all of them, with
+	// wait). True iff none is still compiling.
+	bool poll(const bool wait=false) const;
+
 	// Given material properties for an Object, return a GLSL
 	// shader that will perform the desired lighting calculations
 	const Shader* getShader(const Material::Material &mat) const;
 
 	// Get the depth-only shader; shader that only outputs fragment depths.
 	const Shader* getDepthShader() const;
+	// Depth-only shader for the orthographic directional light cascades.
+	const Shader* getCascadeDepthShader() const;
+	// Single-pass (layered) depth shader for point light cube maps.
+	const Shader* getCubeDepthShader() const;
+	// Depth shader for the hemispheres of dual-paraboloid point light shadows.
+	const Shader* getParaboloidDepthShader() const;
+	// Separable blur used to prefilter exponential shadow maps.
+	const Shader* getShadowBlurShader() const;
 	const Shader* getDeferredGeometryPassShader() const;
-	const Shader* getDeferredPointLightPassShader() const;
-	const Shader* getDeferredDirectionalLightPassShader() const;
+	// Light passes built with the given SHADER_FEATURE_* bits; features
+	// that config.h leaves out are ignored.
+	const Shader* getDeferredPointLightPassShader(unsigned int features = SHADER_FEATURES_DEFAULT) const;
+	const Shader* getDeferredDirectionalLightPassShader(unsigned int features = SHADER_FEATURES_DEFAULT) const;
 };
 
 }
@@ -40,6 +40,14 @@ protected:
 	bool m_isReady;
 	// True iff the program for shadow mapping is ready
 	bool m_isShadowReady;
+	// SHADER_FEATURE_* bits the program was built with
+	unsigned int m_features;
+	// true until the programs have been finished; see poll()
+	bool m_isPending;
+
+	// Look up the uniforms once the programs have linked, and set
+	// m_isReady & m_isShadowReady
+	virtual void initUniforms();
 
 public:
 	Shader();
@@ -47,6 +55,13 @@ public:
 
 	inline bool getIsReady(const bool useShadow=false) const { return useShadow?m_isShadowReady:m_isReady; }
 	inline GLuint getID(const bool useShadow=false) const { return useShadow?m_shadowProgram.getID():m_program.getID(); }
+	inline unsigned int getFeatures() const { return m_features; }
+
+	// Shaders hand their programs to the driver when they are created
+	// and are not ready until poll() finishes them. Without wait, poll()
+	// only does so once the driver is done compiling.
+	// Returns true iff the shader no longer waits on the driver.
+	bool poll(const bool wait=false);
 
 	// Bind/unbind the GLSL program for this shader
 	virtual void bindGL(const bool useShadow=false) const;
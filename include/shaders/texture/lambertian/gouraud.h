@@ -35,6 +35,7 @@ namespace Lambertian
 class Gouraud : public Shader
 {
 protected:
+	virtual void initUniforms();
 public:
 	Gouraud();
 	virtual ~Gouraud();
@@ -37,6 +37,7 @@ namespace Specular
 class Gouraud : public Shader
 {
 protected:
+	virtual void initUniforms();
 public:
 	Gouraud();
 	virtual ~Gouraud();
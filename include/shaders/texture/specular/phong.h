@@ -36,6 +36,7 @@ namespace Specular
 class Phong : public Shader
 {
 protected:
+	virtual void initUniforms();
 public:
 	Phong();
 	virtual ~Phong();
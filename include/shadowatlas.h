@@ -0,0 +1,160 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#pragma once
+#ifndef __INC_SHADOWATLAS_H_
+#define __INC_SHADOWATLAS_H_
+
+//==============================================================================
+
+#include <gl3/gl3.h>
+#include <gml/gml.h>
+#include <camera.h>
+#include <config.h>
+#include <shadowfilter.h>
+#include <vector>
+
+//==============================================================================
+
+class Light;
+
+namespace Shader
+{
+	class Manager;
+}
+
+namespace Object
+{
+	class Object;
+}
+
+// One depth texture shared by the shadows of every point light.
+//  Each frame the lights are ranked by how much of the screen their
+//  influence covers, and given a tile of six cube faces sized to match
+//  (two faces for lights with dual-paraboloid shadows).
+//  When the tiles do not fit, the tiles that are largest for their
+//  light's importance are shrunk first, and the least important lights
+//  are dropped (left unshadowed) as a last resort, so the memory spent
+//  on point light shadows never changes.
+//  The time spent is bounded too: only a budget of stale cube faces is
+//  re-rendered each frame. Lights are served in order of importance
+//  weighted by how far they moved since their faces were rendered, one
+//  face at a time and stalest face first, so the faces of a light are
+//  refreshed round-robin.
+class ShadowAtlas
+{
+public:
+	typedef std::vector<Object::Object*> ObjectVec;
+	typedef std::vector<Light*> LightVec;
+
+private:
+	struct Request
+	{
+		Light *light;
+		float importance;      // Projected screen coverage, 0 to 1
+		unsigned int faceSize; // Texels along one side of a cube face
+		unsigned short faces;  // Cube faces or paraboloid hemispheres
+		gml::vec4_t rect;      // Tile assigned by pack()
+		float staleness[6];    // See Light::getShadowFaceStaleness()
+		float priority;        // Update order; 0 when nothing is stale
+		unsigned int faceMask; // Faces to render this frame
+		unsigned int cleared;  // Faces that were never rendered into the tile
+	};
+	typedef std::vector<Request> RequestVec;
+
+	struct Shelf
+	{
+		unsigned int y;
+		unsigned int height;
+		unsigned int used;
+	};
+	typedef std::vector<Shelf> ShelfVec;
+
+	GLuint m_fbo;
+	GLuint m_texture;
+	unsigned int m_size;
+	bool m_isReady;
+	const Shader::Manager *m_manager;
+
+	// Exponential shadow map of the atlas, created on first use
+	int m_filterMode;
+	ShadowFilter m_filter;
+
+	// Scratch storage reused every frame. m_requests is kept sorted by
+	// decreasing importance; m_order is the packing order.
+	RequestVec m_requests;
+	std::vector<unsigned int> m_order;
+	ShelfVec m_shelves;
+
+	// Update budget, and the GPU time per face it is measured against
+	unsigned int m_faceBudget;
+	double m_timeBudgetMs;
+	double m_faceCostMs;
+	// Faces rendered, reused and left stale by the last create()
+	unsigned int m_facesUpdated;
+	unsigned int m_facesReused;
+	unsigned int m_facesDeferred;
+
+	// GPU time of create(), read back once it is available so it never stalls
+	GLuint m_timerQuery;
+	bool m_timerPending;
+	unsigned int m_timedFaces;
+	double m_lastTimeMs;
+
+	bool pack();
+	unsigned int schedule();
+
+public:
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	bool init(const unsigned int & size, const Shader::Manager *manager);
+
+	// Hand out tiles to the shadowed point lights in view of camera
+	void allocate(const LightVec & lights, const Camera & camera);
+	// Refresh the shadows of the lights that received a tile, within the
+	// update budget
+	void create(const ObjectVec & scene, const Camera & camera);
+
+	// At most faces cube faces per frame, and no more than ms of GPU time
+	// going by the measured cost of a face (0 = no time limit)
+	void setBudget(unsigned int faces, double ms) { m_faceBudget = faces; m_timeBudgetMs = ms; }
+	unsigned int getFaceBudget() const { return m_faceBudget; }
+	double getTimeBudget() const { return m_timeBudgetMs; }
+
+	// One of the SHADOW_FILTER_ modes. Returns false if the mode could
+	// not be set up. The lights' faces must be invalidated as well, so
+	// that the exponential map gets filled in.
+	bool setFilter(int mode);
+	int getFilter() const { return m_filterMode; }
+
+	void bindGL(GLenum textureUnit) const;
+	void unbindGL(GLenum textureUnit) const;
+	// Exponential shadow map, for SHADOW_FILTER_ESM
+	void bindFilterGL(GLenum textureUnit) const;
+	void unbindFilterGL(GLenum textureUnit) const;
+	bool isReady() const { return m_isReady; }
+	unsigned int getSize() const { return m_size; }
+	unsigned int getNumAllocated() const { return m_requests.size(); }
+	unsigned int getNumUpdated() const { return m_facesUpdated; }
+	unsigned int getNumReused() const { return m_facesReused; }
+	unsigned int getNumDeferred() const { return m_facesDeferred; }
+	// GPU time of the most recently completed create(), in milliseconds
+	double getLastTime() const { return m_lastTimeMs; }
+};
+
+//==============================================================================
+
+#endif // __INC_SHADOWATLAS_H_
+
+//==============================================================================
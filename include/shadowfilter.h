@@ -0,0 +1,109 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#pragma once
+#ifndef __INC_SHADOWFILTER_H_
+#define __INC_SHADOWFILTER_H_
+
+//==============================================================================
+
+#include <gl3/gl3.h>
+#include <config.h>
+
+//==============================================================================
+
+// Shadow filtering modes, chosen at run time. The light pass shaders
+// branch on the mode, so the _STR forms are spliced into their source.
+//  PCF     - one bilinear (2x2) hardware PCF fetch
+//  POISSON - SHADOW_PCF_TAPS bilinear PCF fetches on a Poisson disk that
+//            is rotated per pixel, trading banding for noise
+//  ESM     - exponential shadow map, blurred once whenever the shadow map
+//            is rendered; one filtered fetch per pixel
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_PCF_STR "0"
+#define SHADOW_FILTER_POISSON 1
+#define SHADOW_FILTER_POISSON_STR "1"
+#define SHADOW_FILTER_ESM 2
+#define SHADOW_FILTER_ESM_STR "2"
+#define NUM_SHADOW_FILTERS 3
+
+// GLSL shared by the light passes: the Poisson disk (any prefix of it is
+// well spread, so SHADOW_PCF_TAPS can be anything from 4 to 8) and its
+// per-pixel rotation, from interleaved gradient noise.
+#define SHADOW_FILTER_GLSL \
+		"const int PoissonTaps = " SHADOW_PCF_TAPS_STR ";\n" \
+		"const vec2 PoissonDisk[8] = vec2[8](\n" \
+		"	vec2(-0.613392, 0.617481), vec2(0.751946, 0.453352),\n" \
+		"	vec2(0.170019, -0.899787), vec2(-0.696890, -0.505950),\n" \
+		"	vec2(0.078707, 0.334565), vec2(-0.262486, -0.037315),\n" \
+		"	vec2(0.542984, -0.365214), vec2(-0.114430, 0.926474));\n" \
+		"mat2 poissonRotation() {\n" \
+		"	float a = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));\n" \
+		"	float s = sin(a), c = cos(a);\n" \
+		"	return mat2(c, s, -s, c);\n" \
+		"}\n"
+
+namespace Shader
+{
+	class Manager;
+}
+
+// Prefiltered exponential shadow map that mirrors a depth shadow map
+// (a 2D texture, or a 2D array with one layer per cascade). filter()
+// brings one region of it up to date with the depth map, so only the
+// parts that were re-rendered are blurred again.
+class ShadowFilter
+{
+private:
+	GLuint m_fbo;
+	GLuint m_vao;
+	// Reads the depth map as plain values, whatever its compare mode
+	GLuint m_sampler;
+	// Result of the horizontal pass, at the origin
+	GLuint m_temp;
+	GLuint m_esm;
+	GLenum m_target;
+	unsigned int m_tempSize;
+	// Near & far of a perspective depth map; zero when it is linear
+	float m_near;
+	float m_far;
+	const Shader::Manager *m_manager;
+	bool m_isReady;
+
+public:
+	ShadowFilter();
+	~ShadowFilter();
+
+	// target is GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY, like the depth map.
+	// Regions passed to filter() may be up to maxRegion texels on a side.
+	bool init(const Shader::Manager *manager, GLenum target, unsigned int size
+			, unsigned int layers, unsigned int maxRegion);
+
+	// Blur region (x, y, w, h) of the given layer of depthMap into the
+	// same region of the exponential shadow map. layer is ignored for 2D
+	// textures.
+	void filter(GLuint depthMap, int layer, GLint x, GLint y, GLsizei w, GLsizei h);
+	// The depth map holds perspective depth with these clip planes, and
+	// is linearized to view depth / far before filtering
+	void setPerspective(float n, float f) { m_near = n; m_far = f; }
+
+	void bindGL(GLenum textureUnit) const;
+	void unbindGL(GLenum textureUnit) const;
+	bool isReady() const { return m_isReady; }
+};
+
+//==============================================================================
+
+#endif // __INC_SHADOWFILTER_H_
+
+//==============================================================================
@@ -23,6 +23,8 @@
 #include <shaders/manager.h>
 #include <objects/object.h>
 #include <lights.h>
+#include <config.h>
+#include <shadowfilter.h>
 #include <vector>
 
 //==============================================================================
@@ -31,12 +33,31 @@
 #define SHADOWMAP_NEAR_STR "1.0f"
 #define SHADOWMAP_FAR 50.0f
 #define SHADOWMAP_FAR_STR "50.0f"
+// Blend between logarithmic (1) and uniform (0) cascade splits
+#define SHADOWMAP_CASCADE_LAMBDA 0.75f
+// Point lights: face mask selecting every cube face
+#define SHADOWMAP_ALL_FACES 0x3f
+// Point lights: hemispheres of a dual-paraboloid shadow
+#define SHADOWMAP_PARABOLOID_FACES 2
+// Shadow maps hold plain hardware depth, so the depth test can run
+// before the fragment shader. Acne is kept away with slope-scaled
+// polygon offset (factor, units) instead of a bias in the shader.
+#if defined (SHADOW_DEPTH_16BIT)
+#define SHADOWMAP_DEPTH_FORMAT GL_DEPTH_COMPONENT16
+#else
+#define SHADOWMAP_DEPTH_FORMAT GL_DEPTH_COMPONENT24
+#endif
+#define SHADOWMAP_CUBE_OFFSET_FACTOR 1.5f
+#define SHADOWMAP_CUBE_OFFSET_UNITS 4.0f
+#define SHADOWMAP_CASCADE_OFFSET_FACTOR 2.0f
+#define SHADOWMAP_CASCADE_OFFSET_UNITS 4.0f
 
 class ShadowMap
 {
 private:
 
 	typedef std::vector<Object::Object*> ObjectVec;
+	typedef std::vector<const Object::Object*> ConstObjectVec;
 	typedef std::vector<Object::Geometry*> GeometryVec;
 	typedef std::vector<Camera*> CameraVec;
 	
@@ -50,31 +71,146 @@ private:
 	float m_near;
 	float m_far;
 
-	void setupCamera(const gml::vec3_t & position = gml::vec3_t(0, 0, 0)
-		, const gml::vec3_t & target = gml::vec3_t(0, 0, -1)
-		, const gml::vec3_t & up = gml::vec3_t(0, 1, 0));
+	// Directional light cascades.
+	//  m_cascadeMats[i] maps main camera view space to the shadow texture
+	//  coordinates of cascade i; m_cascadeSplits[i] is the far view depth
+	//  covered by cascade i.
+	gml::mat4x4_t m_cascadeMats[SHADOW_NUM_CASCADES];
+	float m_cascadeSplits[SHADOW_NUM_CASCADES];
+	// Scratch storage reused every frame: light-space bounding spheres of
+	// the scene (xyz = centre, w = radius), with the centres moved to light
+	// space as one batch in m_casterCenters, and the casters that survived
+	// culling against the current cascade or the point light's range.
+	std::vector<gml::vec4_t> m_casterBounds;
+	gml::vec3array_t m_casterCenters;
+	ConstObjectVec m_casters;
+	// World matrices of m_casters, gathered once before they are drawn,
+	// and their modelView matrices for the face or cascade being drawn
+	std::vector<gml::affine_t> m_casterWorld;
+	std::vector<gml::affine_t> m_casterView;
+
+	// Point lights render their six cube faces into a tile of the shared
+	// ShadowAtlas. m_atlasRect is the tile in atlas texels (x, y, face
+	// size, atlas size); a face size of 0 means no tile this frame.
+	// m_cubeMats[i] maps main camera view space to the texture
+	// coordinates of face i.
+	// Dual-paraboloid shadows have two faces instead, the hemispheres
+	// looking down -z and +z, side by side in the tile. Their matrices
+	// map main camera view space to the space of the hemisphere, which
+	// looks down its -z; the projection is done in the shaders.
+	gml::vec4_t m_atlasRect;
+	gml::mat4x4_t m_cubeMats[6];
+	gml::mat4x4_t m_viewToWorld;
+
+	// Point lights: render all six cube faces in one layered pass instead
+	// of one pass per face.
+	bool m_layered;
+	// Point lights: reach of the light; casters beyond it are ignored.
+	float m_range;
+	// Point lights: dual-paraboloid instead of cube shadows
+	bool m_paraboloid;
+
+	// Caching. A cube face, or a cascade, is only re-rendered when the
+	// light, its atlas tile, its projection or its set of casters (see
+	// signature()) differ from when it was last rendered. Cube faces are
+	// tracked one by one, as ShadowAtlas may refresh only some of them in
+	// a frame; m_facePosition[i] is where the light was when face i was
+	// rendered, and m_cubeMats[i] keeps looking up from there.
+	bool m_faceValid[6];
+	gml::vec3_t m_facePosition[6];
+	gml::vec4_t m_cachedRect;
+	unsigned int m_cachedCasters;
+	bool m_cascadeValid[SHADOW_NUM_CASCADES];
+	gml::mat4x4_t m_cascadeLightProj[SHADOW_NUM_CASCADES];
+	unsigned int m_cascadeCasters[SHADOW_NUM_CASCADES];
+	// Cube faces or cascades rendered and reused by the last create()
+	unsigned int m_updated;
+	unsigned int m_reused;
+
+	// Directional lights: exponential shadow map of the cascades, created
+	// on first use
+	int m_filterMode;
+	ShadowFilter m_filter;
+
+	// Directional lights: GPU time spent in the last create(), from a
+	// GL_TIME_ELAPSED query that is read back once its result is available,
+	// so it never stalls. ShadowAtlas times the point lights as a whole.
+	GLuint m_timerQuery;
+	bool m_timerPending;
+	double m_lastTimeMs;
+
+	void setupCamera(const gml::vec3_t & position = gml::vec3_t(0, 0, 0));
+
+	void updateCubeMatrix(unsigned short face, const gml::vec3_t & position);
+	void createCube(const gml::vec3_t & position, unsigned int faceMask);
+	void createCubeSixPass(const gml::vec4_t & tile, unsigned int faceMask);
+	void createCubeLayered(const gml::vec4_t & tile, unsigned int faceMask);
+	void createParaboloid(const gml::vec3_t & position, unsigned int faceMask);
+	static gml::mat4x4_t paraboloidView(unsigned short face, const gml::vec3_t & position);
+	static unsigned int signature(const ConstObjectVec & casters);
+	void gatherCasters();
+	void transformCasters(const gml::mat4x4_t & view);
+	void createCascades(const ObjectVec & scene, const Camera &mainCamera, const gml::vec3_t & direction);
 
 public:
-	ShadowMap(LightType lt, const gml::vec3_t & position = gml::vec3_t(0, 0, 0)
-		, const gml::vec3_t & target = gml::vec3_t(0, 0, -1)
-		, const gml::vec3_t & up = gml::vec3_t(0, 1, 0));
+	ShadowMap(LightType lt, const gml::vec3_t & position = gml::vec3_t(0, 0, 0));
 	~ShadowMap();
 
 	bool init(const unsigned int & smapSize, const Shader::Manager *manager);
 
-	void create(const ObjectVec & scene, const gml::mat4x4_t &worldview
+	// Point lights: find the casters in range and update the lookup
+	// matrices for this frame. Faces whose tile or casters changed are
+	// cleared and marked for re-rendering. Must precede create(), with the
+	// ShadowAtlas framebuffer bound.
+	void prepare(const ObjectVec & scene, const Camera &mainCamera, const gml::vec3_t & position);
+	// Render the shadow map. Point lights only re-render the stale faces
+	// (or hemispheres) among those in faceMask.
+	void create(const ObjectVec & scene, const Camera &mainCamera
 				, const gml::vec3_t & position = gml::vec3_t(0, 0, 0)
 				, const gml::vec3_t & target = gml::vec3_t(0, 0, -1)
-				, const gml::vec3_t & up = gml::vec3_t(0, 1, 0));
+				, unsigned int faceMask = SHADOWMAP_ALL_FACES);
 
 	void bindGL(GLenum textureUnit) const;
 	void unbindGL(GLenum textureUnit) const;
+	// Directional lights: exponential shadow map, for SHADOW_FILTER_ESM
+	void bindFilterGL(GLenum textureUnit) const;
+	void unbindFilterGL(GLenum textureUnit) const;
 	bool isReady() const { return m_isReady; }
 	void setNear(const float & n) { m_near = n; }
 	void setFar(const float & f) { m_far = f; }
 	void setType(LightType lt) { m_type = lt; setupCamera(); }
 	LightType getType() { return m_type; }
-	gml::mat4x4_t getCamProjectionMatrix () { if (m_cameras.size() > 0) return m_cameras[0]->getProjection(); return gml::identity4(); }
+	void setLayered(bool layered) { m_layered = layered; invalidate(); }
+	void setRange(const float & r) { m_range = r; }
+	// Force the next create() to re-render everything
+	void invalidate();
+	unsigned int getNumUpdated() const { return m_updated; }
+	unsigned int getNumReused() const { return m_reused; }
+	// Point lights: how far the light has moved since face was last
+	// rendered; 0 when the face is up to date and SHADOWMAP_FAR when it
+	// has never been rendered into its current tile.
+	float getFaceStaleness(unsigned short face, const gml::vec3_t & position) const;
+	bool isLayered() const { return m_layered; }
+	// Point lights: two paraboloid hemispheres instead of six cube faces.
+	// Cheaper to render and to store, but less accurate.
+	void setParaboloid(bool paraboloid);
+	bool isParaboloid() const { return m_paraboloid; }
+	// Point lights: faces in the atlas tile, laid out 3 to a row
+	unsigned short getNumFaces() const { return m_paraboloid ? SHADOWMAP_PARABOLOID_FACES : 6; }
+	// One of the SHADOW_FILTER_ modes; see shadowfilter.h. Returns false
+	// if the mode could not be set up.
+	bool setFilter(int mode);
+	// GPU time of the most recently completed create(), in milliseconds
+	double getLastTime() const { return m_lastTimeMs; }
+	// Point lights: atlas tile, in texels, assigned by ShadowAtlas. Losing
+	// the tile, or moving to another, drops the cached faces.
+	void setAtlasRect(const gml::vec4_t & rect);
+	bool hasAtlasRect() const { return m_atlasRect.z > 0.0f; }
+	// Tile in normalized atlas coordinates (x, y, face size, 1 / face texels)
+	gml::vec4_t getAtlasRect() const;
+	const gml::mat4x4_t* getCubeMatrices() const { return m_cubeMats; }
+	const gml::mat4x4_t* getCascadeMatrices() const { return m_cascadeMats; }
+	gml::vec4_t getCascadeSplits() const;
 };
 
 //==============================================================================
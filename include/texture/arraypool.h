@@ -0,0 +1,158 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Texture arrays for material batching.
+ *
+ * Textures added to the pool that have the same size, format, mip levels
+ * and sampling parameters are packed into the layers of one
+ * GL_TEXTURE_2D_ARRAY. Objects whose textures share an array are then
+ * drawn with that one array bound, and pick their layer with a uniform,
+ * instead of binding their textures one by one.
+ *
+ * Textures stay with their Manager; the layers are copies of their levels,
+ * made on the GPU through a pixel buffer object. A texture that is alone
+ * in its group, or not ready yet, is not packed, and is bound as usual.
+ * When a texture becomes ready or is reloaded with other levels (see
+ * Manager), update() moves it to the group it now belongs to. Only the
+ * arrays of the groups that changed are touched; the others keep their
+ * layers. Arrays are made with free layers to grow into, so that textures
+ * that become ready one at a time are not all copied again each time.
+ *
+ * The copies take as much GL memory as the textures, and up to as much
+ * again in free layers. With a Manager set (see setManager()), only the
+ * groups that fit in what its textures leave of its budget are packed,
+ * so the textures never lose levels to them.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_ARRAYPOOL_H_
+#define __INC_TEXTURE_ARRAYPOOL_H_
+
+#include <vector>
+#include <texture/texture.h>
+
+namespace Texture
+{
+
+class Manager;
+
+class ArrayPool
+{
+public:
+	// Where a packed texture is
+	struct Layer
+	{
+		GLuint m_array; // GL_TEXTURE_2D_ARRAY
+		GLint m_layer;
+	};
+
+protected:
+	// What textures must share to be packed together
+	struct Key
+	{
+		bool m_isReady;
+		GLenum m_format;
+		uint16_t m_width, m_height; // Of GL level 0
+		uint8_t m_numLevels;
+		FilterType m_minFilter;
+		FilterType m_magFilter;
+		WrapMode m_wrap;
+		float m_anisotropy;
+
+		bool operator<(const Key &other) const;
+		bool operator!=(const Key &other) const;
+	};
+
+	struct Member
+	{
+		const Texture *m_texture;
+		// As it was at the last update()
+		Key m_key;
+		// m_array is 0 if it is not packed
+		Layer m_layer;
+	};
+
+	struct Array
+	{
+		GLuint m_handle;
+		Key m_key;
+		// Texture in each layer; NULL if the layer is free
+		std::vector<const Texture*> m_layers;
+		size_t m_layerBytes;
+	};
+
+	std::vector<Member> m_members;
+	std::vector<Array> m_arrays;
+	// Staging buffer of the copies
+	GLuint m_buffer;
+	size_t m_bufferBytes;
+	size_t m_bytes;
+	// Whose budget the arrays fit in; may be NULL
+	const Manager *mp_manager;
+	// Of the smallest group left unpacked for lack of room; 0 if none
+	size_t m_unpackedBytes;
+	// Textures were added or removed since the arrays were packed
+	bool m_isDirty;
+	// Bumped whenever a texture is packed or unpacked
+	unsigned int m_revision;
+
+	static Key key(const Texture *texture);
+	void destroy();
+	// GL memory the arrays may take
+	size_t room() const;
+	// Free the layer of member, if it has one
+	void unpack(Member &member);
+	// Delete m_arrays[array] and unpack its textures
+	void release(size_t array);
+	// Pack the ready textures that are not yet, into the arrays of their
+	// group or new ones, as long as the arrays fit in room bytes
+	bool pack(size_t room);
+	// Make m_arrays[array] count layers, copying its textures again
+	bool grow(size_t array, size_t count);
+	// Make an array of count layers for textures like key, and bind it
+	GLuint createArray(const Key &key, GLsizei count);
+	// Copy the levels of texture into layer of the bound array
+	bool copyLayer(const Texture *texture, const Key &key, GLint layer);
+public:
+	ArrayPool();
+	~ArrayPool();
+
+	// Pack texture with the others, once it is ready. Textures must stay
+	// until they are removed or the pool is deleted.
+	void add(const Texture *texture);
+	void remove(const Texture *texture);
+
+	// Keep the arrays within what the textures of manager leave of its
+	// budget; NULL for no limit
+	void setManager(const Manager *manager) { mp_manager = manager; }
+
+	// Call once a frame, after Manager::update(); repacks the textures
+	// that have changed since they were packed, and gives up or adds
+	// arrays as the room for them changes.
+	void update();
+
+	// Where texture is packed; NULL if it is not.
+	const Layer* find(const Texture *texture) const;
+
+	// textureUnit is one of GL_TEXTURE#, as for Texture::bindGL()
+	void bindGL(const Layer &layer, GLenum textureUnit) const;
+	void unbindGL(GLenum textureUnit) const;
+
+	unsigned int getRevision() const { return m_revision; }
+	unsigned int getNumArrays() const { return m_arrays.size(); }
+	// GL memory of the arrays
+	size_t getBytes() const { return m_bytes; }
+};
+
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * On-disk cache of block compressed textures.
+ *
+ * Compressing a texture and its mip chain is slow, so the result is kept
+ * in a directory, one file per texture. A file is keyed by the image's
+ * path, size and modification time, and by the block format asked for,
+ * so editing the image or changing what the GL supports makes a new one.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_CACHE_H_
+#define __INC_TEXTURE_CACHE_H_
+
+#include <texture/compress.h>
+
+namespace Texture
+{
+
+// Keep compressed textures in dir, creating it if need be. NULL turns
+// the cache off. Returns false if the directory cannot be made.
+bool setCompressedCache(const char *dir);
+
+// The cached compression of filename in the given RGB format (BC1 or BC7;
+// single channel images are BC4 regardless). Returns false on a miss.
+bool loadCompressed(const char *filename, BlockFormat rgbFormat, CompressedImage &image);
+
+// Add image, compressed from filename, to the cache
+void saveCompressed(const char *filename, BlockFormat rgbFormat, const CompressedImage &image);
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Block compression of decoded images.
+ *
+ * Each 4x4 block of texels is stored as two endpoint colours and a
+ * small index per texel into the colours interpolated between them.
+ * The endpoints are the extremes of the block's texels along their
+ * principal axis, and each texel takes the nearest interpolated colour.
+ *
+ * Formats, by the image they are used for:
+ *   BC1 (S3TC DXT1)  RGB; 8 bytes per block, 1/6 of GL_RGB8
+ *   BC7 (BPTC)       RGB; 16 bytes per block, better quality. Only
+ *                    mode 6 (one colour line, 4 bit indices) is encoded.
+ *   BC4 (RGTC1)      single channel; 8 bytes per block
+ * The decoders strip alpha, so there is no BC3.
+ *
+ * BC1 and BC7 have sRGB variants, for images that are kept sRGB encoded
+ * (see Image::Decoder::decodeSRGB()). They are encoded the same way; the
+ * GL decodes the texels to linear when it samples them.
+ *
+ * Images are in the Image::Decoder layout; 16-bit images are reduced to
+ * 8 bits. Texels beyond the edges of images that are not a multiple of 4
+ * in size repeat the edge.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_COMPRESS_H_
+#define __INC_TEXTURE_COMPRESS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <gl3/gl3.h>
+
+// EXT_texture_compression_s3tc and EXT_texture_sRGB; not in the gl3w
+// headers
+#if !defined (GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#if !defined (GL_COMPRESSED_SRGB_S3TC_DXT1_EXT)
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+
+namespace Texture
+{
+
+typedef enum
+{
+	BLOCK_NONE = 0,
+	BLOCK_BC1 = GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+	BLOCK_BC4 = GL_COMPRESSED_RED_RGTC1,
+	BLOCK_BC7 = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB,
+	BLOCK_BC1_SRGB = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,
+	BLOCK_BC7_SRGB = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB
+} BlockFormat;
+
+// Whether format is an sRGB variant
+bool isSRGB(BlockFormat format);
+// The variant of format with sRGB (or linear) texels; BLOCK_NONE if there
+// is none, e.g. for BC4
+BlockFormat sRGBFormat(BlockFormat format);
+BlockFormat linearFormat(BlockFormat format);
+
+// The mip levels of a block compressed texture, largest first
+struct CompressedImage
+{
+	BlockFormat m_format;
+	uint16_t m_width, m_height; // Of level 0
+	uint8_t m_nChannels;        // Of the image it was made from
+	std::vector< std::vector<uint8_t> > m_levels;
+};
+
+// Bytes per 4x4 block
+unsigned int blockBytes(BlockFormat format);
+
+// Bytes of a width x height image
+size_t compressedSize(BlockFormat format, uint16_t width, uint16_t height);
+
+// Encode image into blocks, which must have room for
+// compressedSize(format, width, height) bytes. Larger images are split
+// across threads, by rows of blocks.
+// Returns false for an unknown format or bit depth.
+bool compress(BlockFormat format, const void *image,
+		uint16_t width, uint16_t height,
+		uint8_t nChannels, uint8_t bitDepth, uint16_t rowBytes,
+		uint8_t *blocks);
+
+}
+
+#endif
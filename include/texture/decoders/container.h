@@ -0,0 +1,106 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * GPU-ready texture containers (.tex), in the spirit of KTX2.
+ *
+ * A container holds a texture as it is uploaded: its levels, largest
+ * first, in their final format, uncompressed or block compressed (see
+ * compress.h). Uncompressed rows are 4-byte aligned, as Decoder::decode()
+ * outputs them. Nothing is left to do at load time; the texture code
+ * maps the file and hands the level pointers straight to the GL.
+ * Stored levels are used as they are, whatever the texture's MipmapMode
+ * (MIPMAP_NONE only takes the top one); missing uncompressed levels are
+ * made from level 0.
+ *
+ * Layout, in host byte order (the endian field tells):
+ *   uint8_t  magic[12]
+ *   uint32_t endian       0x04030201
+ *   uint32_t version
+ *   uint32_t format       BlockFormat; BLOCK_NONE if uncompressed
+ *   uint16_t width, height
+ *   uint8_t  nChannels, bitDepth, numLevels, flags
+ *   uint64_t offset, bytes of each level
+ * and then the levels, each 16-byte aligned. Bit 0 of flags is set when
+ * the texels are sRGB encoded.
+ *
+ * tools/texconv.cpp makes them from PNG files.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_DECODER_CONTAINER_H_
+#define __INC_TEXTURE_DECODER_CONTAINER_H_
+
+#include <cstddef>
+#include <vector>
+#include <texture/decoders/decoder.h>
+#include <texture/compress.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+// A container mapped into memory; the levels point into the mapping
+struct Container
+{
+	uint16_t m_width, m_height; // Of level 0
+	uint8_t m_nChannels;
+	uint8_t m_bitDepth;
+	BlockFormat m_format;
+	bool m_sRGB;                // Texels are sRGB encoded
+	std::vector<const uint8_t*> m_levels;
+	std::vector<size_t> m_levelBytes;
+
+	void *m_map;
+	size_t m_mapBytes;
+
+	Container() : m_sRGB(false), m_map(0), m_mapBytes(0) {}
+};
+
+class ContainerDecoder : public Decoder {
+public:
+	ContainerDecoder();
+	virtual ~ContainerDecoder();
+
+	virtual bool checkSig(FILE *ifile) const;
+	// Copies out level 0; fails for block compressed containers, and
+	// decode() for sRGB encoded ones. map() is the way to load a texture.
+	virtual void *decode(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes) const;
+	virtual void *decodeSRGB(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes, bool &sRGB) const;
+
+	// Map filename, if it is a container. Returns false, quietly, if it
+	// is not; with a message if it is broken.
+	static bool map(const char *filename, Container &container);
+	static void unmap(Container &container);
+
+	// Bytes per row of uncompressed level of the given width
+	static size_t rowBytes(uint16_t width, uint8_t nChannels, uint8_t bitDepth);
+
+	// Write a container of the given levels, largest first, sRGB encoded
+	// if sRGB. Returns false if the file cannot be written.
+	static bool write(const char *filename,
+			uint16_t width, uint16_t height,
+			uint8_t nChannels, uint8_t bitDepth, BlockFormat format, bool sRGB,
+			const std::vector<const void*> &levels,
+			const std::vector<size_t> &levelBytes);
+};
+
+}
+}
+
+#endif
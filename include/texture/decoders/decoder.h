@@ -16,6 +16,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace Texture
 {
@@ -25,7 +26,8 @@ namespace Image
 
 // Base class for reading an image from a file.
 // Notes:
-//	 1) Image decoders _always_ output linearized intensity values.
+//	 1) Image decoders output linearized intensity values, unless asked
+//	    to keep them sRGB encoded (decodeSRGB()).
 //	 2) RGB images are output in RGB order.
 //	 3) All output images are output as 8 bits per channel.
 class Decoder {
@@ -62,8 +64,36 @@ public:
 			uint16_t &width, uint16_t &height,
 			uint8_t &nChannels, uint8_t &bitdepth,
 			uint16_t &rowbytes) const = 0;
+
+	// As decode(), but RGB images that are sRGB encoded are left that way,
+	// for the GL to decode when it samples them (GL_SRGB8); sRGB says
+	// whether they were. Single channel images are always linearized,
+	// since the GL has no single channel sRGB format.
+	// The default decodes to linear.
+	virtual void *decodeSRGB(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes, bool &sRGB) const;
+
+protected:
+	// Read ifile from the current position to the end
+	static bool readFile(FILE *ifile, std::vector<uint8_t> &data);
+	// Linearize the 8-bit image, encoded with gamma fileGamma (0.45455
+	// for sRGB), as png_set_gamma() does
+	static void linearize(uint8_t *image, size_t bytes, double fileGamma);
 };
 
+// The decoders textures are loaded with, picked by signature. By default
+// QOIDecoder and PNGDecoder (libpng); registering a LodePNGDecoder makes
+// it take PNGs instead. Register decoders before textures are loaded: the
+// Streamer's threads look them up without locking.
+
+// Add decoder, to be tried before the others; it is not deleted
+void registerDecoder(const Decoder *decoder);
+// The decoder that recognizes the signature at ifile's position; 0 if
+// none does
+const Decoder* findDecoder(FILE *ifile);
+
 }
 
 }
@@ -0,0 +1,48 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Decoder of PNG images with the bundled LodePNG (external/lodepng.h),
+ * for builds without libpng. Output is always 8 bits per channel; the
+ * sRGB and gAMA chunks are honoured as PNGDecoder does.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_DECODER_LODEPNG_H_
+#define __INC_TEXTURE_DECODER_LODEPNG_H_
+
+#include <texture/decoders/decoder.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+class LodePNGDecoder : public Decoder {
+public:
+	LodePNGDecoder();
+	virtual ~LodePNGDecoder();
+
+	virtual bool checkSig(FILE *ifile) const;
+	virtual void *decode(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes) const;
+	virtual void *decodeSRGB(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes, bool &sRGB) const;
+};
+
+}
+}
+
+#endif
@@ -30,6 +30,11 @@ public:
 			uint16_t &width, uint16_t &height,
 			uint8_t &nChannels, uint8_t &bitdepth,
 			uint16_t &rowbytes) const;
+	// Keeps images with an sRGB chunk, or a gAMA of 1/2.2, sRGB encoded
+	virtual void *decodeSRGB(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes, bool &sRGB) const;
 };
 
 }
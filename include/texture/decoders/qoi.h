@@ -0,0 +1,55 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Decoder of QOI images (https://qoiformat.org).
+ *
+ * QOI is lossless like PNG, but each pixel is one of a handful of byte
+ * codes (a run, an index into the last 64 colours, a small difference
+ * from the previous pixel, or the pixel itself), with no entropy coding.
+ * Decoding is a single pass over the file, several times faster than
+ * inflating a PNG of the same image.
+ *
+ * Images in the sRGB colour space are linearized as the Decoder notes
+ * require, except by decodeSRGB().
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_DECODER_QOI_H_
+#define __INC_TEXTURE_DECODER_QOI_H_
+
+#include <texture/decoders/decoder.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+class QOIDecoder : public Decoder {
+public:
+	QOIDecoder();
+	virtual ~QOIDecoder();
+
+	virtual bool checkSig(FILE *ifile) const;
+	virtual void *decode(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes) const;
+	virtual void *decodeSRGB(FILE *ifile,
+			uint16_t &width, uint16_t &height,
+			uint8_t &nChannels, uint8_t &bitdepth,
+			uint16_t &rowbytes, bool &sRGB) const;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Definition of a Manager for textures.
+ *
+ * Textures are requested by filename and sampling parameters. The first
+ * request loads the texture; later requests with the same filename and
+ * parameters share it. Each request holds a reference that must be
+ * released, and the texture is deleted with its last reference.
+ *
+ * The Manager also keeps the textures' GL memory within a budget. When
+ * they go over it, the texture that was bound the longest ago gives up
+ * its top mip level (a quarter of its memory), and so on until they fit.
+ * The levels below are copied on the GPU, so the file is not read again;
+ * textures with a single level are not evicted. Once a texture that lost
+ * levels is bound again it gets them back, if they fit: it is loaded
+ * again by the Streamer, and keeps its current levels until then.
+ *
+ * Textures requested with m_stream set are loaded in the background by
+ * a Streamer; acquire() returns them right away, and they bind as a
+ * placeholder until they are ready.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_MANAGER_H_
+#define __INC_TEXTURE_MANAGER_H_
+
+#include <map>
+#include <string>
+#include <texture/texture.h>
+#include <texture/streamer.h>
+
+namespace Texture
+{
+
+class Manager
+{
+public:
+	// Parameters a texture is loaded with; see the Texture constructor.
+	struct Params
+	{
+		FilterType m_minFilter;
+		FilterType m_magFilter;
+		WrapMode m_wrap;
+		MipmapMode m_mipmaps;
+		float m_anisotropy;
+		bool m_compress;
+		bool m_sRGB;
+		bool m_stream;
+
+		Params();
+	};
+
+protected:
+	typedef struct
+	{
+		Texture *m_texture;
+		unsigned int m_refs;
+		Params m_params;
+		// m_texture with levels it lost, streamed in to take its place;
+		// NULL if none. m_reloadBytes is its size, as estimated.
+		Texture *m_reload;
+		size_t m_reloadBytes;
+	} Entry;
+
+	// Keyed by filename and Params
+	typedef std::map<std::string, Entry> EntryMap;
+	EntryMap m_entries;
+
+	Streamer m_streamer;
+
+	// In bytes; 0 for no budget
+	size_t m_budget;
+	size_t m_bytes;
+
+	static std::string key(const char *filename, const Params &params);
+	EntryMap::iterator find(const Texture *texture);
+	// Drop one level of the least recently used texture that has one to
+	// give. False if none does.
+	bool evict();
+	// Give a texture back the levels it lost, if they fit, by reloading it
+	// in the background
+	void restore(Entry &entry);
+public:
+	Manager();
+	// Deletes the textures, whether released or not
+	~Manager();
+
+	// The texture of filename with params, loaded if need be. Returns
+	// NULL if it cannot be loaded.
+	const Texture* acquire(const char *filename, const Params &params = Params());
+	// Give back a texture from acquire()
+	void release(const Texture *texture);
+
+	// Limit the GL memory of the textures to bytes; 0 for no limit
+	void setBudget(size_t bytes);
+	size_t getBudget() const { return m_budget; }
+	// GL memory of the textures now
+	size_t getBytes() const { return m_bytes; }
+	unsigned int getNumTextures() const { return m_entries.size(); }
+	// Textures still loading in the background
+	unsigned int getNumPending() const { return m_streamer.getNumPending(); }
+
+	// Call once a frame: uploads streamed textures, starts the next frame
+	// for the least recently used ordering, and enforces the budget.
+	void update();
+};
+
+}
+
+#endif
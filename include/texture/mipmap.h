@@ -0,0 +1,47 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * CPU mip chain generation.
+ *
+ * Images are in the layout the Image::Decoders produce: 1 or 3 channels
+ * of 8 or 16 bits, rows padded to a multiple of 4 bytes. The decoders
+ * output linear intensities, so averaging them is correct.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_MIPMAP_H_
+#define __INC_TEXTURE_MIPMAP_H_
+
+#include <cstdint>
+
+namespace Texture
+{
+
+// Number of levels in the full mip chain of a width x height image
+uint8_t numMipLevels(uint16_t width, uint16_t height);
+
+// Box filter image down to the next mip level, half the size rounded
+// down (but at least 1). Each output texel is the average of a 2x2 block
+// of input texels; an odd last row or column is dropped.
+// sRGB encoded texels are averaged in linear, and the result re-encoded.
+// Return:
+//	 outWidth, outHeight, outRowBytes -- as for Image::Decoder::decode
+//	 return val -- malloc'd image data, 0 on failure.
+void *downsample(const void *image,
+		uint16_t width, uint16_t height,
+		uint8_t nChannels, uint8_t bitDepth, uint16_t rowBytes,
+		uint16_t &outWidth, uint16_t &outHeight, uint16_t &outRowBytes,
+		bool sRGB=false);
+
+}
+
+#endif
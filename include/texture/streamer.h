@@ -0,0 +1,97 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Background loading of textures.
+ *
+ * Queued textures are decoded by a pool of worker threads: the file is
+ * read (or its compressed chain taken from the cache, see cache.h), and
+ * the mip levels are built and compressed as the Texture constructor
+ * would. Containers (decoders/container.h) are just mapped. Nothing here
+ * touches the GL.
+ *
+ * update(), on the GL thread, then uploads the decoded levels through a
+ * ring of pixel buffer object segments, one segment per frame. At most
+ * TEXTURE_STREAM_KB are copied in a frame, so a large texture is spread
+ * over several frames, a band of rows at a time. Each segment is fenced,
+ * and only rewritten once the GL is done reading it.
+ *
+ * A texture shows a 1x1 placeholder until its last level is uploaded.
+ */
+
+#pragma once
+#ifndef __INC_TEXTURE_STREAMER_H_
+#define __INC_TEXTURE_STREAMER_H_
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <texture/texture.h>
+
+namespace Texture
+{
+
+class Streamer
+{
+protected:
+	struct Job;
+
+	std::vector<std::thread> m_workers;
+	// Guards m_queue, m_decoded and m_stop
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<Job*> m_queue;   // Waiting for a worker
+	std::deque<Job*> m_decoded; // Waiting for update()
+	bool m_stop;
+
+	// GL thread only
+	std::vector<Job*> m_jobs;   // Every job not yet dropped
+	std::deque<Job*> m_uploads;
+	unsigned int m_numPending;
+
+	// Upload ring; one segment per frame
+	GLuint m_buffer;
+	GLsync *m_fences;
+	unsigned int m_segment;
+
+	void work();
+	static void decode(Job &job);
+	void drop(Job *job);
+public:
+	Streamer();
+	// Unfinished textures are left as placeholders
+	~Streamer();
+
+	// Load texture, constructed with stream set, in the background.
+	// rgbFormat is the block format to compress linear RGB images to (see
+	// Texture::blockFormatFor()), BLOCK_NONE for none; sRGB encoded ones
+	// get its sRGB counterpart, if the GL has one. The top skipLevels
+	// levels are left out, as by Texture::setSkipLevels().
+	void queue(Texture *texture, BlockFormat rgbFormat, uint8_t skipLevels = 0);
+	// Forget texture; call before deleting it
+	void cancel(const Texture *texture);
+	// Whether texture is queued and not finished yet; false once it is
+	// ready, or could not be loaded
+	bool isPending(const Texture *texture) const;
+
+	// Upload decoded textures, within this frame's budget. Call once a
+	// frame, from the GL thread.
+	void update();
+
+	// Textures queued and not yet ready
+	unsigned int getNumPending() const { return m_numPending; }
+};
+
+}
+
+#endif
@@ -16,17 +16,32 @@
 
 #include <gl3/gl3.h>
 #include <gml/gml.h>
+#include <config.h>
+#include <texture/compress.h>
+#include <texture/decoders/container.h>
 
 namespace Texture
 {
 
-// Filter types
+// Filter types. Only NEAREST and LINEAR apply to magnification.
 typedef enum
 {
 	NEAREST=GL_NEAREST,  // Nearest neighbour
-			LINEAR=GL_LINEAR      // Linear (bi-linear) filtering
+			LINEAR=GL_LINEAR,      // Linear (bi-linear) filtering
+			NEAREST_MIPMAP_NEAREST=GL_NEAREST_MIPMAP_NEAREST,
+			LINEAR_MIPMAP_NEAREST=GL_LINEAR_MIPMAP_NEAREST, // Bi-linear in the nearest mip level
+			NEAREST_MIPMAP_LINEAR=GL_NEAREST_MIPMAP_LINEAR,
+			LINEAR_MIPMAP_LINEAR=GL_LINEAR_MIPMAP_LINEAR    // Tri-linear filtering
 } FilterType;
 
+// Where the mip levels below level 0 come from
+typedef enum
+{
+	MIPMAP_NONE,  // Level 0 only
+	MIPMAP_GPU,   // glGenerateMipmap
+	MIPMAP_CPU    // Box filtered on load (see mipmap.h)
+} MipmapMode;
+
 // Ways to wrap out-of-range texture coordinates
 typedef enum
 {
@@ -48,32 +63,161 @@ protected:
 
 	WrapMode m_wrapMode;
 
+	MipmapMode m_mipmaps;
+	uint8_t m_numLevels;
+
+	// Block compress on load, when the GL can
+	bool m_compress;
+
+	// Keep sRGB encoded images that way, in an sRGB format the GL
+	// decodes when sampling (m_useSRGB); m_isSRGB if the texture is
+	bool m_useSRGB;
+	bool m_isSRGB;
+
+	// Top levels of the mip chain left out to save memory (see Manager);
+	// level 0 of the GL texture is level m_skipLevels of the image.
+	uint8_t m_skipLevels;
+	// Levels of a block compressed file that has fewer than the full
+	// chain, so fewer can be skipped; 0 otherwise
+	uint8_t m_storedLevels;
+	// Streamed textures that finish() with glGenerateMipmap
+	bool m_generateMipmaps;
+
+	// Maximum anisotropy of the filtering; 1 is isotropic
+	float m_anisotropy;
+
 	GLuint m_handle;
 
 	bool m_isReady;
 
-	// Image properties
+	// Image properties, of the full size image. The image itself is only
+	// held while it is uploaded.
 	uint16_t m_width, m_height;
 	uint8_t m_nChannels;
 	uint8_t m_bitDepth;
 	uint16_t m_rowBytes;
 
-	// Image data
-	// malloc'd array of image data
-	//	8-bit, this is a uint8_t*
-	//	16-bit, this is a uint16_t*
-	void *m_image;
+	// Block format of the texture; BLOCK_NONE if uncompressed
+	BlockFormat m_blockFormat;
+
+	// GL memory of the texture, all levels
+	size_t m_bytes;
+
+	// Frame the texture was last bound in
+	mutable unsigned int m_lastUse;
+	static unsigned int s_frame;
+
+	// Bound in place of textures that are not ready
+	static GLuint s_placeholder;
+
+	// (Re)create the GL texture from the file
+	void load();
+	// Generate and bind m_handle, with the sampling parameters
+	bool create();
+	// Upload a mapped container (see decoders/container.h)
+	bool uploadContainer(const Image::Container &container);
+	// Upload image as level 0 of the bound texture, along with the mip
+	// levels below it. With blocks, every level is compressed to
+	// blocks->m_format first, and blocks gets the result.
+	bool uploadImage(const void *image, CompressedImage *blocks);
+	// Upload the levels of a compressed texture
+	bool uploadCompressed(const CompressedImage &blocks);
+	// Upload the stored levels that are not skipped, as they are
+	bool uploadLevels(const std::vector<const uint8_t*> &levels, const std::vector<size_t> &sizes);
+	// Copy all but the top count levels into a new GL texture, on the GPU,
+	// and replace m_handle with it. False, leaving the texture as it was,
+	// if the copy fails.
+	bool copyLevels(uint8_t count);
+	// Bytes of one width x height level
+	size_t levelBytes(uint16_t width, uint16_t height) const;
+	// Internal format of uncompressed levels
+	GLenum internalFormat() const;
+	// Block format of the compressed cache of the file, BLOCK_NONE for none
+	BlockFormat getCacheFormat() const;
 public:
 
 	Texture(const char *filename,
-			FilterType minFilter=LINEAR,
+			FilterType minFilter=LINEAR_MIPMAP_LINEAR,
 			FilterType magFilter=LINEAR,
-			WrapMode wrap=REPEAT);
+			WrapMode wrap=REPEAT,
+			MipmapMode mipmaps=MIPMAP_CPU,
+			float anisotropy=TEXTURE_ANISOTROPY,
+			bool compress=TEXTURE_COMPRESS,
+			bool sRGB=TEXTURE_SRGB,
+			bool stream=false);
 
 	~Texture();
 
 	bool getIsReady() const { return m_isReady; }
 
+	// Sampling parameters; these bind the texture to the active unit.
+	void setFilters(FilterType minFilter, FilterType magFilter);
+	// Clamped to [1, getMaxAnisotropy()]
+	void setAnisotropy(float anisotropy);
+
+	FilterType getMinFilter() const { return m_minFilter; }
+	FilterType getMagFilter() const { return m_magFilter; }
+	WrapMode getWrapMode() const { return m_wrapMode; }
+	float getAnisotropy() const { return m_anisotropy; }
+	uint8_t getNumLevels() const { return m_numLevels; }
+	MipmapMode getMipmapMode() const { return m_mipmaps; }
+	BlockFormat getBlockFormat() const { return m_blockFormat; }
+	bool getUseSRGB() const { return m_useSRGB; }
+	bool getIsSRGB() const { return m_isSRGB; }
+	const char* getFilename() const { return m_filename; }
+	// Of the full size image, before any levels are skipped
+	uint16_t getWidth() const { return m_width; }
+	uint16_t getHeight() const { return m_height; }
+	// Internal format of the GL texture's levels
+	GLenum getInternalFormat() const { return (BLOCK_NONE != m_blockFormat) ? (GLenum)m_blockFormat : internalFormat(); }
+	GLuint getHandle() const { return m_handle; }
+	size_t getBytes() const { return m_bytes; }
+
+	// Leave out the top skip levels, at least the 1x1 level kept. The
+	// levels below are copied on the GPU, so the texture must have them
+	// (see canDropLevels()). Returns false, leaving the texture as it was,
+	// if it does not or the copy fails. Levels are brought back by loading
+	// the texture again with fewer skipped, and adopt()ing it.
+	bool setSkipLevels(uint8_t skip);
+	uint8_t getSkipLevels() const { return m_skipLevels; }
+	// Whether count more levels can be left out
+	bool canDropLevels(uint8_t count) const { return m_isReady && count < m_numLevels; }
+	// Take over the GL texture and levels of other, a texture of the same
+	// file and parameters, in place of this one's. other is left empty.
+	void adopt(Texture &other);
+	uint8_t getMaxSkipLevels() const;
+
+	// Frames are counted by the Manager; bindGL() stamps the texture
+	// with the current one.
+	unsigned int getLastUse() const { return m_lastUse; }
+	// Stamp the texture as bound, when it is sampled from a copy instead
+	// (see ArrayPool)
+	void touch() const { m_lastUse = s_frame; }
+	static unsigned int getFrame() { return s_frame; }
+	static void nextFrame() { ++s_frame; }
+
+	// The largest anisotropy the GL supports; 1 without
+	// EXT_texture_filter_anisotropic
+	static float getMaxAnisotropy();
+
+	// The block format images of nChannels channels are compressed to,
+	// sRGB encoded or not; BLOCK_NONE if the GL has none.
+	static BlockFormat blockFormatFor(uint8_t nChannels, bool sRGB=false);
+
+	// Streaming (see Streamer). A texture constructed with stream set
+	// is not loaded; the Streamer decodes its file, allocate()s it, fills
+	// its levels with glTexSubImage2D and finish()es it. It is not ready,
+	// and binds as a 1x1 placeholder, until then.
+	// Allocate numLevels levels of storage for a width x height image,
+	// in format (BLOCK_NONE for uncompressed, sRGB encoded if sRGB),
+	// leaving out its top skipLevels levels. storedLevels as for
+	// m_storedLevels.
+	bool allocate(uint16_t width, uint16_t height, uint8_t nChannels,
+			uint8_t bitDepth, BlockFormat format, bool sRGB, uint8_t numLevels,
+			uint8_t storedLevels=0, uint8_t skipLevels=0);
+	// Once the levels are uploaded; makes the texture ready
+	void finish();
+
 	// textureUnit is one of GL_TEXTURE#, where # is 0,1,2,3,...,etc
 	void bindGL(GLenum textureUnit) const;
 
@@ -0,0 +1,67 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Per-frame transform stage.
+ *
+ * Computes the world, modelView and normal matrices of every object in
+ * the scene once per frame, into one contiguous array per quantity,
+ * indexed like the scene. The passes that draw the scene look them up
+ * instead of multiplying and inverting per draw.
+ *
+ * Object and camera transforms are affine, so they are kept as
+ * gml::affine_t: composing them skips the bottom row, and the normal
+ * matrix is the inverse-transpose of the 3x3 linear part instead of a
+ * general 4x4 inverse. They are only promoted to mat4x4_t (embed()) when
+ * they are uploaded.
+ */
+
+#pragma once
+#ifndef __INC_TRANSFORMS_H_
+#define __INC_TRANSFORMS_H_
+
+//==============================================================================
+
+#include <vector>
+#include <cstddef>
+#include <gml/gml.h>
+#include <objects/object.h>
+
+//==============================================================================
+
+class TransformStage
+{
+public:
+	typedef std::vector<Object::Object*> ObjectVec;
+
+	TransformStage();
+	~TransformStage();
+
+	// Recompute the matrices of every object in scene, as seen from
+	// worldView.
+	void update(const ObjectVec & scene, const gml::mat4x4_t & worldView);
+
+	size_t size() const { return m_world.size(); }
+	const gml::affine_t & getWorld(size_t i) const { return m_world[i]; }
+	const gml::affine_t & getModelView(size_t i) const { return m_modelView[i]; }
+	const gml::mat3x3_t & getNormal(size_t i) const { return m_normal[i]; }
+
+protected:
+	std::vector<gml::affine_t> m_world;
+	std::vector<gml::affine_t> m_modelView;
+	std::vector<gml::mat3x3_t> m_normal;
+};
+
+//==============================================================================
+
+#endif
@@ -1,6 +1,7 @@
 
 //==============================================================================
 
+#include <math.h>
 #include <lights.h>
 #include <shadowmap.h>
 #include <objects/object.h>
@@ -20,6 +21,7 @@ Light::Light()
 	, LinearAttenuation(0.0f)
 	, ExpAttenuation(0.0f)
 	, Shadow(false)
+	, ContactShadow(false)
 	, m_type(LT_NONE)
 {
 	mp_shadowmap = new ShadowMap(m_type);
@@ -35,13 +37,24 @@ bool Light::initShadow(const unsigned int & shadow_size, Shader::Manager * shade
 
 //------------------------------------------------------------------------------
 
-void Light::createShadow(const ObjectVec & scene, const Camera &mainCamera)
+void Light::prepareShadow(const ObjectVec & scene, const Camera &mainCamera)
+{
+	if (!Shadow || LT_POINT != m_type)
+		return;
+
+	mp_shadowmap->setRange(getBoundingRadius());
+	mp_shadowmap->prepare(scene, mainCamera, Position);
+}
+
+//------------------------------------------------------------------------------
+
+void Light::createShadow(const ObjectVec & scene, const Camera &mainCamera, unsigned int faceMask)
 {
 	if (!Shadow)
 		return;
 
 	//TODO: complete the function call by sending other arguments.
-	mp_shadowmap->create(scene, mainCamera.getWorldView(), Position, gml::add(Direction, Position));
+	mp_shadowmap->create(scene, mainCamera, Position, gml::add(Direction, Position), faceMask);
 }
 
 //------------------------------------------------------------------------------
@@ -56,6 +69,33 @@ void Light::bindShadow(GLenum textureUnit)
 
 //------------------------------------------------------------------------------
 
+bool Light::setShadowFilter(int mode)
+{
+	return mp_shadowmap->setFilter(mode);
+}
+
+//------------------------------------------------------------------------------
+
+void Light::bindShadowFilter(GLenum textureUnit)
+{
+	if (!Shadow)
+		return;
+
+	mp_shadowmap->bindFilterGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
+void Light::unbindShadowFilter(GLenum textureUnit)
+{
+	if (!Shadow)
+		return;
+
+	mp_shadowmap->unbindFilterGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
 void Light::unbindShadow(GLenum textureUnit)
 {
 	if (!Shadow)
@@ -73,9 +113,96 @@ void Light::setType(LightType lt)
 
 //------------------------------------------------------------------------------
 
-gml::mat4x4_t Light::getCamProjectionMatrix ()
-{ 
-	return mp_shadowmap->getCamProjectionMatrix(); 
+const gml::mat4x4_t* Light::getCascadeMatrices() const
+{
+	return mp_shadowmap->getCascadeMatrices();
+}
+
+//------------------------------------------------------------------------------
+
+gml::vec4_t Light::getCascadeSplits() const
+{
+	return mp_shadowmap->getCascadeSplits();
+}
+
+//------------------------------------------------------------------------------
+
+void Light::setShadowLayered(bool layered)
+{
+	mp_shadowmap->setLayered(layered);
+}
+
+//------------------------------------------------------------------------------
+
+void Light::setShadowParaboloid(bool paraboloid)
+{
+	mp_shadowmap->setParaboloid(paraboloid);
+}
+
+//------------------------------------------------------------------------------
+
+bool Light::isShadowParaboloid() const
+{
+	return mp_shadowmap->isParaboloid();
+}
+
+//------------------------------------------------------------------------------
+
+unsigned short Light::getShadowFaceCount() const
+{
+	return mp_shadowmap->getNumFaces();
+}
+
+//------------------------------------------------------------------------------
+
+double Light::getShadowTime() const
+{
+	return mp_shadowmap->getLastTime();
+}
+
+//------------------------------------------------------------------------------
+
+void Light::getShadowCacheStats(unsigned int & updated, unsigned int & reused) const
+{
+	updated = mp_shadowmap->getNumUpdated();
+	reused = mp_shadowmap->getNumReused();
+}
+
+//------------------------------------------------------------------------------
+
+float Light::getShadowFaceStaleness(unsigned short face) const
+{
+	return mp_shadowmap->getFaceStaleness(face, Position);
+}
+
+//------------------------------------------------------------------------------
+
+float Light::getBoundingRadius() const
+{
+	float MaxChannel = fmax(fmax(Radiance.x, Radiance.y), Radiance.z);
+	float c = MaxChannel * DiffuseIntensity;
+	return (8.0f * sqrtf(c) + 1.0f);
+}
+
+//------------------------------------------------------------------------------
+
+void Light::setShadowRect(const gml::vec4_t & rect)
+{
+	mp_shadowmap->setAtlasRect(rect);
+}
+
+//------------------------------------------------------------------------------
+
+gml::vec4_t Light::getShadowRect() const
+{
+	return mp_shadowmap->getAtlasRect();
+}
+
+//------------------------------------------------------------------------------
+
+const gml::mat4x4_t* Light::getShadowCubeMatrices() const
+{
+	return mp_shadowmap->getCubeMatrices();
 }
 
 //==============================================================================
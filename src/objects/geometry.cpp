@@ -15,7 +15,12 @@
 namespace Object
 {
 
-Geometry::Geometry() {}
+Geometry::Geometry()
+	: m_boundCenter(0.0f, 0.0f, 0.0f)
+	, m_boundRadius(1.0f)
+	, m_revision(0)
+{
+}
 Geometry::~Geometry() {}
 
 }
@@ -140,6 +140,7 @@ Octahedron::~Octahedron() {}
 
 bool Octahedron::init()
 {
+	++m_revision;
 	return m_mesh.init(GL_TRIANGLES, NUM_VERTS, _verts, _normals, _texcoords, 8*3, _indices);
 }
 
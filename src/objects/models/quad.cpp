@@ -45,11 +45,16 @@ static GLuint _indices[] =
 		2, 3, 0
 };
 
-Quad::Quad() {}
+Quad::Quad()
+{
+	m_boundCenter = gml::vec3_t(0.0f, 0.0f, -1.0f);
+	m_boundRadius = (float)M_SQRT2;
+}
 Quad::~Quad() {}
 
 bool Quad::init()
 {
+	++m_revision;
 	return m_mesh.init(GL_TRIANGLES, 4, _verts, _normals, _texCoords, 2*3, _indices);
 }
 
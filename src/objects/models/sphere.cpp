@@ -151,6 +151,7 @@ bool Sphere::init(const uint8_t nFacetIterations)
 
 	// All done. Exit
 	free(positions);
+	++m_revision;
 	return success;
 }
 
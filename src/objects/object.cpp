@@ -22,10 +22,26 @@ Object::Object(const Geometry *geom, const Material::Material &mat,
 	// Note: We don't own this item, so we best not delete it!
 	m_geometry = geom;
 	m_material = mat;
-	m_objectToWorld = objectToWorld;
+	m_objectToWorld = gml::affine(objectToWorld);
+	m_revision = 0;
 }
 Object::~Object()
 {
 }
 
+void Object::setTransform(const gml::mat4x4_t transform)
+{
+	m_objectToWorld = gml::affine(transform);
+	++m_revision;
+}
+
+void Object::getBoundingSphere(gml::vec3_t &center, float &radius) const
+{
+	center = gml::transformPoint(m_objectToWorld, m_geometry->getBoundCenter());
+	// Conservative: scale the radius by the largest axis scale of the transform
+	const gml::mat3x3_t L = gml::extract(m_objectToWorld);
+	float s = fmaxf(gml::length2(L[0]), fmaxf(gml::length2(L[1]), gml::length2(L[2])));
+	radius = m_geometry->getBoundRadius() * sqrtf(s);
+}
+
 }
@@ -20,6 +20,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <gml/expr.h>
+#include <texture/cache.h>
 
 #include <objects/models/sphere.h>
 #include <objects/models/octahedron.h>
@@ -50,6 +53,9 @@ static const int CAMERA_ROTATE_DOWN = 0x200;
 static const int CAMERA_SPIN_LEFT = 0x400;
 static const int CAMERA_SPIN_RIGHT = 0x800;
 
+// Number of frames averaged by each shadow timing report
+static const unsigned int SHADOW_REPORT_FRAMES = 100;
+
 //==============================================================================
 
 Root::Root(unsigned int w, unsigned int h)
@@ -58,6 +64,7 @@ Root::Root(unsigned int w, unsigned int h)
 	, m_movementSpeed(2.0f)
 	, m_cameraMovement(0)
 	, m_rotationSpeed((40.0f * M_PI) / 180.0f)
+	, m_shadersReady(false)
 	, m_sRGBframebuffer(false)
 	, m_renderWireframe(false)
 #if defined (DO_SHADOW)
@@ -68,6 +75,26 @@ Root::Root(unsigned int w, unsigned int h)
 	, m_shadowmapSize(512)
 #if defined (PIPELINE_DEFERRED)
 	, m_gbuffer_inited(false)
+	, m_drawOrderRevision(0)
+	, m_layeredShadows(true)
+	, m_paraboloidShadows(true)
+	, m_contactShadows(true)
+	, m_shadowFrames(0)
+	, m_pointShadowTime(0.0)
+	, m_shadowUpdated(0)
+	, m_shadowReused(0)
+	, m_facesUpdated(0)
+	, m_facesReused(0)
+	, m_facesDeferred(0)
+#if defined (DO_SMOOTH_SHADOW)
+	, m_shadowFilter(SHADOW_FILTER_POISSON)
+#else
+	, m_shadowFilter(SHADOW_FILTER_PCF)
+#endif
+	, m_lightPassQuery(0)
+	, m_lightPassPending(false)
+	, m_lightPassTime(0.0)
+	, m_lightPassFrames(0)
 #endif
 {
 	m_lastIdleTime = UI::getTime();
@@ -125,13 +152,20 @@ bool Root::init()
 
 	const float pi2 = (90.0f * M_PI) / 180.0f;
 	const float sz = 15.0f;
-	m_texture = new Texture::Texture("./media/wood-as-a-conductor-of-heat-1.png");
-	if ( !m_texture->getIsReady() )
+#if defined (TEXTURE_CACHE_DIR)
+	if ( !Texture::setCompressedCache(TEXTURE_CACHE_DIR) )
+	{
+		fprintf(stderr, "Texture cache unavailable; compressing every texture\n");
+	}
+#endif
+	m_textureManager.setBudget((size_t)TEXTURE_BUDGET_MB << 20);
+	const Texture::Texture *texture = m_textureManager.acquire("./media/wood-as-a-conductor-of-heat-1.png");
+	if ( !texture )
 	{
 		fprintf(stderr, "ERROR! Texture not ready\n");
 		return false;
 	}
-	mat.setTexture(m_texture);
+	mat.setTexture(texture);
 	mat.setShaderType(Material::PHONG);
 	mat.setSpecExp(16.0f);
 	mat.setSurfReflectance(gml::vec3_t(0.4, 0.5, 0.6));
@@ -148,13 +182,13 @@ bool Root::init()
 	m_scene.push_back(new Object::Object(m_geometries[PLANE_LOC], mat, gml::mul(gml::translate(gml::vec3_t(0.0,0.0,sz/2)), gml::mul(gml::rotateXh(-pi2),gml::scaleh(sz, 1.0, sz)))));
 	m_scene.push_back(new Object::Object(m_geometries[PLANE_LOC], mat, gml::mul(gml::translate(gml::vec3_t(0.0,0.0,-sz/2)), gml::mul(gml::rotateXh(pi2),gml::scaleh(sz, 1.0, sz)))));
 
-	m_texture = new Texture::Texture("./media/testPattern.png");
-	if ( !m_texture->getIsReady() )
+	texture = m_textureManager.acquire("./media/testPattern.png");
+	if ( !texture )
 	{
 		fprintf(stderr, "ERROR! Texture not ready\n");
 		return false;
 	}
-	mat.setTexture(m_texture);
+	mat.setTexture(texture);
 	unsigned int count_factor = 4;
 	float scale_factor = 2.0f;
 	float scl = 0.75f;
@@ -166,6 +200,11 @@ bool Root::init()
 	//m_scene.push_back(new Object::Object(m_geometries[OCTAHEDRON_LOC], mat, gml::mul(gml::translate(gml::vec3_t(0.0,1.5,0.0)), gml::scaleh(1.0,1.5,1.0))));
 
 #if defined (PIPELINE_DEFERRED)
+#if defined (TEXTURE_ARRAYS)
+	for (size_t i = 0; i < m_scene.size(); ++i)
+		m_texturePool.add(m_scene[i]->getMaterial().getTexture());
+	m_texturePool.setManager(&m_textureManager);
+#endif
 	m_dummySphere = new Object::Object(m_geometries[SPHERE_LOC], mat, gml::identity4());
 	m_dummyQuad = new Object::Object(m_geometries[QUAD_LOC], mat, gml::identity4());
 	if (!initLights())
@@ -189,6 +228,11 @@ bool Root::init()
 			"  [keypad 9] -- Spin camera right\n"
 			"Other Controls:\n"
 			"  [F1] -- Toggle shadows\n"
+			"  [F2] -- Toggle layered/six-pass point light shadows\n"
+			"  [F3] -- Cycle shadow filtering (PCF, Poisson PCF, ESM)\n"
+			"  [F4] -- Toggle dual-paraboloid shadows for minor point lights\n"
+			"  [F5] -- Toggle contact shadows for point lights without shadow maps\n"
+			"  [-]/[=] -- Halve/double the shadow face update budget\n"
 			"  [g] -- Toggle sRGB framebuffer\n"
 			"  [f] -- Toggle wireframe rendering\n"
 			"  [o] -- Set to orthographic camera\n"
@@ -287,6 +331,51 @@ void Root::specialKeyboard(UI::KeySpecial_t key, UI::ButtonState_t state)
 			m_enableShadows = !m_enableShadows;
 		break;
 
+#if defined (PIPELINE_DEFERRED)
+	case UI::KEY_F2:
+		if (state == UI::BUTTON_DOWN)
+		{
+			m_layeredShadows = !m_layeredShadows;
+			for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
+				(*itr)->setShadowLayered(m_layeredShadows);
+			resetShadowStats();
+			printf("%s point light shadows\n", m_layeredShadows ? "Layered" : "Six-pass");
+		}
+		break;
+	case UI::KEY_F3:
+		if (state == UI::BUTTON_DOWN)
+			setShadowFilter((m_shadowFilter + 1) % NUM_SHADOW_FILTERS);
+		break;
+	case UI::KEY_F4:
+		if (state == UI::BUTTON_DOWN)
+		{
+			setParaboloidShadows(!m_paraboloidShadows);
+			printf("%s point light shadows\n", m_paraboloidShadows ? "Cube & dual-paraboloid" : "Cube");
+		}
+		break;
+	case UI::KEY_F5:
+		if (state == UI::BUTTON_DOWN)
+		{
+			m_contactShadows = !m_contactShadows;
+			printf("Contact shadows %s\n", m_contactShadows ? "enabled" : "disabled");
+		}
+		break;
+	case UI::KEY_MINUS:
+	case UI::KEY_EQUAL:
+		if (state == UI::BUTTON_DOWN)
+		{
+			unsigned int faces = m_shadowAtlas.getFaceBudget();
+			if (key == UI::KEY_MINUS)
+				faces = (faces > 1) ? faces / 2 : 1;
+			else
+				faces = (faces < 6 * 64) ? faces * 2 : faces;
+			m_shadowAtlas.setBudget(faces, m_shadowAtlas.getTimeBudget());
+			resetShadowStats();
+			printf("Shadow update budget: %u faces, %.1f ms\n", faces, m_shadowAtlas.getTimeBudget());
+		}
+		break;
+#endif
+
 	case UI::KEY_G:
 		if (state == UI::BUTTON_DOWN)
 		{
@@ -374,9 +463,11 @@ bool Root::initLights()
 		l->ConstantAttenuation = pl_c_att;
 		l->LinearAttenuation = pl_lin_att;
 		l->ExpAttenuation = pl_ex_att;
-		l->Shadow = false;
+		l->Shadow = true;
+		l->ContactShadow = true;
 		m_lights.push_back(l);
 	}
+	m_animatedLights.resize(20);
 
 #if defined (DO_SHADOW)
 	for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
@@ -386,6 +477,13 @@ bool Root::initLights()
 				fprintf(stderr, "Failed to initialize shadow mapping members.\n");
 				return false;
 			}
+	if (!m_shadowAtlas.init(SHADOW_ATLAS_SIZE, &m_shaderManager))
+	{
+		fprintf(stderr, "Failed to initialize the shadow atlas.\n");
+		return false;
+	}
+	setShadowFilter(m_shadowFilter);
+	setParaboloidShadows(m_paraboloidShadows);
 #endif
 
 	return true;
@@ -417,17 +515,48 @@ void Root::rasterizeSceneDeferred()
 		shader->bindGL(false);
 		if (isGLError()) return;
 
-		for (ObjectVec::iterator itr = m_scene.begin(); itr != m_scene.end(); ++itr)
+		if (m_drawOrder.size() != m_scene.size() || m_drawOrderRevision != m_texturePool.getRevision())
+			sortDrawOrder();
+
+		// Packed textures are sampled from their array, on unit 1 (see
+		// geometrypass.cpp), the others from unit 0
+		GLuint boundArray = 0;
+		const Texture::Texture *boundTexture = 0;
+		for (size_t n = 0; n < m_drawOrder.size(); ++n)
 		{
-			shaderUniforms.m_modelView = gml::mul(m_camera.getWorldView(), (*itr)->getObjectToWorld());
-			shaderUniforms.m_normalTrans = gml::transpose(gml::inverse(shaderUniforms.m_modelView));
-			(*itr)->getMaterial().getTexture()->bindGL(GL_TEXTURE0);
+			const size_t i = m_drawOrder[n];
+			shaderUniforms.m_modelView = gml::embed(m_transforms.getModelView(i));
+			shaderUniforms.m_normalTrans = gml::embed(m_transforms.getNormal(i));
+
+			const Texture::Texture *texture = m_scene[i]->getMaterial().getTexture();
+			const Texture::ArrayPool::Layer *layer = m_texturePool.find(texture);
+			if (layer)
+			{
+				if (layer->m_array != boundArray)
+				{
+					m_texturePool.bindGL(*layer, GL_TEXTURE1);
+					boundArray = layer->m_array;
+				}
+				texture->touch();
+				shaderUniforms.m_textureLayer = layer->m_layer;
+			}
+			else
+			{
+				if (texture != boundTexture)
+				{
+					texture->bindGL(GL_TEXTURE0);
+					boundTexture = texture;
+				}
+				shaderUniforms.m_textureLayer = -1;
+			}
 
 			if ( !shader->setUniforms(shaderUniforms, m_enableShadows) || isGLError() ) return;
 
-			(*itr)->rasterize();
+			m_scene[i]->rasterize();
 			if (isGLError()) return;
 		}
+		if (boundArray)
+			m_texturePool.unbindGL(GL_TEXTURE1);
 		shader->unbindGL();
 	}
 
@@ -446,6 +575,48 @@ void Root::rasterizeSceneDeferred()
 
 //------------------------------------------------------------------------------
 
+namespace
+{
+	// Where an object's texture is, for ordering the draws
+	struct DrawKey
+	{
+		GLuint m_array;
+		GLint m_layer;
+		const Texture::Texture *m_texture;
+		size_t m_object;
+
+		bool operator<(const DrawKey &other) const
+		{
+			if (m_array != other.m_array) return m_array < other.m_array;
+			if (m_layer != other.m_layer) return m_layer < other.m_layer;
+			return m_texture < other.m_texture;
+		}
+	};
+}
+
+void Root::sortDrawOrder()
+{
+	std::vector<DrawKey> keys(m_scene.size());
+	for (size_t i = 0; i < m_scene.size(); ++i)
+	{
+		const Texture::Texture *texture = m_scene[i]->getMaterial().getTexture();
+		const Texture::ArrayPool::Layer *layer = m_texturePool.find(texture);
+		keys[i].m_array = layer ? layer->m_array : 0;
+		keys[i].m_layer = layer ? layer->m_layer : -1;
+		keys[i].m_texture = texture;
+		keys[i].m_object = i;
+	}
+	// Stable, so that objects of a texture keep their order
+	std::stable_sort(keys.begin(), keys.end());
+
+	m_drawOrder.resize(keys.size());
+	for (size_t i = 0; i < keys.size(); ++i)
+		m_drawOrder[i] = keys[i].m_object;
+	m_drawOrderRevision = m_texturePool.getRevision();
+}
+
+//------------------------------------------------------------------------------
+
 void Root::DSGeometryPass()
 {
     m_gbuffer.BindForWriting();
@@ -468,26 +639,25 @@ void Root::BeginLightPasses()
 
 //------------------------------------------------------------------------------
 
-float CalcPointLightBSphere(const gml::vec3_t& Color, float Intensity)
-{
-   	float MaxChannel = fmax(fmax(Color.x, Color.y), Color.z);
-   	float c = MaxChannel * Intensity;
-   	return (8.0f * sqrtf(c) + 1.0f);
-}
-
-//------------------------------------------------------------------------------
-
 void Root::DSPointLightsPass()
 {
 	Shader::GLProgUniforms shaderUniforms;
 	shaderUniforms.m_projection = m_camera.getProjection();
 	shaderUniforms.m_ds_ScreenSize = gml::vec2_t(m_width, m_height);
 
-	const Shader::Shader *shader = m_shaderManager.getDeferredPointLightPassShader();
+	// Parts that are switched off are left out of the program altogether
+	unsigned int features = SHADER_FEATURES_DEFAULT;
+	if (!m_enableShadows) features &= ~SHADER_FEATURE_SHADOW;
+	if (!m_contactShadows) features &= ~SHADER_FEATURE_CONTACT_SHADOW;
+	const Shader::Shader *shader = m_shaderManager.getDeferredPointLightPassShader(features);
 
 	if (shader->getIsReady(false))
 	{
 		shader->bindGL(false);
+		m_shadowAtlas.bindGL(GL_TEXTURE3);
+		if (SHADOW_FILTER_ESM == m_shadowFilter)
+			m_shadowAtlas.bindFilterGL(GL_TEXTURE4);
+		shaderUniforms.m_shadowFilter = m_shadowFilter;
 		if (isGLError()) return;
 
 		for (LightVec::iterator itr = m_lights.begin(); itr < m_lights.end(); ++itr)
@@ -495,10 +665,21 @@ void Root::DSPointLightsPass()
 			Light& lit = **itr;
 			if (lit.getType() != LT_POINT)
 				continue;
-			if (lit.Shadow)
-				lit.bindShadow(GL_TEXTURE3);
-			if (isGLError()) return;
-			shaderUniforms.m_lightPos = gml::extract3(gml::mul(m_camera.getWorldView(), gml::vec4_t(lit.Position, 1.0f)));
+			// Lights without an atlas tile this frame are left unshadowed
+			shaderUniforms.m_shadowRect = gml::vec4_t(0, 0, 0, 0);
+			shaderUniforms.m_shadowParaboloid = 0;
+			if (m_enableShadows && lit.Shadow)
+			{
+				shaderUniforms.m_shadowRect = lit.getShadowRect();
+				shaderUniforms.m_shadowParaboloid = lit.isShadowParaboloid();
+				const gml::mat4x4_t *cubeMats = lit.getShadowCubeMatrices();
+				for (unsigned int i = 0; i < 6; ++i)
+					shaderUniforms.m_cube_face_mats[i] = cubeMats[i];
+			}
+			// and fall back to contact shadows
+			shaderUniforms.m_contactShadow = m_contactShadows && lit.ContactShadow &&
+				shaderUniforms.m_shadowRect.z <= 0.0f;
+			shaderUniforms.m_lightPos = gml::expr::eval3(gml::expr::mul(m_camera.getWorldView(), gml::expr::point(lit.Position)));
 			shaderUniforms.m_lightRad = lit.Radiance;
 			shaderUniforms.m_ds_AmbientIntensity = lit.AmbientIntensity;
 			shaderUniforms.m_ds_DiffuseIntensity = lit.DiffuseIntensity;
@@ -506,17 +687,18 @@ void Root::DSPointLightsPass()
 			shaderUniforms.m_ds_AttenuationLinear = lit.LinearAttenuation;
 			shaderUniforms.m_ds_AttenuationExp = lit.ExpAttenuation;
 
-			float _scale = CalcPointLightBSphere(lit.Radiance, lit.DiffuseIntensity);
-			shaderUniforms.m_modelView = gml::mul(m_camera.getWorldView(), gml::mul(gml::translate(lit.Position), gml::scaleh(_scale, _scale, _scale)));
+			float _scale = lit.getBoundingRadius();
+			shaderUniforms.m_modelView = gml::expr::eval(gml::expr::mul(m_camera.getWorldView(),
+					gml::expr::mul(gml::expr::translate(lit.Position), gml::expr::scaleh(_scale, _scale, _scale))));
 
 			if ( !shader->setUniforms(shaderUniforms, m_enableShadows) || isGLError() ) return;
 
 			m_dummySphere->rasterize();
 			if (isGLError()) return;
-
-			if (lit.Shadow)
-				lit.unbindShadow(GL_TEXTURE3);
 		}
+		m_shadowAtlas.unbindGL(GL_TEXTURE3);
+		if (SHADOW_FILTER_ESM == m_shadowFilter)
+			m_shadowAtlas.unbindFilterGL(GL_TEXTURE4);
 		shader->unbindGL();
 	}
 	
@@ -532,7 +714,8 @@ void Root::DSDirectionalLightPass()
 	shaderUniforms.m_ds_ScreenSize = gml::vec2_t(m_width, m_height);
 	shaderUniforms.m_modelView = gml::identity4();
 
-	const Shader::Shader *shader = m_shaderManager.getDeferredDirectionalLightPassShader();
+	const Shader::Shader *shader = m_shaderManager.getDeferredDirectionalLightPassShader(
+			m_enableShadows ? SHADER_FEATURES_DEFAULT : 0);
 
 	if (shader->getIsReady(false))
 	{
@@ -545,9 +728,15 @@ void Root::DSDirectionalLightPass()
 			if (lit.getType() != LT_DIRECTIONAL)
 				continue;
 			if (lit.Shadow) {
-				shaderUniforms.m_ds_light_projection_mat = lit.getCamProjectionMatrix();
+				const gml::mat4x4_t *cascadeMats = lit.getCascadeMatrices();
+				for (unsigned int i = 0; i < SHADOW_NUM_CASCADES; ++i)
+					shaderUniforms.m_ds_cascade_mats[i] = cascadeMats[i];
+				shaderUniforms.m_ds_cascade_splits = lit.getCascadeSplits();
 				lit.bindShadow(GL_TEXTURE3);
+				if (SHADOW_FILTER_ESM == m_shadowFilter)
+					lit.bindShadowFilter(GL_TEXTURE4);
 			}
+			shaderUniforms.m_shadowFilter = m_shadowFilter;
 			if (isGLError()) return;
 			shaderUniforms.m_lightRad = lit.Radiance;
 			shaderUniforms.m_ds_AmbientIntensity = lit.AmbientIntensity;
@@ -567,6 +756,122 @@ void Root::DSDirectionalLightPass()
 
 //------------------------------------------------------------------------------
 
+void Root::reportShadowStats()
+{
+	if (m_lightPassPending)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(m_lightPassQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(m_lightPassQuery, GL_QUERY_RESULT, &elapsed);
+			m_lightPassTime += elapsed * 1.0e-6;
+			++m_lightPassFrames;
+			m_lightPassPending = false;
+		}
+	}
+
+	// Point lights are all rendered, and timed, by the atlas
+	m_pointShadowTime += m_shadowAtlas.getLastTime();
+	m_facesUpdated += m_shadowAtlas.getNumUpdated();
+	m_facesReused += m_shadowAtlas.getNumReused();
+	m_facesDeferred += m_shadowAtlas.getNumDeferred();
+
+	for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
+	{
+		Light & lit = **itr;
+		if (!lit.Shadow || lit.getType() == LT_POINT)
+			continue;
+
+		unsigned int updated, reused;
+		lit.getShadowCacheStats(updated, reused);
+		m_shadowUpdated += updated;
+		m_shadowReused += reused;
+	}
+
+	if (++m_shadowFrames == SHADOW_REPORT_FRAMES)
+	{
+		printf("%s point light shadows: %.3f ms/frame, %u lights in the atlas\n"
+			, m_layeredShadows ? "Layered" : "Six-pass"
+			, m_pointShadowTime / m_shadowFrames, m_shadowAtlas.getNumAllocated());
+		printf("Cube faces per frame: %.1f updated, %.1f reused, %.1f deferred (budget %u faces, %.1f ms)\n"
+			, (double)m_facesUpdated / m_shadowFrames
+			, (double)m_facesReused / m_shadowFrames
+			, (double)m_facesDeferred / m_shadowFrames
+			, m_shadowAtlas.getFaceBudget(), m_shadowAtlas.getTimeBudget());
+		printf("Cascades per frame: %.1f updated, %.1f reused\n"
+			, (double)m_shadowUpdated / m_shadowFrames
+			, (double)m_shadowReused / m_shadowFrames);
+		static const char *filterNames[NUM_SHADOW_FILTERS] = { "PCF", "Poisson PCF", "ESM" };
+		printf("Light passes with %s shadows: %.3f ms/frame\n"
+			, filterNames[m_shadowFilter], m_lightPassFrames ? m_lightPassTime / m_lightPassFrames : 0.0);
+		unsigned int issued, skipped;
+		Shader::GLProgram::getUniformStats(issued, skipped);
+		printf("Uniform uploads per frame: %.1f issued, %.1f skipped\n"
+			, (double)issued / m_shadowFrames, (double)skipped / m_shadowFrames);
+		resetShadowStats();
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void Root::resetShadowStats()
+{
+	m_shadowFrames = 0;
+	m_pointShadowTime = 0.0;
+	m_shadowUpdated = 0;
+	m_shadowReused = 0;
+	m_facesUpdated = 0;
+	m_facesReused = 0;
+	m_facesDeferred = 0;
+	m_lightPassTime = 0.0;
+	m_lightPassFrames = 0;
+	Shader::GLProgram::resetUniformStats();
+}
+
+//------------------------------------------------------------------------------
+
+void Root::setShadowFilter(int mode)
+{
+	// Every shadow map is invalidated, so exponential maps are filled in
+	// from scratch when switching to ESM
+	bool ok = m_shadowAtlas.setFilter(mode);
+	for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
+		if ((*itr)->Shadow)
+			ok = (*itr)->setShadowFilter(mode) && ok;
+	if (!ok)
+	{
+		fprintf(stderr, "Failed to set up shadow filtering mode %d\n", mode);
+		mode = SHADOW_FILTER_PCF;
+		m_shadowAtlas.setFilter(mode);
+		for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
+			if ((*itr)->Shadow)
+				(*itr)->setShadowFilter(mode);
+	}
+	m_shadowFilter = mode;
+	resetShadowStats();
+}
+
+//------------------------------------------------------------------------------
+
+void Root::setParaboloidShadows(bool enable)
+{
+	// The first point lights are the hero lights and keep their cube maps
+	unsigned int n = 0;
+	for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
+	{
+		if ((*itr)->getType() != LT_POINT)
+			continue;
+		(*itr)->setShadowParaboloid(enable && n >= SHADOW_CUBE_LIGHTS);
+		++n;
+	}
+	m_paraboloidShadows = enable;
+	resetShadowStats();
+}
+
+//------------------------------------------------------------------------------
+
 #if defined (PIPELINE_DEFERRED_DEBUG)
 
 void Root::DSLightPass()
@@ -693,8 +998,29 @@ void Root::rasterizeScene()
 
 void Root::repaint()
 {
+	m_textureManager.update();
+
+	// The driver compiles the shader programs while the window is up
+	// (see Shader::Manager::init); until they are done, frames are blank
+	if (!m_shadersReady)
+	{
+		if (!m_shaderManager.poll())
+		{
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			return;
+		}
+		m_shadersReady = true;
+		printf("First frame at %.3f s; shader programs: %u loaded from cache, %u compiled; %u textures still loading\n",
+				UI::getTime(), Shader::GLProgram::getNumLoaded(), Shader::GLProgram::getNumCompiled(),
+				m_textureManager.getNumPending());
+	}
+
 #if defined (PIPELINE_DEFERRED)
 
+	m_transforms.update(m_scene, m_camera.getWorldView());
+	m_texturePool.update();
+
 	if (!m_gbuffer_inited) {
 	 	m_gbuffer.Init(m_width, m_height);
 	 	m_gbuffer_inited = true;
@@ -702,10 +1028,14 @@ void Root::repaint()
 #if defined (DO_SHADOW)
 	if (m_enableShadows)
 	{
+		// Point lights render into their tiles of the shared atlas
+		m_shadowAtlas.allocate(m_lights, m_camera);
+		m_shadowAtlas.create(m_scene, m_camera);
 		for (LightVec::iterator itr = m_lights.begin(); itr != m_lights.end(); ++itr)
-			if ((*itr)->Shadow)
+			if ((*itr)->Shadow && (*itr)->getType() != LT_POINT)
 				(*itr)->createShadow(m_scene, m_camera);
 		if ( isGLError() ) return;
+		reportShadowStats();
 	}
 #endif
 
@@ -713,9 +1043,19 @@ void Root::repaint()
 #if defined (PIPELINE_DEFERRED_DEBUG)
 	DSLightPass();
 #else	
+	if (0 == m_lightPassQuery)
+		glGenQueries(1, &m_lightPassQuery);
+	const bool timed = !m_lightPassPending;
+	if (timed)
+		glBeginQuery(GL_TIME_ELAPSED, m_lightPassQuery);
 	BeginLightPasses();
 	DSPointLightsPass();
 	DSDirectionalLightPass();
+	if (timed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_lightPassPending = true;
+	}
 #endif
 
 #else
@@ -785,11 +1125,14 @@ void Root::idle()
 	}
 //*/
 	const float deltaT = currTime - m_lastIdleTime;
-	for (unsigned int i = 0; i < 20; ++i)
+	if (0 != deltaT)
 	{
-		Light & lit = *m_lights[i+2];
-		if (0 != deltaT)
-			lit.Position = gml::extract3(gml::mul(gml::rotateYh(0.5f * deltaT * m_rotationSpeed), gml::vec4_t(lit.Position, 1.0)));
+		const gml::vec3soa_t pos = m_animatedLights.soa();
+		for (size_t i = 0; i < pos.n; ++i)
+			pos.set(i, m_lights[i+2]->Position);
+		gml::transformPoints(gml::rotateYh(0.5f * deltaT * m_rotationSpeed), pos, pos);
+		for (size_t i = 0; i < pos.n; ++i)
+			m_lights[i+2]->Position = pos.get(i);
 	}
 //*/
 	m_lastIdleTime = currTime;
@@ -0,0 +1,70 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <gl3/gl3w.h>
+#include <cstdio>
+
+#include <shaders/constant/cascadedepth.h>
+#include <glUtils.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+static const char vertShader[] =
+		"#version 330\n"
+		"uniform mat4 " UNIF_MODELVIEW ";\n"
+		"uniform mat4 " UNIF_PROJECTION ";\n"
+		"layout (location=0) in vec3 position;\n"
+		"void main(void) {\n"
+		" gl_Position = " UNIF_PROJECTION " * " UNIF_MODELVIEW " * vec4(position, 1.0);\n"
+		"}";
+static const char fragShader[] =
+		"#version 330\n"
+		// No gl_FragDepth write; the bias comes from glPolygonOffset so
+		// early-z stays enabled.
+		"void main(void) {\n"
+		"}";
+
+CascadeDepth::CascadeDepth()
+{
+	// Try to create, compile, & link a GLSL program using the source
+	// you give it.
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
+	{
+		fprintf(stderr, "ERROR: CascadeDepth failed to initialize\n");
+	}
+}
+
+void CascadeDepth::initUniforms()
+{
+	// Make sure that every uniform that you are using in your shader
+	// is given a handle.
+	// variable names that do not correspond with a uniform will have
+	// been given the value -1
+	m_isReady =
+			(m_program.getUniformID(UNIFORM_MODELVIEW) >= 0) &&
+			(m_program.getUniformID(UNIFORM_PROJECTION) >= 0);
+}
+CascadeDepth::~CascadeDepth() {}
+
+
+bool CascadeDepth::setUniforms(const GLProgUniforms &uniforms, const bool) const
+{
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+    m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+
+ 	return !isGLError();
+}
+
+}
+}
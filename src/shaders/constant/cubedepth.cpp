@@ -0,0 +1,118 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <gl3/gl3w.h>
+#include <cstdio>
+
+#include <shaders/constant/cubedepth.h>
+#include <glUtils.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+static const char vertShader[] =
+		"#version 330\n"
+		"uniform mat4 " UNIF_MODELVIEW ";\n"
+		"layout (location=0) in vec3 position;\n"
+		"void main(void) {\n"
+		" gl_Position = " UNIF_MODELVIEW " * vec4(position, 1.0);\n"
+		"}";
+static const char geomShader[] =
+		"#version 330\n"
+		"layout (triangles) in;\n"
+		"layout (triangle_strip, max_vertices = 18) out;\n"
+		"uniform mat4 " UNIF_CUBE_FACE_MATS "[6];\n"
+		"uniform mat4 " UNIF_PROJECTION ";\n"
+		// Tile of this light in the atlas: xy = corner, z = face size
+		"uniform vec4 " UNIF_SHADOW_RECT ";\n"
+		// Faces to render; the others keep their contents
+		"uniform int " UNIF_CUBE_FACE_MASK ";\n"
+		"void main(void) {\n"
+		" for (int face = 0; face < 6; ++face) {\n"
+		"  if ((" UNIF_CUBE_FACE_MASK " & (1 << face)) == 0) continue;\n"
+		"  vec4 p[3];\n"
+		"  vec4 c[3];\n"
+		"  for (int i = 0; i < 3; ++i) {\n"
+		"   p[i] = " UNIF_CUBE_FACE_MATS "[face] * gl_in[i].gl_Position;\n"
+		"   c[i] = " UNIF_PROJECTION " * p[i];\n"
+		"  }\n"
+		// Skip this face if all three vertices are outside one of its planes
+		"  vec3 x = vec3(c[0].x, c[1].x, c[2].x);\n"
+		"  vec3 y = vec3(c[0].y, c[1].y, c[2].y);\n"
+		"  vec3 w = vec3(c[0].w, c[1].w, c[2].w);\n"
+		"  if (all(greaterThan(x, w)) || all(lessThan(x, -w)) ||\n"
+		"      all(greaterThan(y, w)) || all(lessThan(y, -w)) ||\n"
+		"      all(lessThan(w, vec3(0.0))))\n"
+		"   continue;\n"
+		// Faces are laid out 3 x 2 inside the tile. Map the face's [-1,1]
+		// square onto its part of the atlas-wide viewport.
+		"  vec2 corner = " UNIF_SHADOW_RECT ".xy + vec2(face % 3, face / 3) * " UNIF_SHADOW_RECT ".z;\n"
+		"  vec2 offset = 2.0 * corner + " UNIF_SHADOW_RECT ".z - 1.0;\n"
+		"  for (int i = 0; i < 3; ++i) {\n"
+		// Clip against the face edges so nothing spills into neighbouring tiles
+		"   gl_ClipDistance[0] = c[i].w - c[i].x;\n"
+		"   gl_ClipDistance[1] = c[i].w + c[i].x;\n"
+		"   gl_ClipDistance[2] = c[i].w - c[i].y;\n"
+		"   gl_ClipDistance[3] = c[i].w + c[i].y;\n"
+		"   gl_Position = vec4(c[i].xy * " UNIF_SHADOW_RECT ".z + offset * c[i].w, c[i].zw);\n"
+		"   EmitVertex();\n"
+		"  }\n"
+		"  EndPrimitive();\n"
+		" }\n"
+		"}";
+static const char fragShader[] =
+		"#version 330\n"
+		// No gl_FragDepth write, so early-z stays enabled; ShadowMap sets
+		// up polygon offset for the bias.
+		"void main(void) {\n"
+		"}";
+
+CubeDepth::CubeDepth()
+{
+	// Try to create, compile, & link a GLSL program using the source
+	// you give it.
+	if ( !m_program.compile(vertShader, geomShader, fragShader) || isGLError() )
+	{
+		fprintf(stderr, "ERROR: CubeDepth failed to initialize\n");
+	}
+}
+
+void CubeDepth::initUniforms()
+{
+	// Make sure that every uniform that you are using in your shader
+	// is given a handle.
+	// variable names that do not correspond with a uniform will have
+	// been given the value -1
+	m_isReady =
+			(m_program.getUniformID(UNIFORM_MODELVIEW) >= 0) &&
+			(m_program.getUniformID(UNIFORM_PROJECTION) >= 0) &&
+			(m_program.getUniformID(UNIFORM_CUBE_FACE_MATS) >= 0) &&
+			(m_program.getUniformID(UNIFORM_SHADOW_RECT) >= 0) &&
+			(m_program.getUniformID(UNIFORM_CUBE_FACE_MASK) >= 0);
+}
+CubeDepth::~CubeDepth() {}
+
+
+bool CubeDepth::setUniforms(const GLProgUniforms &uniforms, const bool) const
+{
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+    m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+    m_program.setUniformMatrix4fv(UNIFORM_CUBE_FACE_MATS, 6, (GLfloat*)uniforms.m_cube_face_mats);
+    m_program.setUniform4fv(UNIFORM_SHADOW_RECT, (GLfloat*)&uniforms.m_shadowRect);
+    m_program.setUniform1i(UNIFORM_CUBE_FACE_MASK, uniforms.m_cube_face_mask);
+
+ 	return !isGLError();
+}
+
+}
+}
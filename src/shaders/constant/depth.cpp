@@ -51,10 +51,14 @@ Depth::Depth()
 {
 	// Try to create, compile, & link a GLSL program using the source
 	// you give it.
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Depth failed to initialize\n");
 	}
+}
+
+void Depth::initUniforms()
+{
 	// Make sure that every uniform that you are using in your shader
 	// is given a handle.
 	// variable names that do not correspond with a uniform will have
@@ -68,8 +72,8 @@ Depth::~Depth() {}
 
 bool Depth::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow) const
 {
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+    m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
 
  	return !isGLError();
 }
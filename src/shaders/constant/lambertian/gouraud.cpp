@@ -56,10 +56,14 @@ static const char fragShader[] =
 Gouraud::Gouraud()
 {
 	//printf("Vert shader:\n%s\n\nFrag shader:\n%s\n", vertShader, fragShader);
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Gouraud failed to initialize\n");
 	}
+}
+
+void Gouraud::initUniforms()
+{
 	m_isReady =
 			(m_program.getUniformID(UNIFORM_LIGHTPOS) >= 0) &&
 			(m_program.getUniformID(UNIFORM_LIGHTRAD) >= 0) &&
@@ -93,13 +97,13 @@ void Gouraud::bindGL(const bool useShadow) const
 
 bool Gouraud::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow) const
 {
-	glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTPOS), 1, (GLfloat*)&uniforms.m_lightPos);
-	glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTRAD), 1, (GLfloat*)&uniforms.m_lightRad);
-	glUniform3fv(m_program.getUniformID(UNIFORM_AMBIENT), 1, (GLfloat*)&uniforms.m_ambientRad);
-	glUniform3fv(m_program.getUniformID(UNIFORM_SURFREF), 1, (GLfloat*)&uniforms.m_surfRefl);
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_NORMALTRANS), 1, GL_FALSE, (GLfloat*)&uniforms.m_normalTrans);
+	m_program.setUniform3fv(UNIFORM_LIGHTPOS, (GLfloat*)&uniforms.m_lightPos);
+	m_program.setUniform3fv(UNIFORM_LIGHTRAD, (GLfloat*)&uniforms.m_lightRad);
+	m_program.setUniform3fv(UNIFORM_AMBIENT, (GLfloat*)&uniforms.m_ambientRad);
+	m_program.setUniform3fv(UNIFORM_SURFREF, (GLfloat*)&uniforms.m_surfRefl);
+	m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+	m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+	m_program.setUniformMatrix4fv(UNIFORM_NORMALTRANS, 1, (GLfloat*)&uniforms.m_normalTrans);
 
 	return !isGLError();
 }
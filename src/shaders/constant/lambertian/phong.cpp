@@ -86,10 +86,19 @@ static const char shadowFragShader[] =
 Phong::Phong()
 {
 	//printf("Vert shader:\n%s\n\nFrag shader:\n%s\n", vertShader, fragShader);
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Phong failed to initialize\n");
 	}
+	if ( !m_shadowProgram.compile(vertShader, NULL, shadowFragShader) || isGLError() )
+	{
+		fprintf(stderr, "ERROR: Phong-shadow failed to initialize\n");
+	}
+}
+
+void Phong::initUniforms()
+{
+	m_shadowProgram.setSampler(UNIFORM_SHADOWMAP, 1); // Shadow map on texture unit 1
 	m_isReady =
 			(m_program.getUniformID(UNIFORM_LIGHTPOS) >= 0) &&
 			(m_program.getUniformID(UNIFORM_LIGHTRAD) >= 0) &&
@@ -99,10 +108,6 @@ Phong::Phong()
 			(m_program.getUniformID(UNIFORM_PROJECTION) >= 0) &&
 			(m_program.getUniformID(UNIFORM_NORMALTRANS) >= 0);
 
-	if ( !m_shadowProgram.init(vertShader, shadowFragShader) || isGLError() )
-	{
-		fprintf(stderr, "ERROR: Phong-shadow failed to initialize\n");
-	}
 	m_isShadowReady =
 			(m_shadowProgram.getUniformID(UNIFORM_LIGHTPOS) >= 0) &&
 			(m_shadowProgram.getUniformID(UNIFORM_LIGHTRAD) >= 0) &&
@@ -128,24 +133,23 @@ bool Phong::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow)
 {
 	if (!usingShadow)
 	{
-		glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTPOS), 1, (GLfloat*)&uniforms.m_lightPos);
-		glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTRAD), 1, (GLfloat*)&uniforms.m_lightRad);
-		glUniform3fv(m_program.getUniformID(UNIFORM_AMBIENT), 1, (GLfloat*)&uniforms.m_ambientRad);
-		glUniform3fv(m_program.getUniformID(UNIFORM_SURFREF), 1, (GLfloat*)&uniforms.m_surfRefl);
-		glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-		glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-		glUniformMatrix4fv(m_program.getUniformID(UNIFORM_NORMALTRANS), 1, GL_FALSE, (GLfloat*)&uniforms.m_normalTrans);
+		m_program.setUniform3fv(UNIFORM_LIGHTPOS, (GLfloat*)&uniforms.m_lightPos);
+		m_program.setUniform3fv(UNIFORM_LIGHTRAD, (GLfloat*)&uniforms.m_lightRad);
+		m_program.setUniform3fv(UNIFORM_AMBIENT, (GLfloat*)&uniforms.m_ambientRad);
+		m_program.setUniform3fv(UNIFORM_SURFREF, (GLfloat*)&uniforms.m_surfRefl);
+		m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+		m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+		m_program.setUniformMatrix4fv(UNIFORM_NORMALTRANS, 1, (GLfloat*)&uniforms.m_normalTrans);
 	}
 	else
 	{
-		glUniform3fv(m_shadowProgram.getUniformID(UNIFORM_LIGHTPOS), 1, (GLfloat*)&uniforms.m_lightPos);
-		glUniform3fv(m_shadowProgram.getUniformID(UNIFORM_LIGHTRAD), 1, (GLfloat*)&uniforms.m_lightRad);
-		glUniform3fv(m_shadowProgram.getUniformID(UNIFORM_AMBIENT), 1, (GLfloat*)&uniforms.m_ambientRad);
-		glUniform3fv(m_shadowProgram.getUniformID(UNIFORM_SURFREF), 1, (GLfloat*)&uniforms.m_surfRefl);
-		glUniformMatrix4fv(m_shadowProgram.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-		glUniformMatrix4fv(m_shadowProgram.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-		glUniformMatrix4fv(m_shadowProgram.getUniformID(UNIFORM_NORMALTRANS), 1, GL_FALSE, (GLfloat*)&uniforms.m_normalTrans);
-		glUniform1i(m_shadowProgram.getUniformID(UNIFORM_SHADOWMAP), 1); // Shadow map on texture unit 1
+		m_shadowProgram.setUniform3fv(UNIFORM_LIGHTPOS, (GLfloat*)&uniforms.m_lightPos);
+		m_shadowProgram.setUniform3fv(UNIFORM_LIGHTRAD, (GLfloat*)&uniforms.m_lightRad);
+		m_shadowProgram.setUniform3fv(UNIFORM_AMBIENT, (GLfloat*)&uniforms.m_ambientRad);
+		m_shadowProgram.setUniform3fv(UNIFORM_SURFREF, (GLfloat*)&uniforms.m_surfRefl);
+		m_shadowProgram.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+		m_shadowProgram.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+		m_shadowProgram.setUniformMatrix4fv(UNIFORM_NORMALTRANS, 1, (GLfloat*)&uniforms.m_normalTrans);
 	}
 	return !isGLError();
 }
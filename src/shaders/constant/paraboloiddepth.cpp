@@ -0,0 +1,74 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <gl3/gl3w.h>
+#include <cstdio>
+
+#include <shaders/constant/paraboloiddepth.h>
+#include <glUtils.h>
+#include <shadowmap.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+static const char vertShader[] =
+		"#version 330\n"
+		"uniform mat4 " UNIF_MODELVIEW ";\n"
+		"layout (location=0) in vec3 position;\n"
+		"void main(void) {\n"
+		" vec3 v = (" UNIF_MODELVIEW " * vec4(position, 1.0)).xyz;\n"
+		" float d = length(v);\n"
+		" vec3 n = v / max(d, 1.0e-6);\n"
+		// Whatever is behind the hemisphere belongs to the other one
+		" gl_ClipDistance[0] = -n.z;\n"
+		// The rim of the hemisphere lands on the unit circle
+		" gl_Position = vec4(n.xy / max(1.0 - n.z, 1.0e-4), 2.0 * d / " SHADOWMAP_FAR_STR " - 1.0, 1.0);\n"
+		"}";
+static const char fragShader[] =
+		"#version 330\n"
+		// No gl_FragDepth write, so early-z stays enabled; ShadowMap sets
+		// up polygon offset for the bias.
+		"void main(void) {\n"
+		"}";
+
+ParaboloidDepth::ParaboloidDepth()
+{
+	// Try to create, compile, & link a GLSL program using the source
+	// you give it.
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
+	{
+		fprintf(stderr, "ERROR: ParaboloidDepth failed to initialize\n");
+	}
+}
+
+void ParaboloidDepth::initUniforms()
+{
+	// Make sure that every uniform that you are using in your shader
+	// is given a handle.
+	// variable names that do not correspond with a uniform will have
+	// been given the value -1
+	m_isReady =
+			(m_program.getUniformID(UNIFORM_MODELVIEW) >= 0);
+}
+ParaboloidDepth::~ParaboloidDepth() {}
+
+
+bool ParaboloidDepth::setUniforms(const GLProgUniforms &uniforms, const bool) const
+{
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+
+ 	return !isGLError();
+}
+
+}
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <gl3/gl3w.h>
+#include <cstdio>
+
+#include <shaders/constant/shadowblur.h>
+#include <glUtils.h>
+
+namespace Shader
+{
+namespace Constant
+{
+
+static const char vertShader[] =
+		"#version 330\n"
+		"void main(void) {\n"
+		// One triangle that covers the whole viewport
+		" vec2 p = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);\n"
+		" gl_Position = vec4(p, 0.0, 1.0);\n"
+		"}";
+static const char fragShader[] =
+		"#version 330\n"
+		"uniform sampler2D " UNIF_TEXTURE0 ";\n"
+		"uniform sampler2DArray " UNIF_SHADOWMAP ";\n"
+		"uniform ivec4 " UNIF_BLUR_SRC_RECT ";\n"
+		"uniform ivec2 " UNIF_BLUR_DST_ORIGIN ";\n"
+		"uniform ivec2 " UNIF_BLUR_STEP ";\n"
+		"uniform int " UNIF_BLUR_LAYER ";\n"
+		"uniform float " UNIF_BLUR_EXPONENT ";\n"
+		"uniform vec2 " UNIF_BLUR_DEPTH_RANGE ";\n"
+		"out vec4 FragColor;\n"
+		// 7-tap binomial kernel
+		"const float Weights[4] = float[4](20.0 / 64.0, 15.0 / 64.0, 6.0 / 64.0, 1.0 / 64.0);\n"
+		// Reads never leave the source region, so neighbouring cube faces
+		// and atlas tiles do not bleed into each other.
+		"float fetch(ivec2 p) {\n"
+		"	p = clamp(p, " UNIF_BLUR_SRC_RECT ".xy, " UNIF_BLUR_SRC_RECT ".xy + " UNIF_BLUR_SRC_RECT ".zw - 1);\n"
+		"	float d = (" UNIF_BLUR_LAYER " < 0) ? texelFetch(" UNIF_TEXTURE0 ", p, 0).r\n"
+		"		: texelFetch(" UNIF_SHADOWMAP ", ivec3(p, " UNIF_BLUR_LAYER "), 0).r;\n"
+		"	if (" UNIF_BLUR_EXPONENT " <= 0.0) return d;\n"
+		// Perspective depth -> view depth / far
+		"	float n = " UNIF_BLUR_DEPTH_RANGE ".x, f = " UNIF_BLUR_DEPTH_RANGE ".y;\n"
+		"	if (n > 0.0) d = 2.0 * n / (f + n - (2.0 * d - 1.0) * (f - n));\n"
+		"	return exp(" UNIF_BLUR_EXPONENT " * d);\n"
+		"}\n"
+		"void main(void) {\n"
+		" ivec2 p = " UNIF_BLUR_SRC_RECT ".xy + ivec2(gl_FragCoord.xy) - " UNIF_BLUR_DST_ORIGIN ";\n"
+		" float sum = Weights[0] * fetch(p);\n"
+		" for (int i = 1; i < 4; ++i)\n"
+		"  sum += Weights[i] * (fetch(p + i * " UNIF_BLUR_STEP ") + fetch(p - i * " UNIF_BLUR_STEP "));\n"
+		" FragColor = vec4(sum);\n"
+		"}";
+
+ShadowBlur::ShadowBlur()
+{
+	// Try to create, compile, & link a GLSL program using the source
+	// you give it.
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
+	{
+		fprintf(stderr, "ERROR: ShadowBlur failed to initialize\n");
+	}
+}
+
+void ShadowBlur::initUniforms()
+{
+	// Make sure that every uniform that you are using in your shader
+	// is given a handle.
+	// variable names that do not correspond with a uniform will have
+	// been given the value -1
+	m_isReady =
+			(m_program.getUniformID(UNIFORM_TEXTURE0) >= 0) &&
+			(m_program.getUniformID(UNIFORM_SHADOWMAP) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_SRC_RECT) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_DST_ORIGIN) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_STEP) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_LAYER) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_EXPONENT) >= 0) &&
+			(m_program.getUniformID(UNIFORM_BLUR_DEPTH_RANGE) >= 0);
+}
+ShadowBlur::~ShadowBlur() {}
+
+
+bool ShadowBlur::setUniforms(const GLProgUniforms &uniforms, const bool) const
+{
+	// The samplers keep the units GLProgram::init() gave them: the 2D
+	// source on unit 0, the array source on unit 3.
+    m_program.setUniform4iv(UNIFORM_BLUR_SRC_RECT, uniforms.m_blur_src_rect);
+    m_program.setUniform2iv(UNIFORM_BLUR_DST_ORIGIN, uniforms.m_blur_dst_origin);
+    m_program.setUniform2iv(UNIFORM_BLUR_STEP, uniforms.m_blur_step);
+    m_program.setUniform1i(UNIFORM_BLUR_LAYER, uniforms.m_blur_layer);
+    m_program.setUniform1f(UNIFORM_BLUR_EXPONENT, uniforms.m_blur_exponent);
+    m_program.setUniform2fv(UNIFORM_BLUR_DEPTH_RANGE, (GLfloat*)&uniforms.m_blur_depth_range);
+
+ 	return !isGLError();
+}
+
+}
+}
@@ -55,10 +55,14 @@ Simple::Simple()
 {
 	// Try to create, compile, & link a GLSL program using the source
 	// you give it.
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Simple failed to initialize\n");
 	}
+}
+
+void Simple::initUniforms()
+{
 	// Make sure that every uniform that you are using in your shader
 	// is given a handle.
 	// variable names that do not correspond with a uniform will have
@@ -75,8 +79,9 @@ bool Simple::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow)
 	// This gets the values for the GLSL shader uniforms from 'uniforms' and
 	// sets the program to use them.
 	//
-	// Different types of uniforms have different glUniform* functions to
-	// be able to set their values.
+	// Different types of uniforms have different GLProgram::setUniform*
+	// functions to be able to set their values; each one only uploads a
+	// value that differs from the last one.
 	//
 	// Note: OpenGL wants data for matrix uniforms supplied as an array in column-major
 	//  order. All of the matrix types in the supplied gml are stored in column-major
@@ -84,8 +89,8 @@ bool Simple::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow)
 	//  and pass the typecast pointer for the matrix data.
 	//  This isn't demonstrated here, but you will need to know it when you
 	//  implement your geometry transforms.
-	glUniform3fv(m_program.getUniformID(UNIFORM_AMBIENT), 1, (GLfloat*)&uniforms.m_ambientRad);
-    glUniform3fv(m_program.getUniformID(UNIFORM_SURFREF), 1, (GLfloat*)&uniforms.m_surfRefl);
+	m_program.setUniform3fv(UNIFORM_AMBIENT, (GLfloat*)&uniforms.m_ambientRad);
+    m_program.setUniform3fv(UNIFORM_SURFREF, (GLfloat*)&uniforms.m_surfRefl);
 
  	return !isGLError();
 }
@@ -16,8 +16,7 @@
 #include <shaders/deferred/directionallightpass.h>
 #include <glUtils.h>
 #include <config.h>
-
-//#undef DO_SHADOW
+#include <shadowfilter.h>
 
 namespace Shader
 {
@@ -42,11 +41,50 @@ static const char fragShader[] =
 		"uniform sampler2D " UNIF_DS_POSTEX ";\n"
 		"uniform sampler2D " UNIF_DS_DIFFTEX ";\n"
 		"uniform sampler2D " UNIF_DS_NORMTEX ";\n"
-#if defined (DO_SHADOW)
-		"uniform sampler2DShadow " UNIF_SHADOWMAP ";\n"
-		"uniform mat4 " UNIF_DS_LIGHT_PROJMAT ";\n"
-#endif
+		"#if defined (DO_SHADOW)\n"
+		"uniform sampler2DArrayShadow " UNIF_SHADOWMAP ";\n"
+		"uniform mat4 " UNIF_DS_CASCADE_MATS "[" SHADOW_NUM_CASCADES_STR "];\n"
+		"uniform vec4 " UNIF_DS_CASCADE_SPLITS ";\n"
+		"uniform sampler2DArray " UNIF_SHADOW_ESM ";\n"
+		"uniform int " UNIF_SHADOW_FILTER ";\n"
+		"#endif\n"
 		"out vec4 FragColor;\n"
+
+		"#if defined (DO_SHADOW)\n"
+		SHADOW_FILTER_GLSL
+		"const int NumCascades = " SHADOW_NUM_CASCADES_STR ";\n"
+		// Fraction of each cascade, at its far end, that is blended into
+		// the next cascade to hide the seam.
+		"const float CascadeBlend = 0.1f;\n"
+		"float cascadeLookup(int cascade, vec3 ViewPos) {\n"
+		"	vec4 coord = " UNIF_DS_CASCADE_MATS "[cascade] * vec4(ViewPos, 1.0f);\n"
+		"	if (" UNIF_SHADOW_FILTER " == " SHADOW_FILTER_ESM_STR ") {\n"
+		"		float occluder = texture(" UNIF_SHADOW_ESM ", vec3(coord.xy, float(cascade))).r;\n"
+		"		return clamp(occluder * exp(-" SHADOW_ESM_EXPONENT_STR " * coord.z), 0.0, 1.0);\n"
+		"	}\n"
+		"	if (" UNIF_SHADOW_FILTER " == " SHADOW_FILTER_POISSON_STR ") {\n"
+		"		mat2 rot = poissonRotation() * (" SHADOW_PCF_RADIUS_STR " / float(textureSize(" UNIF_SHADOWMAP ", 0).x));\n"
+		"		float sum = 0.0;\n"
+		"		for (int i = 0; i < PoissonTaps; ++i)\n"
+		"			sum += texture(" UNIF_SHADOWMAP ", vec4(coord.xy + rot * PoissonDisk[i], float(cascade), coord.z));\n"
+		"		return sum / float(PoissonTaps);\n"
+		"	}\n"
+		"	return texture(" UNIF_SHADOWMAP ", vec4(coord.xy, float(cascade), coord.z));\n"
+		"}\n"
+		"float cascadeShadow(vec3 ViewPos) {\n"
+		"	float depth = -ViewPos.z;\n"
+		"	int cascade = 0;\n"
+		"	while (cascade < NumCascades && depth > " UNIF_DS_CASCADE_SPLITS "[cascade]) ++cascade;\n"
+		"	if (cascade == NumCascades) return 1.0f;\n"	// beyond the last cascade
+		"	float notShadow = cascadeLookup(cascade, ViewPos);\n"
+		"	float splitNear = (cascade == 0) ? 0.0f : " UNIF_DS_CASCADE_SPLITS "[cascade - 1];\n"
+		"	float blendStart = mix(" UNIF_DS_CASCADE_SPLITS "[cascade], splitNear, CascadeBlend);\n"
+		"	if (cascade + 1 < NumCascades && depth > blendStart)\n"
+		"		notShadow = mix(notShadow, cascadeLookup(cascade + 1, ViewPos),\n"
+		"			(depth - blendStart) / (" UNIF_DS_CASCADE_SPLITS "[cascade] - blendStart));\n"
+		"	return notShadow;\n"
+		"}\n"
+		"#endif\n"
 		"void main(void) {\n"
 			"vec2 TexCoord = gl_FragCoord.xy / " UNIF_DS_SCREENSIZE ";\n"
 			"vec3 WorldPos = texture(" UNIF_DS_POSTEX ", TexCoord).xyz;\n"
@@ -56,14 +94,12 @@ static const char fragShader[] =
 			// Lighting Internals
 			"vec4 AmbientColor = vec4(" UNIF_LIGHTRAD ", 1.0f) * " UNIF_DS_AMBIENTINTENCITY ";\n"
 
-#if defined (DO_SHADOW)
-			"vec4 shadowtexcoord = " UNIF_DS_LIGHT_PROJMAT " * vec4(WorldPos, 1.0f);\n"
-			"shadowtexcoord /= shadowtexcoord.w;\n"
-			"float notShadow = texture(" UNIF_SHADOWMAP ", shadowtexcoord.xyz);\n"
+		"#if defined (DO_SHADOW)\n"
+			"float notShadow = cascadeShadow(WorldPos);\n"
 			"float DiffuseFactor = notShadow * dot(Normal, -" UNIF_DS_DLDIRECTION ");\n"
-#else
+		"#else\n"
 			"float DiffuseFactor = dot(Normal, -" UNIF_DS_DLDIRECTION ");\n"
-#endif
+		"#endif\n"
 			"vec4 DiffuseColor  = vec4(0, 0, 0, 0);\n"
 			"vec4 SpecularColor = vec4(0, 0, 0, 0);\n"
 
@@ -78,11 +114,11 @@ static const char fragShader[] =
 
 				"vec3 LightReflect = normalize(reflect(" UNIF_DS_DLDIRECTION ", Normal));\n"
 				"float SpecularFactor = dot(VertexToEye, LightReflect);\n"
-#if defined (DO_SHADOW)
+		"#if defined (DO_SHADOW)\n"
 				"SpecularFactor = notShadow * pow(SpecularFactor, gSpecularPower);\n"
-#else
+		"#else\n"
 				"SpecularFactor = pow(SpecularFactor, gSpecularPower);\n"
-#endif
+		"#endif\n"
 				"if (SpecularFactor > 0) {\n"
 					"SpecularColor = vec4(" UNIF_LIGHTRAD ", 1.0f) * gMatSpecularIntensity * SpecularFactor;\n"
 				"}\n"
@@ -92,14 +128,19 @@ static const char fragShader[] =
 			"FragColor = vec4(Color, 1.0) * (AmbientColor + DiffuseColor + SpecularColor);\n"
 		"}";
 
-DirectionalLightPass::DirectionalLightPass()
+DirectionalLightPass::DirectionalLightPass(unsigned int features)
 {
+	m_features = features;
 	// Try to create, compile, & link a GLSL program using the source
 	// you give it.
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader, features) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Depth failed to initialize\n");
 	}
+}
+
+void DirectionalLightPass::initUniforms()
+{
 	// Make sure that every uniform that you are using in your shader
 	// is given a handle.
 	// variable names that do not correspond with a uniform will have
@@ -114,12 +155,16 @@ DirectionalLightPass::DirectionalLightPass()
 			(m_program.getUniformID(UNIFORM_DS_SCREENSIZE) >= 0) &&
 			(m_program.getUniformID(UNIFORM_DS_POSTEX) >= 0) &&
 			(m_program.getUniformID(UNIFORM_DS_DIFFTEX) >= 0) &&
-			(m_program.getUniformID(UNIFORM_DS_NORMTEX) >= 0)
-#if defined (DO_SHADOW)
-			&& (m_program.getUniformID(UNIFORM_SHADOWMAP) >= 0)
-			&& (m_program.getUniformID(UNIFORM_DS_LIGHT_PROJMAT) >= 0)
-#endif
-			;
+			(m_program.getUniformID(UNIFORM_DS_NORMTEX) >= 0);
+	if (m_features & SHADER_FEATURE_SHADOW)
+	{
+		m_isReady = m_isReady &&
+				(m_program.getUniformID(UNIFORM_SHADOWMAP) >= 0) &&
+				(m_program.getUniformID(UNIFORM_DS_CASCADE_MATS) >= 0) &&
+				(m_program.getUniformID(UNIFORM_DS_CASCADE_SPLITS) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_ESM) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_FILTER) >= 0);
+	}
 }
 
 DirectionalLightPass::~DirectionalLightPass() {}
@@ -127,20 +172,19 @@ DirectionalLightPass::~DirectionalLightPass() {}
 
 bool DirectionalLightPass::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow) const
 {
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-	glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTRAD), 1, (GLfloat*)&uniforms.m_lightRad);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_AMBIENTINTENCITY), uniforms.m_ds_AmbientIntensity);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_DIFFUSEINTENSITY), uniforms.m_ds_DiffuseIntensity);
-	glUniform3fv(m_program.getUniformID(UNIFORM_DS_DLDIRECTION), 1, (GLfloat*)&uniforms.m_ds_DirectionalLightDirection);
-    glUniform2fv(m_program.getUniformID(UNIFORM_DS_SCREENSIZE), 1, (GLfloat*)&uniforms.m_ds_ScreenSize);
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_POSTEX), 0);
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_DIFFTEX), 1);
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_NORMTEX), 2);
-#if defined (DO_SHADOW)
-	glUniform1i(m_program.getUniformID(UNIFORM_SHADOWMAP), 3);
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_DS_LIGHT_PROJMAT), 1, GL_FALSE, (GLfloat*)&uniforms.m_ds_light_projection_mat);
-#endif
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+    m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+	m_program.setUniform3fv(UNIFORM_LIGHTRAD, (GLfloat*)&uniforms.m_lightRad);
+	m_program.setUniform1f(UNIFORM_DS_AMBIENTINTENCITY, uniforms.m_ds_AmbientIntensity);
+	m_program.setUniform1f(UNIFORM_DS_DIFFUSEINTENSITY, uniforms.m_ds_DiffuseIntensity);
+	m_program.setUniform3fv(UNIFORM_DS_DLDIRECTION, (GLfloat*)&uniforms.m_ds_DirectionalLightDirection);
+    m_program.setUniform2fv(UNIFORM_DS_SCREENSIZE, (GLfloat*)&uniforms.m_ds_ScreenSize);
+	if (m_features & SHADER_FEATURE_SHADOW)
+	{
+		m_program.setUniformMatrix4fv(UNIFORM_DS_CASCADE_MATS, SHADOW_NUM_CASCADES, (GLfloat*)uniforms.m_ds_cascade_mats);
+		m_program.setUniform4fv(UNIFORM_DS_CASCADE_SPLITS, (GLfloat*)&uniforms.m_ds_cascade_splits);
+		m_program.setUniform1i(UNIFORM_SHADOW_FILTER, uniforms.m_shadowFilter);
+	}
 
  	return !isGLError();
 }
@@ -42,16 +42,22 @@ static const char vertShader[] =
 static const char fragShader[] =
 		"#version 330\n"
 		"uniform sampler2D " UNIF_TEXTURE0 ";\n"
-		"in vec3 o_position;\n"
-		"in vec2 o_texCoord;\n"
-		"in vec3 o_normal;\n"
+		// Textures packed into arrays are sampled from their layer
+		"uniform sampler2DArray " UNIF_TEXTURE_ARRAY ";\n"
+		"uniform int " UNIF_TEXTURE_LAYER ";\n"
+		"smooth in vec3 o_position;\n"
+		"smooth in vec2 o_texCoord;\n"
+		"smooth in vec3 o_normal;\n"
 		"out vec3 Position;\n"
 		"out vec3 Diffuse;\n"
 		"out vec3 Normal;\n"
 		"out vec3 TexCoord;\n"
 		"void main(void) {\n"
 		" Position = o_position;\n"
-		" Diffuse = texture(" UNIF_TEXTURE0 ", o_texCoord).xyz;\n"
+		" if (" UNIF_TEXTURE_LAYER " < 0)\n"
+		"  Diffuse = texture(" UNIF_TEXTURE0 ", o_texCoord).xyz;\n"
+		" else\n"
+		"  Diffuse = texture(" UNIF_TEXTURE_ARRAY ", vec3(o_texCoord, " UNIF_TEXTURE_LAYER ")).xyz;\n"
 		" Normal = normalize(o_normal);\n"
 		" TexCoord = vec3(o_texCoord, 0.0).xyz;\n"
 		"}";
@@ -60,10 +66,14 @@ GeometryPass::GeometryPass()
 {
 	// Try to create, compile, & link a GLSL program using the source
 	// you give it.
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Depth failed to initialize\n");
 	}
+}
+
+void GeometryPass::initUniforms()
+{
 	// Make sure that every uniform that you are using in your shader
 	// is given a handle.
 	// variable names that do not correspond with a uniform will have
@@ -72,17 +82,19 @@ GeometryPass::GeometryPass()
 			(m_program.getUniformID(UNIFORM_MODELVIEW) >= 0) &&
 			(m_program.getUniformID(UNIFORM_PROJECTION) >= 0) &&
 			(m_program.getUniformID(UNIFORM_NORMALTRANS) >= 0) &&
-			(m_program.getUniformID(UNIFORM_TEXTURE0) >= 0);
+			(m_program.getUniformID(UNIFORM_TEXTURE0) >= 0) &&
+			(m_program.getUniformID(UNIFORM_TEXTURE_ARRAY) >= 0) &&
+			(m_program.getUniformID(UNIFORM_TEXTURE_LAYER) >= 0);
 }
 GeometryPass::~GeometryPass() {}
 
 
 bool GeometryPass::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow) const
 {
-	glUniform1i(m_program.getUniformID(UNIFORM_TEXTURE0), 0);
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-    glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_NORMALTRANS), 1, GL_FALSE, (GLfloat*)&uniforms.m_normalTrans);
+    m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+    m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+	m_program.setUniformMatrix4fv(UNIFORM_NORMALTRANS, 1, (GLfloat*)&uniforms.m_normalTrans);
+	m_program.setUniform1i(UNIFORM_TEXTURE_LAYER, uniforms.m_textureLayer);
 
  	return !isGLError();
 }
@@ -16,8 +16,8 @@
 #include <shaders/deferred/pointlightpass.h>
 #include <glUtils.h>
 #include <config.h>
-
-#undef	DO_SHADOW
+#include <shadowmap.h>
+#include <shadowfilter.h>
 
 namespace Shader
 {
@@ -45,22 +45,110 @@ static const char fragShader[] =
 		"uniform sampler2D " UNIF_DS_POSTEX ";\n"
 		"uniform sampler2D " UNIF_DS_DIFFTEX ";\n"
 		"uniform sampler2D " UNIF_DS_NORMTEX ";\n"
-#if defined (DO_SHADOW)
-		"uniform samplerCubeShadow " UNIF_SHADOWMAP ";\n"
-#endif
+		"#if defined (DO_SHADOW)\n"
+		"uniform sampler2DShadow " UNIF_SHADOWMAP ";\n"
+		"uniform mat4 " UNIF_CUBE_FACE_MATS "[6];\n"
+		"uniform vec4 " UNIF_SHADOW_RECT ";\n"
+		"uniform sampler2D " UNIF_SHADOW_ESM ";\n"
+		"uniform int " UNIF_SHADOW_FILTER ";\n"
+		"uniform int " UNIF_SHADOW_PARABOLOID ";\n"
+		"#endif\n"
+		"#if defined (DO_CONTACT_SHADOW)\n"
+		"uniform mat4 " UNIF_PROJECTION ";\n"
+		"uniform int " UNIF_CONTACT_SHADOW ";\n"
+		"#endif\n"
 		"out vec4 FragColor;\n"
 
-#if defined (DO_SHADOW)
-#if defined (DO_SMOOTH_SHADOW)
-		// The following function can be used to do a projected texture map read
-		// with an offset given in texel units. The variable texmapscale is a 
-		// float2 containing 1/width and 1/height of the shadow map		
-		"float offset_lookup(samplerCubeShadow map, vec4 loc, vec2 offset) {\n"
-		"	float threshold = 0.001f;\n"	// texmapscale
-		"	return texture(map, vec4(loc.xy + offset * vec2(threshold, threshold) * loc.w, loc.z, loc.w));\n"
+		"#if defined (DO_SHADOW)\n"
+		SHADOW_FILTER_GLSL
+		// Cube faces live in a 3 x 2 block of the shadow atlas. The faces
+		// are fixed in world space; the one to read is the one the surface
+		// is furthest in front of, i.e. with the largest clip w. Project
+		// into it and compare against the depth the face stores, which is
+		// the face's own projected depth. Faces may be refreshed on
+		// different frames (see ShadowAtlas); their matrices keep the light
+		// where it was when they were rendered, so the compare holds.
+		// Exponential maps store linear depth along the face axis, i.e. w.
+		// Dual-paraboloid shadows have two faces side by side, the
+		// hemispheres in front of and behind the light. Their matrices
+		// lead to hemisphere space, where the paraboloid projection gives
+		// the texture coordinates, and the faces store the distance to the
+		// light over the far plane.
+		"float pointShadow(vec3 WorldPos) {\n"
+		"	if (" UNIF_SHADOW_RECT ".z <= 0.0) return 1.0;\n" // no tile this frame
+		"	int face = 0;\n"
+		"	vec2 uv;\n"
+		"	float ref;\n"
+		"	float lin;\n"
+		"	if (" UNIF_SHADOW_PARABOLOID " != 0) {\n"
+		"		if ((" UNIF_CUBE_FACE_MATS "[0] * vec4(WorldPos, 1.0)).z > 0.0) face = 1;\n"
+		"		vec3 v = (" UNIF_CUBE_FACE_MATS "[face] * vec4(WorldPos, 1.0)).xyz;\n"
+		"		vec3 n = normalize(v);\n"
+		"		uv = 0.5 * n.xy / (1.0 - n.z) + 0.5;\n"
+		"		ref = length(v) / " SHADOWMAP_FAR_STR ";\n"
+		"		lin = ref;\n"
+		"	} else {\n"
+		"		float best = -1.0e30;\n"
+		"		for (int i = 0; i < 6; ++i) {\n"
+		"			mat4 m = " UNIF_CUBE_FACE_MATS "[i];\n"
+		"			float w = dot(vec4(m[0][3], m[1][3], m[2][3], m[3][3]), vec4(WorldPos, 1.0));\n"
+		"			if (w > best) { best = w; face = i; }\n"
+		"		}\n"
+		"		vec4 p = " UNIF_CUBE_FACE_MATS "[face] * vec4(WorldPos, 1.0);\n"
+		"		uv = p.xy / p.w;\n"
+		"		ref = p.z / p.w;\n"
+		"		lin = p.w / " SHADOWMAP_FAR_STR ";\n"
+		"	}\n"
+		// Every tap stays half a texel inside the face, so the bilinear
+		// footprint never reaches a neighbouring face or tile.
+		"	vec2 lo = vec2(0.5 * " UNIF_SHADOW_RECT ".w);\n"
+		"	vec2 hi = vec2(1.0) - lo;\n"
+		"	vec2 base = " UNIF_SHADOW_RECT ".xy + vec2(face % 3, face / 3) * " UNIF_SHADOW_RECT ".z;\n"
+		"	if (" UNIF_SHADOW_FILTER " == " SHADOW_FILTER_ESM_STR ") {\n"
+		"		float occluder = texture(" UNIF_SHADOW_ESM ", base + clamp(uv, lo, hi) * " UNIF_SHADOW_RECT ".z).r;\n"
+		"		return clamp(occluder * exp(-" SHADOW_ESM_EXPONENT_STR " * lin), 0.0, 1.0);\n"
+		"	}\n"
+		"	if (" UNIF_SHADOW_FILTER " == " SHADOW_FILTER_POISSON_STR ") {\n"
+		// The disk is measured in texels of the face itself, whatever the
+		// size of the tile.
+		"		mat2 rot = poissonRotation();\n"
+		"		float sum = 0.0;\n"
+		"		for (int i = 0; i < PoissonTaps; ++i) {\n"
+		"			vec2 o = rot * PoissonDisk[i] * (" SHADOW_PCF_RADIUS_STR " * " UNIF_SHADOW_RECT ".w);\n"
+		"			sum += texture(" UNIF_SHADOWMAP ", vec3(base + clamp(uv + o, lo, hi) * " UNIF_SHADOW_RECT ".z, ref));\n"
+		"		}\n"
+		"		return sum / float(PoissonTaps);\n"
+		"	}\n"
+		"	return texture(" UNIF_SHADOWMAP ", vec3(base + clamp(uv, lo, hi) * " UNIF_SHADOW_RECT ".z, ref));\n"
+		"}\n"
+		"#endif\n"
+
+		"#if defined (DO_CONTACT_SHADOW)\n"
+		// March a short way from the surface towards the light, projecting
+		// each step onto the screen. The ray is blocked where it passes
+		// just behind what the G-buffer holds at its pixel; anything much
+		// further in front is taken to be a separate object, not a blocker.
+		// The start is nudged off the surface along the normal, and
+		// jittered per pixel to hide the banding of the few steps.
+		"float screenSpaceShadow(vec3 WorldPos, vec3 Normal) {\n"
+		"	vec3 toLight = " UNIF_LIGHTPOS " - WorldPos;\n"
+		"	float len = min(" CONTACT_SHADOW_LENGTH_STR ", length(toLight));\n"
+		"	vec3 stp = normalize(toLight) * (len / " CONTACT_SHADOW_STEPS_STR ".0);\n"
+		"	float jitter = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));\n"
+		"	vec3 p = WorldPos + Normal * 0.02 + stp * jitter;\n"
+		"	for (int i = 0; i < " CONTACT_SHADOW_STEPS_STR "; ++i) {\n"
+		"		p += stp;\n"
+		"		vec4 c = " UNIF_PROJECTION " * vec4(p, 1.0);\n"
+		"		vec2 uv = 0.5 * c.xy / c.w + 0.5;\n"
+		"		if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) break;\n"
+		"		float z = texture(" UNIF_DS_POSTEX ", uv).z;\n"
+		"		if (z >= 0.0) continue;\n" // background
+		"		float d = z - p.z;\n"
+		"		if (d > 0.01 && d < " CONTACT_SHADOW_THICKNESS_STR ") return 0.0;\n"
+		"	}\n"
+		"	return 1.0;\n"
 		"}\n"
-#endif
-#endif
+		"#endif\n"
 
 		"void main(void) {\n"
 			"vec2 TexCoord = gl_FragCoord.xy / " UNIF_DS_SCREENSIZE ";\n"
@@ -73,26 +161,17 @@ static const char fragShader[] =
 			"float Distance = length(LightDirection);\n"
 			"LightDirection = normalize(LightDirection);\n"
 
-#if defined (DO_SHADOW)
-#if defined (DO_SMOOTH_SHADOW)
-			"float sum = 0;\n"
-			"float x, y;\n"
-			"float resolution = 1.5;"	// default: 1.5
-			" for (y = -resolution; y <= resolution; y += 1.0)\n"
-			"	for (x = -resolution; x <= resolution; x += 1.0)\n"
-			"		sum += offset_lookup(" UNIF_SHADOWMAP ", vec4(LightDirection, Distance), vec2(x, y));\n"
-			" float notShadow = sum / 16.0f;\n"
-#else
-			" float notShadow = texture(" UNIF_SHADOWMAP ", vec4(LightDirection, Distance));\n"
-#endif
-#endif
+		"#if defined (DO_SHADOW)\n"
+			" float notShadow = pointShadow(WorldPos);\n"
+		"#else\n"
+			" float notShadow = 1.0;\n"
+		"#endif\n"
+		"#if defined (DO_CONTACT_SHADOW)\n"
+			" if (" UNIF_CONTACT_SHADOW " != 0) notShadow *= screenSpaceShadow(WorldPos, Normal);\n"
+		"#endif\n"
 			// Lighting Internals
 			"vec4 AmbientColor = vec4(" UNIF_LIGHTRAD ", 1.0f) * " UNIF_DS_AMBIENTINTENCITY ";\n"
-#if defined (DO_SHADOW)
 			"float DiffuseFactor = notShadow * dot(Normal, -LightDirection);\n"
-#else
-			"float DiffuseFactor = dot(Normal, -LightDirection);\n"
-#endif
 			"vec4 DiffuseColor  = vec4(0, 0, 0, 0);\n"
 			"vec4 SpecularColor = vec4(0, 0, 0, 0);\n"
 
@@ -107,11 +186,7 @@ static const char fragShader[] =
 				
 				"vec3 LightReflect = normalize(reflect(LightDirection, Normal));\n"
 				"float SpecularFactor = dot(VertexToEye, LightReflect);\n"
-#if defined (DO_SHADOW)
 				"SpecularFactor = notShadow * pow(SpecularFactor, gSpecularPower);\n"
-#else
-				"SpecularFactor = pow(SpecularFactor, gSpecularPower);\n"
-#endif
 				"if (SpecularFactor > 0) {\n"
 					"SpecularColor = vec4(" UNIF_LIGHTRAD ", 1.0f) * gMatSpecularIntensity * SpecularFactor;\n"
 				"}\n"
@@ -126,14 +201,19 @@ static const char fragShader[] =
 			"FragColor = vec4(Color, 1.0) * (_color / Attenuation);\n"
 		"}";
 
-PointLightPass::PointLightPass()
+PointLightPass::PointLightPass(unsigned int features)
 {
+	m_features = features;
 	// Try to create, compile, & link a GLSL program using the source
 	// you give it.
-	if ( !m_program.init(vertShader, fragShader) || isGLError() )
+	if ( !m_program.compile(vertShader, NULL, fragShader, features) || isGLError() )
 	{
 		fprintf(stderr, "ERROR: Depth failed to initialize\n");
 	}
+}
+
+void PointLightPass::initUniforms()
+{
 	// Make sure that every uniform that you are using in your shader
 	// is given a handle.
 	// variable names that do not correspond with a uniform will have
@@ -151,33 +231,48 @@ PointLightPass::PointLightPass()
 			(m_program.getUniformID(UNIFORM_DS_POSTEX) >= 0) &&
 			(m_program.getUniformID(UNIFORM_DS_DIFFTEX) >= 0) &&
 			(m_program.getUniformID(UNIFORM_DS_NORMTEX) >= 0) &&
-			(m_program.getUniformID(UNIFORM_DS_SCREENSIZE) >= 0)
-#if defined (DO_SHADOW)
-			&& (m_program.getUniformID(UNIFORM_SHADOWMAP) >= 0)
-#endif
-			;
+			(m_program.getUniformID(UNIFORM_DS_SCREENSIZE) >= 0);
+	if (m_features & SHADER_FEATURE_SHADOW)
+	{
+		m_isReady = m_isReady &&
+				(m_program.getUniformID(UNIFORM_SHADOWMAP) >= 0) &&
+				(m_program.getUniformID(UNIFORM_CUBE_FACE_MATS) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_RECT) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_ESM) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_FILTER) >= 0) &&
+				(m_program.getUniformID(UNIFORM_SHADOW_PARABOLOID) >= 0);
+	}
+	if (m_features & SHADER_FEATURE_CONTACT_SHADOW)
+	{
+		m_isReady = m_isReady && (m_program.getUniformID(UNIFORM_CONTACT_SHADOW) >= 0);
+	}
 }
 PointLightPass::~PointLightPass() {}
 
 
 bool PointLightPass::setUniforms(const GLProgUniforms &uniforms, const bool usingShadow) const
 {
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_POSTEX), 0);
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_DIFFTEX), 1);
-	glUniform1i(m_program.getUniformID(UNIFORM_DS_NORMTEX), 2);
-#if defined (DO_SHADOW)
-	glUniform1i(m_program.getUniformID(UNIFORM_SHADOWMAP), 3);
-#endif
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_MODELVIEW), 1, GL_FALSE, (GLfloat*)&uniforms.m_modelView);
-	glUniformMatrix4fv(m_program.getUniformID(UNIFORM_PROJECTION), 1, GL_FALSE, (GLfloat*)&uniforms.m_projection);
-	glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTPOS), 1, (GLfloat*)&uniforms.m_lightPos);
-	glUniform3fv(m_program.getUniformID(UNIFORM_LIGHTRAD), 1, (GLfloat*)&uniforms.m_lightRad);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_AMBIENTINTENCITY), uniforms.m_ds_AmbientIntensity);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_DIFFUSEINTENSITY), uniforms.m_ds_DiffuseIntensity);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_ATTENCONSTANT), uniforms.m_ds_AttenuationConstant);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_ATTENLINEAR), uniforms.m_ds_AttenuationLinear);
-	glUniform1f(m_program.getUniformID(UNIFORM_DS_ATTENEXP), uniforms.m_ds_AttenuationExp);
-    glUniform2fv(m_program.getUniformID(UNIFORM_DS_SCREENSIZE), 1, (GLfloat*)&uniforms.m_ds_ScreenSize);
+	if (m_features & SHADER_FEATURE_SHADOW)
+	{
+		m_program.setUniformMatrix4fv(UNIFORM_CUBE_FACE_MATS, 6, (GLfloat*)uniforms.m_cube_face_mats);
+		m_program.setUniform4fv(UNIFORM_SHADOW_RECT, (GLfloat*)&uniforms.m_shadowRect);
+		m_program.setUniform1i(UNIFORM_SHADOW_FILTER, uniforms.m_shadowFilter);
+		m_program.setUniform1i(UNIFORM_SHADOW_PARABOLOID, uniforms.m_shadowParaboloid);
+	}
+	if (m_features & SHADER_FEATURE_CONTACT_SHADOW)
+	{
+		m_program.setUniform1i(UNIFORM_CONTACT_SHADOW, uniforms.m_contactShadow);
+	}
+	m_program.setUniformMatrix4fv(UNIFORM_MODELVIEW, 1, (GLfloat*)&uniforms.m_modelView);
+	m_program.setUniformMatrix4fv(UNIFORM_PROJECTION, 1, (GLfloat*)&uniforms.m_projection);
+	m_program.setUniform3fv(UNIFORM_LIGHTPOS, (GLfloat*)&uniforms.m_lightPos);
+	m_program.setUniform3fv(UNIFORM_LIGHTRAD, (GLfloat*)&uniforms.m_lightRad);
+	m_program.setUniform1f(UNIFORM_DS_AMBIENTINTENCITY, uniforms.m_ds_AmbientIntensity);
+	m_program.setUniform1f(UNIFORM_DS_DIFFUSEINTENSITY, uniforms.m_ds_DiffuseIntensity);
+	m_program.setUniform1f(UNIFORM_DS_ATTENCONSTANT, uniforms.m_ds_AttenuationConstant);
+	m_program.setUniform1f(UNIFORM_DS_ATTENLINEAR, uniforms.m_ds_AttenuationLinear);
+	m_program.setUniform1f(UNIFORM_DS_ATTENEXP, uniforms.m_ds_AttenuationExp);
+    m_program.setUniform2fv(UNIFORM_DS_SCREENSIZE, (GLfloat*)&uniforms.m_ds_ScreenSize);
 
  	return !isGLError();
 }
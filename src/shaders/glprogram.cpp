@@ -12,89 +12,535 @@
 
 #include <gl3/gl3w.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <vector>
 #include <shaders/glprogram.h>
 
+// KHR_parallel_shader_compile; newer than the gl3w headers
+#if !defined (GL_COMPLETION_STATUS_KHR)
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace Shader
 {
 
-GLProgram::GLProgram() : m_prog(0)
+GLProgram::GLProgram() : m_prog(0), m_isPending(false)
 {
+	m_stages[0] = m_stages[1] = m_stages[2] = 0;
 	for (int i=0; i<NUM_UNIFORM_VARS; i++)
 	{
 		m_uniformLocs[i] = -1;
+		m_uniformOffset[i] = 0;
+		m_uniformSize[i] = 0;
+		m_uniformSet[i] = false;
 	}
 }
 
 GLProgram::~GLProgram()
 {
+	deleteStages();
 	if (m_prog != 0)
 	{
 		glDeleteProgram(m_prog);
 	}
 }
 
-bool GLProgram::init(const char *vertCode, const char *fragCode)
+// Program binary cache; see setBinaryCache()
+static std::string s_cacheDir;
+static std::string s_driver;
+static unsigned int s_numLoaded = 0;
+static unsigned int s_numCompiled = 0;
+// Whether the driver compiles on its own threads; see setParallelCompile()
+static bool s_parallel = false;
+
+// Header of a cached program binary file
+typedef struct _BinaryHeader
 {
-	GLuint vertHandle, fragHandle;
-	if (vertCode == NULL || fragCode == NULL)
+	char m_magic[4];
+	GLenum m_format;
+	GLint m_length;
+} BinaryHeader;
+
+static const char BinaryMagic[4] = { 'G', 'L', 'P', 'B' };
+
+bool GLProgram::setBinaryCache(const char *dir)
+{
+	s_cacheDir.clear();
+	if (dir == NULL)
+	{
+		return true;
+	}
+
+	// Without a binary format there is nothing to save
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0)
 	{
 		return false;
 	}
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+	{
+		fprintf(stderr, "Could not create the shader cache directory %s\n", dir);
+		return false;
+	}
+	s_cacheDir = dir;
 
-	// Compiling a GLSL program is just like compiling
-	// a C program
+	// Binaries only load into the driver that made them; it is part of
+	// every program's key, so a new driver gets a fresh set of files.
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	s_driver.clear();
+	for (unsigned int i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i)
+	{
+		const GLubyte *str = glGetString(strings[i]);
+		if (str) s_driver += (const char*)str;
+		s_driver += '\n';
+	}
+	return true;
+}
 
-	// 1) First we create a vertex shader program object within
-	//    the OpenGL context, and try to compile it
-	vertHandle = glCreateShader(GL_VERTEX_SHADER); // returns 0 on error
-	if (!compileShader(vertCode, vertHandle))
+unsigned int GLProgram::getNumLoaded()
+{
+	return s_numLoaded;
+}
+
+unsigned int GLProgram::getNumCompiled()
+{
+	return s_numCompiled;
+}
+
+std::string GLProgram::addFeatures(const char *code, unsigned int features)
+{
+	// The defines must follow the #version line
+	static const char *macros[NUM_SHADER_FEATURES] = SHADER_FEATURE_MACROS;
+	std::string defines;
+	for (unsigned int i = 0; i < NUM_SHADER_FEATURES; ++i)
+	{
+		if (features & (1u << i))
+		{
+			defines += "#define ";
+			defines += macros[i];
+			defines += " 1\n";
+		}
+	}
+
+	std::string result(code);
+	size_t pos = 0;
+	if (result.compare(0, 8, "#version") == 0)
+	{
+		pos = result.find('\n');
+		pos = (pos == std::string::npos) ? result.size() : pos + 1;
+	}
+	result.insert(pos, defines);
+	return result;
+}
+
+std::string GLProgram::binaryPath(const std::string &vert, const std::string &geom, const std::string &frag)
+{
+	// FNV-1a over the driver and the final source of every stage
+	unsigned long long h = 14695981039346656037ull;
+	const std::string *parts[] = { &s_driver, &vert, &geom, &frag };
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		const std::string &str = *parts[i];
+		for (size_t j = 0; j < str.size(); ++j)
+			h = (h ^ (unsigned char)str[j]) * 1099511628211ull;
+		h = (h ^ 0xffu) * 1099511628211ull; // stage separator
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", h);
+	return s_cacheDir + name;
+}
+
+bool GLProgram::loadBinary(const std::string &path)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp == NULL)
 	{
-		glDeleteShader(vertHandle);
 		return false;
 	}
-	// 2) Then create a fragment shader program object within
-	//   the OpenGL context, and try to compile it
-	fragHandle = glCreateShader(GL_FRAGMENT_SHADER); // returns 0 on error
-	if (!compileShader(fragCode, fragHandle))
+
+	BinaryHeader header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+			memcmp(header.m_magic, BinaryMagic, sizeof(BinaryMagic)) == 0 &&
+			header.m_length > 0;
+	if (ok)
+	{
+		binary.resize(header.m_length);
+		ok = fread(&binary[0], 1, binary.size(), fp) == binary.size();
+	}
+	fclose(fp);
+	if (!ok)
 	{
-		glDeleteShader(fragHandle);
-		glDeleteShader(vertHandle);
 		return false;
 	}
-	// 3) Next we're going to attach the vertex & fragment shader
-	//   programs to a GLSL program, and try to link them together
-	//     -- Linking will associate outs from the vertex shader
-	//      with ins in the fragment shader by name.
+
+	// The driver may still turn the binary down, e.g. after an update
+	// that kept its version string; the caller then compiles as usual.
 	m_prog = glCreateProgram();
-	if (m_prog == 0)
+	glProgramBinary(m_prog, header.m_format, &binary[0], header.m_length);
+	GLint success = GL_FALSE;
+	glGetProgramiv(m_prog, GL_LINK_STATUS, &success);
+	glGetError(); // An unknown format is an error, not a failure
+	if (success == GL_FALSE)
 	{
-		glDeleteShader(fragHandle);
-		glDeleteShader(vertHandle);
+		glDeleteProgram(m_prog);
+		m_prog = 0;
 		return false;
 	}
-	glAttachShader(m_prog, vertHandle);
-	glAttachShader(m_prog, fragHandle);
-	glLinkProgram(m_prog);
+	return true;
+}
 
-	// Flag the vert & frag GLProgram objects for deletion
-	// when the program object gets deleted.
-	glDeleteShader(vertHandle);
-	glDeleteShader(fragHandle);
+void GLProgram::saveBinary(const std::string &path) const
+{
+	BinaryHeader header;
+	memcpy(header.m_magic, BinaryMagic, sizeof(BinaryMagic));
+	header.m_length = 0;
+	glGetProgramiv(m_prog, GL_PROGRAM_BINARY_LENGTH, &header.m_length);
+	if (header.m_length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(header.m_length);
+	glGetProgramBinary(m_prog, header.m_length, &header.m_length, &header.m_format, &binary[0]);
+
+	// Written under a temporary name and renamed, so another instance
+	// never reads a partial file
+	const std::string tmp = path + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	if (fp == NULL)
+	{
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			fwrite(&binary[0], 1, header.m_length, fp) == (size_t)header.m_length;
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		remove(tmp.c_str());
+	}
+}
+
+// GLSL name of each of the UniformVars
+static const char *UniformNames[NUM_UNIFORM_VARS] =
+{
+	UNIF_LIGHTPOS, UNIF_LIGHTRAD, UNIF_AMBIENT, UNIF_SURFREF, UNIF_TEXTURE0,
+	UNIF_SPECEXP, UNIF_SPECREF, UNIF_MODELVIEW, UNIF_PROJECTION, UNIF_NORMALTRANS,
+	UNIF_SHADOWMAP, UNIF_DS_AMBIENTINTENCITY, UNIF_DS_DIFFUSEINTENSITY,
+	UNIF_DS_ATTENCONSTANT, UNIF_DS_ATTENLINEAR, UNIF_DS_ATTENEXP, UNIF_DS_DLDIRECTION,
+	UNIF_DS_POSTEX, UNIF_DS_DIFFTEX, UNIF_DS_NORMTEX, UNIF_DS_TEXCOORDTEX,
+	UNIF_DS_SCREENSIZE, UNIF_DS_CASCADE_MATS, UNIF_DS_CASCADE_SPLITS,
+	UNIF_CUBE_FACE_MATS, UNIF_SHADOW_RECT, UNIF_CUBE_FACE_MASK, UNIF_SHADOW_FILTER,
+	UNIF_SHADOW_ESM, UNIF_SHADOW_PARABOLOID, UNIF_CONTACT_SHADOW,
+	UNIF_BLUR_SRC_RECT, UNIF_BLUR_DST_ORIGIN, UNIF_BLUR_STEP, UNIF_BLUR_LAYER,
+	UNIF_BLUR_EXPONENT, UNIF_BLUR_DEPTH_RANGE,
+	UNIF_TEXTURE_ARRAY, UNIF_TEXTURE_LAYER
+};
+
+// Texture unit each sampler is bound to at link time; -1 if not a sampler
+static const GLint UniformSamplerUnits[NUM_UNIFORM_VARS] =
+{
+	-1, -1, -1, -1, 0,       // TEXTURE0
+	-1, -1, -1, -1, -1,
+	3, -1, -1,               // SHADOWMAP
+	-1, -1, -1, -1,
+	0, 1, 2, -1,             // DS_POSTEX, DS_DIFFTEX, DS_NORMTEX
+	-1, -1, -1,
+	-1, -1, -1, -1,
+	4, -1, -1,               // SHADOW_ESM
+	-1, -1, -1, -1,
+	-1, -1,
+	1, -1                    // TEXTURE_ARRAY
+};
+
+// Uniform uploads since resetUniformStats()
+static unsigned int s_uniformsIssued = 0;
+static unsigned int s_uniformsSkipped = 0;
+
+// Bytes in one element of a uniform of the given type
+static GLsizei uniformTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL: return 4;
+	case GL_FLOAT_VEC2: case GL_INT_VEC2: return 8;
+	case GL_FLOAT_VEC3: case GL_INT_VEC3: return 12;
+	case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_FLOAT_MAT2: return 16;
+	case GL_FLOAT_MAT3: return 36;
+	case GL_FLOAT_MAT4: return 64;
+	}
+	return 4; // samplers
+}
+
+void GLProgram::reflectUniforms()
+{
+	for (int i = 0; i < NUM_UNIFORM_VARS; ++i)
+	{
+		m_uniformLocs[i] = -1;
+		m_uniformOffset[i] = 0;
+		m_uniformSize[i] = 0;
+		m_uniformSet[i] = false;
+	}
+	m_uniformValues.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(m_prog, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1, '\0');
+	for (GLint u = 0; u < count; ++u)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(m_prog, u, maxLength + 1, NULL, &size, &type, &name[0]);
+		// Arrays are reported by their first element
+		char *bracket = strchr(&name[0], '[');
+		if (bracket) *bracket = '\0';
+
+		for (int i = 0; i < NUM_UNIFORM_VARS; ++i)
+		{
+			if (strcmp(&name[0], UniformNames[i]) != 0)
+				continue;
+			m_uniformLocs[i] = glGetUniformLocation(m_prog, UniformNames[i]);
+			m_uniformOffset[i] = m_uniformValues.size();
+			m_uniformSize[i] = size * uniformTypeSize(type);
+			m_uniformValues.resize(m_uniformValues.size() + m_uniformSize[i]);
+			break;
+		}
+	}
+}
+
+bool GLProgram::isChanged(UniformVars var, const void *value, GLsizei size) const
+{
+	if (size > m_uniformSize[var])
+	{
+		size = m_uniformSize[var];
+	}
+	unsigned char *shadow = &m_uniformValues[m_uniformOffset[var]];
+	if (m_uniformSet[var] && memcmp(shadow, value, size) == 0)
+	{
+		++s_uniformsSkipped;
+		return false;
+	}
+	memcpy(shadow, value, size);
+	m_uniformSet[var] = true;
+	++s_uniformsIssued;
+	return true;
+}
+
+void GLProgram::setUniform1i(UniformVars var, GLint v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, &v, sizeof(v)))
+		glUniform1i(m_uniformLocs[var], v);
+}
+
+void GLProgram::setUniform1f(UniformVars var, GLfloat v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, &v, sizeof(v)))
+		glUniform1f(m_uniformLocs[var], v);
+}
+
+void GLProgram::setUniform2fv(UniformVars var, const GLfloat *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, 2 * sizeof(GLfloat)))
+		glUniform2fv(m_uniformLocs[var], 1, v);
+}
+
+void GLProgram::setUniform3fv(UniformVars var, const GLfloat *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, 3 * sizeof(GLfloat)))
+		glUniform3fv(m_uniformLocs[var], 1, v);
+}
+
+void GLProgram::setUniform4fv(UniformVars var, const GLfloat *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, 4 * sizeof(GLfloat)))
+		glUniform4fv(m_uniformLocs[var], 1, v);
+}
+
+void GLProgram::setUniform2iv(UniformVars var, const GLint *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, 2 * sizeof(GLint)))
+		glUniform2iv(m_uniformLocs[var], 1, v);
+}
+
+void GLProgram::setUniform4iv(UniformVars var, const GLint *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, 4 * sizeof(GLint)))
+		glUniform4iv(m_uniformLocs[var], 1, v);
+}
+
+void GLProgram::setUniformMatrix4fv(UniformVars var, GLsizei count, const GLfloat *v) const
+{
+	if (m_uniformLocs[var] >= 0 && isChanged(var, v, count * 16 * sizeof(GLfloat)))
+		glUniformMatrix4fv(m_uniformLocs[var], count, GL_FALSE, v);
+}
+
+void GLProgram::setSampler(UniformVars var, GLint unit)
+{
+	if (m_uniformLocs[var] < 0)
+	{
+		return;
+	}
+	glUseProgram(m_prog);
+	glUniform1i(m_uniformLocs[var], unit);
+	glUseProgram(0);
+}
+
+void GLProgram::getUniformStats(unsigned int &issued, unsigned int &skipped)
+{
+	issued = s_uniformsIssued;
+	skipped = s_uniformsSkipped;
+}
+
+void GLProgram::resetUniformStats()
+{
+	s_uniformsIssued = 0;
+	s_uniformsSkipped = 0;
+}
+
+bool GLProgram::setParallelCompile()
+{
+	s_parallel = false;
+	GLint n = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+	for (GLint i = 0; i < n && !s_parallel; ++i)
+	{
+		const char *ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (ext && (strcmp(ext, "GL_KHR_parallel_shader_compile") == 0 ||
+				strcmp(ext, "GL_ARB_parallel_shader_compile") == 0))
+		{
+			s_parallel = true;
+		}
+	}
+	if (s_parallel)
+	{
+		// Let the driver pick how many threads to compile on
+		typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADS)(GLuint count);
+		PFNMAXSHADERCOMPILERTHREADS maxThreads =
+				(PFNMAXSHADERCOMPILERTHREADS)gl3wGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (maxThreads == NULL)
+			maxThreads = (PFNMAXSHADERCOMPILERTHREADS)gl3wGetProcAddress("glMaxShaderCompilerThreadsARB");
+		if (maxThreads) maxThreads(0xFFFFFFFFu);
+	}
+	return s_parallel;
+}
+
+bool GLProgram::init(const char *vertCode, const char *fragCode)
+{
+	return init(vertCode, NULL, fragCode, 0);
+}
 
-	// Make sure the link was successful
+bool GLProgram::init(const char *vertCode, const char *geomCode, const char *fragCode, unsigned int features)
+{
+	return compile(vertCode, geomCode, fragCode, features) && finish();
+}
+
+bool GLProgram::compile(const char *vertCode, const char *geomCode, const char *fragCode, unsigned int features)
+{
+	if (vertCode == NULL || fragCode == NULL)
+	{
+		return false;
+	}
+
+	// Every stage sees the macros of the features asked for
+	const std::string vert = addFeatures(vertCode, features);
+	const std::string geom = (geomCode != NULL) ? addFeatures(geomCode, features) : std::string();
+	const std::string frag = addFeatures(fragCode, features);
+
+	// A program that this driver linked from the same source before is
+	// loaded as a binary, without compiling anything
+	m_binaryPath.clear();
+	if (!s_cacheDir.empty())
+	{
+		m_binaryPath = binaryPath(vert, geom, frag);
+		if (loadBinary(m_binaryPath))
+		{
+			++s_numLoaded;
+			m_binaryPath.clear();
+			m_isPending = true;
+			return true;
+		}
+	}
+	return link(vert.c_str(), (geomCode != NULL) ? geom.c_str() : NULL, frag.c_str());
+}
+
+bool GLProgram::isCompiling() const
+{
+	if (!m_isPending || !s_parallel || m_prog == 0)
+	{
+		return false;
+	}
+	GLint done = GL_TRUE;
+	glGetProgramiv(m_prog, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_FALSE;
+}
+
+bool GLProgram::finish()
+{
+	if (!m_isPending)
+	{
+		return m_prog != 0;
+	}
+	m_isPending = false;
+	if (m_prog == 0)
+	{
+		return false;
+	}
+
+	// Make sure the link was successful; this waits for the driver
 	GLint success;
 	glGetProgramiv(m_prog, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE)
 	{
-		char errLog[1024];
-		glGetProgramInfoLog(success, 1024, NULL, errLog);
-		fprintf(stderr,
-				"========== LINK ERROR ===================\n%s\n",
-				errLog);
+		// A stage that did not compile explains the failure best
+		bool compiled = true;
+		for (int i = 0; i < 3; ++i)
+		{
+			compiled = checkShader(m_stages[i]) && compiled;
+		}
+		if (compiled)
+		{
+			char errLog[1024];
+			glGetProgramInfoLog(m_prog, 1024, NULL, errLog);
+			fprintf(stderr,
+					"========== LINK ERROR ===================\n%s\n",
+					errLog);
+		}
+		deleteStages();
 		glDeleteProgram(m_prog);
 		m_prog = 0;
 		return false;
 	}
+	// The program keeps what it needs of the linked stages
+	if (m_stages[0] != 0)
+	{
+		deleteStages();
+		++s_numCompiled;
+		if (!m_binaryPath.empty())
+		{
+			saveBinary(m_binaryPath);
+		}
+	}
+
+	// Find out the handle of each of the uniforms that the program uses
+	reflectUniforms();
+
+	// Point the samplers at the texture units that the renderer binds them
+	// to, so validation does not see samplers of different types sharing
+	// the default unit 0. Shaders that bind elsewhere call setSampler().
+	glUseProgram(m_prog);
+	for (int i = 0; i < NUM_UNIFORM_VARS; ++i)
+	{
+		if (m_uniformLocs[i] >= 0 && UniformSamplerUnits[i] >= 0)
+		{
+			glUniform1i(m_uniformLocs[i], UniformSamplerUnits[i]);
+		}
+	}
+	glUseProgram(0);
 
 	// Validate the linked program
 	glValidateProgram(m_prog);
@@ -108,59 +554,96 @@ bool GLProgram::init(const char *vertCode, const char *fragCode)
 		return false;
 	}
 
-	// Find out the handle for each of the uniform variables in the GLSL program.
-	m_uniformLocs[UNIFORM_LIGHTPOS] = glGetUniformLocation(m_prog, UNIF_LIGHTPOS);
-	m_uniformLocs[UNIFORM_LIGHTRAD] = glGetUniformLocation(m_prog, UNIF_LIGHTRAD);
-	m_uniformLocs[UNIFORM_AMBIENT] = glGetUniformLocation(m_prog, UNIF_AMBIENT);
-	m_uniformLocs[UNIFORM_SURFREF]  = glGetUniformLocation(m_prog, UNIF_SURFREF);
-	m_uniformLocs[UNIFORM_TEXTURE0] = glGetUniformLocation(m_prog, UNIF_TEXTURE0);
-	m_uniformLocs[UNIFORM_SPECEXP] = glGetUniformLocation(m_prog, UNIF_SPECEXP);
-	m_uniformLocs[UNIFORM_SPECREF] = glGetUniformLocation(m_prog, UNIF_SPECREF);
-	m_uniformLocs[UNIFORM_MODELVIEW] = glGetUniformLocation(m_prog, UNIF_MODELVIEW);
-	m_uniformLocs[UNIFORM_PROJECTION] = glGetUniformLocation(m_prog, UNIF_PROJECTION);
-	m_uniformLocs[UNIFORM_NORMALTRANS] = glGetUniformLocation(m_prog, UNIF_NORMALTRANS);
-	m_uniformLocs[UNIFORM_SHADOWMAP] = glGetUniformLocation(m_prog, UNIF_SHADOWMAP);
-	m_uniformLocs[UNIFORM_DS_AMBIENTINTENCITY] = glGetUniformLocation(m_prog, UNIF_DS_AMBIENTINTENCITY);
-	m_uniformLocs[UNIFORM_DS_DIFFUSEINTENSITY] = glGetUniformLocation(m_prog, UNIF_DS_DIFFUSEINTENSITY);
-	m_uniformLocs[UNIFORM_DS_ATTENCONSTANT] = glGetUniformLocation(m_prog, UNIF_DS_ATTENCONSTANT);
-	m_uniformLocs[UNIFORM_DS_ATTENLINEAR] = glGetUniformLocation(m_prog, UNIF_DS_ATTENLINEAR);
-	m_uniformLocs[UNIFORM_DS_ATTENEXP] = glGetUniformLocation(m_prog, UNIF_DS_ATTENEXP);
-	m_uniformLocs[UNIFORM_DS_DLDIRECTION] = glGetUniformLocation(m_prog, UNIF_DS_DLDIRECTION);
-	m_uniformLocs[UNIFORM_DS_POSTEX] = glGetUniformLocation(m_prog, UNIF_DS_POSTEX);
-	m_uniformLocs[UNIFORM_DS_DIFFTEX] = glGetUniformLocation(m_prog, UNIF_DS_DIFFTEX);
-	m_uniformLocs[UNIFORM_DS_NORMTEX] = glGetUniformLocation(m_prog, UNIF_DS_NORMTEX);
-	m_uniformLocs[UNIFORM_DS_TEXCOORDTEX] = glGetUniformLocation(m_prog, UNIF_DS_TEXCOORDTEX);
-	m_uniformLocs[UNIFORM_DS_SCREENSIZE] = glGetUniformLocation(m_prog, UNIF_DS_SCREENSIZE);
-	m_uniformLocs[UNIFORM_DS_LIGHT_PROJMAT] = glGetUniformLocation(m_prog, UNIF_DS_LIGHT_PROJMAT);
+	return true;
+}
+
+bool GLProgram::link(const char *vertCode, const char *geomCode, const char *fragCode)
+{
+	// Compiling a GLSL program is just like compiling
+	// a C program. Nothing here waits for the driver; errors are
+	// picked up by finish().
 
+	// 1) First we create a vertex shader program object within
+	//    the OpenGL context, and compile it
+	m_stages[0] = compileShader(GL_VERTEX_SHADER, vertCode);
+	// 2) Then create a fragment shader program object within
+	//   the OpenGL context, and compile it
+	m_stages[1] = compileShader(GL_FRAGMENT_SHADER, fragCode);
+	// 2b) The geometry shader is optional
+	m_stages[2] = (geomCode != NULL) ? compileShader(GL_GEOMETRY_SHADER, geomCode) : 0;
+	// 3) Next we're going to attach the vertex & fragment shader
+	//   programs to a GLSL program, and link them together
+	//     -- Linking will associate outs from the vertex shader
+	//      with ins in the fragment shader by name.
+	m_prog = glCreateProgram();
+	if (m_prog == 0 || m_stages[0] == 0 || m_stages[1] == 0 || (geomCode != NULL && m_stages[2] == 0))
+	{
+		deleteStages();
+		if (m_prog != 0) glDeleteProgram(m_prog);
+		m_prog = 0;
+		return false;
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		if (m_stages[i] != 0) glAttachShader(m_prog, m_stages[i]);
+	}
+	if (!m_binaryPath.empty())
+	{
+		glProgramParameteri(m_prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(m_prog);
+	m_isPending = true;
 	return true;
 }
 
-bool GLProgram::compileShader(const char *code, const GLuint handle) const
+GLuint GLProgram::compileShader(const GLenum type, const char *code) const
 {
+	GLuint handle = glCreateShader(type); // returns 0 on error
 	if (handle == 0)
 	{
-		return false;
+		return 0;
 	}
 	glShaderSource(handle, 1, &code, 0);
 	glCompileShader(handle);
+	return handle;
+}
 
-	// Check for errors
+bool GLProgram::checkShader(const GLuint handle) const
+{
+	if (handle == 0)
+	{
+		return true;
+	}
 	GLint success;
 	glGetShaderiv(handle, GL_COMPILE_STATUS, &success);
 	if (success == GL_FALSE)
 	{
 		char errLog[1024];
 		glGetShaderInfoLog(handle, 1024, NULL, errLog);
+		GLint length = 0;
+		glGetShaderiv(handle, GL_SHADER_SOURCE_LENGTH, &length);
+		std::vector<char> code(length + 1, '\0');
+		if (length > 0) glGetShaderSource(handle, length, NULL, &code[0]);
 		fprintf(stderr,
 				"========== COMPILE ERROR ===================\n%s\n"
 				"=================================\n%s\n=================================\n",
-				errLog, code);
+				errLog, &code[0]);
 		return false;
 	}
 	return true;
 }
 
+void GLProgram::deleteStages()
+{
+	// Flag the vert, geom & frag shader objects for deletion
+	// when the program object gets deleted.
+	for (int i = 0; i < 3; ++i)
+	{
+		if (m_stages[i] != 0) glDeleteShader(m_stages[i]);
+		m_stages[i] = 0;
+	}
+}
+
 void GLProgram::bind() const
 {
 	glUseProgram(m_prog);
@@ -17,6 +17,10 @@
 
 #include <shaders/constant/simple.h>
 #include <shaders/constant/depth.h>
+#include <shaders/constant/cascadedepth.h>
+#include <shaders/constant/cubedepth.h>
+#include <shaders/constant/paraboloiddepth.h>
+#include <shaders/constant/shadowblur.h>
 #include <shaders/constant/lambertian/gouraud.h>
 #include <shaders/constant/lambertian/phong.h>
 #include <shaders/constant/specular/gouraud.h>
@@ -47,6 +51,10 @@ typedef enum
 	DEFERRED_GEOMETRY_PASS,
 	DEFERRED_POINTLIGHT_PASS,
 	DEFERRED_DIRECTIONALLIGHT_PASS,
+	CASCADE_DEPTH,
+	CUBE_DEPTH,
+	SHADOW_BLUR,
+	PARABOLOID_DEPTH,
 	NUM_SHADERS
 } ShaderOffsets;
 
@@ -65,54 +73,93 @@ Manager::~Manager()
 		}
 		delete[] m_shaders;
 	}
+	std::map<unsigned int, Shader*>::iterator it;
+	for (it = m_permutations.begin(); it != m_permutations.end(); ++it)
+	{
+		delete it->second;
+	}
 }
 
 bool Manager::init()
 {
+#if defined (SHADER_CACHE_DIR)
+	if (!GLProgram::setBinaryCache(SHADER_CACHE_DIR))
+	{
+		fprintf(stderr, "Shader cache unavailable; compiling every program\n");
+	}
+#endif
+	GLProgram::setParallelCompile();
+
 	m_nShaders = NUM_SHADERS;
 	m_shaders = new Shader*[m_nShaders];
 	memset(m_shaders, 0x00, sizeof(Shader*)*m_nShaders);
 
-	m_shaders[SIMPLE] = new Constant::Simple();
-	if ( !m_shaders[SIMPLE] ) return false;
-
-	m_shaders[DEPTH] = new Constant::Depth();
-	if ( !m_shaders[DEPTH] ) return false;
-
-	m_shaders[CONST_LAMB_GOURAUD] = new Constant::Lambertian::Gouraud();
-	if ( !m_shaders[CONST_LAMB_GOURAUD] ) return false;
-
-	m_shaders[CONST_LAMB_PHONG] = new Constant::Lambertian::Phong();
-	if ( !m_shaders[CONST_LAMB_PHONG] ) return false;
-
-	m_shaders[CONST_SPEC_GOURAUD] = new Constant::Specular::Gouraud();
-	if ( !m_shaders[CONST_SPEC_GOURAUD] ) return false;
-
-	m_shaders[CONST_SPEC_PHONG] = new Constant::Specular::Phong();
-	if ( !m_shaders[CONST_SPEC_PHONG] ) return false;
-
-	m_shaders[TEXTURE_LAMB_GOURAUD] = new Texture::Lambertian::Gouraud();
-	if ( !m_shaders[TEXTURE_LAMB_GOURAUD] ) return false;
-
-	m_shaders[TEXTURE_LAMB_PHONG] = new Texture::Lambertian::Phong();
-	if ( !m_shaders[TEXTURE_LAMB_PHONG] ) return false;
-
-	m_shaders[TEXTURE_SPEC_GOURAUD] = new Texture::Specular::Gouraud();
-	if ( !m_shaders[TEXTURE_SPEC_GOURAUD] ) return false;
-
-	m_shaders[TEXTURE_SPEC_PHONG] = new Texture::Specular::Phong();
-	if ( !m_shaders[TEXTURE_SPEC_PHONG] ) return false;
-
-	m_shaders[DEFERRED_GEOMETRY_PASS] = new Deferred::GeometryPass();
-	if ( !m_shaders[DEFERRED_GEOMETRY_PASS] ) return false;
+	// Hand the programs the pipeline draws with to the driver now, so it
+	// can compile them side by side; the rest wait for their first use.
+#if defined (PIPELINE_DEFERRED)
+	const int used[] = { DEFERRED_GEOMETRY_PASS, DEFERRED_POINTLIGHT_PASS, DEFERRED_DIRECTIONALLIGHT_PASS,
+			CASCADE_DEPTH, CUBE_DEPTH, PARABOLOID_DEPTH, SHADOW_BLUR };
+#else
+	const int used[] = { CONST_LAMB_GOURAUD, CONST_LAMB_PHONG, CONST_SPEC_GOURAUD, CONST_SPEC_PHONG,
+			TEXTURE_LAMB_GOURAUD, TEXTURE_LAMB_PHONG, TEXTURE_SPEC_GOURAUD, TEXTURE_SPEC_PHONG,
+			SIMPLE, DEPTH, CASCADE_DEPTH, CUBE_DEPTH, PARABOLOID_DEPTH, SHADOW_BLUR };
+#endif
+	for (unsigned int i = 0; i < sizeof(used) / sizeof(used[0]); ++i)
+	{
+		m_shaders[used[i]] = create(used[i]);
+		if ( !m_shaders[used[i]] ) return false;
+	}
+	return true;
+}
 
-	m_shaders[DEFERRED_POINTLIGHT_PASS] = new Deferred::PointLightPass();
-	if ( !m_shaders[DEFERRED_POINTLIGHT_PASS] ) return false;
+Shader* Manager::create(int shader)
+{
+	switch (shader)
+	{
+	case SIMPLE: return new Constant::Simple();
+	case DEPTH: return new Constant::Depth();
+	case CONST_LAMB_GOURAUD: return new Constant::Lambertian::Gouraud();
+	case CONST_LAMB_PHONG: return new Constant::Lambertian::Phong();
+	case CONST_SPEC_GOURAUD: return new Constant::Specular::Gouraud();
+	case CONST_SPEC_PHONG: return new Constant::Specular::Phong();
+	case TEXTURE_LAMB_GOURAUD: return new Texture::Lambertian::Gouraud();
+	case TEXTURE_LAMB_PHONG: return new Texture::Lambertian::Phong();
+	case TEXTURE_SPEC_GOURAUD: return new Texture::Specular::Gouraud();
+	case TEXTURE_SPEC_PHONG: return new Texture::Specular::Phong();
+	case DEFERRED_GEOMETRY_PASS: return new Deferred::GeometryPass();
+	case DEFERRED_POINTLIGHT_PASS: return new Deferred::PointLightPass();
+	case DEFERRED_DIRECTIONALLIGHT_PASS: return new Deferred::DirectionalLightPass(SHADER_FEATURES_DEFAULT & SHADER_FEATURE_SHADOW);
+	case CASCADE_DEPTH: return new Constant::CascadeDepth();
+	case CUBE_DEPTH: return new Constant::CubeDepth();
+	case SHADOW_BLUR: return new Constant::ShadowBlur();
+	case PARABOLOID_DEPTH: return new Constant::ParaboloidDepth();
+	}
+	return 0;
+}
 
-	m_shaders[DEFERRED_DIRECTIONALLIGHT_PASS] = new Deferred::DirectionalLightPass();
-	if ( !m_shaders[DEFERRED_DIRECTIONALLIGHT_PASS] ) return false;
+const Shader* Manager::get(int shader) const
+{
+	if ( !m_shaders[shader] )
+	{
+		m_shaders[shader] = create(shader);
+	}
+	m_shaders[shader]->poll();
+	return m_shaders[shader];
+}
 
-	return true;
+bool Manager::poll(const bool wait) const
+{
+	bool done = true;
+	for (int i = 0; i < m_nShaders; ++i)
+	{
+		if (m_shaders[i]) done = m_shaders[i]->poll(wait) && done;
+	}
+	std::map<unsigned int, Shader*>::const_iterator it;
+	for (it = m_permutations.begin(); it != m_permutations.end(); ++it)
+	{
+		done = it->second->poll(wait) && done;
+	}
+	return done;
 }
 
 const Shader* Manager::getShader(const Material::Material &mat) const
@@ -125,20 +172,20 @@ const Shader* Manager::getShader(const Material::Material &mat) const
 		case Material::CONSTANT:
 			if (!mat.hasSpecular())
 			{
-				return m_shaders[CONST_LAMB_GOURAUD];
+				return get(CONST_LAMB_GOURAUD);
 			}
 			else
 			{
-				return m_shaders[CONST_SPEC_GOURAUD];
+				return get(CONST_SPEC_GOURAUD);
 			}
 		case Material::TEXTURE:
 			if (!mat.hasSpecular())
 			{
-				return m_shaders[TEXTURE_LAMB_GOURAUD];
+				return get(TEXTURE_LAMB_GOURAUD);
 			}
 			else
 			{
-				return m_shaders[TEXTURE_SPEC_GOURAUD];
+				return get(TEXTURE_SPEC_GOURAUD);
 			}
 		}
 		break;
@@ -148,47 +195,100 @@ const Shader* Manager::getShader(const Material::Material &mat) const
 		case Material::CONSTANT:
 			if (!mat.hasSpecular())
 			{
-				return m_shaders[CONST_LAMB_PHONG];
+				return get(CONST_LAMB_PHONG);
 			}
 			else
 			{
-				return m_shaders[CONST_SPEC_PHONG];
+				return get(CONST_SPEC_PHONG);
 			}
 		case Material::TEXTURE:
 			if (!mat.hasSpecular())
 			{
-				return m_shaders[TEXTURE_LAMB_PHONG];
+				return get(TEXTURE_LAMB_PHONG);
 			}
 			else
 			{
-				return m_shaders[TEXTURE_SPEC_PHONG];
+				return get(TEXTURE_SPEC_PHONG);
 			}
 		}
 		break;
 	default:
-		return m_shaders[SIMPLE];
+		return get(SIMPLE);
 	}
-	return m_shaders[SIMPLE];
+	return get(SIMPLE);
 }
 
 const Shader* Manager::getDepthShader() const
 {
-	return m_shaders[DEPTH];
+	return get(DEPTH);
+}
+
+const Shader* Manager::getCascadeDepthShader() const
+{
+	return get(CASCADE_DEPTH);
+}
+
+const Shader* Manager::getCubeDepthShader() const
+{
+	return get(CUBE_DEPTH);
+}
+
+const Shader* Manager::getShadowBlurShader() const
+{
+	return get(SHADOW_BLUR);
+}
+
+const Shader* Manager::getParaboloidDepthShader() const
+{
+	return get(PARABOLOID_DEPTH);
 }
 
 const Shader* Manager::getDeferredGeometryPassShader() const
 {
-	return m_shaders[DEFERRED_GEOMETRY_PASS];
+	return get(DEFERRED_GEOMETRY_PASS);
 }
 
-const Shader* Manager::getDeferredPointLightPassShader() const
+const Shader* Manager::getDeferredPointLightPassShader(unsigned int features) const
 {
-	return m_shaders[DEFERRED_POINTLIGHT_PASS];
+	return getPermutation(DEFERRED_POINTLIGHT_PASS, features);
 }
 
-const Shader* Manager::getDeferredDirectionalLightPassShader() const
+const Shader* Manager::getDeferredDirectionalLightPassShader(unsigned int features) const
 {
-	return m_shaders[DEFERRED_DIRECTIONALLIGHT_PASS];
+	return getPermutation(DEFERRED_DIRECTIONALLIGHT_PASS, features & SHADER_FEATURE_SHADOW);
+}
+
+const Shader* Manager::getPermutation(int shader, unsigned int features) const
+{
+	features &= SHADER_FEATURES_DEFAULT;
+	const Shader *def = get(shader);
+	if (features == def->getFeatures())
+	{
+		return def;
+	}
+
+	// Built like the default ones; until the driver is done with it
+	// the permutation is not ready and its pass is skipped
+	const unsigned int key = ((unsigned int)shader << 16) | features;
+	std::map<unsigned int, Shader*>::iterator it = m_permutations.find(key);
+	if (it == m_permutations.end())
+	{
+		Shader *perm = 0;
+		switch (shader)
+		{
+		case DEFERRED_POINTLIGHT_PASS:
+			perm = new Deferred::PointLightPass(features);
+			break;
+		case DEFERRED_DIRECTIONALLIGHT_PASS:
+			perm = new Deferred::DirectionalLightPass(features);
+			break;
+		default:
+			return def;
+		}
+		it = m_permutations.insert(std::make_pair(key, perm)).first;
+	}
+	it->second->poll();
+	return it->second;
 }
 
 }
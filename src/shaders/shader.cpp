@@ -21,8 +21,29 @@ Shader::Shader()
 {
 	m_isReady = false;
 	m_isShadowReady = false;
+	m_features = 0;
+	m_isPending = true;
 }
 Shader::~Shader() {}
+bool Shader::poll(const bool wait)
+{
+	if (!m_isPending)
+	{
+		return true;
+	}
+	if (!wait && (m_program.isCompiling() || m_shadowProgram.isCompiling()))
+	{
+		return false;
+	}
+	m_program.finish();
+	m_shadowProgram.finish();
+	m_isPending = false;
+	initUniforms();
+	return true;
+}
+void Shader::initUniforms()
+{
+}
 void Shader::bindGL(const bool useShadow) const
 {
 	if (!useShadow)
@@ -0,0 +1,419 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+//==============================================================================
+
+#include <cstdio>
+#include <math.h>
+#include <algorithm>
+#include <gml/expr.h>
+#include <shadowatlas.h>
+#include <gl3/gl3w.h>
+#include <glUtils.h>
+#include <lights.h>
+#include <shadowmap.h>
+
+//==============================================================================
+
+ShadowAtlas::ShadowAtlas()
+	: m_fbo(0)
+	, m_texture(0)
+	, m_size(0)
+	, m_isReady(false)
+	, m_manager(NULL)
+	, m_filterMode(SHADOW_FILTER_PCF)
+	, m_faceBudget(SHADOW_UPDATE_FACES)
+	, m_timeBudgetMs(SHADOW_UPDATE_MS)
+	, m_faceCostMs(0.0)
+	, m_facesUpdated(0)
+	, m_facesReused(0)
+	, m_facesDeferred(0)
+	, m_timerQuery(0)
+	, m_timerPending(false)
+	, m_timedFaces(0)
+	, m_lastTimeMs(0.0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+ShadowAtlas::~ShadowAtlas()
+{
+	if (m_fbo > 0) glDeleteFramebuffers(1, &m_fbo);
+	if (m_texture > 0) glDeleteTextures(1, &m_texture);
+	if (m_timerQuery > 0) glDeleteQueries(1, &m_timerQuery);
+}
+
+//------------------------------------------------------------------------------
+
+bool ShadowAtlas::init(const unsigned int & size, const Shader::Manager *manager)
+{
+	m_manager = manager;
+
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+
+	// Linear filtering with depth compare gives 2x2 PCF in hardware
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, SHADOWMAP_DEPTH_FORMAT, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Depth-only framebuffer; there is no colour buffer to draw to.
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_texture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	m_isReady = GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// Start fully lit
+	if (m_isReady)
+	{
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	}
+
+	glGenQueries(1, &m_timerQuery);
+
+	m_size = size;
+	return m_isReady && !isGLError();
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::allocate(const LightVec & lights, const Camera & camera)
+{
+	m_requests.clear();
+
+	const gml::mat4x4_t & worldView = camera.getWorldView();
+	const float tanV = tanf(0.5f * camera.getFOV());
+	const float tanH = tanV * camera.getAspect();
+	// Distance from the view axis to the side planes scales with depth;
+	// these turn that into a distance along each plane's normal.
+	const float normV = sqrtf(1.0f + tanV * tanV);
+	const float normH = sqrtf(1.0f + tanH * tanH);
+
+	for (LightVec::const_iterator itr = lights.begin(); itr != lights.end(); ++itr)
+	{
+		Light & lit = **itr;
+		if (lit.getType() != LT_POINT || !lit.Shadow)
+			continue;
+		lit.setShadowRect(gml::vec4_t(0, 0, 0, 0));
+
+		gml::vec3_t c = gml::expr::eval3(gml::expr::mul(worldView, gml::expr::point(lit.Position)));
+		const float r = lit.getBoundingRadius();
+		const float depth = -c.z;
+
+		// Lights that cannot touch anything on screen get no tile
+		if (depth < -r ||
+			fabsf(c.x) - tanH * depth > r * normH ||
+			fabsf(c.y) - tanV * depth > r * normV)
+			continue;
+
+		// Fraction of the screen height covered by the light's influence
+		const float d = gml::length(c);
+		float coverage = 1.0f;
+		if (d > r)
+			coverage = fminf(1.0f, r / (sqrtf(d * d - r * r) * tanV));
+
+		Request q;
+		q.light = &lit;
+		q.importance = coverage;
+		q.faces = lit.getShadowFaceCount();
+		q.faceSize = SHADOW_ATLAS_MIN_TILE;
+		while (q.faceSize < SHADOW_ATLAS_MAX_TILE && q.faceSize < coverage * SHADOW_ATLAS_MAX_TILE)
+			q.faceSize *= 2;
+		m_requests.push_back(q);
+	}
+
+	// Most important first
+	for (unsigned int i = 1; i < m_requests.size(); ++i)
+		for (unsigned int j = i; j > 0 && m_requests[j - 1].importance < m_requests[j].importance; --j)
+			std::swap(m_requests[j - 1], m_requests[j]);
+
+	// Until everything fits, halve the tile that is largest for its
+	// importance (the least important one on ties); drop the least
+	// important lights once every tile is at the minimum size.
+	while (!pack())
+	{
+		int victim = -1;
+		float worst = 0.0f;
+		for (int i = (int)m_requests.size() - 1; i >= 0; --i)
+		{
+			const Request & q = m_requests[i];
+			const float cost = q.faceSize / fmaxf(q.importance, 1.0e-3f);
+			if (q.faceSize > SHADOW_ATLAS_MIN_TILE && cost > worst)
+			{
+				victim = i;
+				worst = cost;
+			}
+		}
+		if (victim >= 0)
+			m_requests[victim].faceSize /= 2;
+		else
+			m_requests.pop_back();
+	}
+
+	for (RequestVec::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+		itr->light->setShadowRect(itr->rect);
+}
+
+//------------------------------------------------------------------------------
+
+bool ShadowAtlas::pack()
+{
+	// Largest tiles first. Requests are already in importance order, so
+	// the insertion sort keeps that order among equal sizes.
+	m_order.resize(m_requests.size());
+	for (unsigned int i = 0; i < m_order.size(); ++i)
+		m_order[i] = i;
+	for (unsigned int i = 1; i < m_order.size(); ++i)
+		for (unsigned int j = i; j > 0 && m_requests[m_order[j - 1]].faceSize < m_requests[m_order[j]].faceSize; --j)
+			std::swap(m_order[j - 1], m_order[j]);
+
+	// First-fit shelf packing of 3 x 2 face tiles, or 2 x 1 for paraboloids
+	m_shelves.clear();
+	unsigned int top = 0;
+	for (unsigned int i = 0; i < m_order.size(); ++i)
+	{
+		Request & q = m_requests[m_order[i]];
+		const unsigned int w = std::min<unsigned int>(q.faces, 3) * q.faceSize;
+		const unsigned int h = ((q.faces + 2) / 3) * q.faceSize;
+
+		Shelf *shelf = NULL;
+		for (ShelfVec::iterator itr = m_shelves.begin(); itr != m_shelves.end(); ++itr)
+			if (itr->height >= h && itr->used + w <= m_size)
+			{
+				shelf = &*itr;
+				break;
+			}
+		if (NULL == shelf)
+		{
+			if (top + h > m_size || w > m_size)
+				return false;
+			Shelf s = { top, h, 0 };
+			m_shelves.push_back(s);
+			shelf = &m_shelves.back();
+			top += h;
+		}
+
+		q.rect = gml::vec4_t((float)shelf->used, (float)shelf->y, (float)q.faceSize, (float)m_size);
+		shelf->used += w;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::create(const ObjectVec & scene, const Camera & camera)
+{
+	m_facesUpdated = 0;
+	m_facesReused = 0;
+	m_facesDeferred = 0;
+
+	if (!m_isReady)
+		return;
+
+	// Read the last query once the GPU has caught up with it; until then
+	// keep the previous time, and leave this frame untimed. Track the cost
+	// of a face with a running average, as it varies with the faces drawn.
+	if (m_timerPending)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(m_timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(m_timerQuery, GL_QUERY_RESULT, &elapsed);
+			m_lastTimeMs = elapsed * 1.0e-6;
+			m_timerPending = false;
+			if (m_timedFaces > 0)
+			{
+				const double cost = m_lastTimeMs / m_timedFaces;
+				m_faceCostMs = (m_faceCostMs > 0.0) ? 0.75 * m_faceCostMs + 0.25 * cost : cost;
+			}
+		}
+	}
+	const bool timed = !m_timerPending;
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+	if (isGLError()) return;
+
+	if (timed)
+		glBeginQuery(GL_TIME_ELAPSED, m_timerQuery);
+
+	for (RequestVec::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+		itr->light->prepareShadow(scene, camera);
+
+	const unsigned int scheduled = schedule();
+	if (timed)
+		m_timedFaces = scheduled;
+
+	for (RequestVec::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+		if (itr->faceMask)
+			itr->light->createShadow(scene, camera, itr->faceMask);
+
+	// Prefilter the faces that changed. Faces that were cleared but not
+	// rendered yet are included, so they never show another light's shadow.
+	if (SHADOW_FILTER_ESM == m_filterMode)
+		for (RequestVec::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+		{
+			const unsigned int faces = itr->faceMask | itr->cleared;
+			const gml::vec4_t & r = itr->rect;
+			// Paraboloids store linear distances, cube faces perspective depth
+			if (itr->light->isShadowParaboloid())
+				m_filter.setPerspective(0.0f, 0.0f);
+			else
+				m_filter.setPerspective(SHADOWMAP_NEAR, SHADOWMAP_FAR);
+			for (unsigned short i = 0; i < itr->faces; ++i)
+				if (faces & (1u << i))
+					m_filter.filter(m_texture, 0, (GLint)(r.x + (i % 3) * r.z), (GLint)(r.y + (i / 3) * r.z)
+									, (GLsizei)r.z, (GLsizei)r.z);
+		}
+
+	if (timed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_timerPending = true;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int ShadowAtlas::schedule()
+{
+	unsigned int budget = m_faceBudget;
+	if (m_timeBudgetMs > 0.0 && m_faceCostMs > 0.0)
+		budget = std::min(budget, std::max(1u, (unsigned int)(m_timeBudgetMs / m_faceCostMs)));
+
+	// Light priority: importance, scaled up by how far the light moved
+	// relative to its reach. Faces that were never rendered count as
+	// having moved SHADOWMAP_FAR.
+	for (RequestVec::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+	{
+		Request & q = *itr;
+		float moved = 0.0f;
+		for (unsigned short i = 0; i < q.faces; ++i)
+		{
+			q.staleness[i] = q.light->getShadowFaceStaleness(i);
+			moved = fmaxf(moved, q.staleness[i]);
+		}
+		q.faceMask = 0;
+		q.cleared = 0;
+		for (unsigned short i = 0; i < q.faces; ++i)
+			if (q.staleness[i] >= SHADOWMAP_FAR)
+				q.cleared |= 1u << i;
+		q.priority = (moved > 0.0f) ? q.importance * (1.0f + moved / q.light->getBoundingRadius()) : 0.0f;
+	}
+
+	m_order.resize(m_requests.size());
+	for (unsigned int i = 0; i < m_order.size(); ++i)
+		m_order[i] = i;
+	for (unsigned int i = 1; i < m_order.size(); ++i)
+		for (unsigned int j = i; j > 0 && m_requests[m_order[j - 1]].priority < m_requests[m_order[j]].priority; --j)
+			std::swap(m_order[j - 1], m_order[j]);
+
+	// Deal out the budget one face per light per round, so one light
+	// cannot starve the others. Each light gives up its stalest face,
+	// which makes its faces take turns from frame to frame.
+	unsigned int faces = 0;
+	bool more = true;
+	while (more && faces < budget)
+	{
+		more = false;
+		for (unsigned int k = 0; k < m_order.size() && faces < budget; ++k)
+		{
+			Request & q = m_requests[m_order[k]];
+			int face = -1;
+			for (unsigned short i = 0; i < q.faces; ++i)
+				if (!(q.faceMask & (1u << i)) && q.staleness[i] > 0.0f &&
+					(face < 0 || q.staleness[i] > q.staleness[face]))
+					face = i;
+			if (face < 0)
+				continue;
+			q.faceMask |= 1u << face;
+			++faces;
+			more = true;
+		}
+	}
+
+	for (RequestVec::const_iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr)
+		for (unsigned short i = 0; i < itr->faces; ++i)
+		{
+			if (itr->faceMask & (1u << i))
+				++m_facesUpdated;
+			else if (itr->staleness[i] > 0.0f)
+				++m_facesDeferred;
+			else
+				++m_facesReused;
+		}
+
+	return faces;
+}
+
+//------------------------------------------------------------------------------
+
+bool ShadowAtlas::setFilter(int mode)
+{
+	if (SHADOW_FILTER_ESM == mode && !m_filter.isReady() &&
+		!m_filter.init(m_manager, GL_TEXTURE_2D, m_size, 1, SHADOW_ATLAS_MAX_TILE))
+		return false;
+	m_filterMode = mode;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::bindFilterGL(GLenum textureUnit) const
+{
+	m_filter.bindGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::unbindFilterGL(GLenum textureUnit) const
+{
+	m_filter.unbindGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::bindGL(GLenum textureUnit) const
+{
+	if (m_isReady)
+	{
+		glActiveTexture(textureUnit);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowAtlas::unbindGL(GLenum textureUnit) const
+{
+	if (m_isReady)
+	{
+		glActiveTexture(textureUnit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+//==============================================================================
@@ -0,0 +1,186 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+//==============================================================================
+
+#include <cstdio>
+#include <shadowfilter.h>
+#include <gl3/gl3w.h>
+#include <glUtils.h>
+#include <shaders/manager.h>
+
+//==============================================================================
+
+ShadowFilter::ShadowFilter()
+	: m_fbo(0)
+	, m_vao(0)
+	, m_sampler(0)
+	, m_temp(0)
+	, m_esm(0)
+	, m_target(GL_TEXTURE_2D)
+	, m_tempSize(0)
+	, m_near(0.0f)
+	, m_far(0.0f)
+	, m_manager(NULL)
+	, m_isReady(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
+ShadowFilter::~ShadowFilter()
+{
+	if (m_fbo > 0) glDeleteFramebuffers(1, &m_fbo);
+	if (m_vao > 0) glDeleteVertexArrays(1, &m_vao);
+	if (m_sampler > 0) glDeleteSamplers(1, &m_sampler);
+	if (m_temp > 0) glDeleteTextures(1, &m_temp);
+	if (m_esm > 0) glDeleteTextures(1, &m_esm);
+}
+
+//------------------------------------------------------------------------------
+
+bool ShadowFilter::init(const Shader::Manager *manager, GLenum target, unsigned int size
+					, unsigned int layers, unsigned int maxRegion)
+{
+	m_manager = manager;
+	m_target = target;
+	m_tempSize = maxRegion;
+
+	// exp(k * depth) needs the range of 32-bit floats
+	glGenTextures(1, &m_esm);
+	glBindTexture(target, m_esm);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (GL_TEXTURE_2D_ARRAY == target)
+		glTexImage3D(target, 0, GL_R32F, size, size, layers, 0, GL_RED, GL_FLOAT, NULL);
+	else
+		glTexImage2D(target, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, NULL);
+	glBindTexture(target, 0);
+
+	glGenTextures(1, &m_temp);
+	glBindTexture(GL_TEXTURE_2D, m_temp);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, maxRegion, maxRegion, 0, GL_RED, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenSamplers(1, &m_sampler);
+	glSamplerParameteri(m_sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(m_sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(m_sampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+	// The blur draws one triangle from gl_VertexID alone, but core
+	// profiles still want a vertex array bound.
+	glGenVertexArrays(1, &m_vao);
+	glGenFramebuffers(1, &m_fbo);
+
+	m_isReady = !isGLError();
+	return m_isReady;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowFilter::filter(GLuint depthMap, int layer, GLint x, GLint y, GLsizei w, GLsizei h)
+{
+	if (!m_isReady || w > (GLsizei)m_tempSize || h > (GLsizei)m_tempSize)
+		return;
+
+	const Shader::Shader* _pblurshdr = m_manager->getShadowBlurShader();
+	if (!_pblurshdr->getIsReady())
+		return;
+	Shader::GLProgUniforms shaderUniforms;
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glBindVertexArray(m_vao);
+	_pblurshdr->bindGL();
+	if (isGLError()) return;
+
+	// Horizontal: depth -> exp(k * depth), into the corner of m_temp
+	glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_temp, 0);
+	glViewport(0, 0, w, h);
+	const bool isArray = (GL_TEXTURE_2D_ARRAY == m_target);
+	glActiveTexture(isArray ? GL_TEXTURE3 : GL_TEXTURE0);
+	glBindTexture(m_target, depthMap);
+	glBindSampler(isArray ? 3 : 0, m_sampler);
+
+	shaderUniforms.m_blur_src_rect[0] = x;
+	shaderUniforms.m_blur_src_rect[1] = y;
+	shaderUniforms.m_blur_src_rect[2] = w;
+	shaderUniforms.m_blur_src_rect[3] = h;
+	shaderUniforms.m_blur_dst_origin[0] = 0;
+	shaderUniforms.m_blur_dst_origin[1] = 0;
+	shaderUniforms.m_blur_step[0] = 1;
+	shaderUniforms.m_blur_step[1] = 0;
+	shaderUniforms.m_blur_layer = isArray ? layer : -1;
+	shaderUniforms.m_blur_exponent = SHADOW_ESM_EXPONENT;
+	shaderUniforms.m_blur_depth_range = gml::vec2_t(m_near, m_far);
+	if ( _pblurshdr->setUniforms(shaderUniforms) && !isGLError() )
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindSampler(isArray ? 3 : 0, 0);
+	glBindTexture(m_target, 0);
+
+	// Vertical: m_temp -> the region of the exponential shadow map
+	if (isArray)
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_esm, 0, layer);
+	else
+		glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_esm, 0);
+	glViewport(x, y, w, h);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_temp);
+
+	shaderUniforms.m_blur_src_rect[0] = 0;
+	shaderUniforms.m_blur_src_rect[1] = 0;
+	shaderUniforms.m_blur_dst_origin[0] = x;
+	shaderUniforms.m_blur_dst_origin[1] = y;
+	shaderUniforms.m_blur_step[0] = 0;
+	shaderUniforms.m_blur_step[1] = 1;
+	shaderUniforms.m_blur_layer = -1;
+	shaderUniforms.m_blur_exponent = 0.0f;
+	if ( _pblurshdr->setUniforms(shaderUniforms) && !isGLError() )
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	_pblurshdr->unbindGL();
+	glBindVertexArray(0);
+	isGLError();
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowFilter::bindGL(GLenum textureUnit) const
+{
+	if (m_isReady)
+	{
+		glActiveTexture(textureUnit);
+		glBindTexture(m_target, m_esm);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowFilter::unbindGL(GLenum textureUnit) const
+{
+	if (m_isReady)
+	{
+		glActiveTexture(textureUnit);
+		glBindTexture(m_target, 0);
+	}
+}
+
+//==============================================================================
@@ -15,7 +15,10 @@
 //==============================================================================
 
 #include <cstdio>
+#include <cstring>
 #include <math.h>
+#include <algorithm>
+#include <gml/expr.h>
 #include <shadowmap.h>
 #include <gl3/gl3.h>
 #include <gl3/gl3w.h>
@@ -25,8 +28,7 @@
 
 //==============================================================================
 
-ShadowMap::	ShadowMap(LightType lt, const gml::vec3_t & position
-		, const gml::vec3_t & target, const gml::vec3_t & up)
+ShadowMap::	ShadowMap(LightType lt, const gml::vec3_t & position)
 {
 	m_fbo = 0;
 	m_shadowmap = 0;
@@ -34,15 +36,36 @@ ShadowMap::	ShadowMap(LightType lt, const gml::vec3_t & position
 	m_near = 1.0;
 	m_far = 50.0;
 	m_shadowMapSize = 512;
-	Shader::Manager *m_manager = NULL;
+	m_manager = NULL;
 	m_isReady = false;
-	setupCamera(position, target, up);
+	m_atlasRect = gml::vec4_t(0, 0, 0, 0);
+	m_cachedRect = gml::vec4_t(0, 0, 0, 0);
+	m_cachedCasters = 0;
+	m_viewToWorld = gml::identity4();
+	m_range = m_far;
+	m_layered = true;
+	m_paraboloid = false;
+	m_filterMode = SHADOW_FILTER_PCF;
+	m_updated = 0;
+	m_reused = 0;
+	invalidate();
+	m_timerQuery = 0;
+	m_timerPending = false;
+	m_lastTimeMs = 0.0;
+	for (unsigned short i = 0; i < SHADOW_NUM_CASCADES; ++i) {
+		m_cascadeMats[i] = gml::identity4();
+		m_cascadeSplits[i] = 0.0f;
+	}
+	for (unsigned short i = 0; i < 6; ++i) {
+		m_cubeMats[i] = gml::identity4();
+		m_facePosition[i] = position;
+	}
+	setupCamera(position);
 }
 
 //------------------------------------------------------------------------------
 
-void ShadowMap::setupCamera(const gml::vec3_t & position
-						, const gml::vec3_t & target, const gml::vec3_t & up)
+void ShadowMap::setupCamera(const gml::vec3_t & position)
 {
 	for (CameraVec::iterator itr = m_cameras.begin(); itr != m_cameras.end(); ++itr)
 		delete *itr;
@@ -77,12 +100,9 @@ void ShadowMap::setupCamera(const gml::vec3_t & position
 	}
 	else if (LT_DIRECTIONAL == m_type)
 	{
+		// Only the orientation of this camera is used; the cascades build
+		// their own orthographic projections around it.
 		Camera* cam = new Camera();
-		
-		cam->lookAt(position, target, up);
-		cam->setFOV(M_PI * 0.5f);
-		cam->setAspect(1.0f);
-		cam->setDepthClip(m_near, m_far);
 		m_cameras.push_back(cam);
 	}
 }
@@ -93,49 +113,54 @@ ShadowMap::~ShadowMap()
 {
 	if (m_fbo > 0) glDeleteFramebuffers(1, &m_fbo);
 	if (m_shadowmap > 0) glDeleteTextures(1, &m_shadowmap);
+	if (m_timerQuery > 0) glDeleteQueries(1, &m_timerQuery);
 
+	for (CameraVec::iterator itr = m_cameras.begin(); itr != m_cameras.end(); ++itr)
+		delete *itr;
 }
 
 //------------------------------------------------------------------------------
 
 bool ShadowMap::init(const unsigned int & smapSize, const Shader::Manager *manager)
 {
-	glGenFramebuffers(1, &m_fbo);
-
-	glGenTextures(1, &m_shadowmap);
+	m_manager = manager;
+	m_shadowMapSize = smapSize;
 
+	// Point lights draw into the ShadowAtlas; they own no texture.
 	if (LT_POINT == m_type)
 	{
-		glBindTexture(GL_TEXTURE_CUBE_MAP, m_shadowmap);
-	
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);	// GL_NEAREST, GL_LINEAR
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);	// GL_NEAREST, GL_LINEAR
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-
-		for (unsigned short i = 0; i < 6; ++i) 
-			glTexImage2D ( GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, smapSize, smapSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		m_isReady = true;
+		return !isGLError();
 	}
-	else if (LT_DIRECTIONAL == m_type)
+
+	glGenQueries(1, &m_timerQuery);
+
+	glGenFramebuffers(1, &m_fbo);
+
+	// Depth-only framebuffer; there is no colour buffer to draw to.
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenTextures(1, &m_shadowmap);
+
+	if (LT_DIRECTIONAL == m_type)
 	{
-		glBindTexture(GL_TEXTURE_2D, m_shadowmap);
+		// One layer per cascade
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_shadowmap);
 	
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		// TODO: Check two following options
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-
-		glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, smapSize, smapSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		// Linear filtering with depth compare gives 2x2 PCF in hardware
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, SHADOWMAP_DEPTH_FORMAT, smapSize, smapSize, SHADOW_NUM_CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	}
 	
-	m_manager = manager;
-	m_shadowMapSize = smapSize;
 	m_isReady = glIsTexture(m_shadowmap) == GL_TRUE;
 
 	//printf("Is shadowmap ready:%s\n", m_isReady ? "True": "False");
@@ -146,9 +171,56 @@ bool ShadowMap::init(const unsigned int & smapSize, const Shader::Manager *manag
 
 //------------------------------------------------------------------------------
 
-void ShadowMap::create(const ObjectVec & scene, const gml::mat4x4_t &worldview
+void ShadowMap::prepare(const ObjectVec & scene, const Camera &mainCamera
+					, const gml::vec3_t & position)
+{
+	if (!m_isReady || LT_POINT != m_type || !hasAtlasRect())
+		return;
+
+	m_viewToWorld = gml::inverse(mainCamera.getWorldView());
+
+	// Only casters within the light's reach can shadow anything it lights
+	m_casters.clear();
+	for (ObjectVec::const_iterator itr = scene.begin(); itr != scene.end(); ++itr)
+	{
+		gml::vec3_t center;
+		float radius;
+		(*itr)->getBoundingSphere(center, radius);
+		if (gml::length(gml::sub(center, position)) < m_range + radius)
+			m_casters.push_back(*itr);
+	}
+
+	// A new tile holds someone else's faces, and new casters make every
+	// face wrong. Start the tile over from fully lit.
+	const unsigned short faces = getNumFaces();
+	const unsigned int casters = signature(m_casters);
+	const gml::vec4_t & r = m_atlasRect;
+	if (casters != m_cachedCasters ||
+		r.x != m_cachedRect.x || r.y != m_cachedRect.y || r.z != m_cachedRect.z)
+	{
+		for (unsigned short i = 0; i < 6; ++i)
+			m_faceValid[i] = false;
+
+		// Only the tile is cleared; the rest of the atlas belongs to other lights
+		glEnable(GL_SCISSOR_TEST);
+		glScissor((GLint)r.x, (GLint)r.y, (GLsizei)(std::min<unsigned short>(faces, 3) * r.z)
+				, (GLsizei)(((faces + 2) / 3) * r.z));
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+
+		m_cachedCasters = casters;
+		m_cachedRect = r;
+	}
+
+	for (unsigned short i = 0; i < faces; ++i)
+		updateCubeMatrix(i, m_faceValid[i] ? m_facePosition[i] : position);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::create(const ObjectVec & scene, const Camera &mainCamera
 					, const gml::vec3_t & position, const gml::vec3_t & target
-					, const gml::vec3_t & up)
+					, unsigned int faceMask)
 {
 	if ( !m_isReady )
 	{
@@ -158,68 +230,174 @@ void ShadowMap::create(const ObjectVec & scene, const gml::mat4x4_t &worldview
 		return;
 	}
 
+	m_updated = 0;
+	m_reused = 0;
+
+	// Point lights render into the ShadowAtlas framebuffer, which the
+	// atlas binds (and times) before asking each light for its faces.
+	if (LT_POINT == m_type)
+	{
+		if (!hasAtlasRect()) return;
+
+		glEnable(GL_DEPTH_TEST);
+		createCube(position, faceMask);
+		glDisable(GL_CULL_FACE);
+		glDisable(GL_DEPTH_TEST);
+		return;
+	}
+
+	// Read the last query once the GPU has caught up with it; until then
+	// keep the previous time, and leave this frame untimed.
+	if (m_timerPending)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(m_timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(m_timerQuery, GL_QUERY_RESULT, &elapsed);
+			m_lastTimeMs = elapsed * 1.0e-6;
+			m_timerPending = false;
+		}
+	}
+	const bool timed = !m_timerPending;
+
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo);
 	glViewport(0, 0, m_shadowMapSize, m_shadowMapSize);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
 	glEnable(GL_DEPTH_TEST);
 
 	if (isGLError()) return;
+
+	if (timed)
+		glBeginQuery(GL_TIME_ELAPSED, m_timerQuery);
 	
-	if (LT_POINT == m_type)
+	if (LT_DIRECTIONAL == m_type)
+		createCascades(scene, mainCamera, gml::sub(target, position));
+
+	if (timed)
 	{
-		gml::vec3_t _light_pos = gml::extract3(gml::mul(worldview, gml::vec4_t(position, 1.0)));
-		for (unsigned short i = 0; i < 6; ++i)
-			m_cameras[i]->setPosition(_light_pos);
+		glEndQuery(GL_TIME_ELAPSED);
+		m_timerPending = true;
 	}
-	else if (LT_DIRECTIONAL == m_type)
+
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::updateCubeMatrix(unsigned short face, const gml::vec3_t & position)
+{
+	if (m_paraboloid)
 	{
-		gml::vec3_t _light_pos = gml::extract3(gml::mul(worldview, gml::vec4_t(position, 1.0)));
-		gml::vec3_t _light_target = gml::extract3(gml::mul(worldview, gml::vec4_t(target, 1.0)));
-		gml::vec3_t _light_up = gml::extract3(gml::mul(worldview, gml::vec4_t(up, 1.0)));
-		m_cameras[0]->lookAt(_light_pos, _light_target, _light_up);
+		m_cubeMats[face] = gml::mul(paraboloidView(face, position), m_viewToWorld);
+		return;
 	}
-		
-	const Shader::Shader* _pdptshdr = m_manager->getDepthShader();
 
-	if (LT_POINT == m_type)
-	{
-		for (unsigned short i = 0; i < 6; ++i) {
-	
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, m_shadowmap, 0);
-			if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) return;
-			glClear(GL_DEPTH_BUFFER_BIT);
-			if (isGLError()) return;
+	// main camera view -> [0,1] texture coordinates of the face
+	const gml::mat4x4_t bias = gml::mul(gml::translate(gml::vec3_t(0.5f, 0.5f, 0.5f)), gml::scaleh(0.5f, 0.5f, 0.5f));
+	m_cameras[face]->setPosition(position);
+	m_cubeMats[face] = gml::mul(bias, gml::mul(m_cameras[face]->getProjection(), gml::mul(m_cameras[face]->getWorldView(), m_viewToWorld)));
+}
 
-			if (_pdptshdr->getIsReady()) {
-				_pdptshdr->bindGL();
-				if (isGLError()) return;
+//------------------------------------------------------------------------------
 
-				Shader::GLProgUniforms shaderUniforms;
-				shaderUniforms.m_projection = m_cameras[i]->getProjection();
+gml::mat4x4_t ShadowMap::paraboloidView(unsigned short face, const gml::vec3_t & position)
+{
+	// World -> hemisphere space. The second hemisphere is turned half way
+	// around y, so both look down their own -z.
+	const gml::mat4x4_t view = gml::translate(gml::scale(-1.0f, position));
+	return (0 == face) ? view : gml::mul(gml::rotateYh(M_PI), view);
+}
+
+//------------------------------------------------------------------------------
 
-				for (ObjectVec::const_iterator itr = scene.begin(); itr != scene.end(); ++itr)
-				{
-					shaderUniforms.m_modelView = gml::mul(m_cameras[i]->getWorldView(), 
-						gml::mul(worldview, (*itr)->getObjectToWorld()));
-					shaderUniforms.m_normalTrans = gml::transpose( gml::inverse(shaderUniforms.m_modelView) );
+float ShadowMap::getFaceStaleness(unsigned short face, const gml::vec3_t & position) const
+{
+	if (face >= getNumFaces())
+		return 0.0f;
+	if (!m_faceValid[face])
+		return SHADOWMAP_FAR;
+	return gml::length(gml::sub(position, m_facePosition[face]));
+}
 
-					if ( !_pdptshdr->setUniforms(shaderUniforms, false) || isGLError() ) return;
+//------------------------------------------------------------------------------
 
-					(*itr)->rasterize();
-					if (isGLError()) return;
-				}
-		
-				_pdptshdr->unbindGL();
-				glFinish();
-			}
+void ShadowMap::createCube(const gml::vec3_t & position, unsigned int faceMask)
+{
+	// The faces are fixed in world space, so moving the main camera only
+	// changes how they are looked up, never their contents.
+	unsigned int render = 0;
+	for (unsigned short i = 0; i < getNumFaces(); ++i)
+	{
+		if ((faceMask & (1u << i)) && getFaceStaleness(i, position) > 0.0f)
+		{
+			render |= 1u << i;
+			m_cameras[i]->setPosition(position);
+			++m_updated;
 		}
+		else
+			++m_reused;
 	}
-	else if (LT_DIRECTIONAL == m_type)
-	{
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_shadowmap, 0);
-		if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) return;
-		glClear(GL_DEPTH_BUFFER_BIT);
+	if (0 == render)
+		return;
+
+	gatherCasters();
+
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+
+	// Clear just the faces being redrawn
+	const gml::vec4_t & r = m_atlasRect;
+	glEnable(GL_SCISSOR_TEST);
+	for (unsigned short i = 0; i < 6; ++i)
+		if (render & (1u << i))
+		{
+			glScissor((GLint)(r.x + (i % 3) * r.z), (GLint)(r.y + (i / 3) * r.z), (GLsizei)r.z, (GLsizei)r.z);
+			glClear(GL_DEPTH_BUFFER_BIT);
+		}
+	glDisable(GL_SCISSOR_TEST);
+	if (isGLError()) return;
+
+	// Casters nearer than the near plane are clamped to it rather than
+	// clipped away, so they still cast.
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(SHADOWMAP_CUBE_OFFSET_FACTOR, SHADOWMAP_CUBE_OFFSET_UNITS);
+	glEnable(GL_DEPTH_CLAMP);
+
+	if (m_paraboloid)
+		createParaboloid(position, render);
+	else if (m_layered && m_manager->getCubeDepthShader()->getIsReady())
+		createCubeLayered(getAtlasRect(), render);
+	else
+		createCubeSixPass(r, render);
+
+	glDisable(GL_DEPTH_CLAMP);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+
+	for (unsigned short i = 0; i < 6; ++i)
+		if (render & (1u << i))
+		{
+			m_faceValid[i] = true;
+			m_facePosition[i] = position;
+			updateCubeMatrix(i, position);
+		}
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::createCubeSixPass(const gml::vec4_t & tile, unsigned int faceMask)
+{
+	// Plain perspective depth, the same as the layered path writes
+	const Shader::Shader* _pdptshdr = m_manager->getCascadeDepthShader();
+
+	for (unsigned short i = 0; i < 6; ++i) {
+		if (!(faceMask & (1u << i)))
+			continue;
+
+		// Faces are laid out 3 x 2 inside the tile
+		glViewport((GLint)(tile.x + (i % 3) * tile.z), (GLint)(tile.y + (i / 3) * tile.z)
+				, (GLsizei)tile.z, (GLsizei)tile.z);
 		if (isGLError()) return;
 
 		if (_pdptshdr->getIsReady()) {
@@ -227,17 +405,16 @@ void ShadowMap::create(const ObjectVec & scene, const gml::mat4x4_t &worldview
 			if (isGLError()) return;
 
 			Shader::GLProgUniforms shaderUniforms;
-			shaderUniforms.m_projection = m_cameras[0]->getProjection();
+			shaderUniforms.m_projection = m_cameras[i]->getProjection();
 
-			for (ObjectVec::const_iterator itr = scene.begin(); itr != scene.end(); ++itr)
+			transformCasters(m_cameras[i]->getWorldView());
+			for (size_t j = 0; j < m_casters.size(); ++j)
 			{
-				shaderUniforms.m_modelView = gml::mul(m_cameras[0]->getWorldView(), 
-					gml::mul(worldview, (*itr)->getObjectToWorld()));
-				shaderUniforms.m_normalTrans = gml::transpose( gml::inverse(shaderUniforms.m_modelView) );
+				shaderUniforms.m_modelView = gml::embed(m_casterView[j]);
 
 				if ( !_pdptshdr->setUniforms(shaderUniforms, false) || isGLError() ) return;
 
-				(*itr)->rasterize();
+				m_casters[j]->rasterize();
 				if (isGLError()) return;
 			}
 	
@@ -245,10 +422,386 @@ void ShadowMap::create(const ObjectVec & scene, const gml::mat4x4_t &worldview
 			glFinish();
 		}
 	}
-	
+}
 
-	glDisable(GL_CULL_FACE);
-	glDisable(GL_DEPTH_TEST);
+//------------------------------------------------------------------------------
+
+void ShadowMap::createCubeLayered(const gml::vec4_t & tile, unsigned int faceMask)
+{
+	// The viewport covers the whole atlas; the geometry shader moves each
+	// face into its part of the tile and clips it to the face edges.
+	glViewport(0, 0, (GLsizei)m_atlasRect.w, (GLsizei)m_atlasRect.w);
+	for (unsigned short i = 0; i < 4; ++i)
+		glEnable(GL_CLIP_DISTANCE0 + i);
+
+	const Shader::Shader* _pdptshdr = m_manager->getCubeDepthShader();
+	_pdptshdr->bindGL();
+	if (isGLError()) return;
+
+	Shader::GLProgUniforms shaderUniforms;
+	shaderUniforms.m_projection = m_cameras[0]->getProjection();
+	shaderUniforms.m_shadowRect = tile;
+	shaderUniforms.m_cube_face_mask = faceMask;
+	for (unsigned short i = 0; i < 6; ++i)
+		shaderUniforms.m_cube_face_mats[i] = m_cameras[i]->getWorldView();
+
+	for (size_t j = 0; j < m_casters.size(); ++j)
+	{
+		shaderUniforms.m_modelView = gml::embed(m_casterWorld[j]);
+
+		if ( !_pdptshdr->setUniforms(shaderUniforms, false) || isGLError() ) break;
+
+		m_casters[j]->rasterize();
+		if (isGLError()) break;
+	}
+
+	_pdptshdr->unbindGL();
+	for (unsigned short i = 0; i < 4; ++i)
+		glDisable(GL_CLIP_DISTANCE0 + i);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::createParaboloid(const gml::vec3_t & position, unsigned int faceMask)
+{
+	const Shader::Shader* _pdptshdr = m_manager->getParaboloidDepthShader();
+	if (!_pdptshdr->getIsReady()) return;
+
+	// The shader clips away what is behind each hemisphere
+	glEnable(GL_CLIP_DISTANCE0);
+	_pdptshdr->bindGL();
+	if (isGLError()) return;
+
+	const gml::vec4_t & r = m_atlasRect;
+	for (unsigned short i = 0; i < SHADOWMAP_PARABOLOID_FACES; ++i)
+	{
+		if (!(faceMask & (1u << i)))
+			continue;
+
+		glViewport((GLint)(r.x + i * r.z), (GLint)r.y, (GLsizei)r.z, (GLsizei)r.z);
+
+		Shader::GLProgUniforms shaderUniforms;
+		transformCasters(paraboloidView(i, position));
+		for (size_t j = 0; j < m_casters.size(); ++j)
+		{
+			shaderUniforms.m_modelView = gml::embed(m_casterView[j]);
+
+			if ( !_pdptshdr->setUniforms(shaderUniforms, false) || isGLError() ) break;
+
+			m_casters[j]->rasterize();
+			if (isGLError()) break;
+		}
+	}
+
+	_pdptshdr->unbindGL();
+	glDisable(GL_CLIP_DISTANCE0);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::setAtlasRect(const gml::vec4_t & rect)
+{
+	// Another light may draw into the old tile meanwhile, so it must not be
+	// reused if this light gets it back later
+	if (rect.z == 0.0f || rect.x != m_atlasRect.x || rect.y != m_atlasRect.y || rect.z != m_atlasRect.z)
+	{
+		m_cachedRect = gml::vec4_t(0, 0, 0, 0);
+		for (unsigned short i = 0; i < 6; ++i)
+			m_faceValid[i] = false;
+	}
+	m_atlasRect = rect;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::setParaboloid(bool paraboloid)
+{
+	// The tile changes shape; have prepare() start it over
+	m_paraboloid = paraboloid;
+	m_cachedRect = gml::vec4_t(0, 0, 0, 0);
+	invalidate();
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int ShadowMap::signature(const ConstObjectVec & casters)
+{
+	// FNV-1a over the identity and revision of every caster, so a caster
+	// changing, entering or leaving the set changes the result
+	unsigned int h = 2166136261u;
+	for (ConstObjectVec::const_iterator itr = casters.begin(); itr != casters.end(); ++itr)
+	{
+		h = (h ^ (unsigned int)(size_t)(*itr)) * 16777619u;
+		h = (h ^ (*itr)->getRevision()) * 16777619u;
+	}
+	return h;
+}
+
+//------------------------------------------------------------------------------
+
+// Off-centre orthographic projection looking down -z of the light frame.
+//  n & f are distances along -z, and may be negative for casters behind
+//  the origin of the light frame.
+static gml::mat4x4_t orthoProjection(float l, float r, float b, float t, float n, float f)
+{
+	gml::mat4x4_t proj = gml::identity4();
+	proj[0][0] = 2.0f / (r - l);
+	proj[1][1] = 2.0f / (t - b);
+	proj[2][2] = -2.0f / (f - n);
+	proj[3] = gml::vec4_t(-(r + l) / (r - l), -(t + b) / (t - b), -(f + n) / (f - n), 1.0f);
+	return proj;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::createCascades(const ObjectVec & scene, const Camera &mainCamera
+					, const gml::vec3_t & direction)
+{
+	// Single-sided room walls facing away from the light must not cast, so
+	// cull back faces and push depth away with a slope-scaled offset instead.
+	// Depth clamping flattens casters in front of the near plane onto it.
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_BACK);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(SHADOWMAP_CASCADE_OFFSET_FACTOR, SHADOWMAP_CASCADE_OFFSET_UNITS);
+	glEnable(GL_DEPTH_CLAMP);
+
+	// The light frame is anchored at the world origin, so it only changes
+	// when the light direction does. Together with the texel snapping below
+	// this keeps the cascades from shimmering as the camera moves.
+	gml::vec3_t _dir = gml::normalize(direction);
+	gml::vec3_t _up = (fabsf(_dir.y) > 0.99f) ? gml::vec3_t(0, 0, 1) : gml::vec3_t(0, 1, 0);
+	m_cameras[0]->lookAt(gml::vec3_t(0, 0, 0), _dir, _up);
+	const gml::mat4x4_t & lightView = m_cameras[0]->getWorldView();
+	const gml::mat4x4_t viewToWorld = gml::inverse(mainCamera.getWorldView());
+
+	// [-1,1] clip coordinates -> [0,1] texture coordinates
+	const gml::mat4x4_t bias = gml::mul(gml::translate(gml::vec3_t(0.5f, 0.5f, 0.5f)), gml::scaleh(0.5f, 0.5f, 0.5f));
+
+	// Practical split scheme
+	const float camNear = mainCamera.getNearClip();
+	const float camFar = mainCamera.getFarClip();
+	float splits[SHADOW_NUM_CASCADES + 1];
+	splits[0] = camNear;
+	for (unsigned short i = 1; i <= SHADOW_NUM_CASCADES; ++i)
+	{
+		float p = (float)i / SHADOW_NUM_CASCADES;
+		float logSplit = camNear * powf(camFar / camNear, p);
+		float uniSplit = camNear + (camFar - camNear) * p;
+		splits[i] = SHADOWMAP_CASCADE_LAMBDA * logSplit + (1.0f - SHADOWMAP_CASCADE_LAMBDA) * uniSplit;
+	}
+
+	// Light-space bounds of every potential caster, shared by all cascades
+	m_casterBounds.resize(scene.size());
+	m_casterCenters.resize(scene.size());
+	const gml::vec3soa_t centers = m_casterCenters.soa();
+	for (unsigned int i = 0; i < scene.size(); ++i)
+	{
+		gml::vec3_t center;
+		scene[i]->getBoundingSphere(center, m_casterBounds[i].w);
+		centers.set(i, center);
+	}
+	gml::transformPoints(lightView, centers, centers);
+	for (unsigned int i = 0; i < scene.size(); ++i)
+		m_casterBounds[i] = gml::vec4_t(centers.get(i), m_casterBounds[i].w);
+
+	const float tanV = tanf(0.5f * mainCamera.getFOV());
+	const float tanH = tanV * mainCamera.getAspect();
+
+	const Shader::Shader* _pdptshdr = m_manager->getCascadeDepthShader();
+	if (!_pdptshdr->getIsReady()) return;
+
+	_pdptshdr->bindGL();
+	if (isGLError()) return;
+
+	unsigned int rendered = 0;
+	for (unsigned short c = 0; c < SHADOW_NUM_CASCADES; ++c)
+	{
+		// Bounding sphere of this slice of the view frustum. Its radius only
+		// depends on the frustum shape, so it does not change as the camera
+		// rotates; rounding it up guards against float noise.
+		gml::vec3_t corners[8];
+		gml::vec3_t center(0, 0, 0);
+		for (unsigned short i = 0; i < 8; ++i)
+		{
+			float d = (i & 4) ? splits[c + 1] : splits[c];
+			gml::vec4_t corner((i & 1 ? d : -d) * tanH, (i & 2 ? d : -d) * tanV, -d, 1.0f);
+			corners[i] = gml::extract3(gml::mul(viewToWorld, corner));
+			center = gml::add(center, corners[i]);
+		}
+		center = gml::scale(1.0f / 8.0f, center);
+		float radius = 0.0f;
+		for (unsigned short i = 0; i < 8; ++i)
+			radius = fmaxf(radius, gml::length(gml::sub(corners[i], center)));
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// Snap the cascade centre to whole shadow map texels in light space
+		gml::vec3_t lc = gml::expr::eval3(gml::expr::mul(lightView, gml::expr::point(center)));
+		const float texel = 2.0f * radius / m_shadowMapSize;
+		lc.x = floorf(lc.x / texel) * texel;
+		lc.y = floorf(lc.y / texel) * texel;
+
+		// The depth range is snapped outwards to coarse steps as well, so
+		// small camera moves leave the cascade, and its cache, untouched.
+		const float zStep = radius / 8.0f;
+		float zNear = -lc.z - radius;
+		float zFar = ceilf((-lc.z + radius) / zStep) * zStep;
+
+		// Per-cascade caster culling. Casters between the light and the
+		// receivers are kept; depth clamping pins them to the near plane,
+		// so the depth range only has to span the receivers.
+		m_casters.clear();
+		for (unsigned int i = 0; i < scene.size(); ++i)
+		{
+			const gml::vec4_t & b = m_casterBounds[i];
+			if (fabsf(b.x - lc.x) > radius + b.w || fabsf(b.y - lc.y) > radius + b.w)
+				continue;
+			if (-b.z - b.w > zFar) // entirely behind every receiver
+				continue;
+			m_casters.push_back(scene[i]);
+		}
+
+		zNear = floorf(zNear / zStep) * zStep;
+
+		gml::mat4x4_t proj = orthoProjection(lc.x - radius, lc.x + radius, lc.y - radius, lc.y + radius, zNear, zFar);
+		m_cascadeMats[c] = gml::mul(bias, gml::mul(proj, gml::mul(lightView, viewToWorld)));
+		m_cascadeSplits[c] = splits[c + 1];
+
+		// Reuse the layer if it would be rendered from the same projection
+		// with the same casters
+		const gml::mat4x4_t lightProj = gml::mul(proj, lightView);
+		const unsigned int casters = signature(m_casters);
+		if (m_cascadeValid[c] && casters == m_cascadeCasters[c] &&
+			0 == memcmp(&lightProj, &m_cascadeLightProj[c], sizeof(lightProj)))
+		{
+			++m_reused;
+			continue;
+		}
+		m_cascadeValid[c] = false;
+
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_shadowmap, 0, c);
+		if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) break;
+		glClear(GL_DEPTH_BUFFER_BIT);
+		if (isGLError()) break;
+
+		Shader::GLProgUniforms shaderUniforms;
+		shaderUniforms.m_projection = proj;
+
+		gatherCasters();
+		transformCasters(lightView);
+		bool drawn = true;
+		for (size_t j = 0; drawn && j < m_casters.size(); ++j)
+		{
+			shaderUniforms.m_modelView = gml::embed(m_casterView[j]);
+
+			if ( !_pdptshdr->setUniforms(shaderUniforms, false) || isGLError() )
+				drawn = false;
+			else
+			{
+				m_casters[j]->rasterize();
+				drawn = !isGLError();
+			}
+		}
+		// A partly drawn layer stays invalid, and is drawn again next frame
+		if (!drawn) break;
+
+		m_cascadeValid[c] = true;
+		m_cascadeCasters[c] = casters;
+		m_cascadeLightProj[c] = lightProj;
+		rendered |= 1u << c;
+		++m_updated;
+	}
+
+	_pdptshdr->unbindGL();
+	glDisable(GL_DEPTH_CLAMP);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+
+	if (SHADOW_FILTER_ESM == m_filterMode)
+		for (unsigned short c = 0; c < SHADOW_NUM_CASCADES; ++c)
+			if (rendered & (1u << c))
+				m_filter.filter(m_shadowmap, c, 0, 0, m_shadowMapSize, m_shadowMapSize);
+	glFinish();
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::gatherCasters()
+{
+	m_casterWorld.resize(m_casters.size());
+	for (size_t i = 0; i < m_casters.size(); ++i)
+		m_casterWorld[i] = m_casters[i]->getTransform();
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::transformCasters(const gml::mat4x4_t & view)
+{
+	// Light views are affine too
+	const gml::affine_t _view = gml::affine(view);
+	m_casterView.resize(m_casterWorld.size());
+	for (size_t i = 0; i < m_casterWorld.size(); ++i)
+		m_casterView[i] = gml::mul(_view, m_casterWorld[i]);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::invalidate()
+{
+	for (unsigned short i = 0; i < 6; ++i)
+		m_faceValid[i] = false;
+	for (unsigned short i = 0; i < SHADOW_NUM_CASCADES; ++i)
+		m_cascadeValid[i] = false;
+}
+
+//------------------------------------------------------------------------------
+
+bool ShadowMap::setFilter(int mode)
+{
+	// Point lights are filtered by the ShadowAtlas
+	if (LT_DIRECTIONAL == m_type && SHADOW_FILTER_ESM == mode && !m_filter.isReady() &&
+		!m_filter.init(m_manager, GL_TEXTURE_2D_ARRAY, m_shadowMapSize, SHADOW_NUM_CASCADES, m_shadowMapSize))
+		return false;
+	m_filterMode = mode;
+	invalidate();
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::bindFilterGL(GLenum textureUnit) const
+{
+	if (LT_DIRECTIONAL == m_type)
+		m_filter.bindGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
+void ShadowMap::unbindFilterGL(GLenum textureUnit) const
+{
+	if (LT_DIRECTIONAL == m_type)
+		m_filter.unbindGL(textureUnit);
+}
+
+//------------------------------------------------------------------------------
+
+gml::vec4_t ShadowMap::getCascadeSplits() const
+{
+	// Unused components are pushed past any view depth
+	gml::vec4_t splits(SHADOWMAP_FAR, SHADOWMAP_FAR, SHADOWMAP_FAR, SHADOWMAP_FAR);
+	for (unsigned short i = 0; i < SHADOW_NUM_CASCADES && i < 4; ++i)
+		splits[i] = m_cascadeSplits[i];
+	return splits;
+}
+
+//------------------------------------------------------------------------------
+
+gml::vec4_t ShadowMap::getAtlasRect() const
+{
+	if (!hasAtlasRect())
+		return gml::vec4_t(0, 0, 0, 0);
+	const float invAtlas = 1.0f / m_atlasRect.w;
+	return gml::vec4_t(m_atlasRect.x * invAtlas, m_atlasRect.y * invAtlas
+					, m_atlasRect.z * invAtlas, 1.0f / m_atlasRect.z);
 }
 
 //------------------------------------------------------------------------------
@@ -257,11 +810,12 @@ void ShadowMap::bindGL(GLenum textureUnit) const
 {
 	if (m_isReady)
 	{
-		glActiveTexture(textureUnit);
-		if (LT_POINT == m_type)
-			glBindTexture(GL_TEXTURE_CUBE_MAP, m_shadowmap);
-		else if (LT_DIRECTIONAL == m_type)
-			glBindTexture(GL_TEXTURE_2D, m_shadowmap);
+		// Point lights are read from the ShadowAtlas texture
+		if (LT_DIRECTIONAL == m_type)
+		{
+			glActiveTexture(textureUnit);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, m_shadowmap);
+		}
 	}
 }
 
@@ -271,11 +825,11 @@ void ShadowMap::unbindGL(GLenum textureUnit) const
 {
 	if (m_isReady)
 	{
-		glActiveTexture(textureUnit);
-		if (LT_POINT == m_type)
-			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		else if (LT_DIRECTIONAL == m_type)
-			glBindTexture(GL_TEXTURE_2D, 0);
+		if (LT_DIRECTIONAL == m_type)
+		{
+			glActiveTexture(textureUnit);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		}
 	}
 }
 
@@ -0,0 +1,546 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdio>
+#include <algorithm>
+
+#include <texture/arraypool.h>
+#include <texture/manager.h>
+#include <gl3/gl3w.h>
+#include <glUtils.h>
+
+// EXT_texture_filter_anisotropic; not in the gl3w headers
+#if !defined (GL_TEXTURE_MAX_ANISOTROPY_EXT)
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+
+namespace Texture
+{
+
+bool ArrayPool::Key::operator<(const Key &other) const
+{
+	if (m_isReady != other.m_isReady) return m_isReady < other.m_isReady;
+	if (m_format != other.m_format) return m_format < other.m_format;
+	if (m_width != other.m_width) return m_width < other.m_width;
+	if (m_height != other.m_height) return m_height < other.m_height;
+	if (m_numLevels != other.m_numLevels) return m_numLevels < other.m_numLevels;
+	if (m_minFilter != other.m_minFilter) return m_minFilter < other.m_minFilter;
+	if (m_magFilter != other.m_magFilter) return m_magFilter < other.m_magFilter;
+	if (m_wrap != other.m_wrap) return m_wrap < other.m_wrap;
+	return m_anisotropy < other.m_anisotropy;
+}
+
+bool ArrayPool::Key::operator!=(const Key &other) const
+{
+	return (*this < other) || (other < *this);
+}
+
+// Uncompressed levels are copied as bytes of GL_RED or GL_RGBA; rows are
+// 4-byte aligned either way.
+static bool isCompressed(GLenum format)
+{
+	return 0 != blockBytes((BlockFormat)format);
+}
+static GLenum copyFormat(GLenum format)
+{
+	return (GL_R8 == format) ? GL_RED : GL_RGBA;
+}
+static size_t copyBytes(GLenum format, uint16_t width, uint16_t height)
+{
+	if (isCompressed(format))
+	{
+		return compressedSize((BlockFormat)format, width, height);
+	}
+	const size_t texel = (GL_RED == copyFormat(format)) ? 1 : 4;
+	return ((width * texel + 3) & ~(size_t)3) * height;
+}
+
+ArrayPool::ArrayPool()
+{
+	m_buffer = 0;
+	m_bufferBytes = 0;
+	m_bytes = 0;
+	mp_manager = 0;
+	m_unpackedBytes = 0;
+	m_isDirty = false;
+	m_revision = 0;
+}
+
+ArrayPool::~ArrayPool()
+{
+	destroy();
+	if (m_buffer) glDeleteBuffers(1, &m_buffer);
+}
+
+ArrayPool::Key ArrayPool::key(const Texture *texture)
+{
+	Key k;
+	k.m_isReady = texture->getIsReady();
+	k.m_format = texture->getInternalFormat();
+	k.m_width = std::max(texture->getWidth() >> texture->getSkipLevels(), 1);
+	k.m_height = std::max(texture->getHeight() >> texture->getSkipLevels(), 1);
+	k.m_numLevels = texture->getNumLevels();
+	k.m_minFilter = texture->getMinFilter();
+	k.m_magFilter = texture->getMagFilter();
+	k.m_wrap = texture->getWrapMode();
+	k.m_anisotropy = texture->getAnisotropy();
+	return k;
+}
+
+void ArrayPool::add(const Texture *texture)
+{
+	if (!texture) return;
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_texture == texture) return;
+	}
+	Member m;
+	m.m_texture = texture;
+	m.m_key = key(texture);
+	m.m_layer.m_array = 0;
+	m.m_layer.m_layer = -1;
+	m_members.push_back(m);
+	m_isDirty = true;
+}
+
+void ArrayPool::remove(const Texture *texture)
+{
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_texture == texture)
+		{
+			unpack(m_members[i]);
+			m_members.erase(m_members.begin() + i);
+			m_isDirty = true;
+			return;
+		}
+	}
+}
+
+void ArrayPool::update()
+{
+	// The layers are copies, so a texture that is reloaded as it was
+	// (even under another handle) keeps its layer; one that changed
+	// leaves its array, and is packed again with its new group
+	bool changed = m_isDirty;
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		const Key k = key(m_members[i].m_texture);
+		if (k != m_members[i].m_key)
+		{
+			unpack(m_members[i]);
+			m_members[i].m_key = k;
+			changed = true;
+		}
+	}
+	// Give up arrays when the textures need the memory, and pack more
+	// once one that was left out fits
+	const size_t limit = room();
+	changed = changed || m_bytes > limit || (m_unpackedBytes && m_bytes + m_unpackedBytes <= limit);
+	if (changed)
+	{
+		pack(limit);
+	}
+}
+
+const ArrayPool::Layer* ArrayPool::find(const Texture *texture) const
+{
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_texture == texture)
+		{
+			return m_members[i].m_layer.m_array ? &m_members[i].m_layer : 0;
+		}
+	}
+	return 0;
+}
+
+void ArrayPool::bindGL(const Layer &layer, GLenum textureUnit) const
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layer.m_array);
+}
+
+void ArrayPool::unbindGL(GLenum textureUnit) const
+{
+	glActiveTexture(textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void ArrayPool::destroy()
+{
+	for (size_t i = 0; i < m_arrays.size(); ++i)
+	{
+		glDeleteTextures(1, &m_arrays[i].m_handle);
+	}
+	m_arrays.clear();
+	m_bytes = 0;
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		m_members[i].m_layer.m_array = 0;
+		m_members[i].m_layer.m_layer = -1;
+	}
+}
+
+void ArrayPool::unpack(Member &member)
+{
+	if (0 == member.m_layer.m_array)
+	{
+		return;
+	}
+	for (size_t i = 0; i < m_arrays.size(); ++i)
+	{
+		if (m_arrays[i].m_handle == member.m_layer.m_array)
+		{
+			m_arrays[i].m_layers[member.m_layer.m_layer] = 0;
+			break;
+		}
+	}
+	member.m_layer.m_array = 0;
+	member.m_layer.m_layer = -1;
+	++m_revision;
+}
+
+void ArrayPool::release(size_t array)
+{
+	Array &a = m_arrays[array];
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_layer.m_array == a.m_handle)
+		{
+			m_members[i].m_layer.m_array = 0;
+			m_members[i].m_layer.m_layer = -1;
+		}
+	}
+	glDeleteTextures(1, &a.m_handle);
+	m_bytes -= a.m_layerBytes * a.m_layers.size();
+	m_arrays.erase(m_arrays.begin() + array);
+	++m_revision;
+}
+
+size_t ArrayPool::room() const
+{
+	const size_t budget = mp_manager ? mp_manager->getBudget() : 0;
+	if (0 == budget)
+	{
+		return (size_t)-1;
+	}
+	return budget - std::min(budget, mp_manager->getBytes());
+}
+
+bool ArrayPool::pack(size_t room)
+{
+	m_unpackedBytes = 0;
+	m_isDirty = false;
+
+	// An array left with one texture gains nothing; the last arrays go
+	// first when there is not room for them all
+	for (size_t i = m_arrays.size(); i-- > 0; )
+	{
+		const size_t used = m_arrays[i].m_layers.size() -
+			std::count(m_arrays[i].m_layers.begin(), m_arrays[i].m_layers.end(), (const Texture*)0);
+		if (used < 2)
+		{
+			release(i);
+		}
+	}
+	while (m_bytes > room && !m_arrays.empty())
+	{
+		release(m_arrays.size() - 1);
+	}
+
+	// Ready members that are not packed, by key; each run of equal keys
+	// is a group
+	std::vector<size_t> order;
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_key.m_isReady && 0 == m_members[i].m_layer.m_array)
+		{
+			order.push_back(i);
+		}
+	}
+	if (order.empty())
+	{
+		return true;
+	}
+	struct ByKey
+	{
+		const std::vector<Member> &m_members;
+		ByKey(const std::vector<Member> &members) : m_members(members) {}
+		bool operator()(size_t a, size_t b) const { return m_members[a].m_key < m_members[b].m_key; }
+	};
+	std::stable_sort(order.begin(), order.end(), ByKey(m_members));
+
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (0 == m_buffer)
+	{
+		glGenBuffers(1, &m_buffer);
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	bool ok = !isGLError() && m_buffer && maxLayers > 1;
+	for (size_t first = 0; ok && first < order.size(); )
+	{
+		const Key &k = m_members[order[first]].m_key;
+		// Layers are the size of the textures
+		const size_t layerBytes = m_members[order[first]].m_texture->getBytes();
+		size_t last = first + 1;
+		while (last < order.size() && !(k != m_members[order[last]].m_key))
+		{
+			++last;
+		}
+
+		// Into the free layers of the group's arrays, growing them if
+		// there are too few. They at least double, so that a texture is
+		// copied again only a few times as the group fills.
+		size_t next = first;
+		for (size_t i = 0; ok && next < last && i < m_arrays.size(); ++i)
+		{
+			Array &a = m_arrays[i];
+			if (a.m_key != k)
+			{
+				continue;
+			}
+			const size_t free = std::count(a.m_layers.begin(), a.m_layers.end(), (const Texture*)0);
+			if (last - next > free && a.m_layers.size() < (size_t)maxLayers)
+			{
+				const size_t count = std::min((size_t)maxLayers,
+						std::max(a.m_layers.size() * 2, a.m_layers.size() + (last - next) - free));
+				const size_t bytes = layerBytes * (count - a.m_layers.size());
+				if (m_bytes + bytes <= room)
+				{
+					ok = grow(i, count);
+				}
+				else if (0 == m_unpackedBytes || bytes < m_unpackedBytes)
+				{
+					m_unpackedBytes = bytes;
+				}
+			}
+			glBindTexture(GL_TEXTURE_2D_ARRAY, a.m_handle);
+			for (size_t layer = 0; ok && next < last && layer < a.m_layers.size(); ++layer)
+			{
+				if (a.m_layers[layer])
+				{
+					continue;
+				}
+				ok = copyLayer(m_members[order[next]].m_texture, k, layer);
+				if (ok)
+				{
+					a.m_layers[layer] = m_members[order[next]].m_texture;
+					m_members[order[next]].m_layer.m_array = a.m_handle;
+					m_members[order[next]].m_layer.m_layer = layer;
+					++m_revision;
+					++next;
+				}
+				else
+				{
+					fprintf(stderr, "ERROR! Could not pack a texture into an array\n");
+				}
+			}
+		}
+
+		// New arrays for the rest; a texture on its own gains nothing
+		// from one
+		while (ok && last - next >= 2)
+		{
+			const size_t count = std::min(last - next, (size_t)maxLayers);
+			const size_t bytes = layerBytes * count;
+			if (m_bytes + bytes > room)
+			{
+				if (0 == m_unpackedBytes || bytes < m_unpackedBytes)
+				{
+					m_unpackedBytes = bytes;
+				}
+				break;
+			}
+			const GLuint handle = createArray(k, count);
+			bool copied = (0 != handle);
+			for (size_t i = 0; copied && i < count; ++i)
+			{
+				copied = copyLayer(m_members[order[next + i]].m_texture, k, i);
+			}
+			if (!copied)
+			{
+				fprintf(stderr, "ERROR! Could not pack %u textures into an array\n", (unsigned int)count);
+				if (handle)
+				{
+					glDeleteTextures(1, &handle);
+				}
+				ok = false;
+				break;
+			}
+			Array a;
+			a.m_handle = handle;
+			a.m_key = k;
+			a.m_layerBytes = layerBytes;
+			for (size_t i = 0; i < count; ++i)
+			{
+				Member &m = m_members[order[next + i]];
+				a.m_layers.push_back(m.m_texture);
+				m.m_layer.m_array = handle;
+				m.m_layer.m_layer = i;
+			}
+			m_arrays.push_back(a);
+			m_bytes += bytes;
+			++m_revision;
+			next += count;
+		}
+		first = last;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return ok;
+}
+
+bool ArrayPool::grow(size_t array, size_t count)
+{
+	// The textures keep their layers; they are copied from the textures,
+	// which still have the levels
+	Array &a = m_arrays[array];
+	const GLuint handle = createArray(a.m_key, count);
+	bool copied = (0 != handle);
+	for (size_t i = 0; copied && i < a.m_layers.size(); ++i)
+	{
+		if (a.m_layers[i])
+		{
+			copied = copyLayer(a.m_layers[i], a.m_key, i);
+		}
+	}
+	if (!copied)
+	{
+		fprintf(stderr, "ERROR! Could not grow an array to %u textures\n", (unsigned int)count);
+		if (handle)
+		{
+			glDeleteTextures(1, &handle);
+		}
+		return false;
+	}
+	for (size_t i = 0; i < m_members.size(); ++i)
+	{
+		if (m_members[i].m_layer.m_array == a.m_handle)
+		{
+			m_members[i].m_layer.m_array = handle;
+		}
+	}
+	glDeleteTextures(1, &a.m_handle);
+	a.m_handle = handle;
+	m_bytes += a.m_layerBytes * (count - a.m_layers.size());
+	a.m_layers.resize(count, 0);
+	++m_revision;
+	return true;
+}
+
+GLuint ArrayPool::createArray(const Key &key, GLsizei count)
+{
+	GLuint array = 0;
+	glGenTextures(1, &array);
+	if ( isGLError() || (0 == array) )
+	{
+		return 0;
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+
+	// Sampled as the textures would be
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, key.m_wrap);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, key.m_wrap);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, key.m_minFilter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, key.m_magFilter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, key.m_numLevels - 1);
+	if (key.m_anisotropy > 1.0f)
+	{
+		glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, key.m_anisotropy);
+	}
+
+	if (glTexStorage3D)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, key.m_numLevels, key.m_format, key.m_width, key.m_height, count);
+	}
+	else
+	{
+		uint16_t width = key.m_width, height = key.m_height;
+		for (uint8_t i = 0; i < key.m_numLevels; ++i)
+		{
+			if (isCompressed(key.m_format))
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, key.m_format, width, height, count, 0,
+						copyBytes(key.m_format, width, height) * count, 0);
+			}
+			else
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, i, key.m_format, width, height, count, 0,
+						copyFormat(key.m_format), GL_UNSIGNED_BYTE, 0);
+			}
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+	}
+
+	// Room for the largest level
+	const size_t bytes = copyBytes(key.m_format, key.m_width, key.m_height);
+	if (bytes > m_bufferBytes)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, 0, GL_STREAM_COPY);
+		m_bufferBytes = bytes;
+	}
+	if (isGLError())
+	{
+		glDeleteTextures(1, &array);
+		return 0;
+	}
+	return array;
+}
+
+bool ArrayPool::copyLayer(const Texture *texture, const Key &key, GLint layer)
+{
+	// Each level is read into the buffer and written from it, without
+	// leaving the GPU
+	GLint bound = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	glBindTexture(GL_TEXTURE_2D, texture->getHandle());
+	uint16_t width = key.m_width, height = key.m_height;
+	for (uint8_t i = 0; i < key.m_numLevels; ++i)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_buffer);
+		if (isCompressed(key.m_format))
+		{
+			glGetCompressedTexImage(GL_TEXTURE_2D, i, 0);
+		}
+		else
+		{
+			glGetTexImage(GL_TEXTURE_2D, i, copyFormat(key.m_format), GL_UNSIGNED_BYTE, 0);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+		if (isCompressed(key.m_format))
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, width, height, 1,
+					key.m_format, copyBytes(key.m_format, width, height), 0);
+		}
+		else
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, width, height, 1,
+					copyFormat(key.m_format), GL_UNSIGNED_BYTE, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	glBindTexture(GL_TEXTURE_2D, bound);
+	return !isGLError();
+}
+
+}
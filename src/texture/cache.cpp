@@ -0,0 +1,161 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <sys/stat.h>
+#include <texture/cache.h>
+
+namespace Texture
+{
+
+static std::string s_cacheDir;
+
+// Header of a cached texture file; followed by the size and the data of
+// each level
+typedef struct _CacheHeader
+{
+	char m_magic[4];
+	uint32_t m_version;
+	uint32_t m_format;
+	uint16_t m_width, m_height;
+	uint8_t m_nChannels;
+	uint8_t m_numLevels;
+	uint16_t m_pad;
+} CacheHeader;
+
+static const char CacheMagic[4] = { 'T', 'X', 'B', 'C' };
+// Bump when the encoder changes, to drop the old files
+static const uint32_t CacheVersion = 2;
+
+bool setCompressedCache(const char *dir)
+{
+	s_cacheDir.clear();
+	if (dir == NULL)
+	{
+		return true;
+	}
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+	{
+		fprintf(stderr, "Could not create the texture cache directory %s\n", dir);
+		return false;
+	}
+	s_cacheDir = dir;
+	return true;
+}
+
+// Cache file of filename, or "" when there is no cache or no such file
+static std::string cachePath(const char *filename, BlockFormat rgbFormat)
+{
+	struct stat st;
+	if (s_cacheDir.empty() || stat(filename, &st) != 0)
+	{
+		return std::string();
+	}
+
+	// FNV-1a over the path, the file's size and time, and the format
+	char key[64];
+	snprintf(key, sizeof(key), "\n%lld\n%lld\n%x", (long long)st.st_size, (long long)st.st_mtime, (unsigned int)rgbFormat);
+	const std::string str = std::string(filename) + key;
+	unsigned long long h = 14695981039346656037ull;
+	for (size_t i = 0; i < str.size(); ++i)
+		h = (h ^ (unsigned char)str[i]) * 1099511628211ull;
+
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.tex", h);
+	return s_cacheDir + name;
+}
+
+bool loadCompressed(const char *filename, BlockFormat rgbFormat, CompressedImage &image)
+{
+	const std::string path = cachePath(filename, rgbFormat);
+	FILE *fp = path.empty() ? NULL : fopen(path.c_str(), "rb");
+	if (fp == NULL)
+	{
+		return false;
+	}
+
+	CacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+			memcmp(header.m_magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+			header.m_version == CacheVersion &&
+			blockBytes((BlockFormat)header.m_format) != 0 &&
+			header.m_numLevels > 0;
+	if (ok)
+	{
+		image.m_format = (BlockFormat)header.m_format;
+		image.m_width = header.m_width;
+		image.m_height = header.m_height;
+		image.m_nChannels = header.m_nChannels;
+		image.m_levels.resize(header.m_numLevels);
+		uint16_t w = image.m_width, h = image.m_height;
+		for (uint8_t i = 0; ok && i < header.m_numLevels; ++i)
+		{
+			// Levels of the wrong size mean a damaged file
+			uint32_t size = 0;
+			ok = fread(&size, sizeof(size), 1, fp) == 1 &&
+					size == compressedSize(image.m_format, w, h);
+			if (ok)
+			{
+				image.m_levels[i].resize(size);
+				ok = fread(&image.m_levels[i][0], 1, size, fp) == size;
+			}
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+	fclose(fp);
+	return ok;
+}
+
+void saveCompressed(const char *filename, BlockFormat rgbFormat, const CompressedImage &image)
+{
+	const std::string path = cachePath(filename, rgbFormat);
+	if (path.empty() || image.m_levels.empty())
+	{
+		return;
+	}
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, CacheMagic, sizeof(CacheMagic));
+	header.m_version = CacheVersion;
+	header.m_format = image.m_format;
+	header.m_width = image.m_width;
+	header.m_height = image.m_height;
+	header.m_nChannels = image.m_nChannels;
+	header.m_numLevels = (uint8_t)image.m_levels.size();
+
+	// Written under a temporary name and renamed, so another instance
+	// never reads a partial file
+	const std::string tmp = path + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	if (fp == NULL)
+	{
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (size_t i = 0; ok && i < image.m_levels.size(); ++i)
+	{
+		const uint32_t size = (uint32_t)image.m_levels[i].size();
+		ok = fwrite(&size, sizeof(size), 1, fp) == 1 &&
+				fwrite(&image.m_levels[i][0], 1, size, fp) == size;
+	}
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		remove(tmp.c_str());
+	}
+}
+
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <texture/compress.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Texture
+{
+
+namespace
+{
+
+// The 16 texels of a block, by channel, in [0, 255]. Row-major, so
+// texel (x, y) of the block is i = 4y + x, as the formats number them.
+struct Block
+{
+	float c[3][16];
+};
+
+void loadBlock(const uint8_t *image, const uint16_t width, const uint16_t height,
+		const uint8_t nChannels, const uint8_t bitDepth, const uint16_t rowBytes,
+		const unsigned int bx, const unsigned int by, Block &b)
+{
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		const unsigned int x = std::min(bx * 4 + i % 4, (unsigned int)width - 1);
+		const unsigned int y = std::min(by * 4 + i / 4, (unsigned int)height - 1);
+		const uint8_t *row = image + y * rowBytes;
+		for (unsigned int ch = 0; ch < 3; ++ch)
+		{
+			const unsigned int k = x * nChannels + (ch < nChannels ? ch : 0);
+			b.c[ch][i] = (8 == bitDepth) ? row[k] : ((const uint16_t*)row)[k] / 257.0f;
+		}
+	}
+}
+
+// t[i] = (texel i - origin) . axis
+void project(const Block &b, const float origin[3], const float axis[3], float t[16])
+{
+	unsigned int i = 0;
+#if defined (__SSE2__)
+	const __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	const __m128 ax = _mm_set1_ps(axis[0]), ay = _mm_set1_ps(axis[1]), az = _mm_set1_ps(axis[2]);
+	for (; i < 16; i += 4)
+	{
+		__m128 r = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.c[0] + i), ox), ax);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.c[1] + i), oy), ay));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b.c[2] + i), oz), az));
+		_mm_storeu_ps(t + i, r);
+	}
+#endif
+	for (; i < 16; ++i)
+		t[i] = (b.c[0][i] - origin[0]) * axis[0] + (b.c[1][i] - origin[1]) * axis[1] + (b.c[2][i] - origin[2]) * axis[2];
+}
+
+// Endpoints of the block's texels along their principal axis; lo is the
+// lower end
+void fitLine(const Block &b, float lo[3], float hi[3])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (unsigned int ch = 0; ch < 3; ++ch)
+	{
+		for (unsigned int i = 0; i < 16; ++i)
+			mean[ch] += b.c[ch][i];
+		mean[ch] /= 16.0f;
+	}
+
+	// Covariance; cov[j][k] of channels j and k
+	float cov[3][3] = { { 0.0f } };
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		const float d[3] = { b.c[0][i] - mean[0], b.c[1][i] - mean[1], b.c[2][i] - mean[2] };
+		for (unsigned int j = 0; j < 3; ++j)
+			for (unsigned int k = j; k < 3; ++k)
+				cov[j][k] += d[j] * d[k];
+	}
+	cov[1][0] = cov[0][1];
+	cov[2][0] = cov[0][2];
+	cov[2][1] = cov[1][2];
+
+	// Power iteration, from the column of the channel that varies most
+	unsigned int maxCh = 0;
+	for (unsigned int ch = 1; ch < 3; ++ch)
+		if (cov[ch][ch] > cov[maxCh][maxCh]) maxCh = ch;
+	float axis[3] = { cov[0][maxCh], cov[1][maxCh], cov[2][maxCh] };
+	float len2 = 0.0f;
+	for (unsigned int iter = 0; iter < 8; ++iter)
+	{
+		const float a[3] = { axis[0], axis[1], axis[2] };
+		for (unsigned int j = 0; j < 3; ++j)
+			axis[j] = cov[j][0] * a[0] + cov[j][1] * a[1] + cov[j][2] * a[2];
+		len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		if (len2 < 1e-12f) break;
+		const float s = 1.0f / sqrtf(len2);
+		for (unsigned int j = 0; j < 3; ++j)
+			axis[j] *= s;
+	}
+
+	// A flat block
+	if (len2 < 1e-12f)
+	{
+		for (unsigned int ch = 0; ch < 3; ++ch)
+			lo[ch] = hi[ch] = mean[ch];
+		return;
+	}
+
+	float t[16];
+	project(b, mean, axis, t);
+	const float tMin = *std::min_element(t, t + 16);
+	const float tMax = *std::max_element(t, t + 16);
+	for (unsigned int ch = 0; ch < 3; ++ch)
+	{
+		lo[ch] = std::min(255.0f, std::max(0.0f, mean[ch] + tMin * axis[ch]));
+		hi[ch] = std::min(255.0f, std::max(0.0f, mean[ch] + tMax * axis[ch]));
+	}
+}
+
+// The axis that maps origin to 0 and end to n
+void scaledAxis(const float origin[3], const float end[3], const float n, float axis[3])
+{
+	float len2 = 0.0f;
+	for (unsigned int ch = 0; ch < 3; ++ch)
+	{
+		axis[ch] = end[ch] - origin[ch];
+		len2 += axis[ch] * axis[ch];
+	}
+	for (unsigned int ch = 0; ch < 3; ++ch)
+		axis[ch] = (len2 > 0.0f) ? axis[ch] * n / len2 : 0.0f;
+}
+
+uint16_t pack565(const float c[3])
+{
+	return (uint16_t)(((int)(c[0] * 31.0f / 255.0f + 0.5f) << 11) |
+			((int)(c[1] * 63.0f / 255.0f + 0.5f) << 5) |
+			(int)(c[2] * 31.0f / 255.0f + 0.5f));
+}
+
+void unpack565(const uint16_t v, float c[3])
+{
+	const unsigned int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (float)((r << 3) | (r >> 2));
+	c[1] = (float)((g << 2) | (g >> 4));
+	c[2] = (float)((b << 3) | (b >> 2));
+}
+
+void encodeBC1(const Block &b, uint8_t *out)
+{
+	float lo[3], hi[3];
+	fitLine(b, lo, hi);
+
+	// c0 > c1 selects the four colour mode
+	uint16_t c0 = pack565(hi), c1 = pack565(lo);
+	if (c0 < c1) std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		// Steps 0 to 3 from c0 to c1 are colours 0, 2, 3, 1
+		static const uint32_t order[4] = { 0, 2, 3, 1 };
+		float p0[3], p1[3], axis[3], t[16];
+		unpack565(c0, p0);
+		unpack565(c1, p1);
+		scaledAxis(p0, p1, 3.0f, axis);
+		project(b, p0, axis, t);
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			const int k = std::min(3, std::max(0, (int)(t[i] + 0.5f)));
+			indices |= order[k] << (2 * i);
+		}
+	}
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for (unsigned int j = 0; j < 4; ++j)
+		out[4 + j] = (indices >> (8 * j)) & 0xff;
+}
+
+void encodeBC4(const Block &b, uint8_t *out)
+{
+	const int r0 = (int)(*std::max_element(b.c[0], b.c[0] + 16) + 0.5f);
+	const int r1 = (int)(*std::min_element(b.c[0], b.c[0] + 16) + 0.5f);
+
+	// r0 > r1 selects the eight value mode; steps 0 to 7 from r0 to r1 are
+	// values 0, 2, ..., 7, 1
+	uint64_t indices = 0;
+	if (r0 > r1)
+	{
+		static const uint64_t order[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+		const float s = 7.0f / (r0 - r1);
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			const int k = std::min(7, std::max(0, (int)((r0 - b.c[0][i]) * s + 0.5f)));
+			indices |= order[k] << (3 * i);
+		}
+	}
+	out[0] = (uint8_t)r0;
+	out[1] = (uint8_t)r1;
+	for (unsigned int j = 0; j < 6; ++j)
+		out[2 + j] = (indices >> (8 * j)) & 0xff;
+}
+
+// Writes fields least significant bit first, as BPTC packs them
+struct BitWriter
+{
+	uint8_t *m_out;
+	unsigned int m_pos;
+	BitWriter(uint8_t *out, unsigned int bytes) : m_out(out), m_pos(0) { memset(out, 0, bytes); }
+	void put(const uint32_t v, const unsigned int n)
+	{
+		for (unsigned int i = 0; i < n; ++i, ++m_pos)
+			if ((v >> i) & 1) m_out[m_pos >> 3] |= 1 << (m_pos & 7);
+	}
+};
+
+void encodeBC7(const Block &b, uint8_t *out)
+{
+	float lo[3], hi[3];
+	fitLine(b, lo, hi);
+
+	// Mode 6: 7 bit RGBA endpoints plus a shared low bit (p-bit) each. The
+	// p-bits are 1, so alpha can be 255.
+	unsigned int q[2][3];
+	float e[2][3];
+	for (unsigned int ch = 0; ch < 3; ++ch)
+	{
+		q[0][ch] = std::min(127, std::max(0, (int)((lo[ch] - 1.0f) * 0.5f + 0.5f)));
+		q[1][ch] = std::min(127, std::max(0, (int)((hi[ch] - 1.0f) * 0.5f + 0.5f)));
+		e[0][ch] = (float)((q[0][ch] << 1) | 1);
+		e[1][ch] = (float)((q[1][ch] << 1) | 1);
+	}
+
+	// Interpolation weights of the 16 indices, out of 64
+	static const float weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+	unsigned int indices[16];
+	float axis[3], t[16];
+	scaledAxis(e[0], e[1], 64.0f, axis);
+	project(b, e[0], axis, t);
+	for (unsigned int i = 0; i < 16; ++i)
+	{
+		unsigned int k = 0;
+		while (k < 15 && t[i] > 0.5f * (weights[k] + weights[k + 1]))
+			++k;
+		indices[i] = k;
+	}
+
+	// The first index is stored without its top bit, which must be 0;
+	// swapping the endpoints flips the indices
+	unsigned int first = 0;
+	if (indices[0] & 8)
+	{
+		first = 1;
+		for (unsigned int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	BitWriter w(out, 16);
+	w.put(1 << 6, 7);
+	for (unsigned int ch = 0; ch < 3; ++ch)
+	{
+		w.put(q[first][ch], 7);
+		w.put(q[1 - first][ch], 7);
+	}
+	w.put(127, 7);
+	w.put(127, 7);
+	w.put(1, 1);
+	w.put(1, 1);
+	w.put(indices[0], 3);
+	for (unsigned int i = 1; i < 16; ++i)
+		w.put(indices[i], 4);
+}
+
+// Rows of blocks [y0, y1)
+void encodeRows(const BlockFormat format, const uint8_t *image,
+		const uint16_t width, const uint16_t height,
+		const uint8_t nChannels, const uint8_t bitDepth, const uint16_t rowBytes,
+		uint8_t *blocks, const unsigned int y0, const unsigned int y1)
+{
+	const unsigned int blocksX = (width + 3) / 4;
+	const unsigned int bytes = blockBytes(format);
+	Block b;
+	for (unsigned int by = y0; by < y1; ++by)
+	{
+		for (unsigned int bx = 0; bx < blocksX; ++bx)
+		{
+			loadBlock(image, width, height, nChannels, bitDepth, rowBytes, bx, by, b);
+			uint8_t *out = blocks + (by * blocksX + bx) * bytes;
+			switch (linearFormat(format))
+			{
+			case BLOCK_BC1: encodeBC1(b, out); break;
+			case BLOCK_BC4: encodeBC4(b, out); break;
+			case BLOCK_BC7: encodeBC7(b, out); break;
+			default: break;
+			}
+		}
+	}
+}
+
+}
+
+bool isSRGB(BlockFormat format)
+{
+	return BLOCK_BC1_SRGB == format || BLOCK_BC7_SRGB == format;
+}
+
+BlockFormat sRGBFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_BC1:
+	case BLOCK_BC1_SRGB:
+		return BLOCK_BC1_SRGB;
+	case BLOCK_BC7:
+	case BLOCK_BC7_SRGB:
+		return BLOCK_BC7_SRGB;
+	default:
+		return BLOCK_NONE;
+	}
+}
+
+BlockFormat linearFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_BC1_SRGB: return BLOCK_BC1;
+	case BLOCK_BC7_SRGB: return BLOCK_BC7;
+	default: return format;
+	}
+}
+
+unsigned int blockBytes(BlockFormat format)
+{
+	switch (linearFormat(format))
+	{
+	case BLOCK_BC1:
+	case BLOCK_BC4:
+		return 8;
+	case BLOCK_BC7:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+size_t compressedSize(BlockFormat format, uint16_t width, uint16_t height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+bool compress(BlockFormat format, const void *image,
+		uint16_t width, uint16_t height,
+		uint8_t nChannels, uint8_t bitDepth, uint16_t rowBytes,
+		uint8_t *blocks)
+{
+	if (!image || 0 == blockBytes(format) || (8 != bitDepth && 16 != bitDepth))
+		return false;
+
+	// Small images, like the bottom of a mip chain, are not worth a thread
+	const unsigned int ROWS_PER_THREAD = 16;
+	const unsigned int blocksY = (height + 3) / 4;
+	const unsigned int nThreads = std::max(1u,
+			std::min(std::thread::hardware_concurrency(), blocksY / ROWS_PER_THREAD));
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < nThreads; ++i)
+	{
+		threads.push_back(std::thread(encodeRows, format, (const uint8_t*)image,
+				width, height, nChannels, bitDepth, rowBytes, blocks,
+				blocksY * i / nThreads, blocksY * (i + 1) / nThreads));
+	}
+	encodeRows(format, (const uint8_t*)image, width, height, nChannels, bitDepth, rowBytes,
+			blocks, 0, blocksY / nThreads);
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	return true;
+}
+
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <texture/decoders/container.h>
+#include <texture/mipmap.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+static const uint8_t Magic[12] = { 0xAB, 'T', 'E', 'X', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t Endian = 0x04030201;
+static const uint32_t Version = 1;
+// Of each level's data
+static const size_t Alignment = 16;
+
+typedef struct
+{
+	uint8_t m_magic[12];
+	uint32_t m_endian;
+	uint32_t m_version;
+	uint32_t m_format;
+	uint16_t m_width, m_height;
+	uint8_t m_nChannels;
+	uint8_t m_bitDepth;
+	uint8_t m_numLevels;
+	uint8_t m_flags;
+} Header;
+
+static const uint8_t FlagSRGB = 0x01;
+
+typedef struct
+{
+	uint64_t m_offset;
+	uint64_t m_bytes;
+} LevelEntry;
+
+ContainerDecoder::ContainerDecoder() {
+}
+ContainerDecoder::~ContainerDecoder() {
+}
+
+bool ContainerDecoder::checkSig(FILE *ifile) const {
+	if (ifile == 0) return false;
+
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return false;
+
+	uint8_t sig[sizeof(Magic)];
+	const bool read = (1 == fread(sig, sizeof(sig), 1, ifile));
+	fsetpos(ifile, &filePos);
+	return read && 0 == memcmp(sig, Magic, sizeof(Magic));
+}
+
+size_t ContainerDecoder::rowBytes(uint16_t width, uint8_t nChannels, uint8_t bitDepth) {
+	return ((size_t)width * nChannels * (bitDepth / 8) + 3) & ~(size_t)3;
+}
+
+// Check header and the level table that follows it, of a file of
+// fileBytes bytes
+static bool checkHeader(const Header &header, const LevelEntry *levels, size_t fileBytes) {
+	if (header.m_endian != Endian || header.m_version != Version ||
+			0 == header.m_width || 0 == header.m_height || 0 == header.m_numLevels ||
+			(1 != header.m_nChannels && 3 != header.m_nChannels) ||
+			(8 != header.m_bitDepth && 16 != header.m_bitDepth))
+		return false;
+	if (BLOCK_NONE != header.m_format && 0 == blockBytes((BlockFormat)header.m_format))
+		return false;
+	// Levels past the 1x1 one would leave the texture incomplete
+	if (header.m_numLevels > numMipLevels(header.m_width, header.m_height))
+		return false;
+	if (!levels)
+		return true;
+
+	uint16_t width = header.m_width, height = header.m_height;
+	for (uint8_t i = 0; i < header.m_numLevels; ++i) {
+		const size_t bytes = (BLOCK_NONE != header.m_format) ?
+				compressedSize((BlockFormat)header.m_format, width, height) :
+				ContainerDecoder::rowBytes(width, header.m_nChannels, header.m_bitDepth) * height;
+		if (levels[i].m_bytes != bytes || levels[i].m_offset > fileBytes ||
+				levels[i].m_bytes > fileBytes - levels[i].m_offset)
+			return false;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return true;
+}
+
+void *ContainerDecoder::decode(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes) const {
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return 0;
+	bool sRGB = false;
+	void *image = decodeSRGB(ifile, width, height, nChannels, bitdepth, rowbytes, sRGB);
+	if (image && sRGB) {
+		free(image);
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	return image;
+}
+
+void *ContainerDecoder::decodeSRGB(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes, bool &sRGB) const {
+	fpos_t filePos;
+	const long start = ftell(ifile);
+	if (0 != fgetpos(ifile, &filePos) || start < 0)
+		return 0;
+
+	Header header;
+	LevelEntry level0;
+	if (1 != fread(&header, sizeof(header), 1, ifile) ||
+			1 != fread(&level0, sizeof(level0), 1, ifile) ||
+			!checkHeader(header, 0, 0) || BLOCK_NONE != header.m_format) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	width = header.m_width;
+	height = header.m_height;
+	nChannels = header.m_nChannels;
+	bitdepth = header.m_bitDepth;
+	rowbytes = rowBytes(width, nChannels, bitdepth);
+	sRGB = 0 != (header.m_flags & FlagSRGB);
+
+	if (level0.m_bytes != (uint64_t)rowbytes * height) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	void *image = malloc(level0.m_bytes);
+	if (!image || 0 != fseek(ifile, start + level0.m_offset, SEEK_SET) ||
+			1 != fread(image, level0.m_bytes, 1, ifile)) {
+		free(image);
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	return image;
+}
+
+bool ContainerDecoder::map(const char *filename, Container &container) {
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	uint8_t sig[sizeof(Magic)];
+	if (0 != fstat(fd, &st) || (size_t)st.st_size < sizeof(Header) ||
+			sizeof(sig) != pread(fd, sig, sizeof(sig), 0) ||
+			0 != memcmp(sig, Magic, sizeof(Magic))) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "ERROR! Could not map %s\n", filename);
+		return false;
+	}
+
+	const uint8_t *bytes = (const uint8_t*)map;
+	const Header &header = *(const Header*)bytes;
+	const LevelEntry *levels = (const LevelEntry*)(bytes + sizeof(Header));
+	if (sizeof(Header) + header.m_numLevels * sizeof(LevelEntry) > (size_t)st.st_size ||
+			!checkHeader(header, levels, st.st_size)) {
+		fprintf(stderr, "ERROR! %s is not a valid texture container\n", filename);
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	container.m_width = header.m_width;
+	container.m_height = header.m_height;
+	container.m_nChannels = header.m_nChannels;
+	container.m_bitDepth = header.m_bitDepth;
+	container.m_format = (BlockFormat)header.m_format;
+	container.m_sRGB = 0 != (header.m_flags & FlagSRGB) || isSRGB(container.m_format);
+	container.m_levels.resize(header.m_numLevels);
+	container.m_levelBytes.resize(header.m_numLevels);
+	for (uint8_t i = 0; i < header.m_numLevels; ++i) {
+		container.m_levels[i] = bytes + levels[i].m_offset;
+		container.m_levelBytes[i] = levels[i].m_bytes;
+	}
+	container.m_map = map;
+	container.m_mapBytes = st.st_size;
+	// The levels are read in order, once
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	return true;
+}
+
+void ContainerDecoder::unmap(Container &container) {
+	if (container.m_map)
+		munmap(container.m_map, container.m_mapBytes);
+	container.m_map = 0;
+	container.m_mapBytes = 0;
+	container.m_levels.clear();
+	container.m_levelBytes.clear();
+}
+
+bool ContainerDecoder::write(const char *filename,
+		uint16_t width, uint16_t height,
+		uint8_t nChannels, uint8_t bitDepth, BlockFormat format, bool sRGB,
+		const std::vector<const void*> &levels,
+		const std::vector<size_t> &levelBytes) {
+	Header header;
+	memcpy(header.m_magic, Magic, sizeof(Magic));
+	header.m_endian = Endian;
+	header.m_version = Version;
+	header.m_format = format;
+	header.m_width = width;
+	header.m_height = height;
+	header.m_nChannels = nChannels;
+	header.m_bitDepth = bitDepth;
+	header.m_numLevels = (uint8_t)levels.size();
+	header.m_flags = (sRGB || isSRGB(format)) ? FlagSRGB : 0;
+
+	std::vector<LevelEntry> table(levels.size());
+	size_t offset = sizeof(Header) + table.size() * sizeof(LevelEntry);
+	for (size_t i = 0; i < levels.size(); ++i) {
+		offset = (offset + Alignment - 1) & ~(Alignment - 1);
+		table[i].m_offset = offset;
+		table[i].m_bytes = levelBytes[i];
+		offset += levelBytes[i];
+	}
+	if (!checkHeader(header, &table[0], offset))
+		return false;
+
+	FILE *ofile = fopen(filename, "wb");
+	if (!ofile)
+		return false;
+	bool ok = (1 == fwrite(&header, sizeof(header), 1, ofile)) &&
+			(table.size() == fwrite(&table[0], sizeof(LevelEntry), table.size(), ofile));
+	static const uint8_t zeros[Alignment] = { 0 };
+	for (size_t i = 0; ok && i < levels.size(); ++i) {
+		const long pad = (long)table[i].m_offset - ftell(ofile);
+		ok = (0 == pad || 1 == fwrite(zeros, pad, 1, ofile)) &&
+				1 == fwrite(levels[i], levelBytes[i], 1, ofile);
+	}
+	ok = (0 == fclose(ofile)) && ok;
+	if (!ok)
+		remove(filename);
+	return ok;
+}
+
+}
+}
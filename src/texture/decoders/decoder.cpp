@@ -11,7 +11,10 @@
  */
 
 
+#include <cmath>
 #include <texture/decoders/decoder.h>
+#include <texture/decoders/png.h>
+#include <texture/decoders/qoi.h>
 
 
 namespace Texture
@@ -22,6 +25,58 @@ namespace Image
 Decoder::Decoder() {}
 Decoder::~Decoder() {}
 
+void *Decoder::decodeSRGB(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes, bool &sRGB) const {
+	sRGB = false;
+	return decode(ifile, width, height, nChannels, bitdepth, rowbytes);
+}
+
+bool Decoder::readFile(FILE *ifile, std::vector<uint8_t> &data) {
+	const long start = ftell(ifile);
+	if (start < 0 || 0 != fseek(ifile, 0, SEEK_END))
+		return false;
+	const long end = ftell(ifile);
+	if (end < start || 0 != fseek(ifile, start, SEEK_SET))
+		return false;
+	data.resize(end - start);
+	return data.empty() || 1 == fread(&data[0], data.size(), 1, ifile);
+}
+
+void Decoder::linearize(uint8_t *image, size_t bytes, double fileGamma) {
+	uint8_t table[256];
+	for (unsigned int i = 0; i < 256; ++i)
+		table[i] = (uint8_t)(pow(i / 255.0, 1.0 / fileGamma) * 255.0 + 0.5);
+	for (size_t i = 0; i < bytes; ++i)
+		image[i] = table[image[i]];
+}
+
+// Most recently registered first
+static std::vector<const Decoder*> & decoders() {
+	static const QOIDecoder s_qoi;
+	static const PNGDecoder s_png;
+	static const Decoder *const s_defaults[] = { &s_qoi, &s_png };
+	static std::vector<const Decoder*> s_decoders(s_defaults, s_defaults + 2);
+	return s_decoders;
+}
+
+void registerDecoder(const Decoder *decoder) {
+	std::vector<const Decoder*> &list = decoders();
+	list.insert(list.begin(), decoder);
+}
+
+const Decoder* findDecoder(FILE *ifile) {
+	if (!ifile)
+		return 0;
+	const std::vector<const Decoder*> &list = decoders();
+	for (size_t i = 0; i < list.size(); ++i) {
+		if (list[i]->checkSig(ifile))
+			return list[i];
+	}
+	return 0;
+}
+
 }
 
 }
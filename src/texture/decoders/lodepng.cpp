@@ -0,0 +1,139 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <external/lodepng.h>
+#include <texture/decoders/lodepng.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+static const uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static uint32_t readBE32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+LodePNGDecoder::LodePNGDecoder() {
+}
+LodePNGDecoder::~LodePNGDecoder() {
+}
+
+bool LodePNGDecoder::checkSig(FILE *ifile) const {
+	if (ifile == 0) return false;
+
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return false;
+
+	uint8_t sig[sizeof(Signature)];
+	const bool read = 1 == fread(sig, sizeof(sig), 1, ifile);
+	fsetpos(ifile, &filePos);
+	return read && 0 == memcmp(sig, Signature, sizeof(Signature));
+}
+
+void *LodePNGDecoder::decode(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes) const {
+	bool sRGB = false;
+	uint8_t *image = (uint8_t*)decodeSRGB(ifile, width, height, nChannels, bitdepth, rowbytes, sRGB);
+	if (image && sRGB)
+		linearize(image, (size_t)height * rowbytes, 0.45455);
+	return image;
+}
+
+void *LodePNGDecoder::decodeSRGB(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes, bool &sRGB) const {
+	sRGB = false;
+
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return 0;
+
+	std::vector<uint8_t> data;
+	if (!readFile(ifile, data) || data.empty()) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	// The header decides the output: 8-bit greyscale or RGB, no alpha
+	LodePNG::Decoder decoder;
+	decoder.inspect(&data[0], data.size());
+	if (decoder.hasError() || decoder.getWidth() > 0xffff || decoder.getHeight() > 0xffff) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	const bool grey = decoder.isGreyscaleType();
+	decoder.getInfoRaw().color.colorType = grey ? LCT_GREY : LCT_RGB;
+	decoder.getInfoRaw().color.bitDepth = 8;
+	// gAMA and sRGB are not known to LodePNG; they are kept with the
+	// other unknown chunks
+	decoder.getSettings().rememberUnknownChunks = 1;
+
+	std::vector<unsigned char> pixels;
+	decoder.decode(pixels, &data[0], data.size());
+	if (decoder.hasError() || pixels.empty()) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	bool hasSRGB = false, hasGamma = false;
+	double fileGamma = 0.45455;
+	const LodePNG_UnknownChunks &chunks = decoder.getInfoPng().unknown_chunks;
+	for (int i = 0; i < 3; ++i) {
+		const unsigned char *chunk = chunks.data[i];
+		const unsigned char *end = chunk + chunks.datasize[i];
+		for ( ; chunk && chunk + 12 <= end; chunk = LodePNG_chunk_next_const(chunk)) {
+			if (LodePNG_chunk_type_equals(chunk, "sRGB"))
+				hasSRGB = true;
+			else if (LodePNG_chunk_type_equals(chunk, "gAMA") && 4 == LodePNG_chunk_length(chunk)) {
+				hasGamma = true;
+				fileGamma = readBE32(LodePNG_chunk_data_const(chunk)) / 100000.0;
+			}
+		}
+	}
+
+	const uint16_t _width = decoder.getWidth();
+	const uint16_t _height = decoder.getHeight();
+	const uint8_t _channels = grey ? 1 : 3;
+	const uint32_t _rowbytes = (_channels * _width + 3) & ~3;
+	uint8_t *image = (uint8_t*)malloc((size_t)_height * _rowbytes);
+	if (!image) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	for (uint16_t y = 0; y < _height; ++y)
+		memcpy(image + (size_t)y * _rowbytes, &pixels[(size_t)y * _channels * _width], _channels * _width);
+
+	if (!grey && (hasSRGB || (hasGamma && fabs(fileGamma - 0.45455) < 0.01)))
+		sRGB = true;
+	else if (hasSRGB)
+		linearize(image, (size_t)_height * _rowbytes, 0.45455);
+	else if (hasGamma && fileGamma > 0.0)
+		linearize(image, (size_t)_height * _rowbytes, fileGamma);
+
+	width = _width;
+	height = _height;
+	nChannels = _channels;
+	bitdepth = 8;
+	rowbytes = _rowbytes;
+	return image;
+}
+
+}
+}
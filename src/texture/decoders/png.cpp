@@ -13,6 +13,7 @@
 #include <png.h>
 #include <cstdio>
 #include <cstdlib>
+#include <cmath>
 #include <texture/decoders/png.h>
 
 namespace Texture
@@ -20,33 +21,13 @@ namespace Texture
 namespace Image
 {
 
-PNGDecoder::PNGDecoder() {
-}
-PNGDecoder::~PNGDecoder() {
-}
-
-bool PNGDecoder::checkSig(FILE *ifile) const {
-	if (ifile == 0) return false;
-
-	// Save the current file position
-	fpos_t filePos;
-	if (0 != fgetpos(ifile, &filePos))
-		return false;
-
-	uint8_t sig[8];
-	if (1 != fread(sig, 8, 1, ifile)) {
-		fsetpos(ifile, &filePos);
-		return false;
-	}
-	fsetpos(ifile, &filePos);
-	bool is_png = 0 == png_sig_cmp(sig, 0, 8);
-	return is_png;
-}
-
-void *PNGDecoder::decode(FILE *ifile,
+// keepSRGB leaves sRGB encoded RGB images encoded, and sets sRGB if it did
+static void *decodePNG(FILE *ifile,
 		uint16_t &width, uint16_t &height,
 		uint8_t &nChannels, uint8_t &bitdepth,
-		uint16_t &rowbytes) const {
+		uint16_t &rowbytes, const bool keepSRGB, bool &sRGB) {
+	sRGB = false;
+
 	// Save the file position. In case of errors.
 	fpos_t filePos;
 	if (0 != fgetpos(ifile, &filePos))
@@ -133,16 +114,22 @@ void *PNGDecoder::decode(FILE *ifile,
 	// Potentially linearize the gamma-corrected intensity data.
 	double _file_gamma = 0.45455; // sRGB standard gamma
 	int _sRGB_intent;
-	if (png_get_sRGB(png_ptr, info_ptr, &_sRGB_intent) != 0) {
+	const bool _has_sRGB = png_get_sRGB(png_ptr, info_ptr, &_sRGB_intent) != 0;
+	const bool _has_gAMA = !_has_sRGB && png_get_gAMA(png_ptr, info_ptr, &_file_gamma) != 0;
+	if (keepSRGB && _channels == 3 &&
+			(_has_sRGB || (_has_gAMA && fabs(_file_gamma - 0.45455) < 0.01))) {
+		// Left for the GL to decode
+		sRGB = true;
+	}
+	else if (_has_sRGB) {
 		// the sRGB chunk is set, so we know that the file gAMA must
 		// be 0.45455
 		png_set_gamma(png_ptr, 1.0, 0.45455);
 	}
-	else
-		if (png_get_gAMA(png_ptr, info_ptr, &_file_gamma) != 0) {
-			// gAMA chunk was set.
-			png_set_gamma(png_ptr, 1.0, _file_gamma);
-		}
+	else if (_has_gAMA) {
+		// gAMA chunk was set.
+		png_set_gamma(png_ptr, 1.0, _file_gamma);
+	}
 
 	// Number of bytes we expect a row to require
 	uint32_t _rowbytes = sizeof(uint8_t) * _channels * _width;
@@ -181,6 +168,44 @@ void *PNGDecoder::decode(FILE *ifile,
 	return toReturn;
 }
 
+PNGDecoder::PNGDecoder() {
+}
+PNGDecoder::~PNGDecoder() {
+}
+
+bool PNGDecoder::checkSig(FILE *ifile) const {
+	if (ifile == 0) return false;
+
+	// Save the current file position
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return false;
+
+	uint8_t sig[8];
+	if (1 != fread(sig, 8, 1, ifile)) {
+		fsetpos(ifile, &filePos);
+		return false;
+	}
+	fsetpos(ifile, &filePos);
+	bool is_png = 0 == png_sig_cmp(sig, 0, 8);
+	return is_png;
+}
+
+void *PNGDecoder::decode(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes) const {
+	bool sRGB = false;
+	return decodePNG(ifile, width, height, nChannels, bitdepth, rowbytes, false, sRGB);
+}
+
+void *PNGDecoder::decodeSRGB(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes, bool &sRGB) const {
+	return decodePNG(ifile, width, height, nChannels, bitdepth, rowbytes, true, sRGB);
+}
+
 
 }
 }
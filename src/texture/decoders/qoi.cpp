@@ -0,0 +1,173 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <texture/decoders/qoi.h>
+
+namespace Texture
+{
+namespace Image
+{
+
+static const uint8_t Magic[4] = { 'q', 'o', 'i', 'f' };
+static const size_t HeaderBytes = 14;
+// Seven 0x00 and a 0x01
+static const size_t EndBytes = 8;
+static const uint8_t ColorspaceSRGB = 0;
+
+// Byte codes; the two bit ones are in the top bits
+static const uint8_t OpIndex = 0x00;
+static const uint8_t OpDiff = 0x40;
+static const uint8_t OpLuma = 0x80;
+static const uint8_t OpRun = 0xc0;
+static const uint8_t OpRGB = 0xfe;
+static const uint8_t OpRGBA = 0xff;
+static const uint8_t OpMask = 0xc0;
+
+static uint32_t readBE32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+QOIDecoder::QOIDecoder() {
+}
+QOIDecoder::~QOIDecoder() {
+}
+
+bool QOIDecoder::checkSig(FILE *ifile) const {
+	if (ifile == 0) return false;
+
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return false;
+
+	uint8_t sig[sizeof(Magic)];
+	const bool read = 1 == fread(sig, sizeof(sig), 1, ifile);
+	fsetpos(ifile, &filePos);
+	return read && 0 == memcmp(sig, Magic, sizeof(Magic));
+}
+
+void *QOIDecoder::decode(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes) const {
+	bool sRGB = false;
+	uint8_t *image = (uint8_t*)decodeSRGB(ifile, width, height, nChannels, bitdepth, rowbytes, sRGB);
+	if (image && sRGB)
+		linearize(image, (size_t)height * rowbytes, 0.45455);
+	return image;
+}
+
+void *QOIDecoder::decodeSRGB(FILE *ifile,
+		uint16_t &width, uint16_t &height,
+		uint8_t &nChannels, uint8_t &bitdepth,
+		uint16_t &rowbytes, bool &sRGB) const {
+	fpos_t filePos;
+	if (0 != fgetpos(ifile, &filePos))
+		return 0;
+
+	std::vector<uint8_t> data;
+	if (!readFile(ifile, data) || data.size() < HeaderBytes + EndBytes ||
+			0 != memcmp(&data[0], Magic, sizeof(Magic))) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+	const uint32_t _width = readBE32(&data[4]);
+	const uint32_t _height = readBE32(&data[8]);
+	const uint8_t _channels = data[12];
+	if (0 == _width || 0 == _height || _width > 0xffff || _height > 0xffff ||
+			(3 != _channels && 4 != _channels)) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	// Alpha is dropped, as the other decoders do
+	const uint32_t _rowbytes = (3 * _width + 3) & ~3;
+	uint8_t *image = (uint8_t*)malloc((size_t)_height * _rowbytes);
+	if (!image) {
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	// Colours seen, by hash; the alpha of each is kept for the hash
+	uint8_t index[64][4];
+	memset(index, 0, sizeof(index));
+	uint8_t px[4] = { 0, 0, 0, 255 };
+
+	const uint8_t *in = &data[HeaderBytes];
+	const uint8_t *end = &data[0] + data.size() - EndBytes;
+	uint32_t run = 0;
+	bool ok = true;
+	for (uint32_t y = 0; y < _height && ok; ++y) {
+		uint8_t *out = image + (size_t)y * _rowbytes;
+		for (uint32_t x = 0; x < _width; ++x, out += 3) {
+			if (run > 0) {
+				--run;
+			}
+			else if (in < end) {
+				const uint8_t b = *in++;
+				if (OpRGB == b) {
+					px[0] = in[0]; px[1] = in[1]; px[2] = in[2];
+					in += 3;
+				}
+				else if (OpRGBA == b) {
+					px[0] = in[0]; px[1] = in[1]; px[2] = in[2]; px[3] = in[3];
+					in += 4;
+				}
+				else if (OpIndex == (b & OpMask)) {
+					memcpy(px, index[b], 4);
+				}
+				else if (OpDiff == (b & OpMask)) {
+					px[0] += ((b >> 4) & 3) - 2;
+					px[1] += ((b >> 2) & 3) - 2;
+					px[2] += (b & 3) - 2;
+				}
+				else if (OpLuma == (b & OpMask)) {
+					const int dg = (b & 0x3f) - 32;
+					const uint8_t b2 = *in++;
+					px[0] += dg - 8 + (b2 >> 4);
+					px[1] += dg;
+					px[2] += dg - 8 + (b2 & 0x0f);
+				}
+				else {
+					// OpRun; this pixel and up to 61 more
+					run = b & ~OpRun;
+				}
+				memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63], px, 4);
+			}
+			else {
+				// Truncated
+				ok = false;
+				break;
+			}
+			out[0] = px[0];
+			out[1] = px[1];
+			out[2] = px[2];
+		}
+	}
+	// The last op may not read past the end marker
+	if (!ok || in > end) {
+		free(image);
+		fsetpos(ifile, &filePos);
+		return 0;
+	}
+
+	width = _width;
+	height = _height;
+	nChannels = 3;
+	bitdepth = 8;
+	rowbytes = _rowbytes;
+	sRGB = ColorspaceSRGB == data[13];
+	return image;
+}
+
+}
+}
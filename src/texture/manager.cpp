@@ -0,0 +1,224 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdio>
+
+#include <texture/manager.h>
+
+namespace Texture
+{
+
+Manager::Params::Params()
+{
+	m_minFilter = LINEAR_MIPMAP_LINEAR;
+	m_magFilter = LINEAR;
+	m_wrap = REPEAT;
+	m_mipmaps = MIPMAP_CPU;
+	m_anisotropy = TEXTURE_ANISOTROPY;
+	m_compress = TEXTURE_COMPRESS;
+	m_sRGB = TEXTURE_SRGB;
+	m_stream = TEXTURE_STREAM;
+}
+
+Manager::Manager()
+{
+	m_budget = 0;
+	m_bytes = 0;
+}
+
+Manager::~Manager()
+{
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		delete it->second.m_texture;
+		delete it->second.m_reload;
+	}
+}
+
+std::string Manager::key(const char *filename, const Params &params)
+{
+	char buf[64];
+	// Streamed or not, the texture ends up the same
+	snprintf(buf, sizeof(buf), "|%x|%x|%x|%d|%g|%d|%d",
+			params.m_minFilter, params.m_magFilter, params.m_wrap,
+			params.m_mipmaps, params.m_anisotropy, params.m_compress ? 1 : 0,
+			params.m_sRGB ? 1 : 0);
+	return std::string(filename) + buf;
+}
+
+Manager::EntryMap::iterator Manager::find(const Texture *texture)
+{
+	EntryMap::iterator it = m_entries.begin();
+	while (it != m_entries.end() && it->second.m_texture != texture)
+	{
+		++it;
+	}
+	return it;
+}
+
+const Texture* Manager::acquire(const char *filename, const Params &params)
+{
+	const std::string k = key(filename, params);
+	EntryMap::iterator it = m_entries.find(k);
+	if (it != m_entries.end())
+	{
+		it->second.m_refs += 1;
+		return it->second.m_texture;
+	}
+
+	Texture *texture = new Texture(filename, params.m_minFilter, params.m_magFilter,
+			params.m_wrap, params.m_mipmaps, params.m_anisotropy, params.m_compress,
+			params.m_sRGB, params.m_stream);
+	if (params.m_stream)
+	{
+		m_streamer.queue(texture, params.m_compress ? Texture::blockFormatFor(3) : BLOCK_NONE);
+	}
+	else if ( !texture->getIsReady() )
+	{
+		fprintf(stderr, "ERROR! Could not load texture %s\n", filename);
+		delete texture;
+		return 0;
+	}
+	Entry entry = { texture, 1, params, 0, 0 };
+	m_entries[k] = entry;
+	m_bytes += texture->getBytes();
+
+	// Make room for it now, rather than at the next update()
+	while (m_budget && m_bytes > m_budget && evict()) ;
+	return texture;
+}
+
+void Manager::release(const Texture *texture)
+{
+	EntryMap::iterator it = find(texture);
+	if (it == m_entries.end())
+	{
+		return;
+	}
+	if (--it->second.m_refs == 0)
+	{
+		m_bytes -= it->second.m_reload ? it->second.m_reloadBytes : it->second.m_texture->getBytes();
+		m_streamer.cancel(it->second.m_texture);
+		delete it->second.m_texture;
+		if (it->second.m_reload)
+		{
+			m_streamer.cancel(it->second.m_reload);
+			delete it->second.m_reload;
+		}
+		m_entries.erase(it);
+	}
+}
+
+void Manager::setBudget(size_t bytes)
+{
+	m_budget = bytes;
+	while (m_budget && m_bytes > m_budget && evict()) ;
+}
+
+bool Manager::evict()
+{
+	// Of textures last used in the same frame, the largest goes first
+	Texture *victim = 0;
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		Texture *t = it->second.m_texture;
+		// The levels of a texture being reloaded are on their way back
+		if (it->second.m_reload)
+		{
+			continue;
+		}
+		// Only a texture with levels below the top one gives it up without
+		// a reload
+		if (!t->canDropLevels(1))
+		{
+			continue;
+		}
+		if (!victim || t->getLastUse() < victim->getLastUse() ||
+				(t->getLastUse() == victim->getLastUse() && t->getBytes() > victim->getBytes()))
+		{
+			victim = t;
+		}
+	}
+	if (!victim)
+	{
+		return false;
+	}
+	m_bytes -= victim->getBytes();
+	victim->setSkipLevels(victim->getSkipLevels() + 1);
+	m_bytes += victim->getBytes();
+	return true;
+}
+
+void Manager::restore(Entry &entry)
+{
+	Texture *texture = entry.m_texture;
+	// A level is a bit over three times the ones below it together, so
+	// the full texture is about 4^skip times its current size.
+	size_t full = texture->getBytes();
+	uint8_t skip = texture->getSkipLevels();
+	for ( ; skip > 0 && (!m_budget || m_bytes - texture->getBytes() + full * 4 <= m_budget); --skip)
+	{
+		full *= 4;
+	}
+	if (skip == texture->getSkipLevels())
+	{
+		return;
+	}
+	// The texture keeps its levels until the reload is done; it is counted
+	// at the size it will have
+	const Params &params = entry.m_params;
+	entry.m_reload = new Texture(texture->getFilename(), params.m_minFilter, params.m_magFilter,
+			params.m_wrap, params.m_mipmaps, params.m_anisotropy, params.m_compress,
+			params.m_sRGB, true);
+	entry.m_reloadBytes = full;
+	m_streamer.queue(entry.m_reload, params.m_compress ? Texture::blockFormatFor(3) : BLOCK_NONE, skip);
+	m_bytes -= texture->getBytes();
+	m_bytes += full;
+}
+
+void Manager::update()
+{
+	// Textures bound in the frame just drawn are the ones worth restoring
+	const unsigned int frame = Texture::getFrame();
+	Texture::nextFrame();
+
+	// Streamed textures have their size once they are allocated. Reloads
+	// that are done take the place of the textures they reload; one that
+	// failed leaves the texture as it was.
+	m_streamer.update();
+	m_bytes = 0;
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		Entry &e = it->second;
+		if (e.m_reload && !m_streamer.isPending(e.m_reload))
+		{
+			if (e.m_reload->getIsReady())
+			{
+				e.m_texture->adopt(*e.m_reload);
+			}
+			delete e.m_reload;
+			e.m_reload = 0;
+		}
+		m_bytes += e.m_reload ? e.m_reloadBytes : e.m_texture->getBytes();
+	}
+
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		Texture *t = it->second.m_texture;
+		if (!it->second.m_reload && t->getSkipLevels() > 0 && t->getLastUse() == frame)
+		{
+			restore(it->second);
+		}
+	}
+	while (m_budget && m_bytes > m_budget && evict()) ;
+}
+
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <texture/mipmap.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Texture
+{
+
+namespace
+{
+
+// sums[i] = a[i] + b[i], over the n channel values of two rows. The
+// vertical half of the box filter, 16 (8-bit) or 8 (16-bit) values at a
+// time.
+void addRows(const uint8_t *a, const uint8_t *b, uint32_t *sums, const uint32_t n)
+{
+	uint32_t i = 0;
+#if defined (__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16)
+	{
+		const __m128i _a = _mm_loadu_si128((const __m128i*)(a + i));
+		const __m128i _b = _mm_loadu_si128((const __m128i*)(b + i));
+		const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(_a, zero), _mm_unpacklo_epi8(_b, zero));
+		const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(_a, zero), _mm_unpackhi_epi8(_b, zero));
+		_mm_storeu_si128((__m128i*)(sums + i), _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(sums + i + 4), _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128((__m128i*)(sums + i + 8), _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128((__m128i*)(sums + i + 12), _mm_unpackhi_epi16(hi, zero));
+	}
+#endif
+	for (; i < n; ++i)
+		sums[i] = a[i] + b[i];
+}
+
+void addRows(const uint16_t *a, const uint16_t *b, uint32_t *sums, const uint32_t n)
+{
+	uint32_t i = 0;
+#if defined (__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8)
+	{
+		const __m128i _a = _mm_loadu_si128((const __m128i*)(a + i));
+		const __m128i _b = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128((__m128i*)(sums + i),
+				_mm_add_epi32(_mm_unpacklo_epi16(_a, zero), _mm_unpacklo_epi16(_b, zero)));
+		_mm_storeu_si128((__m128i*)(sums + i + 4),
+				_mm_add_epi32(_mm_unpackhi_epi16(_a, zero), _mm_unpackhi_epi16(_b, zero)));
+	}
+#endif
+	for (; i < n; ++i)
+		sums[i] = a[i] + b[i];
+}
+
+template <typename T>
+void downsample(const uint8_t *src, uint8_t *dst,
+		const uint16_t width, const uint16_t height, const uint8_t nChannels, const uint16_t rowBytes,
+		const uint16_t outWidth, const uint16_t outHeight, const uint16_t outRowBytes)
+{
+	std::vector<uint32_t> sums(width * nChannels);
+	for (uint16_t y = 0; y < outHeight; ++y)
+	{
+		const T *a = (const T*)(src + 2 * y * rowBytes);
+		const T *b = (const T*)(src + (height > 1 ? 2 * y + 1 : 0) * rowBytes);
+		addRows(a, b, &sums[0], width * nChannels);
+
+		// Horizontal half
+		T *out = (T*)(dst + y * outRowBytes);
+		for (uint16_t x = 0; x < outWidth; ++x)
+		{
+			const uint32_t *s0 = &sums[2 * x * nChannels];
+			const uint32_t *s1 = &sums[(width > 1 ? 2 * x + 1 : 0) * nChannels];
+			for (uint8_t c = 0; c < nChannels; ++c)
+				out[x * nChannels + c] = (T)((s0[c] + s1[c] + 2) >> 2);
+		}
+	}
+}
+
+// sRGB <-> linear, with linear values in 16-bit fixed point
+struct SRGBTables
+{
+	uint16_t m_toLinear8[256];
+	uint16_t m_toLinear16[65536];
+	uint16_t m_toSRGB16[65536];
+
+	static float toLinear(const float c)
+	{
+		return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+	static float toSRGB(const float l)
+	{
+		return (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+	}
+
+	SRGBTables()
+	{
+		for (unsigned int i = 0; i < 256; ++i)
+			m_toLinear8[i] = (uint16_t)(toLinear(i / 255.0f) * 65535.0f + 0.5f);
+		for (unsigned int i = 0; i < 65536; ++i)
+		{
+			m_toLinear16[i] = (uint16_t)(toLinear(i / 65535.0f) * 65535.0f + 0.5f);
+			m_toSRGB16[i] = (uint16_t)(toSRGB(i / 65535.0f) * 65535.0f + 0.5f);
+		}
+	}
+
+	static const SRGBTables & get()
+	{
+		static const SRGBTables tables;
+		return tables;
+	}
+	uint16_t toLinear(const uint8_t v) const { return m_toLinear8[v]; }
+	uint16_t toLinear(const uint16_t v) const { return m_toLinear16[v]; }
+	void encode(const uint32_t l, uint8_t &v) const { v = (uint8_t)((m_toSRGB16[l] * 255u + 32767u) / 65535u); }
+	void encode(const uint32_t l, uint16_t &v) const { v = m_toSRGB16[l]; }
+};
+
+// As downsample(), for sRGB texels: decoded to linear, averaged and
+// encoded again through tables
+template <typename T>
+void downsampleSRGB(const uint8_t *src, uint8_t *dst,
+		const uint16_t width, const uint16_t height, const uint8_t nChannels, const uint16_t rowBytes,
+		const uint16_t outWidth, const uint16_t outHeight, const uint16_t outRowBytes)
+{
+	const SRGBTables &tables = SRGBTables::get();
+	const unsigned int dx = (width > 1) ? nChannels : 0;
+	for (uint16_t y = 0; y < outHeight; ++y)
+	{
+		const T *a = (const T*)(src + 2 * y * rowBytes);
+		const T *b = (const T*)(src + (height > 1 ? 2 * y + 1 : 0) * rowBytes);
+		T *out = (T*)(dst + y * outRowBytes);
+		for (uint16_t x = 0; x < outWidth; ++x)
+		{
+			const unsigned int i = 2 * x * nChannels;
+			for (uint8_t c = 0; c < nChannels; ++c)
+			{
+				const uint32_t sum = tables.toLinear(a[i + c]) + tables.toLinear(a[i + dx + c]) +
+						tables.toLinear(b[i + c]) + tables.toLinear(b[i + dx + c]);
+				tables.encode((sum + 2) >> 2, out[x * nChannels + c]);
+			}
+		}
+	}
+}
+
+}
+
+uint8_t numMipLevels(uint16_t width, uint16_t height)
+{
+	uint8_t n = 1;
+	while (width > 1 || height > 1)
+	{
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		++n;
+	}
+	return n;
+}
+
+void *downsample(const void *image,
+		uint16_t width, uint16_t height,
+		uint8_t nChannels, uint8_t bitDepth, uint16_t rowBytes,
+		uint16_t &outWidth, uint16_t &outHeight, uint16_t &outRowBytes,
+		bool sRGB)
+{
+	if (!image || (8 != bitDepth && 16 != bitDepth))
+		return 0;
+
+	outWidth = width > 1 ? width / 2 : 1;
+	outHeight = height > 1 ? height / 2 : 1;
+	// Rows padded to a multiple of 4 bytes, as the decoders do
+	outRowBytes = (outWidth * nChannels * (bitDepth / 8) + 3) & ~3;
+
+	uint8_t *dst = (uint8_t*)malloc(outHeight * outRowBytes);
+	if (!dst)
+		return 0;
+
+	if (sRGB && 8 == bitDepth)
+		downsampleSRGB<uint8_t>((const uint8_t*)image, dst, width, height, nChannels, rowBytes,
+				outWidth, outHeight, outRowBytes);
+	else if (sRGB)
+		downsampleSRGB<uint16_t>((const uint8_t*)image, dst, width, height, nChannels, rowBytes,
+				outWidth, outHeight, outRowBytes);
+	else if (8 == bitDepth)
+		downsample<uint8_t>((const uint8_t*)image, dst, width, height, nChannels, rowBytes,
+				outWidth, outHeight, outRowBytes);
+	else
+		downsample<uint16_t>((const uint8_t*)image, dst, width, height, nChannels, rowBytes,
+				outWidth, outHeight, outRowBytes);
+	return dst;
+}
+
+}
@@ -0,0 +1,542 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+#include <texture/streamer.h>
+#include <texture/mipmap.h>
+#include <texture/cache.h>
+#include <gl3/gl3w.h>
+#include <glUtils.h>
+#include <config.h>
+#include <texture/decoders/decoder.h>
+
+namespace Texture
+{
+
+// Decoding is mostly inflate and the block encoder, which has threads
+// of its own; a few workers keep the disk busy.
+static const unsigned int MAX_WORKERS = 4;
+// Segments in the upload ring; the GL has this many frames to read one
+static const unsigned int RING_SEGMENTS = 3;
+// Bytes copied per frame; a row of the widest texture must fit
+static const size_t SEGMENT_BYTES = std::max<size_t>(TEXTURE_STREAM_KB << 10, 512 << 10);
+
+// A level as it is uploaded: m_rows rows of m_rowBytes bytes. The rows of
+// a compressed level are rows of blocks. m_bytes points to m_data, or
+// into a mapped container.
+struct Level
+{
+	uint16_t m_width, m_height;
+	uint16_t m_rows;
+	uint32_t m_rowBytes;
+	const uint8_t *m_bytes;
+	std::vector<uint8_t> m_data;
+};
+
+struct Streamer::Job
+{
+	// Set to 0 when cancelled; read by the GL thread only
+	Texture *m_texture;
+	// Copies of what the worker needs from m_texture
+	std::string m_filename;
+	MipmapMode m_mipmaps;
+	bool m_useSRGB;
+	// Block formats for linear and sRGB encoded RGB images, and the
+	// cache's, as Texture::load() picks them
+	BlockFormat m_rgbFormat, m_sRGBFormat, m_cacheFormat;
+	// Top levels left out
+	uint8_t m_skipLevels;
+	std::atomic<bool> m_cancelled;
+
+	// Decoded by the worker
+	bool m_ok;
+	uint16_t m_width, m_height;
+	uint8_t m_nChannels, m_bitDepth;
+	BlockFormat m_format;
+	bool m_sRGB;
+	uint8_t m_storedLevels;
+	std::vector<Level> m_levels;
+	Image::Container m_container;
+
+	// Upload progress
+	size_t m_level;
+	uint16_t m_row;
+
+	~Job() { Image::ContainerDecoder::unmap(m_container); }
+
+	// Drop the decoded levels above m_skipLevels; at least one is kept
+	void skipLevels()
+	{
+		if (m_skipLevels >= m_levels.size())
+		{
+			m_skipLevels = m_levels.size() - 1;
+		}
+		m_levels.erase(m_levels.begin(), m_levels.begin() + m_skipLevels);
+		if (MIPMAP_NONE == m_mipmaps)
+		{
+			m_levels.resize(1);
+		}
+	}
+};
+
+Streamer::Streamer()
+{
+	m_stop = false;
+	m_numPending = 0;
+	m_buffer = 0;
+	m_fences = new GLsync[RING_SEGMENTS];
+	for (unsigned int i = 0; i < RING_SEGMENTS; ++i)
+		m_fences[i] = 0;
+	m_segment = 0;
+
+	const unsigned int n = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_WORKERS));
+	for (unsigned int i = 0; i < n; ++i)
+		m_workers.push_back(std::thread(&Streamer::work, this));
+}
+
+Streamer::~Streamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_workers.size(); ++i)
+		m_workers[i].join();
+
+	for (size_t i = 0; i < m_jobs.size(); ++i)
+		delete m_jobs[i];
+	for (unsigned int i = 0; i < RING_SEGMENTS; ++i)
+		if (m_fences[i]) glDeleteSync(m_fences[i]);
+	delete [] m_fences;
+	if (m_buffer) glDeleteBuffers(1, &m_buffer);
+}
+
+void Streamer::queue(Texture *texture, BlockFormat rgbFormat, uint8_t skipLevels)
+{
+	Job *job = new Job;
+	job->m_texture = texture;
+	job->m_filename = texture->getFilename();
+	job->m_mipmaps = texture->getMipmapMode();
+	job->m_useSRGB = texture->getUseSRGB();
+	job->m_rgbFormat = rgbFormat;
+	job->m_sRGBFormat = (BLOCK_NONE != rgbFormat && job->m_useSRGB) ? Texture::blockFormatFor(3, true) : BLOCK_NONE;
+	job->m_cacheFormat = (BLOCK_NONE != job->m_sRGBFormat) ? job->m_sRGBFormat : rgbFormat;
+	job->m_skipLevels = skipLevels;
+	job->m_cancelled = false;
+	job->m_ok = false;
+	job->m_sRGB = false;
+	job->m_storedLevels = 0;
+	job->m_level = 0;
+	job->m_row = 0;
+	m_jobs.push_back(job);
+	m_numPending += 1;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(job);
+	}
+	m_wake.notify_one();
+}
+
+void Streamer::cancel(const Texture *texture)
+{
+	for (size_t i = 0; i < m_jobs.size(); ++i)
+	{
+		if (m_jobs[i]->m_texture == texture)
+		{
+			m_jobs[i]->m_texture = 0;
+			m_jobs[i]->m_cancelled = true;
+			m_numPending -= 1;
+		}
+	}
+}
+
+bool Streamer::isPending(const Texture *texture) const
+{
+	for (size_t i = 0; i < m_jobs.size(); ++i)
+	{
+		if (m_jobs[i]->m_texture == texture)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void Streamer::drop(Job *job)
+{
+	m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), job));
+	delete job;
+}
+
+void Streamer::work()
+{
+	for (;;)
+	{
+		Job *job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_stop && m_queue.empty())
+				m_wake.wait(lock);
+			if (m_stop)
+				return;
+			job = m_queue.front();
+			m_queue.pop_front();
+		}
+		if (!job->m_cancelled)
+			decode(*job);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decoded.push_back(job);
+	}
+}
+
+void Streamer::decode(Job &job)
+{
+	const char *filename = job.m_filename.c_str();
+	const Image::Container &container = job.m_container;
+	// Level 0, if the other levels are to be made from it, and its copy
+	// from the decoder
+	const void *image = 0;
+	void *decoded = 0;
+	uint16_t rowBytes = 0;
+	// Compressed textures keep their whole chain, for the cache, as in
+	// Texture::uploadImage()
+	CompressedImage blocks;
+	if (Image::ContainerDecoder::map(filename, job.m_container))
+	{
+		job.m_width = container.m_width;
+		job.m_height = container.m_height;
+		job.m_nChannels = container.m_nChannels;
+		job.m_bitDepth = container.m_bitDepth;
+		job.m_format = container.m_format;
+		job.m_sRGB = container.m_sRGB;
+
+		// As Texture::uploadContainer(), the levels are uploaded from the
+		// mapping if they are all there
+		const uint8_t stored = (uint8_t)container.m_levels.size();
+		const uint8_t fullLevels = numMipLevels(job.m_width, job.m_height);
+		if (BLOCK_NONE == job.m_format && MIPMAP_NONE != job.m_mipmaps && stored != fullLevels)
+		{
+			image = container.m_levels[0];
+			rowBytes = Image::ContainerDecoder::rowBytes(job.m_width, job.m_nChannels, job.m_bitDepth);
+		}
+		else
+		{
+			if (BLOCK_NONE != job.m_format && stored < fullLevels)
+			{
+				job.m_storedLevels = stored;
+			}
+			const uint8_t numLevels = (MIPMAP_NONE == job.m_mipmaps) ?
+					std::min<uint8_t>(stored, job.m_skipLevels + 1) : stored;
+			uint16_t width = job.m_width, height = job.m_height;
+			for (uint8_t i = 0; i < numLevels; ++i)
+			{
+				job.m_levels.push_back(Level());
+				Level &l = job.m_levels.back();
+				l.m_width = width;
+				l.m_height = height;
+				if (BLOCK_NONE != job.m_format)
+				{
+					l.m_rows = (height + 3) / 4;
+					l.m_rowBytes = ((width + 3) / 4) * blockBytes(job.m_format);
+				}
+				else
+				{
+					l.m_rows = height;
+					l.m_rowBytes = Image::ContainerDecoder::rowBytes(width, job.m_nChannels, job.m_bitDepth);
+				}
+				l.m_bytes = container.m_levels[i];
+				width = width > 1 ? width / 2 : 1;
+				height = height > 1 ? height / 2 : 1;
+			}
+			job.skipLevels();
+			job.m_ok = true;
+			return;
+		}
+	}
+	else if (BLOCK_NONE != job.m_cacheFormat && loadCompressed(filename, job.m_cacheFormat, blocks))
+	{
+		job.m_width = blocks.m_width;
+		job.m_height = blocks.m_height;
+		job.m_nChannels = blocks.m_nChannels;
+		job.m_bitDepth = 8;
+		job.m_format = blocks.m_format;
+		job.m_sRGB = isSRGB(blocks.m_format);
+	}
+	else
+	{
+		FILE *infile = fopen(filename, "r");
+		if (!infile)
+		{
+			fprintf(stderr, "ERROR! Could not open texture %s\n", filename);
+			return;
+		}
+		const Image::Decoder *decoder = Image::findDecoder(infile);
+		if ( !decoder )
+		{
+			fprintf(stderr, "ERROR! Texture file %s is not in a known format\n", filename);
+			fclose(infile);
+			return;
+		}
+		decoded = job.m_useSRGB ?
+				decoder->decodeSRGB(infile, job.m_width, job.m_height, job.m_nChannels, job.m_bitDepth, rowBytes, job.m_sRGB) :
+				decoder->decode(infile, job.m_width, job.m_height, job.m_nChannels, job.m_bitDepth, rowBytes);
+		fclose(infile);
+		if ( !decoded )
+		{
+			return;
+		}
+		image = decoded;
+		job.m_format = (BLOCK_NONE == job.m_rgbFormat) ? BLOCK_NONE :
+				(1 == job.m_nChannels) ? BLOCK_BC4 :
+				job.m_sRGB ? job.m_sRGBFormat : job.m_rgbFormat;
+	}
+
+	if (image)
+	{
+		// Down to the first level that is kept, when the GL makes the rest
+		const uint8_t fullLevels = numMipLevels(job.m_width, job.m_height);
+		const uint8_t numLevels = (BLOCK_NONE != job.m_format || MIPMAP_CPU == job.m_mipmaps) ? fullLevels :
+				std::min<uint8_t>(fullLevels, job.m_skipLevels + 1);
+		blocks.m_format = job.m_format;
+		blocks.m_width = job.m_width;
+		blocks.m_height = job.m_height;
+		blocks.m_nChannels = job.m_nChannels;
+
+		const void *level = image;
+		uint16_t width = job.m_width, height = job.m_height;
+		bool ok = true;
+		for (uint8_t i = 0; ok; ++i)
+		{
+			if (BLOCK_NONE != job.m_format)
+			{
+				blocks.m_levels.push_back(std::vector<uint8_t>(compressedSize(job.m_format, width, height)));
+				ok = compress(job.m_format, level, width, height, job.m_nChannels, job.m_bitDepth, rowBytes, &blocks.m_levels.back()[0]);
+			}
+			else
+			{
+				job.m_levels.push_back(Level());
+				Level &l = job.m_levels.back();
+				l.m_width = width;
+				l.m_height = l.m_rows = height;
+				l.m_rowBytes = rowBytes;
+				l.m_data.assign((const uint8_t*)level, (const uint8_t*)level + (size_t)rowBytes * height);
+			}
+			if (i + 1 == numLevels)
+			{
+				break;
+			}
+			uint16_t w, h, rb;
+			void *next = downsample(level, width, height, job.m_nChannels, job.m_bitDepth, rowBytes, w, h, rb, job.m_sRGB);
+			if (level != image) free((void*)level);
+			level = next;
+			ok = (0 != next);
+			width = w;
+			height = h;
+			rowBytes = rb;
+		}
+		if (level != image) free((void*)level);
+		free(decoded);
+		if (!ok)
+		{
+			return;
+		}
+		if (BLOCK_NONE != job.m_format)
+		{
+			saveCompressed(filename, job.m_cacheFormat, blocks);
+		}
+	}
+
+	if (BLOCK_NONE != job.m_format)
+	{
+		// Rows of blocks, of the levels that are uploaded
+		const size_t numLevels = (MIPMAP_NONE == job.m_mipmaps) ?
+				std::min<size_t>(blocks.m_levels.size(), job.m_skipLevels + 1) : blocks.m_levels.size();
+		uint16_t width = job.m_width, height = job.m_height;
+		for (size_t i = 0; i < numLevels; ++i)
+		{
+			job.m_levels.push_back(Level());
+			Level &l = job.m_levels.back();
+			l.m_width = width;
+			l.m_height = height;
+			l.m_rows = (height + 3) / 4;
+			l.m_rowBytes = ((width + 3) / 4) * blockBytes(job.m_format);
+			l.m_data.swap(blocks.m_levels[i]);
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+	}
+	for (size_t i = 0; i < job.m_levels.size(); ++i)
+	{
+		job.m_levels[i].m_bytes = &job.m_levels[i].m_data[0];
+	}
+	job.skipLevels();
+	job.m_ok = true;
+}
+
+void Streamer::update()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uploads.insert(m_uploads.end(), m_decoded.begin(), m_decoded.end());
+		m_decoded.clear();
+	}
+	// Drop what was cancelled or failed, and allocate the rest
+	for (std::deque<Job*>::iterator it = m_uploads.begin(); it != m_uploads.end(); )
+	{
+		Job *job = *it;
+		if (job->m_texture && !job->m_ok)
+		{
+			fprintf(stderr, "ERROR! Could not load texture %s\n", job->m_filename.c_str());
+			m_numPending -= 1;
+			job->m_texture = 0;
+		}
+		if (!job->m_texture)
+		{
+			it = m_uploads.erase(it);
+			drop(job);
+			continue;
+		}
+		if (0 == job->m_texture->getHandle() &&
+				!job->m_texture->allocate(job->m_width, job->m_height, job->m_nChannels,
+						job->m_bitDepth, job->m_format, job->m_sRGB, (uint8_t)job->m_levels.size(),
+						job->m_storedLevels, job->m_skipLevels))
+		{
+			fprintf(stderr, "ERROR! Could not allocate texture %s\n", job->m_filename.c_str());
+			m_numPending -= 1;
+			it = m_uploads.erase(it);
+			drop(job);
+			continue;
+		}
+		++it;
+	}
+	if (m_uploads.empty())
+	{
+		return;
+	}
+
+	if (0 == m_buffer)
+	{
+		glGenBuffers(1, &m_buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, SEGMENT_BYTES * RING_SEGMENTS, 0, GL_STREAM_DRAW);
+	}
+	else
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+	}
+
+	// The segment was last used RING_SEGMENTS frames ago; the GL is all
+	// but certainly done reading it
+	GLsync &fence = m_fences[m_segment];
+	if (fence)
+	{
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		glDeleteSync(fence);
+		fence = 0;
+	}
+	const size_t base = m_segment * SEGMENT_BYTES;
+	uint8_t *mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, base, SEGMENT_BYTES,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!mapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		isGLError();
+		return;
+	}
+
+	// Copy this frame's bands of rows into the segment. The GL cannot
+	// read a mapped buffer, so they are uploaded after it is unmapped.
+	typedef struct
+	{
+		Job *m_job;
+		size_t m_level;
+		uint16_t m_row, m_rows;
+		size_t m_offset;
+	} Band;
+	std::vector<Band> bands;
+	size_t used = 0;
+	for (size_t j = 0; j < m_uploads.size(); ++j)
+	{
+		Job *job = m_uploads[j];
+		while (job->m_level < job->m_levels.size())
+		{
+			const Level &l = job->m_levels[job->m_level];
+			const uint16_t rows = (uint16_t)std::min<size_t>(l.m_rows - job->m_row, (SEGMENT_BYTES - used) / l.m_rowBytes);
+			if (0 == rows)
+			{
+				break;
+			}
+			Band band = { job, job->m_level, job->m_row, rows, used };
+			memcpy(mapped + used, l.m_bytes + (size_t)job->m_row * l.m_rowBytes, (size_t)rows * l.m_rowBytes);
+			bands.push_back(band);
+			used += (size_t)rows * l.m_rowBytes;
+			job->m_row += rows;
+			if (job->m_row == l.m_rows)
+			{
+				job->m_level += 1;
+				job->m_row = 0;
+			}
+		}
+		if (job->m_level < job->m_levels.size())
+		{
+			break;
+		}
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// Rows of decoded images are 4-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (size_t i = 0; i < bands.size(); ++i)
+	{
+		const Band &b = bands[i];
+		const Job &job = *b.m_job;
+		const Level &l = job.m_levels[b.m_level];
+		const void *offset = (const void*)(base + b.m_offset);
+		glBindTexture(GL_TEXTURE_2D, job.m_texture->getHandle());
+		if (BLOCK_NONE != job.m_format)
+		{
+			const uint16_t y = b.m_row * 4;
+			const uint16_t height = std::min<int>(b.m_rows * 4, l.m_height - y);
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, b.m_level, 0, y, l.m_width, height,
+					job.m_format, (GLsizei)b.m_rows * l.m_rowBytes, offset);
+		}
+		else
+		{
+			glTexSubImage2D(GL_TEXTURE_2D, b.m_level, 0, b.m_row, l.m_width, b.m_rows,
+					(job.m_nChannels==1)?GL_RED:GL_RGB,
+					(job.m_bitDepth==8)?GL_UNSIGNED_BYTE:GL_UNSIGNED_SHORT,
+					offset);
+		}
+	}
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_segment = (m_segment + 1) % RING_SEGMENTS;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// Finish the textures that are all uploaded
+	while (!m_uploads.empty() && m_uploads.front()->m_level == m_uploads.front()->m_levels.size())
+	{
+		Job *job = m_uploads.front();
+		m_uploads.pop_front();
+		job->m_texture->finish();
+		m_numPending -= 1;
+		drop(job);
+	}
+	isGLError();
+}
+
+}
@@ -12,193 +12,625 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 
 #include <texture/texture.h>
+#include <texture/mipmap.h>
+#include <texture/cache.h>
+#include <texture/decoders/decoder.h>
 #include <gl3/gl3w.h>
 #include <glUtils.h>
 #include <config.h>
 
-#if defined (PNG_LOADER_LIBPNG)
-	#include <texture/decoders/png.h>
-#elif defined (PNG_LOADER_LODEPNG)
-	#include <external/lodepng.h>
+// EXT_texture_filter_anisotropic; not in the gl3w headers
+#if !defined (GL_TEXTURE_MAX_ANISOTROPY_EXT)
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
 #endif
 
 namespace Texture
 {
 
-#if defined (PNG_LOADER_LODEPNG)
-GLuint createTexture(const char* filename)
+// RGTC (BC4) is core in GL 3.0. BPTC has sRGB formats of its own; S3TC
+// needs EXT_texture_sRGB for them.
+BlockFormat Texture::blockFormatFor(const uint8_t nChannels, const bool sRGB)
 {
-	std::vector< unsigned char > rawImage;
-	LodePNG::loadFile( rawImage, filename );
+	static int s_bptc = -1, s_s3tc = -1, s_s3tcSRGB = -1;
+	if (s_bptc < 0)
+	{
+		s_bptc = isExtensionSupported("GL_ARB_texture_compression_bptc");
+		s_s3tc = isExtensionSupported("GL_EXT_texture_compression_s3tc");
+		s_s3tcSRGB = s_s3tc && isExtensionSupported("GL_EXT_texture_sRGB");
+	}
+	if (1 == nChannels) return BLOCK_BC4;
+	if (sRGB) return s_bptc ? BLOCK_BC7_SRGB : s_s3tcSRGB ? BLOCK_BC1_SRGB : BLOCK_NONE;
+	return s_bptc ? BLOCK_BC7 : s_s3tc ? BLOCK_BC1 : BLOCK_NONE;
+}
 
-	LodePNG::Decoder decoder;
-	std::vector< unsigned char > image;
-	decoder.decode( image, rawImage.empty() ? 0 : &rawImage[0],
-		            (unsigned)rawImage.size() );
+unsigned int Texture::s_frame = 0;
+GLuint Texture::s_placeholder = 0;
 
-	//
-	// Flip and invert the PNG image since OpenGL likes to load everything
-	// backwards from what is considered normal!
-	//
+Texture::Texture(const char *filename,
+		FilterType minFilter, FilterType magFilter,
+		WrapMode wrap, MipmapMode mipmaps, float anisotropy,
+		bool compress, bool sRGB, bool stream)
+{
+	m_filename = strdup(filename);
+	m_minFilter = minFilter;
+	m_magFilter = magFilter;
 
-	unsigned char *imagePtr = &image[0];
-	int halfTheHeightInPixels = decoder.getHeight() / 2;
-	int heightInPixels = decoder.getHeight();
+	m_wrapMode = wrap;
+	m_mipmaps = mipmaps;
+	m_numLevels = 1;
+	m_compress = compress;
+	m_useSRGB = sRGB;
+	m_isSRGB = false;
+	m_skipLevels = 0;
+	m_storedLevels = 0;
+	m_generateMipmaps = false;
+	m_anisotropy = anisotropy;
+	m_blockFormat = BLOCK_NONE;
+	m_bytes = 0;
+	m_lastUse = s_frame;
+
+	m_width = m_height = 0;
+	m_handle = 0;
 
-	// Assuming RGBA for 4 components per pixel.
-	int numColorComponents = 4;
+	m_isReady = false;
 
-	// Assuming each color component is an unsigned char.
-	int widthInChars = decoder.getWidth() * numColorComponents;
+	if (!stream)
+	{
+		load();
+	}
+}
+
+void Texture::load()
+{
+	m_isReady = false;
+	m_bytes = 0;
 
-	unsigned char *top = NULL;
-	unsigned char *bottom = NULL;
-	unsigned char temp = 0;
+	// GPU-ready containers are uploaded straight from the mapped file
+	Image::Container container;
+	if (Image::ContainerDecoder::map(m_filename, container))
+	{
+		const bool uploaded = create() && uploadContainer(container);
+		Image::ContainerDecoder::unmap(container);
+		if ( !uploaded )
+		{
+			fprintf(stderr, "ERROR! Could not upload %s\n", m_filename);
+			return;
+		}
+		setAnisotropy(m_anisotropy);
+		m_isReady = glIsTexture(m_handle) == GL_TRUE;
+		return;
+	}
 
-	for( int h = 0; h < halfTheHeightInPixels; ++h )
+	// A compressed texture from an earlier run needs no decoding
+	const BlockFormat rgbFormat = getCacheFormat();
+	CompressedImage blocks;
+	const bool cached = (BLOCK_NONE != rgbFormat) && loadCompressed(m_filename, rgbFormat, blocks);
+	void *image = 0;
+	if (cached)
+	{
+		m_isSRGB = isSRGB(blocks.m_format);
+		m_width = blocks.m_width;
+		m_height = blocks.m_height;
+		m_nChannels = blocks.m_nChannels;
+		m_bitDepth = 8;
+		m_rowBytes = 0;
+	}
+	else
 	{
-		top = imagePtr + h * widthInChars;
-		bottom = imagePtr + (heightInPixels - h - 1) * widthInChars;
+		// Try to read in the image file
+		FILE *infile = fopen(m_filename, "r");
+		if (!infile)
+		{
+			return;
+		}
 
-		for( int w = 0; w < widthInChars; ++w )
+		const Image::Decoder *decoder = Image::findDecoder(infile);
+		if ( !decoder )
 		{
-		    // Swap the chars around.
-		    temp = *top;
-		    *top = *bottom;
-		    *bottom = temp;
+			fprintf(stderr, "ERROR! Texture file %s is not in a known format\n", m_filename);
+			fclose(infile);
+			return;
+		}
 
-		    ++top;
-		    ++bottom;
+		m_isSRGB = false;
+		image = m_useSRGB ?
+				decoder->decodeSRGB(infile, m_width, m_height, m_nChannels, m_bitDepth, m_rowBytes, m_isSRGB) :
+				decoder->decode(infile, m_width, m_height, m_nChannels, m_bitDepth, m_rowBytes);
+		fclose(infile);
+
+		if ( !image )
+		{
+			return;
 		}
 	}
 
-	GLuint texid;
-	//glEnable(GL_TEXTURE_2D);
-	glGenTextures( 1, &texid );
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture( GL_TEXTURE_2D, texid );
+	// Upload the texture to the GL context
+	if ( !create() )
+	{
+		fprintf(stderr, "ERROR! Could not set up %s\n", m_filename);
+		free(image);
+		return;
+	}
 
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	//fprintf(stderr, "Channels = %u\nwidth = %u\nheight = %u\nbitdepth = %u\n", m_nChannels, m_width, m_height, m_bitDepth);
 
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, decoder.getWidth(),
-		          decoder.getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
-		          &image[0] );
+	bool uploaded;
+	if (cached)
+	{
+		uploaded = uploadCompressed(blocks);
+	}
+	else if (m_compress && BLOCK_NONE != blockFormatFor(m_nChannels, m_isSRGB))
+	{
+		// Compress on this first load, and keep the result for the next
+		blocks.m_format = blockFormatFor(m_nChannels, m_isSRGB);
+		uploaded = uploadImage(image, &blocks);
+		if (uploaded) saveCompressed(m_filename, rgbFormat, blocks);
+	}
+	else
+	{
+		uploaded = uploadImage(image, 0);
+	}
+	// The GL has its own copy now
+	free(image);
+	if ( !uploaded )
+	{
+		fprintf(stderr, "ERROR! Could not upload %s\n", m_filename);
+		return;
+	}
+	setAnisotropy(m_anisotropy);
 
-	if (isGLError())
-		return -1;
+	m_isReady = glIsTexture(m_handle) == GL_TRUE;
+}
 
-	return texid;
+bool Texture::create()
+{
+	glGenTextures(1, &m_handle);
+	if ( isGLError() || (0==m_handle) )
+	{
+		return false;
+	}
+	glBindTexture(GL_TEXTURE_2D, m_handle);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_wrapMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_wrapMode);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_magFilter);
+
+	// Each row of image data is 4-byte aligned.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	return !isGLError();
 }
-#endif
 
-Texture::Texture(const char *filename,
-		FilterType minFilter, FilterType magFilter,
-		WrapMode wrap)
+bool Texture::uploadContainer(const Image::Container &container)
 {
-#if defined (PNG_LOADER_LIBPNG)
-	m_filename = strdup(filename);
-	m_minFilter = minFilter;
-	m_magFilter = magFilter;
+	m_width = container.m_width;
+	m_height = container.m_height;
+	m_nChannels = container.m_nChannels;
+	m_bitDepth = container.m_bitDepth;
+	m_rowBytes = Image::ContainerDecoder::rowBytes(m_width, m_nChannels, m_bitDepth);
+	m_blockFormat = container.m_format;
+	m_isSRGB = container.m_sRGB;
+
+	const uint8_t stored = (uint8_t)container.m_levels.size();
+	if (BLOCK_NONE != m_blockFormat)
+	{
+		m_storedLevels = (stored < numMipLevels(m_width, m_height)) ? stored : 0;
+		if (m_skipLevels > getMaxSkipLevels()) m_skipLevels = getMaxSkipLevels();
+		return uploadLevels(container.m_levels, container.m_levelBytes);
+	}
 
-	m_wrapMode = wrap;
+	// Uncompressed levels that are not in the file are made from level 0,
+	// as for a decoded image
+	m_storedLevels = 0;
+	const bool haveLevels = (MIPMAP_NONE == m_mipmaps) ? m_skipLevels < stored :
+			stored == numMipLevels(m_width, m_height);
+	if (!haveLevels)
+	{
+		return uploadImage(container.m_levels[0], 0);
+	}
+	return uploadLevels(container.m_levels, container.m_levelBytes);
+}
 
-	m_image = 0;
+bool Texture::setSkipLevels(uint8_t skip)
+{
+	if (skip > getMaxSkipLevels()) skip = getMaxSkipLevels();
+	if (skip == m_skipLevels)
+	{
+		return m_isReady;
+	}
+	// Levels only come back with a reload; see adopt()
+	if (skip < m_skipLevels || !canDropLevels(skip - m_skipLevels))
+	{
+		return false;
+	}
+	return copyLevels(skip - m_skipLevels);
+}
+
+void Texture::adopt(Texture &other)
+{
+	if (m_handle)
+	{
+		glDeleteTextures(1, &m_handle);
+	}
+	m_handle = other.m_handle;
+	m_isReady = other.m_isReady;
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_nChannels = other.m_nChannels;
+	m_bitDepth = other.m_bitDepth;
+	m_rowBytes = other.m_rowBytes;
+	m_blockFormat = other.m_blockFormat;
+	m_isSRGB = other.m_isSRGB;
+	m_numLevels = other.m_numLevels;
+	m_skipLevels = other.m_skipLevels;
+	m_storedLevels = other.m_storedLevels;
+	m_bytes = other.m_bytes;
+
+	other.m_handle = 0;
+	other.m_isReady = false;
+	other.m_bytes = 0;
+}
+
+bool Texture::copyLevels(uint8_t count)
+{
+	// Uncompressed levels are copied as bytes of GL_RED or GL_RGBA, in
+	// rows 4-byte aligned
+	const bool compressed = (BLOCK_NONE != m_blockFormat);
+	const GLenum format = (m_nChannels==1) ? GL_RED : GL_RGBA;
+	const uint8_t skip = m_skipLevels + count;
+	const uint8_t numLevels = m_numLevels - count;
+	uint16_t width = std::max(m_width >> skip, 1), height = std::max(m_height >> skip, 1);
+	const size_t bufferBytes = compressed ? compressedSize(m_blockFormat, width, height) :
+			(((size_t)width * ((m_nChannels==1) ? 1 : 4) + 3) & ~(size_t)3) * height;
+
+	// Each level is read into the buffer and written from it, without
+	// leaving the GPU
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, bufferBytes, 0, GL_STREAM_COPY);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	const GLuint source = m_handle;
 	m_handle = 0;
+	bool ok = !isGLError() && buffer && create();
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
-	m_isReady = false;
+	size_t bytes = 0;
+	for (uint8_t i = 0; ok && i < numLevels; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, source);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+		if (compressed)
+		{
+			glGetCompressedTexImage(GL_TEXTURE_2D, i + count, 0);
+		}
+		else
+		{
+			glGetTexImage(GL_TEXTURE_2D, i + count, format, GL_UNSIGNED_BYTE, 0);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	// Try to read in the image file
-	FILE *infile = fopen(filename, "r");
-	if (!infile)
+		glBindTexture(GL_TEXTURE_2D, m_handle);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		if (compressed)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, m_blockFormat, width, height, 0,
+					compressedSize(m_blockFormat, width, height), 0);
+		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, i, internalFormat(), width, height, 0,
+					format, GL_UNSIGNED_BYTE, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ok = !isGLError();
+
+		bytes += levelBytes(width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	if (buffer) glDeleteBuffers(1, &buffer);
+	if (ok)
 	{
-		return;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+		ok = !isGLError();
 	}
-
-	Image::PNGDecoder decoder;
-	if ( !decoder.checkSig(infile) )
+	if (!ok)
 	{
-		fprintf(stderr, "ERROR! Texture file not a png\n");
-		fclose(infile);
-		return;
+		fprintf(stderr, "ERROR! Could not copy the levels of %s\n", m_filename);
+		if (m_handle) glDeleteTextures(1, &m_handle);
+		m_handle = source;
+		return false;
 	}
 
-	void *m_image = decoder.decode(infile, m_width, m_height, m_nChannels, m_bitDepth, m_rowBytes);
+	glDeleteTextures(1, &source);
+	m_skipLevels = skip;
+	m_numLevels = numLevels;
+	m_bytes = bytes;
+	setAnisotropy(m_anisotropy);
+	return true;
+}
 
-	if ( !m_image )
+uint8_t Texture::getMaxSkipLevels() const
+{
+	if (m_storedLevels)
 	{
-		return;
+		return m_storedLevels - 1;
 	}
+	return (m_width && m_height) ? numMipLevels(m_width, m_height) - 1 : 0;
+}
 
-	// Upload the texture to the GL context
-	glGenTextures(1, &m_handle);
-	if ( isGLError() || (0==m_handle) )
+size_t Texture::levelBytes(uint16_t width, uint16_t height) const
+{
+	if (BLOCK_NONE != m_blockFormat)
 	{
-		return;
+		return compressedSize(m_blockFormat, width, height);
 	}
-	glBindTexture(GL_TEXTURE_2D, m_handle);
+	// GL_RGB8 is padded to 4 bytes a texel by every driver we know of
+	return (size_t)width * height * ((m_nChannels==1) ? 1 : 4) * (m_bitDepth / 8);
+}
+
+GLenum Texture::internalFormat() const
+{
+	if (m_nChannels==1) return GL_R8;
+	return m_isSRGB ? GL_SRGB8 : GL_RGB8;
+}
+
+// The cache of an sRGB encoded file may hold either kind of blocks, as
+// the file's chunks decide; with no sRGB block format, only linear ones.
+BlockFormat Texture::getCacheFormat() const
+{
+	if (!m_compress) return BLOCK_NONE;
+	const BlockFormat format = blockFormatFor(3, m_useSRGB);
+	return (BLOCK_NONE != format) ? format : blockFormatFor(3);
+}
 
-	if ( isGLError() )
+bool Texture::uploadImage(const void *image, CompressedImage *blocks)
+{
+	// Compressed formats cannot be glGenerateMipmap'd, and the compressed
+	// chain is kept whole for the cache whatever is skipped
+	const uint8_t fullLevels = numMipLevels(m_width, m_height);
+	const bool cpuMips = (MIPMAP_CPU == m_mipmaps) || (blocks && MIPMAP_NONE != m_mipmaps);
+	const uint8_t lastUpload = cpuMips ? fullLevels - 1 : m_skipLevels;
+	const uint8_t lastLevel = blocks ? fullLevels - 1 : lastUpload;
+	if (blocks)
 	{
-		fprintf(stderr, "ERROR!! 1\n");
-		return;
+		m_blockFormat = blocks->m_format;
+		blocks->m_width = m_width;
+		blocks->m_height = m_height;
+		blocks->m_nChannels = m_nChannels;
+		blocks->m_levels.clear();
 	}
+	m_bytes = 0;
+	m_numLevels = 0;
+
+	// Each level from the one above it
+	const void *level = image;
+	uint16_t width = m_width, height = m_height, rowBytes = m_rowBytes;
+	bool ok = true;
+	for (uint8_t i = 0; ok; ++i)
+	{
+		const bool upload = (i >= m_skipLevels) && (i <= lastUpload);
+		if (blocks)
+		{
+			blocks->m_levels.push_back(std::vector<uint8_t>(compressedSize(m_blockFormat, width, height)));
+			std::vector<uint8_t> &data = blocks->m_levels.back();
+			ok = ::Texture::compress(m_blockFormat, level, width, height, m_nChannels, m_bitDepth, rowBytes, &data[0]);
+			if (upload)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, i - m_skipLevels, m_blockFormat,
+						width, height, 0, data.size(), &data[0]);
+			}
+		}
+		else if (upload)
+		{
+			glTexImage2D(GL_TEXTURE_2D, i - m_skipLevels,
+					internalFormat(), width, height, 0,
+					(m_nChannels==1)?GL_RED:GL_RGB,
+					(m_bitDepth==8)?GL_UNSIGNED_BYTE:GL_UNSIGNED_SHORT,
+					level);
+		}
+		if (upload)
+		{
+			m_bytes += levelBytes(width, height);
+			++m_numLevels;
+		}
+		if (i == lastLevel)
+		{
+			break;
+		}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_wrapMode);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_wrapMode);
+		uint16_t w, h, rb;
+		void *next = downsample(level, width, height, m_nChannels, m_bitDepth, rowBytes, w, h, rb, m_isSRGB);
+		if (level != image) free((void*)level);
+		level = next;
+		ok = (0 != next);
+		width = w;
+		height = h;
+		rowBytes = rb;
+	}
+	if (level != image) free((void*)level);
 
-	if ( isGLError() )
+	if (!cpuMips && MIPMAP_GPU == m_mipmaps)
 	{
-		fprintf(stderr, "ERROR!! 1\n");
-		return;
+		glGenerateMipmap(GL_TEXTURE_2D);
+		for (m_numLevels = 1; m_numLevels < fullLevels - m_skipLevels; ++m_numLevels)
+		{
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+			m_bytes += levelBytes(width, height);
+		}
 	}
+	// Keeps the texture complete with mip filters when there are no mips
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_numLevels - 1);
+	return ok && !isGLError();
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_minFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_magFilter);
+bool Texture::uploadCompressed(const CompressedImage &blocks)
+{
+	m_blockFormat = blocks.m_format;
+	std::vector<const uint8_t*> levels(blocks.m_levels.size());
+	std::vector<size_t> sizes(blocks.m_levels.size());
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		levels[i] = &blocks.m_levels[i][0];
+		sizes[i] = blocks.m_levels[i].size();
+	}
+	return uploadLevels(levels, sizes);
+}
+
+bool Texture::uploadLevels(const std::vector<const uint8_t*> &levels, const std::vector<size_t> &sizes)
+{
+	const size_t lastUpload = (MIPMAP_NONE == m_mipmaps) ? m_skipLevels : levels.size() - 1;
+	if (lastUpload >= levels.size())
+	{
+		return false;
+	}
+	m_bytes = 0;
+	m_numLevels = 0;
+	uint16_t width = m_width, height = m_height;
+	for (size_t i = 0; i <= lastUpload; ++i)
+	{
+		if (i >= m_skipLevels)
+		{
+			if (BLOCK_NONE != m_blockFormat)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, m_numLevels, m_blockFormat, width, height, 0,
+						sizes[i], levels[i]);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, m_numLevels,
+						internalFormat(), width, height, 0,
+						(m_nChannels==1)?GL_RED:GL_RGB,
+						(m_bitDepth==8)?GL_UNSIGNED_BYTE:GL_UNSIGNED_SHORT,
+						levels[i]);
+			}
+			m_bytes += levelBytes(width, height);
+			++m_numLevels;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_numLevels - 1);
+	return !isGLError();
+}
 
-	if ( isGLError() )
+bool Texture::allocate(uint16_t width, uint16_t height, uint8_t nChannels,
+		uint8_t bitDepth, BlockFormat format, bool sRGB, uint8_t numLevels,
+		uint8_t storedLevels, uint8_t skipLevels)
+{
+	m_width = width;
+	m_height = height;
+	m_nChannels = nChannels;
+	m_bitDepth = bitDepth;
+	m_rowBytes = 0;
+	m_blockFormat = format;
+	m_isSRGB = sRGB;
+	m_skipLevels = skipLevels;
+	m_storedLevels = storedLevels;
+	// Level 0 of the GL texture
+	width = std::max(width >> skipLevels, 1);
+	height = std::max(height >> skipLevels, 1);
+	// glGenerateMipmap fills in the rest in finish()
+	m_generateMipmaps = (BLOCK_NONE == format && MIPMAP_GPU == m_mipmaps && 1 == numLevels);
+	if (m_generateMipmaps)
 	{
-		fprintf(stderr, "ERROR!! 1\n");
-		return;
+		numLevels = numMipLevels(width, height);
 	}
+	m_numLevels = numLevels;
 
-	// Each row of image data is 4-byte aligned.
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if ( !create() )
+	{
+		return false;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_numLevels - 1);
 
-	if ( isGLError() )
+	const GLenum levelFormat = (BLOCK_NONE != format) ? (GLenum)format : internalFormat();
+	if (glTexStorage2D)
 	{
-		fprintf(stderr, "ERROR!! 1\n");
-		return;
+		glTexStorage2D(GL_TEXTURE_2D, m_numLevels, levelFormat, width, height);
+	}
+	m_bytes = 0;
+	for (uint8_t i = 0; i < m_numLevels; ++i)
+	{
+		if (!glTexStorage2D)
+		{
+			if (BLOCK_NONE != format)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, levelFormat, width, height, 0,
+						compressedSize(format, width, height), 0);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, i, levelFormat, width, height, 0,
+						(m_nChannels==1)?GL_RED:GL_RGB, GL_UNSIGNED_BYTE, 0);
+			}
+		}
+		m_bytes += levelBytes(width, height);
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
 	}
+	return !isGLError();
+}
 
-	//fprintf(stderr, "Channels = %u\nwidth = %u\nheight = %u\nbitdepth = %u\n", m_nChannels, m_width, m_height, m_bitDepth);
+void Texture::finish()
+{
+	glBindTexture(GL_TEXTURE_2D, m_handle);
+	if (m_generateMipmaps)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	setAnisotropy(m_anisotropy);
+	m_isReady = !isGLError() && glIsTexture(m_handle) == GL_TRUE;
+}
 
-	glTexImage2D(GL_TEXTURE_2D, 0,
-			(m_nChannels==1)?GL_RED:GL_RGB8,
-			m_width, m_height, 0,
-			(m_nChannels==1)?GL_RED:GL_RGB,
-			(m_bitDepth==8)?GL_UNSIGNED_BYTE:GL_UNSIGNED_SHORT,
-			m_image);
+void Texture::setFilters(FilterType minFilter, FilterType magFilter)
+{
+	m_minFilter = minFilter;
+	m_magFilter = magFilter;
+	if (m_handle)
+	{
+		glBindTexture(GL_TEXTURE_2D, m_handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_magFilter);
+	}
+}
 
-	if ( isGLError() )
+void Texture::setAnisotropy(float anisotropy)
+{
+	const float maxAnisotropy = getMaxAnisotropy();
+	m_anisotropy = (anisotropy < 1.0f) ? 1.0f : (anisotropy > maxAnisotropy) ? maxAnisotropy : anisotropy;
+	if (m_handle && maxAnisotropy > 1.0f)
 	{
-		fprintf(stderr, "ERROR!! 1\n");
-		return;
+		glBindTexture(GL_TEXTURE_2D, m_handle);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, m_anisotropy);
 	}
+}
 
-	m_isReady = glIsTexture(m_handle) == GL_TRUE;
-#elif defined (PNG_LOADER_LODEPNG)
-	m_handle = createTexture(filename);
-	m_isReady = glIsTexture(m_handle) == GL_TRUE;
-#endif
+float Texture::getMaxAnisotropy()
+{
+	static float s_maxAnisotropy = 0.0f;
+	if (s_maxAnisotropy < 1.0f)
+	{
+		s_maxAnisotropy = 1.0f;
+		if (isExtensionSupported("GL_EXT_texture_filter_anisotropic") ||
+				isExtensionSupported("GL_ARB_texture_filter_anisotropic"))
+		{
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &s_maxAnisotropy);
+		}
+	}
+	return s_maxAnisotropy;
 }
 
 Texture::~Texture()
 {
 	if (m_filename) free((char*)m_filename);
-	if (m_image) free(m_image);
 	if (m_handle)
 	{
 		glDeleteTextures(1, &m_handle);
@@ -208,11 +640,24 @@ Texture::~Texture()
 
 void Texture::bindGL(GLenum textureUnit) const
 {
+	glActiveTexture(textureUnit);
 	if (m_isReady)
 	{
-		glActiveTexture(textureUnit);
+		m_lastUse = s_frame;
 		glBindTexture(GL_TEXTURE_2D, m_handle);
+		return;
+	}
+	if (0 == s_placeholder)
+	{
+		const uint8_t grey[4] = { 128, 128, 128, 0 };
+		glGenTextures(1, &s_placeholder);
+		glBindTexture(GL_TEXTURE_2D, s_placeholder);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
 	}
+	glBindTexture(GL_TEXTURE_2D, s_placeholder);
 }
 
 }
@@ -0,0 +1,48 @@
+//==============================================================================
+
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+//==============================================================================
+
+#include <transforms.h>
+
+//==============================================================================
+
+TransformStage::TransformStage()
+{
+}
+
+//------------------------------------------------------------------------------
+
+TransformStage::~TransformStage()
+{
+}
+
+//------------------------------------------------------------------------------
+
+void TransformStage::update(const ObjectVec & scene, const gml::mat4x4_t & worldView)
+{
+	const size_t n = scene.size();
+	m_world.resize(n);
+	m_modelView.resize(n);
+	m_normal.resize(n);
+
+	const gml::affine_t view = gml::affine(worldView);
+	for (size_t i = 0; i < n; ++i)
+	{
+		m_world[i] = scene[i]->getTransform();
+		m_modelView[i] = gml::mul(view, m_world[i]);
+		m_normal[i] = gml::normalMatrix(m_modelView[i]);
+	}
+}
+
+//==============================================================================
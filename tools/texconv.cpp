@@ -0,0 +1,155 @@
+/*
+ * Copyright:
+ * Daniel D. Neilson (ddneilson@ieee.org)
+ * University of Saskatchewan
+ * All rights reserved
+ *
+ * Permission granted to use for use in assignments and
+ * projects for CMPT 485 & CMPT 829 at the University
+ * of Saskatchewan.
+ */
+
+/*
+ * Offline converter of PNG and QOI images to GPU-ready texture containers
+ * (see texture/decoders/container.h).
+ *
+ *   texconv [-f none|bc1|bc7] [-m none|full] [-s keep|linear] in.png|in.qoi out.tex
+ *
+ * -f  block format of RGB images; single channel images are BC4 when
+ *     this is not none. Default none.
+ * -m  levels to store: level 0 only, or the full mip chain, box
+ *     filtered as MIPMAP_CPU does. Default full.
+ * -s  keep sRGB encoded RGB images that way, for GL_SRGB8 or the sRGB
+ *     block formats, or linearize them. Default keep.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <texture/decoders/decoder.h>
+#include <texture/decoders/container.h>
+#include <texture/compress.h>
+#include <texture/mipmap.h>
+
+using namespace Texture;
+
+static void usage()
+{
+	fprintf(stderr, "usage: texconv [-f none|bc1|bc7] [-m none|full] [-s keep|linear] in.png|in.qoi out.tex\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	BlockFormat rgbFormat = BLOCK_NONE;
+	bool mipmaps = true;
+	bool keepSRGB = true;
+	int arg = 1;
+	for ( ; arg + 1 < argc && argv[arg][0] == '-'; arg += 2)
+	{
+		const char *value = argv[arg + 1];
+		if (0 == strcmp(argv[arg], "-f"))
+		{
+			if (0 == strcmp(value, "none")) rgbFormat = BLOCK_NONE;
+			else if (0 == strcmp(value, "bc1")) rgbFormat = BLOCK_BC1;
+			else if (0 == strcmp(value, "bc7")) rgbFormat = BLOCK_BC7;
+			else usage();
+		}
+		else if (0 == strcmp(argv[arg], "-m"))
+		{
+			if (0 == strcmp(value, "none")) mipmaps = false;
+			else if (0 == strcmp(value, "full")) mipmaps = true;
+			else usage();
+		}
+		else if (0 == strcmp(argv[arg], "-s"))
+		{
+			if (0 == strcmp(value, "keep")) keepSRGB = true;
+			else if (0 == strcmp(value, "linear")) keepSRGB = false;
+			else usage();
+		}
+		else usage();
+	}
+	if (arg + 2 != argc) usage();
+	const char *inName = argv[arg];
+	const char *outName = argv[arg + 1];
+
+	FILE *infile = fopen(inName, "rb");
+	const Image::Decoder *decoder = Image::findDecoder(infile);
+	if (!decoder)
+	{
+		fprintf(stderr, "ERROR! %s is not a png or qoi image\n", inName);
+		return 1;
+	}
+	uint16_t width, height, rowBytes;
+	uint8_t nChannels, bitDepth;
+	bool sRGB = false;
+	void *image = keepSRGB ?
+			decoder->decodeSRGB(infile, width, height, nChannels, bitDepth, rowBytes, sRGB) :
+			decoder->decode(infile, width, height, nChannels, bitDepth, rowBytes);
+	fclose(infile);
+	if (!image)
+	{
+		fprintf(stderr, "ERROR! Could not decode %s\n", inName);
+		return 1;
+	}
+
+	// Compressed images are 8-bit
+	const BlockFormat format = (BLOCK_NONE == rgbFormat) ? BLOCK_NONE :
+			(1 == nChannels) ? BLOCK_BC4 : sRGB ? sRGBFormat(rgbFormat) : rgbFormat;
+	const uint8_t numLevels = mipmaps ? numMipLevels(width, height) : 1;
+
+	std::vector< std::vector<uint8_t> > data(numLevels);
+	const void *level = image;
+	uint16_t w = width, h = height, rb = rowBytes;
+	for (uint8_t i = 0; i < numLevels; ++i)
+	{
+		if (BLOCK_NONE != format)
+		{
+			data[i].resize(compressedSize(format, w, h));
+			compress(format, level, w, h, nChannels, bitDepth, rb, &data[i][0]);
+		}
+		else
+		{
+			data[i].assign((const uint8_t*)level, (const uint8_t*)level + (size_t)rb * h);
+		}
+		if (i + 1 == numLevels)
+		{
+			break;
+		}
+		uint16_t nw, nh, nrb;
+		void *next = downsample(level, w, h, nChannels, bitDepth, rb, nw, nh, nrb, sRGB);
+		if (level != image) free((void*)level);
+		if (!next)
+		{
+			fprintf(stderr, "ERROR! Out of memory\n");
+			return 1;
+		}
+		level = next;
+		w = nw;
+		h = nh;
+		rb = nrb;
+	}
+	if (level != image) free((void*)level);
+	free(image);
+
+	std::vector<const void*> levels(numLevels);
+	std::vector<size_t> levelBytes(numLevels);
+	size_t total = 0;
+	for (uint8_t i = 0; i < numLevels; ++i)
+	{
+		levels[i] = &data[i][0];
+		levelBytes[i] = data[i].size();
+		total += data[i].size();
+	}
+	if (!Image::ContainerDecoder::write(outName, width, height, nChannels,
+			(BLOCK_NONE != format) ? 8 : bitDepth, format, sRGB, levels, levelBytes))
+	{
+		fprintf(stderr, "ERROR! Could not write %s\n", outName);
+		return 1;
+	}
+	printf("%s: %ux%u, %u channel(s), %u levels, format 0x%x%s, %zu bytes\n",
+			outName, width, height, nChannels, numLevels, format, sRGB ? " (sRGB)" : "", total);
+	return 0;
+}